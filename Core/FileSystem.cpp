@@ -1,11 +1,21 @@
 
 #include "FileSystem.h"
 
+#ifdef _WIN32
 #include "WindowsUtils.h"
 
-
 #undef CreateDirectory
 #undef GetFileAttributes
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_PATH PATH_MAX
+#endif
 
 
 namespace ui {
@@ -133,6 +143,7 @@ bool WriteBinaryFile(StringView path, const void* data, size_t size)
 }
 
 
+#ifdef _WIN32
 bool DirectoryExists(StringView path)
 {
 	auto attr = ::GetFileAttributesW(UTF8toWCHAR(path).c_str());
@@ -143,6 +154,18 @@ bool CreateDirectory(StringView path)
 {
 	return ::CreateDirectoryW(UTF8toWCHAR(path).c_str(), nullptr) != FALSE;
 }
+#else
+bool DirectoryExists(StringView path)
+{
+	struct stat st;
+	return stat(CStr<MAX_PATH>(path), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool CreateDirectory(StringView path)
+{
+	return mkdir(CStr<MAX_PATH>(path), 0777) == 0;
+}
+#endif
 
 bool CreateMissingDirectories(StringView path)
 {
@@ -163,6 +186,7 @@ bool CreateMissingParentDirectories(StringView path)
 }
 
 
+#ifdef _WIN32
 std::string GetWorkingDirectory()
 {
 	DWORD len = ::GetCurrentDirectoryW(0, nullptr);
@@ -185,8 +209,41 @@ bool SetWorkingDirectory(StringView sv)
 {
 	return ::SetCurrentDirectoryW(UTF8toWCHAR(sv).c_str()) != FALSE;
 }
+#else
+std::string GetWorkingDirectory()
+{
+	char buf[PATH_MAX];
+	if (getcwd(buf, sizeof(buf)))
+		return buf;
+	return {};
+}
 
+bool SetWorkingDirectory(StringView sv)
+{
+	return chdir(CStr<MAX_PATH>(sv)) == 0;
+}
+#endif
 
+std::string GetUserCacheDirectory()
+{
+	std::string dir;
+#ifdef _WIN32
+	if (auto* localAppData = getenv("LOCALAPPDATA"))
+		dir = localAppData;
+#else
+	if (auto* cacheHome = getenv("XDG_CACHE_HOME"))
+		dir = cacheHome;
+	else if (auto* home = getenv("HOME"))
+		dir = PathJoin(home, ".cache");
+#endif
+	for (auto& c : dir)
+		if (c == '\\')
+			c = '/';
+	return dir;
+}
+
+
+#ifdef _WIN32
 struct DirectoryIteratorImpl
 {
 	std::wstring path;
@@ -222,7 +279,14 @@ bool DirectoryIterator::GetNext(std::string& retFile)
 		if (_impl->handle == nullptr)
 		{
 			_impl->handle = FindFirstFileW(_impl->path.c_str(), &_impl->findData);
-			success = _impl->handle != nullptr;
+			if (_impl->handle == INVALID_HANDLE_VALUE)
+			{
+				// missing directory
+				_impl->handle = nullptr;
+				_impl->path.clear();
+				return false;
+			}
+			success = true;
 		}
 		else
 			success = FindNextFileW(_impl->handle, &_impl->findData) != FALSE;
@@ -241,8 +305,48 @@ bool DirectoryIterator::GetNext(std::string& retFile)
 	retFile = WCHARtoUTF8(_impl->findData.cFileName);
 	return true;
 }
+#else
+struct DirectoryIteratorImpl
+{
+	DIR* dir = nullptr;
+
+	~DirectoryIteratorImpl()
+	{
+		if (dir)
+			closedir(dir);
+	}
+};
+
+DirectoryIterator::DirectoryIterator(StringView path) : _impl(new DirectoryIteratorImpl)
+{
+	_impl->dir = opendir(CStr<MAX_PATH>(path));
+}
+
+DirectoryIterator::~DirectoryIterator()
+{
+	delete _impl;
+}
+
+bool DirectoryIterator::GetNext(std::string& retFile)
+{
+	if (!_impl->dir)
+		return false;
+
+	while (auto* entry = readdir(_impl->dir))
+	{
+		if (strcmp(entry->d_name, ".") != 0 &&
+			strcmp(entry->d_name, "..") != 0)
+		{
+			retFile = entry->d_name;
+			return true;
+		}
+	}
+	return false;
+}
+#endif
 
 
+#ifdef _WIN32
 unsigned GetFileAttributes(StringView path)
 {
 	auto attr = GetFileAttributesW(UTF8toWCHAR(path).c_str());
@@ -270,5 +374,107 @@ uint64_t GetFileModTimeUTC(StringView path)
 	uli.LowPart = t.dwLowDateTime;
 	return uli.QuadPart / 10000; // to milliseconds
 }
+#else
+unsigned GetFileAttributes(StringView path)
+{
+	CStr<MAX_PATH> cpath(path);
+	struct stat st;
+	if (stat(cpath, &st) != 0)
+		return 0;
+	unsigned ret = FA_Exists;
+	if (S_ISDIR(st.st_mode))
+		ret |= FA_Directory;
+	struct stat lst;
+	if (lstat(cpath, &lst) == 0 && S_ISLNK(lst.st_mode))
+		ret |= FA_Symlink;
+	return ret;
+}
+
+uint64_t GetFileModTimeUTC(StringView path)
+{
+	struct stat st;
+	if (stat(CStr<MAX_PATH>(path), &st) != 0)
+		return 0;
+	return uint64_t(st.st_mtime) * 1000; // to milliseconds
+}
+#endif
+
+
+#ifdef _WIN32
+struct MappedFileImpl
+{
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+
+	~MappedFileImpl()
+	{
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+	}
+};
+
+MappedFile::MappedFile(StringView path) : _impl(new MappedFileImpl)
+{
+	_impl->file = CreateFileW(UTF8toWCHAR(path).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (_impl->file == INVALID_HANDLE_VALUE)
+		return;
+
+	LARGE_INTEGER fsize;
+	if (!GetFileSizeEx(_impl->file, &fsize) || fsize.QuadPart == 0)
+		return; // empty files cannot be mapped
+
+	_impl->mapping = CreateFileMappingW(_impl->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!_impl->mapping)
+		return;
+
+	data = MapViewOfFile(_impl->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data)
+		size = fsize.QuadPart;
+}
+
+MappedFile::~MappedFile()
+{
+	if (data)
+		UnmapViewOfFile(data);
+	delete _impl;
+}
+#else
+struct MappedFileImpl
+{
+	int fd = -1;
+
+	~MappedFileImpl()
+	{
+		if (fd != -1)
+			close(fd);
+	}
+};
+
+MappedFile::MappedFile(StringView path) : _impl(new MappedFileImpl)
+{
+	_impl->fd = open(CStr<MAX_PATH>(path), O_RDONLY);
+	if (_impl->fd == -1)
+		return;
+
+	struct stat st;
+	if (fstat(_impl->fd, &st) != 0 || st.st_size == 0)
+		return; // empty files cannot be mapped
+
+	void* mem = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, _impl->fd, 0);
+	if (mem == MAP_FAILED)
+		return;
+	data = mem;
+	size = uint64_t(st.st_size);
+}
+
+MappedFile::~MappedFile()
+{
+	if (data)
+		munmap(const_cast<void*>(data), size_t(size));
+	delete _impl;
+}
+#endif
 
 } // ui
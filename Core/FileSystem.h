@@ -26,6 +26,8 @@ bool CreateMissingParentDirectories(StringView path);
 
 std::string GetWorkingDirectory();
 bool SetWorkingDirectory(StringView sv);
+// per-user directory for cached data (%LOCALAPPDATA% on Windows, $XDG_CACHE_HOME or ~/.cache elsewhere), empty if unknown
+std::string GetUserCacheDirectory();
 
 struct DirectoryIterator
 {
@@ -46,4 +48,19 @@ enum FileAttributes
 unsigned GetFileAttributes(StringView path);
 uint64_t GetFileModTimeUTC(StringView path);
 
+// read-only view of the whole file, data = nullptr on failure
+struct MappedFile
+{
+	struct MappedFileImpl* _impl = nullptr;
+	const void* data = nullptr;
+	uint64_t size = 0;
+
+	MappedFile(StringView path);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator = (const MappedFile&) = delete;
+
+	bool IsValid() const { return data != nullptr; }
+};
+
 } // ui
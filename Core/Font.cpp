@@ -1,6 +1,7 @@
 
 #include "Font.h"
 #include "FileSystem.h"
+#include "FontProvider.h"
 #include "HashTable.h"
 #include "../Render/Render.h"
 
@@ -9,9 +10,11 @@
 
 #include <vector>
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 #include <Windows.h>
+#endif
 
 
 namespace ui {
@@ -41,6 +44,17 @@ struct FontKey
 };
 static HashMap<FontKey, Font*, FontKey::Hasher> g_loadedFonts;
 
+// sizes from this one up are drawn from a single distance field glyph set (if the renderer antialiases its edges)
+static constexpr int SDF_MIN_SIZE = 24;
+static constexpr int SDF_BASE_SIZE = 32;
+static constexpr int SDF_PADDING = 4;
+static constexpr unsigned char SDF_ONEDGE = 128;
+
+// longer strings are not cached (each run stores a copy of the text and a quad per character)
+static constexpr size_t MAX_TEXT_RUN_LENGTH = 256;
+// the cache is cleared when the runs take more memory than this
+static constexpr size_t MAX_TEXT_RUN_BYTES = 4 * 1024 * 1024;
+
 struct GlyphValue
 {
 	draw::ImageHandle img;
@@ -51,6 +65,64 @@ struct GlyphValue
 	float xadv;
 };
 
+struct SDFGlyphValue
+{
+	draw::ImageHandle img;
+	// quad at SDF_BASE_SIZE, relative to the pen position
+	float x0;
+	float y0;
+	float x1;
+	float y1;
+};
+
+struct TextRunQuad
+{
+	draw::IImage* img;
+	// relative to the start of the run
+	float x;
+	float y;
+	float w;
+	float h;
+};
+
+// all glyph quads of one (font, size, text) combination
+struct TextRun
+{
+	Font* font = nullptr;
+	int size = 0;
+	bool distanceField = false;
+	std::string text;
+	float width = 0;
+	std::vector<TextRunQuad> quads;
+};
+static HashMap<uint64_t, TextRun> g_textRuns;
+static size_t g_textRunBytes = 0;
+static bool g_textRunCacheEnabled = true;
+
+static size_t GetTextRunBytes(const TextRun& run)
+{
+	return sizeof(TextRun) + run.text.capacity() + run.quads.capacity() * sizeof(TextRunQuad);
+}
+
+static void ClearTextRuns()
+{
+	g_textRuns.clear();
+	g_textRunBytes = 0;
+}
+
+static uint64_t GetTextRunKey(Font* font, int size, StringView text)
+{
+	uint64_t h = std::hash<StringView>()(text);
+	h = (h ^ uint64_t(uintptr_t(font))) * 1099511628211;
+	h = (h ^ uint64_t(size)) * 1099511628211;
+	return h;
+}
+
+static bool IsRunFor(const TextRun& run, Font* font, int size, StringView text)
+{
+	return run.font == font && run.size == size && StringView(run.text) == text;
+}
+
 struct Font
 {
 	struct SizeContext
@@ -61,21 +133,26 @@ struct Font
 
 	~Font()
 	{
+		// runs point to the glyphs of this font
+		ClearTextRuns();
 		g_loadedFonts.erase(key);
+		delete mapping;
 	}
 
-	bool LoadFromPath(const char* path)
+	bool LoadFromPath(const char* path, int index = 0)
 	{
-		data = ReadBinaryFile(path);
-		if (data.empty())
+		delete mapping;
+		mapping = new MappedFile(path);
+		if (!mapping->IsValid())
 			return false;
 
-		return InitFromMemory();
+		return InitFromMemory(static_cast<const unsigned char*>(mapping->data), index);
 	}
 
-	bool InitFromMemory()
+	bool InitFromMemory(const unsigned char* fontData, int index = 0)
 	{
-		if (!stbtt_InitFont(&info, (const unsigned char*)data.data(), 0))
+		int offset = stbtt_GetFontOffsetForIndex(fontData, index);
+		if (offset < 0 || !stbtt_InitFont(&info, fontData, offset))
 			return false;
 		return true;
 	}
@@ -124,13 +201,98 @@ struct Font
 		return *gv;
 	}
 
+	const SDFGlyphValue& FindSDFGlyph(uint32_t codepoint)
+	{
+		auto it = sdfGlyphs.find(codepoint);
+		if (it != sdfGlyphs.end())
+			return it->value;
+
+		int glyphID = stbtt_FindGlyphIndex(&info, codepoint);
+		float scale = stbtt_ScaleForMappingEmToPixels(&info, float(SDF_BASE_SIZE));
+
+		auto& gv = sdfGlyphs[codepoint];
+		int w = 0, h = 0, x = 0, y = 0;
+		auto* bitmap = stbtt_GetGlyphSDF(&info, scale, glyphID, SDF_PADDING, SDF_ONEDGE, float(SDF_ONEDGE) / SDF_PADDING, &w, &h, &x, &y);
+		if (bitmap)
+		{
+			gv.img = draw::ImageCreateA8(w, h, bitmap, draw::TexFlags::Packed);
+			stbtt_FreeSDF(bitmap, nullptr);
+		}
+		gv.x0 = float(x);
+		gv.y0 = float(y);
+		gv.x1 = float(x + w);
+		gv.y1 = float(y + h);
+		return gv;
+	}
+
 	FontKey key;
-	std::string data;
+	// font file is mapped, only the GDI fallback copies the data
+	MappedFile* mapping = nullptr;
+	std::string ownedData;
 	stbtt_fontinfo info;
 	HashMap<int, SizeContext> sizes;
+	HashMap<uint32_t, SDFGlyphValue> sdfGlyphs;
 };
 
+static const TextRun& BuildTextRun(TextRun& run, Font* font, int size, StringView text)
+{
+	run.font = font;
+	run.size = size;
+	// the distance field edges are only antialiased by some renderers
+	run.distanceField = size >= SDF_MIN_SIZE && draw::CanDrawSmoothDistanceField();
+	run.text.assign(text.data(), text.size());
+	run.quads.clear();
 
+	auto& sctx = font->GetSizeContext(size);
+	float sdfScale = float(size) / SDF_BASE_SIZE;
+	float x = 0;
+	for (size_t i = 0; i < text.size(); )
+	{
+		uint32_t ch = UTF8Decode(text, i);
+		if (run.distanceField)
+		{
+			auto gv = font->FindGlyph(sctx, ch, false);
+			const auto& sgv = font->FindSDFGlyph(ch);
+			if (sgv.img)
+				run.quads.push_back({ sgv.img, x + sgv.x0 * sdfScale, sgv.y0 * sdfScale, (sgv.x1 - sgv.x0) * sdfScale, (sgv.y1 - sgv.y0) * sdfScale });
+			x += gv.xadv;
+		}
+		else
+		{
+			auto gv = font->FindGlyph(sctx, ch, true);
+			run.quads.push_back({ gv.img, x + gv.xoff, gv.yoff, float(gv.w), float(gv.h) });
+			x += gv.xadv;
+		}
+	}
+	run.width = x;
+	return run;
+}
+
+static const TextRun& GetTextRun(Font* font, int size, StringView text)
+{
+	if (!g_textRunCacheEnabled || text.size() > MAX_TEXT_RUN_LENGTH)
+	{
+		static TextRun tmp;
+		return BuildTextRun(tmp, font, size, text);
+	}
+
+	uint64_t key = GetTextRunKey(font, size, text);
+	auto it = g_textRuns.find(key);
+	if (it.is_valid() && IsRunFor(it->value, font, size, text))
+		return it->value;
+
+	if (g_textRunBytes >= MAX_TEXT_RUN_BYTES)
+		ClearTextRuns();
+	auto& run = g_textRuns[key];
+	// replaced if another run had the same key
+	g_textRunBytes -= run.font ? GetTextRunBytes(run) : 0;
+	BuildTextRun(run, font, size, text);
+	g_textRunBytes += GetTextRunBytes(run);
+	return run;
+}
+
+
+#ifdef _WIN32
 struct FontEnumData
 {
 	int weight;
@@ -171,6 +333,7 @@ static std::string FindFontDataByName(const char* name, int weight, bool italic)
 	ReleaseDC(nullptr, dc);
 	return data;
 }
+#endif
 
 static Font* FindExistingFont(const FontKey& key)
 {
@@ -192,27 +355,83 @@ Font* GetFontByPath(const char* path)
 	return font;
 }
 
+static bool LoadInstalledFont(Font* font, const char* name, int weight, bool italic)
+{
+	auto* ffi = FontProviderFind(name, weight, italic);
+	if (!ffi)
+		return false;
+	if (font->LoadFromPath(ffi->path.c_str(), ffi->index))
+		return true;
+
+	// file was removed since the index was built
+	delete font->mapping;
+	font->mapping = nullptr;
+	if (!FontProviderRefresh())
+		return false;
+	ffi = FontProviderFind(name, weight, italic);
+	return ffi && font->LoadFromPath(ffi->path.c_str(), ffi->index);
+}
+
+#ifndef _WIN32
+static bool LoadFallbackFont(Font* font, int weight, bool italic);
+#endif
+
 Font* GetFontByName(const char* name, int weight, bool italic)
 {
 	FontKey key = { name, weight, italic };
 	if (auto* f = FindExistingFont(key))
 		return f;
 	Font* font = new Font;
-	font->data = FindFontDataByName(name, weight, italic);
-	font->InitFromMemory();
+	if (!LoadInstalledFont(font, name, weight, italic))
+	{
+#ifdef _WIN32
+		font->ownedData = FindFontDataByName(name, weight, italic);
+		font->InitFromMemory((const unsigned char*)font->ownedData.data());
+#else
+		LoadFallbackFont(font, weight, italic);
+#endif
+	}
 	font->key = key;
 	g_loadedFonts[key] = font;
 	return font;
 }
 
+static const char* g_sansSerifFontNames[] = { "Segoe UI", "DejaVu Sans", "Liberation Sans", "Noto Sans", "Helvetica", "Arial" };
+static const char* g_serifFontNames[] = { "Times New Roman", "DejaVu Serif", "Liberation Serif", "Noto Serif", "Times" };
+static const char* g_monospaceFontNames[] = { "Consolas", "DejaVu Sans Mono", "Liberation Mono", "Noto Sans Mono", "Menlo", "Courier New" };
+
+#ifndef _WIN32
+// the first installed sans-serif font, otherwise any installed font
+static bool LoadFallbackFont(Font* font, int weight, bool italic)
+{
+	for (const char* name : g_sansSerifFontNames)
+		if (LoadInstalledFont(font, name, weight, italic))
+			return true;
+	for (const auto& ffi : FontProviderGetAll())
+	{
+		if (font->LoadFromPath(ffi.path.c_str(), ffi.index))
+			return true;
+	}
+	return false;
+}
+#endif
+
+static Font* GetFirstInstalledFont(ArrayView<const char*> names, int weight, bool italic)
+{
+	for (const char* name : names)
+		if (FontProviderFind(name, weight, italic))
+			return GetFontByName(name, weight, italic);
+	return GetFontByName(names[0], weight, italic);
+}
+
 Font* GetFontByFamily(const char* family, int weight, bool italic)
 {
 	if (strcmp(family, FONT_FAMILY_SANS_SERIF) == 0)
-		return GetFontByName("Segoe UI", weight, italic);
+		return GetFirstInstalledFont(g_sansSerifFontNames, weight, italic);
 	if (strcmp(family, FONT_FAMILY_SERIF) == 0)
-		return GetFontByName("Times New Roman", weight, italic);
+		return GetFirstInstalledFont(g_serifFontNames, weight, italic);
 	if (strcmp(family, FONT_FAMILY_MONOSPACE) == 0)
-		return GetFontByName("Consolas", weight, italic);
+		return GetFirstInstalledFont(g_monospaceFontNames, weight, italic);
 	return nullptr;
 }
 
@@ -225,32 +444,70 @@ Font* GetFont(const char* nameOrFamily, int weight, bool italic)
 
 float GetTextWidth(Font* font, int size, StringView text)
 {
+	auto it = g_textRuns.find(GetTextRunKey(font, size, text));
+	if (it.is_valid() && IsRunFor(it->value, font, size, text))
+		return it->value.width;
+
 	auto& sctx = font->GetSizeContext(size);
 	float out = 0;
-	for (char c : text)
+	for (size_t i = 0; i < text.size(); )
 	{
-		out += font->FindGlyph(sctx, (uint8_t)c, false).xadv;
+		out += font->FindGlyph(sctx, UTF8Decode(text, i), false).xadv;
 	}
 	return out;
 }
 
+void GetTextPrefixWidths(Font* font, int size, StringView text, std::vector<float>& out)
+{
+	out.resize(text.size() + 1);
+	auto& sctx = font->GetSizeContext(size);
+	float x = 0;
+	for (size_t i = 0; i < text.size(); )
+	{
+		size_t start = i;
+		float xadv = font->FindGlyph(sctx, UTF8Decode(text, i), false).xadv;
+		for (size_t j = start; j < i; j++)
+			out[j] = x;
+		x += xadv;
+	}
+	out[text.size()] = x;
+}
+
 namespace draw {
 
 void TextLine(Font* font, int size, float x, float y, StringView text, Color4b color)
 {
-	auto& sctx = font->GetSizeContext(size);
-	for (char ch : text)
+	const auto& run = GetTextRun(font, size, text);
+	if (run.distanceField)
+	{
+		x = roundf(x);
+		y = roundf(y);
+		for (const auto& q : run.quads)
+			draw::RectColTexDistanceField(x + q.x, y + q.y, x + q.x + q.w, y + q.y + q.h, color, q.img, 0, 0, 1, 1);
+	}
+	else
 	{
-		auto gv = font->FindGlyph(sctx, (uint8_t)ch, true);
-		gv.xoff = roundf(gv.xoff + x);
-		gv.yoff = roundf(gv.yoff + y);
-		draw::RectColTex(gv.xoff, gv.yoff, gv.xoff + gv.w, gv.yoff + gv.h, color, gv.img);
-		x += gv.xadv;
+		for (const auto& q : run.quads)
+		{
+			float x0 = roundf(q.x + x);
+			float y0 = roundf(q.y + y);
+			draw::RectColTex(x0, y0, x0 + q.w, y0 + q.h, color, q.img);
+		}
 	}
 }
 
 } // draw
 
+namespace debug {
+
+void SetTextRunCacheEnabled(bool enabled)
+{
+	g_textRunCacheEnabled = enabled;
+	ClearTextRuns();
+}
+
+} // debug
+
 
 // TODO
 Font* g_font;
@@ -265,6 +522,9 @@ void FreeFont()
 	delete g_font;
 	g_font = nullptr;
 	g_loadedFonts.dealloc();
+	g_textRuns.dealloc();
+	g_textRunBytes = 0;
+	FontProviderFree();
 }
 
 float GetTextWidth(const char* text, size_t num)
@@ -272,6 +532,11 @@ float GetTextWidth(const char* text, size_t num)
 	return GetTextWidth(g_font, GetFontHeight(), num == SIZE_MAX ? StringView(text) : StringView(text, num));
 }
 
+void GetTextPrefixWidths(StringView text, std::vector<float>& out)
+{
+	GetTextPrefixWidths(g_font, GetFontHeight(), text, out);
+}
+
 float GetFontHeight()
 {
 	return 12;
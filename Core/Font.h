@@ -5,6 +5,7 @@
 #include "Image.h"
 
 #include <string>
+#include <vector>
 
 
 namespace ui {
@@ -24,14 +25,23 @@ Font* GetFontByFamily(const char* family, int weight = FONT_WEIGHT_NORMAL, bool
 Font* GetFont(const char* nameOrFamily, int weight = FONT_WEIGHT_NORMAL, bool italic = false);
 
 float GetTextWidth(Font* font, int size, StringView text);
+// out[i] = width of text[0..i), one entry per byte + one for the end
+// (bytes inside a multibyte character get the position of its start)
+void GetTextPrefixWidths(Font* font, int size, StringView text, std::vector<float>& out);
 
 namespace draw {
 void TextLine(Font* font, int size, float x, float y, StringView text, Color4b color);
 } // draw
 
+namespace debug {
+// for comparing text drawing performance, glyph quads are otherwise cached per (font, size, text)
+void SetTextRunCacheEnabled(bool enabled);
+} // debug
+
 void InitFont();
 void FreeFont();
 float GetTextWidth(const char* text, size_t num = SIZE_MAX);
+void GetTextPrefixWidths(StringView text, std::vector<float>& out);
 float GetFontHeight();
 void DrawTextLine(float x, float y, const char* text, float r, float g, float b, float a = 1);
 
@@ -0,0 +1,377 @@
+
+#include "FontProvider.h"
+#include "FileSystem.h"
+
+#include "../ThirdParty/stb_truetype.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unordered_set>
+
+
+namespace ui {
+
+static std::string g_fontIndexCachePath;
+static std::vector<FontFileInfo> g_fontIndex;
+static bool g_fontIndexLoaded = false;
+static bool g_fontIndexScanned = false;
+// lookups that found nothing in a freshly scanned index (family in lowercase, weight, italic)
+static std::unordered_set<std::string> g_failedLookups;
+
+static uint16_t ReadU16BE(const uint8_t* p) { return uint16_t((p[0] << 8) | p[1]); }
+static uint32_t ReadU32BE(const uint8_t* p) { return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3]; }
+
+static const uint8_t* FindTable(const uint8_t* data, size_t size, uint32_t fontOffset, const char* tag, uint32_t minLength)
+{
+	if (fontOffset + 12 > size)
+		return nullptr;
+	uint16_t numTables = ReadU16BE(data + fontOffset + 4);
+	for (uint16_t i = 0; i < numTables; i++)
+	{
+		uint32_t rec = fontOffset + 12 + i * 16;
+		if (rec + 16 > size)
+			return nullptr;
+		if (memcmp(data + rec, tag, 4) == 0)
+		{
+			uint32_t off = ReadU32BE(data + rec + 8);
+			uint32_t len = ReadU32BE(data + rec + 12);
+			if (len < minLength || uint64_t(off) + len > size)
+				return nullptr;
+			return data + off;
+		}
+	}
+	return nullptr;
+}
+
+static std::string GetNameString(const stbtt_fontinfo& info, int nameID)
+{
+	int len = 0;
+	// UTF-16BE
+	if (const char* str = stbtt_GetFontNameString(&info, &len, STBTT_PLATFORM_ID_MICROSOFT, STBTT_MS_EID_UNICODE_BMP, STBTT_MS_LANG_ENGLISH, nameID))
+	{
+		std::string out;
+		for (int i = 0; i + 1 < len; i += 2)
+		{
+			uint32_t c = ReadU16BE((const uint8_t*)str + i);
+			if (c >= 0xD800 && c < 0xDC00 && i + 3 < len)
+			{
+				uint32_t lo = ReadU16BE((const uint8_t*)str + i + 2);
+				if (lo >= 0xDC00 && lo < 0xE000)
+				{
+					c = 0x10000 + ((c - 0xD800) << 10) + (lo - 0xDC00);
+					i += 2;
+				}
+			}
+			if (c < 0x80)
+				out.push_back(char(c));
+			else if (c < 0x800)
+			{
+				out.push_back(char(0xC0 | (c >> 6)));
+				out.push_back(char(0x80 | (c & 0x3F)));
+			}
+			else if (c < 0x10000)
+			{
+				out.push_back(char(0xE0 | (c >> 12)));
+				out.push_back(char(0x80 | ((c >> 6) & 0x3F)));
+				out.push_back(char(0x80 | (c & 0x3F)));
+			}
+			else
+			{
+				out.push_back(char(0xF0 | (c >> 18)));
+				out.push_back(char(0x80 | ((c >> 12) & 0x3F)));
+				out.push_back(char(0x80 | ((c >> 6) & 0x3F)));
+				out.push_back(char(0x80 | (c & 0x3F)));
+			}
+		}
+		return out;
+	}
+	// Mac Roman, ASCII compatible
+	if (const char* str = stbtt_GetFontNameString(&info, &len, STBTT_PLATFORM_ID_MAC, STBTT_MAC_EID_ROMAN, STBTT_MAC_LANG_ENGLISH, nameID))
+		return std::string(str, len);
+	return {};
+}
+
+static void AddFontsFromFile(StringView path)
+{
+	MappedFile mf(path);
+	if (!mf.IsValid())
+		return;
+	auto* data = static_cast<const uint8_t*>(mf.data);
+
+	int numFonts = stbtt_GetNumberOfFonts(data);
+	for (int i = 0; i < numFonts; i++)
+	{
+		int offset = stbtt_GetFontOffsetForIndex(data, i);
+		stbtt_fontinfo info;
+		if (offset < 0 || !stbtt_InitFont(&info, data, offset))
+			continue;
+
+		FontFileInfo ffi;
+		ffi.path = to_string(path);
+		ffi.index = i;
+		if (auto* os2 = FindTable(data, mf.size, offset, "OS/2", 64))
+		{
+			ffi.weight = ReadU16BE(os2 + 4);
+			ffi.italic = (ReadU16BE(os2 + 62) & 1) != 0;
+		}
+		else if (auto* head = FindTable(data, mf.size, offset, "head", 54))
+		{
+			uint16_t macStyle = ReadU16BE(head + 44);
+			ffi.weight = macStyle & 1 ? 700 : 400;
+			ffi.italic = (macStyle & 2) != 0;
+		}
+
+		// typographic family groups all weights, the legacy one is what GDI names would use
+		auto typoFamily = GetNameString(info, 16);
+		auto family = GetNameString(info, 1);
+		if (!typoFamily.empty())
+		{
+			ffi.family = typoFamily;
+			g_fontIndex.push_back(ffi);
+		}
+		if (!family.empty() && family != typoFamily)
+		{
+			ffi.family = family;
+			g_fontIndex.push_back(ffi);
+		}
+	}
+}
+
+static bool IsFontFile(StringView name)
+{
+	auto ext = name.after_last(".");
+	return ext.equal_to_ci("ttf") || ext.equal_to_ci("otf") || ext.equal_to_ci("ttc");
+}
+
+static void ScanFontDirectory(const std::string& dir, int depth)
+{
+	DirectoryIterator it(dir);
+	std::string name;
+	while (it.GetNext(name))
+	{
+		auto path = PathJoin(dir, name);
+		if (GetFileAttributes(path) & FA_Directory)
+		{
+			if (depth < 8)
+				ScanFontDirectory(path, depth + 1);
+		}
+		else if (IsFontFile(name))
+			AddFontsFromFile(path);
+	}
+}
+
+#ifndef _WIN32
+// the <dir> entries of a fontconfig file ("~/" is the home directory, relative and prefixed paths are skipped)
+static void AddFontconfigDirectories(const char* confPath, std::vector<std::string>& dirs)
+{
+	auto text = ReadTextFile(confPath);
+	size_t pos = 0;
+	while ((pos = text.find("<dir", pos)) != std::string::npos)
+	{
+		size_t attrEnd = text.find('>', pos);
+		if (attrEnd == std::string::npos)
+			break;
+		size_t end = text.find("</dir>", attrEnd);
+		if (end == std::string::npos)
+			break;
+		StringView attrs(text.data() + pos + 4, attrEnd - pos - 4);
+		StringView dir = StringView(text.data() + attrEnd + 1, end - attrEnd - 1).trim();
+		pos = end;
+		// <dirs>, <dir/> or a path relative to an XDG directory or the configuration
+		if ((attrs.size() && attrs[0] != ' ') || attrs.ends_with("/") || to_string(attrs).find("prefix") != std::string::npos)
+			continue;
+		if (dir.starts_with("~/"))
+		{
+			if (auto* home = getenv("HOME"))
+				dirs.push_back(PathJoin(home, dir.substr(2)));
+		}
+		else if (dir.starts_with("/"))
+			dirs.push_back(to_string(dir));
+	}
+}
+#endif
+
+static std::vector<std::string> GetFontDirectories()
+{
+	std::vector<std::string> dirs;
+#ifdef _WIN32
+	if (auto* windir = getenv("WINDIR"))
+		dirs.push_back(PathJoin(windir, "Fonts"));
+	if (auto* localAppData = getenv("LOCALAPPDATA"))
+		dirs.push_back(PathJoin(localAppData, "Microsoft/Windows/Fonts"));
+	for (auto& dir : dirs)
+		for (auto& c : dir)
+			if (c == '\\')
+				c = '/';
+#elif defined(__APPLE__)
+	dirs.push_back("/System/Library/Fonts");
+	dirs.push_back("/Library/Fonts");
+	if (auto* home = getenv("HOME"))
+		dirs.push_back(PathJoin(home, "Library/Fonts"));
+#else
+	// the defaults of fontconfig, in case its configuration can't be read
+	dirs.push_back("/usr/share/fonts");
+	dirs.push_back("/usr/local/share/fonts");
+	if (auto* dataHome = getenv("XDG_DATA_HOME"))
+		dirs.push_back(PathJoin(dataHome, "fonts"));
+	else if (auto* home = getenv("HOME"))
+		dirs.push_back(PathJoin(home, ".local/share/fonts"));
+	if (auto* home = getenv("HOME"))
+		dirs.push_back(PathJoin(home, ".fonts"));
+	AddFontconfigDirectories("/etc/fonts/fonts.conf", dirs);
+	AddFontconfigDirectories("/etc/fonts/local.conf", dirs);
+
+	// nested directories would be scanned twice (sorted so that the parents come first)
+	std::sort(dirs.begin(), dirs.end());
+	std::vector<std::string> outerDirs;
+	for (auto& dir : dirs)
+	{
+		bool nested = false;
+		for (const auto& outer : outerDirs)
+			nested |= PathIsRelativeTo(dir, outer);
+		if (!nested)
+			outerDirs.push_back(std::move(dir));
+	}
+	dirs = std::move(outerDirs);
+#endif
+	return dirs;
+}
+
+// one font per line: weight, italic, index, family, path (tab-separated)
+static bool LoadFontIndex()
+{
+	if (g_fontIndexCachePath.empty())
+		return false;
+	auto text = ReadTextFile(g_fontIndexCachePath);
+	if (text.empty())
+		return false;
+
+	StringView it = text;
+	if (!it.take_if_equal("FONTINDEX1\n"))
+		return false;
+	while (!it.empty())
+	{
+		StringView line = it.until_first("\n");
+		it = it.substr(min(line.size() + 1, it.size()));
+
+		FontFileInfo ffi;
+		char family[256], path[1024];
+		int italic = 0;
+		if (sscanf(to_string(line).c_str(), "%d\t%d\t%d\t%255[^\t]\t%1023[^\n]", &ffi.weight, &italic, &ffi.index, family, path) != 5)
+			continue;
+		ffi.italic = italic != 0;
+		ffi.family = family;
+		ffi.path = path;
+		g_fontIndex.push_back(ffi);
+	}
+	return !g_fontIndex.empty();
+}
+
+static void SaveFontIndex()
+{
+	if (g_fontIndexCachePath.empty())
+		return;
+	std::string text = "FONTINDEX1\n";
+	for (const auto& ffi : g_fontIndex)
+		text += Format("%d\t%d\t%d\t%s\t%s\n", ffi.weight, ffi.italic ? 1 : 0, ffi.index, ffi.family.c_str(), ffi.path.c_str());
+	CreateMissingParentDirectories(g_fontIndexCachePath);
+	WriteTextFile(g_fontIndexCachePath, text);
+}
+
+static void EnsureFontIndex()
+{
+	if (g_fontIndexLoaded)
+		return;
+	g_fontIndexLoaded = true;
+	if (!LoadFontIndex())
+		FontProviderRescan();
+}
+
+void FontProviderSetIndexCachePath(StringView path)
+{
+	g_fontIndexCachePath = to_string(path);
+}
+
+void FontProviderRescan()
+{
+	g_fontIndex.clear();
+	g_failedLookups.clear();
+	for (const auto& dir : GetFontDirectories())
+		ScanFontDirectory(dir, 0);
+	g_fontIndexLoaded = true;
+	g_fontIndexScanned = true;
+	SaveFontIndex();
+}
+
+ArrayView<FontFileInfo> FontProviderGetAll()
+{
+	EnsureFontIndex();
+	return g_fontIndex;
+}
+
+static const FontFileInfo* FindInIndex(StringView family, int weight, bool italic)
+{
+	const FontFileInfo* best = nullptr;
+	int bestProximity = INT_MAX;
+	for (const auto& ffi : g_fontIndex)
+	{
+		if (!StringView(ffi.family).equal_to_ci(family))
+			continue;
+		// same metric as the GDI font enumeration
+		int prox = abs(weight - ffi.weight) + abs(int(italic) - int(ffi.italic)) * 2000;
+		if (prox < bestProximity)
+		{
+			best = &ffi;
+			bestProximity = prox;
+		}
+	}
+	return best;
+}
+
+static std::string GetLookupKey(StringView family, int weight, bool italic)
+{
+	std::string key = Format("%d %d ", weight, italic ? 1 : 0);
+	for (char c : family)
+		key.push_back(c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c);
+	return key;
+}
+
+const FontFileInfo* FontProviderFind(StringView family, int weight, bool italic)
+{
+	EnsureFontIndex();
+	if (auto* ffi = FindInIndex(family, weight, italic))
+		return ffi;
+
+	auto key = GetLookupKey(family, weight, italic);
+	if (g_failedLookups.count(key))
+		return nullptr;
+	// the cached index may be stale (newly installed fonts)
+	if (FontProviderRefresh())
+	{
+		if (auto* ffi = FindInIndex(family, weight, italic))
+			return ffi;
+	}
+	g_failedLookups.insert(key);
+	return nullptr;
+}
+
+bool FontProviderRefresh()
+{
+	EnsureFontIndex();
+	if (g_fontIndexScanned)
+		return false;
+	FontProviderRescan();
+	return true;
+}
+
+void FontProviderFree()
+{
+	g_fontIndex = {};
+	g_failedLookups = {};
+	g_fontIndexLoaded = false;
+	g_fontIndexScanned = false;
+}
+
+} // ui
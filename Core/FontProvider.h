@@ -0,0 +1,33 @@
+
+#pragma once
+
+#include "String.h"
+
+#include <vector>
+
+
+namespace ui {
+
+struct FontFileInfo
+{
+	std::string family;
+	std::string path;
+	int weight = 400;
+	bool italic = false;
+	// index into a font collection (.ttc)
+	int index = 0;
+};
+
+// the system and user font directories (on Linux, also those listed in the fontconfig configuration) are scanned on first use,
+// the resulting index can be cached on disk (empty path = in-memory only, Application sets one in the user cache directory)
+void FontProviderSetIndexCachePath(StringView path);
+void FontProviderRescan();
+ArrayView<FontFileInfo> FontProviderGetAll();
+// closest weight/italic match in the family, nullptr if the family is not installed
+// (families that are not found are remembered until the next rescan)
+const FontFileInfo* FontProviderFind(StringView family, int weight, bool italic);
+// rescans if the index was loaded from the cache, at most once per session, returns true if it did
+bool FontProviderRefresh();
+void FontProviderFree();
+
+} // ui
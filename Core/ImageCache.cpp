@@ -0,0 +1,123 @@
+
+#include "ImageCache.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+
+
+namespace ui {
+
+static constexpr uint32_t IMAGE_CACHE_MAGIC = 0x43494955; // "UIIC"
+static constexpr uint32_t IMAGE_CACHE_VERSION = 1;
+
+struct ImageCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t modTime;
+	uint32_t width;
+	uint32_t height;
+	uint32_t variant;
+	uint32_t pathLength;
+	// followed by path, padded to 16 bytes, then pixels
+};
+static_assert(sizeof(ImageCacheHeader) == 32, "unexpected cache header size");
+
+static std::string g_imageCacheDir;
+static ImageCacheStats g_imageCacheStats;
+
+static size_t GetPixelDataOffset(size_t pathLength)
+{
+	return (sizeof(ImageCacheHeader) + pathLength + 15) & ~size_t(15);
+}
+
+static std::string GetCacheFilePath(StringView path, uint32_t variant)
+{
+	char bfr[32];
+	snprintf(bfr, 32, "%016" PRIx64 "_%X.uic", uint64_t(std::hash<StringView>()(path)), unsigned(variant));
+	return PathJoin(g_imageCacheDir, bfr);
+}
+
+void ImageCacheSetDirectory(StringView dir)
+{
+	g_imageCacheDir = to_string(dir);
+}
+
+StringView ImageCacheGetDirectory()
+{
+	return g_imageCacheDir;
+}
+
+bool ImageCacheLoad(StringView path, uint32_t variant, CachedImage& out)
+{
+	if (g_imageCacheDir.empty())
+		return false;
+
+	uint64_t modTime = GetFileModTimeUTC(path);
+	auto* mf = new MappedFile(GetCacheFilePath(path, variant));
+
+	const auto* hdr = static_cast<const ImageCacheHeader*>(mf->data);
+	bool valid = mf->IsValid() &&
+		mf->size >= sizeof(ImageCacheHeader) &&
+		hdr->magic == IMAGE_CACHE_MAGIC &&
+		hdr->version == IMAGE_CACHE_VERSION &&
+		hdr->modTime == modTime &&
+		hdr->variant == variant &&
+		hdr->pathLength == path.size() &&
+		mf->size == GetPixelDataOffset(hdr->pathLength) + uint64_t(hdr->width) * hdr->height * 4 &&
+		memcmp(hdr + 1, path.data(), path.size()) == 0;
+	if (!valid)
+	{
+		delete mf;
+		g_imageCacheStats.misses++;
+		return false;
+	}
+
+	delete out._file;
+	out._file = mf;
+	out.width = hdr->width;
+	out.height = hdr->height;
+	out.pixels = reinterpret_cast<const uint32_t*>(static_cast<const char*>(mf->data) + GetPixelDataOffset(hdr->pathLength));
+	g_imageCacheStats.hits++;
+	return true;
+}
+
+bool ImageCacheStore(StringView path, uint32_t variant, uint32_t w, uint32_t h, const void* pixels)
+{
+	if (g_imageCacheDir.empty())
+		return false;
+
+	ImageCacheHeader hdr;
+	hdr.magic = IMAGE_CACHE_MAGIC;
+	hdr.version = IMAGE_CACHE_VERSION;
+	hdr.modTime = GetFileModTimeUTC(path);
+	hdr.width = w;
+	hdr.height = h;
+	hdr.variant = variant;
+	hdr.pathLength = uint32_t(path.size());
+
+	size_t pixelOffset = GetPixelDataOffset(path.size());
+	size_t pixelSize = size_t(w) * h * 4;
+	std::string data;
+	data.resize(pixelOffset + pixelSize);
+	memcpy(&data[0], &hdr, sizeof(hdr));
+	memcpy(&data[sizeof(hdr)], path.data(), path.size());
+	memcpy(&data[pixelOffset], pixels, pixelSize);
+
+	if (!CreateMissingDirectories(g_imageCacheDir))
+		return false;
+	if (!WriteBinaryFile(GetCacheFilePath(path, variant), data.data(), data.size()))
+	{
+		printf("failed to write image cache entry for %.*s\n", int(path.size()), path.data());
+		return false;
+	}
+	g_imageCacheStats.stores++;
+	return true;
+}
+
+ImageCacheStats ImageCacheGetStats()
+{
+	return g_imageCacheStats;
+}
+
+} // ui
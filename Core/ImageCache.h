@@ -0,0 +1,40 @@
+
+#pragma once
+
+#include "FileSystem.h"
+
+
+namespace ui {
+
+// persistent cache of decoded RGBA8 images
+// disabled until a directory is set
+// entries are keyed by source path, variant (e.g. texture flags) and source file modification time
+void ImageCacheSetDirectory(StringView dir);
+StringView ImageCacheGetDirectory();
+
+struct CachedImage
+{
+	MappedFile* _file = nullptr;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	// points into the mapped cache file, valid while the object is alive
+	const uint32_t* pixels = nullptr;
+
+	CachedImage() {}
+	~CachedImage() { delete _file; }
+	CachedImage(const CachedImage&) = delete;
+	CachedImage& operator = (const CachedImage&) = delete;
+};
+
+bool ImageCacheLoad(StringView path, uint32_t variant, CachedImage& out);
+bool ImageCacheStore(StringView path, uint32_t variant, uint32_t w, uint32_t h, const void* pixels);
+
+struct ImageCacheStats
+{
+	uint32_t hits = 0;
+	uint32_t misses = 0;
+	uint32_t stores = 0;
+};
+ImageCacheStats ImageCacheGetStats();
+
+} // ui
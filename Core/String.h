@@ -319,4 +319,26 @@ inline std::string Format(const char* fmt, ...)
 	return ret;
 }
 
+// decodes the codepoint at `pos` and moves `pos` to the next one
+// invalid/truncated sequences decode as a single byte (Latin-1)
+inline uint32_t UTF8Decode(StringView s, size_t& pos)
+{
+	uint8_t c0 = s[pos++];
+	if (c0 < 0x80)
+		return c0;
+	int len = c0 >= 0xF8 ? 0 : c0 >= 0xF0 ? 3 : c0 >= 0xE0 ? 2 : c0 >= 0xC0 ? 1 : 0;
+	if (len == 0 || pos + len > s.size())
+		return c0;
+	uint32_t cp = c0 & (0x3F >> len);
+	for (int i = 0; i < len; i++)
+	{
+		uint8_t c = s[pos + i];
+		if ((c & 0xC0) != 0x80)
+			return c0;
+		cp = (cp << 6) | (c & 0x3F);
+	}
+	pos += len;
+	return cp;
+}
+
 } // ui
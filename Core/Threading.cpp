@@ -1,8 +1,12 @@
 
 #include <queue>
+#include <deque>
+#include <vector>
 #include <mutex>
 #include <thread>
 #include <atomic>
+#include <algorithm>
+#include <condition_variable>
 #include <assert.h>
 
 #include "Threading.h"
@@ -224,4 +228,118 @@ bool WorkerQueue::IsQuitting()
 	return _impl->quit;
 }
 
+
+struct ParallelJob
+{
+	void (*fn)(void*, size_t);
+	void* userdata;
+	size_t count;
+	std::atomic<size_t> next{ 0 };
+	// pool threads currently running items of this job
+	int active = 0;
+};
+
+static void RunParallelJobItems(ParallelJob* job)
+{
+	for (;;)
+	{
+		size_t i = job->next++;
+		if (i >= job->count)
+			return;
+		job->fn(job->userdata, i);
+	}
+}
+
+struct ThreadPool
+{
+	std::mutex m;
+	std::condition_variable cv;
+	std::deque<ParallelJob*> jobs;
+	std::vector<std::thread> threads;
+	bool quit = false;
+
+	ThreadPool()
+	{
+		unsigned n = std::thread::hardware_concurrency();
+		for (unsigned i = 1; i < n; i++)
+			threads.emplace_back([this]() { Proc(); });
+	}
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> g(m);
+			quit = true;
+		}
+		cv.notify_all();
+		for (auto& t : threads)
+			t.join();
+	}
+	void Proc()
+	{
+		std::unique_lock<std::mutex> ulk(m);
+		for (;;)
+		{
+			while (!quit && jobs.empty())
+				cv.wait(ulk);
+			if (quit)
+				return;
+			auto* job = jobs.front();
+			if (job->next >= job->count)
+			{
+				jobs.pop_front();
+				continue;
+			}
+			job->active++;
+			ulk.unlock();
+			RunParallelJobItems(job);
+			ulk.lock();
+			job->active--;
+			cv.notify_all();
+		}
+	}
+};
+
+static ThreadPool& GetThreadPool()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+unsigned GetParallelThreadCount()
+{
+	return unsigned(GetThreadPool().threads.size() + 1);
+}
+
+void _ParallelFor(size_t count, void (*fn)(void* userdata, size_t i), void* userdata)
+{
+	if (count == 0)
+		return;
+	auto& pool = GetThreadPool();
+	if (count == 1 || pool.threads.empty())
+	{
+		for (size_t i = 0; i < count; i++)
+			fn(userdata, i);
+		return;
+	}
+
+	ParallelJob job;
+	job.fn = fn;
+	job.userdata = userdata;
+	job.count = count;
+	{
+		std::lock_guard<std::mutex> g(pool.m);
+		pool.jobs.push_back(&job);
+	}
+	pool.cv.notify_all();
+
+	RunParallelJobItems(&job);
+
+	std::unique_lock<std::mutex> ulk(pool.m);
+	auto it = std::find(pool.jobs.begin(), pool.jobs.end(), &job);
+	if (it != pool.jobs.end())
+		pool.jobs.erase(it);
+	while (job.active > 0)
+		pool.cv.wait(ulk);
+}
+
 } // ui
@@ -116,4 +116,15 @@ struct WorkerQueue
 	struct WorkerQueueImpl* _impl;
 };
 
+// number of threads used by ParallelFor (including the calling thread)
+unsigned GetParallelThreadCount();
+void _ParallelFor(size_t count, void (*fn)(void* userdata, size_t i), void* userdata);
+// calls f(i) for each i in [0; count) on the calling thread and a shared pool of worker threads
+// returns after all calls have finished
+template <class F> void ParallelFor(size_t count, F&& f)
+{
+	using FT = typename std::remove_reference<F>::type;
+	_ParallelFor(count, [](void* userdata, size_t i) { (*static_cast<FT*>(userdata))(i); }, const_cast<void*>(static_cast<const void*>(&f)));
+}
+
 } // ui
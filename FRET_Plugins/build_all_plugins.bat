@@ -1,2 +1,4 @@
 clang++ -g -gcodeview -std=c++11 -o tar.exe tar.cpp -lws2_32
 clang++ -g -gcodeview -std=c++11 -o wav.exe wav.cpp -lws2_32
+clang++ -g -gcodeview -std=c++11 -shared -DFRET_PLUGIN_DLL -o tar.dll tar.cpp -lws2_32
+clang++ -g -gcodeview -std=c++11 -shared -DFRET_PLUGIN_DLL -o wav.dll wav.cpp -lws2_32
@@ -11,14 +11,19 @@
 #define NOUSER
 #define NONLS
 #include <winsock2.h>
+#include <io.h>
+#include <fcntl.h>
 #include <assert.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
 
-char* get_file_contents(const char* filename, int& size)
+char* get_file_contents(const char* filename, int64_t& size)
 {
 	if (FILE* fp = fopen(filename, "rb"))
 	{
-		fseek(fp, 0, SEEK_END);
-		size = ftell(fp);
+		_fseeki64(fp, 0, SEEK_END);
+		size = _ftelli64(fp);
 		char* contents = (char*) malloc(size);
 		rewind(fp);
 		fread(contents, 1, size, fp);
@@ -59,9 +64,35 @@ typedef uint64_t u64;
 typedef float f32;
 typedef double f64;
 
-struct SendSocket
+// the interface of the plugins built as DLLs (with FRET_PLUGIN_DLL defined) that fret runs in its own process
+// must match the copy in fret/FileStructureViewer.h
+#define FRET_PLUGIN_ABI_VERSION 1
+struct FRETPluginHost
 {
-	SOCKET s;
+	u32 version;
+	// the whole file (memory mapped by fret)
+	const void* data;
+	u64 size;
+	u64 position;
+	const char* type;
+	// receives each batch (valid only during the call)
+	void (*write)(void* userdata, const void* batch, u32 size);
+	// checked after each batch, parsing stops if it returns nonzero
+	int (*cancel)(void* userdata);
+	void* userdata;
+};
+
+// records are collected and sent in batches, each is a u32 (little endian) size followed by whole records
+// names are sent once, after that by index (ULEB 0 + string for a new one, index + 1 otherwise)
+static const size_t SEND_BATCH_SIZE = 64 * 1024;
+
+struct Sender
+{
+	SOCKET s = -1;
+	FILE* fp = nullptr;
+	const FRETPluginHost* host = nullptr;
+	std::vector<char> batch;
+	std::unordered_map<std::string, u32> names;
 	
 	void init(int port)
 	{
@@ -89,40 +120,67 @@ struct SendSocket
 			fprintf(stderr, "failed to connect to port %d\n", port);
 			exit(EXIT_FAILURE);
 		}
+		batch.reserve(SEND_BATCH_SIZE * 2);
+	}
+	// "-" is stdout (for reading the output through a pipe)
+	void init(const char* path)
+	{
+		if (strcmp(path, "-") == 0)
+		{
+			_setmode(_fileno(stdout), _O_BINARY);
+			fp = stdout;
+		}
+		else if (!(fp = fopen(path, "wb")))
+		{
+			fprintf(stderr, "failed to open %s for writing\n", path);
+			exit(EXIT_FAILURE);
+		}
+		batch.reserve(SEND_BATCH_SIZE * 2);
+	}
+	void init(const FRETPluginHost* h)
+	{
+		host = h;
+		batch.reserve(SEND_BATCH_SIZE * 2);
 	}
 	void free()
 	{
-		closesocket(s);
-		s = -1;
-		WSACleanup();
+		flush();
+		host = nullptr;
+		if (s != -1)
+		{
+			closesocket(s);
+			s = -1;
+			WSACleanup();
+		}
+		if (fp)
+		{
+			if (fp != stdout)
+				fclose(fp);
+			else
+				fflush(fp);
+			fp = nullptr;
+		}
 	}
 	bool on() const
 	{
-		return s != -1;
+		return s != -1 || fp || host;
 	}
 	
 	void send_char(char code)
 	{
-		send_buf(&code, 1);
+		batch.push_back(code);
 	}
 	void send_uleb(u64 v)
 	{
-		u8 tmp[10];
-		int size = 0;
 		do
 		{
 			u8 byte = v & 0x7f;
 			v >>= 7;
 			if (v != 0)
 				byte |= 0x80;
-			tmp[size++] = byte;
+			batch.push_back(byte);
 		}
 		while (v != 0);
-		send_buf(tmp, size);
-	}
-	void send_u64(u64 v)
-	{
-		send_buf(&v, sizeof(v));
 	}
 	void send_str(const char* s)
 	{
@@ -131,25 +189,83 @@ struct SendSocket
 	void send_str(const char* s, size_t len)
 	{
 		send_uleb(len);
-		send_buf(s, len);
+		batch.insert(batch.end(), s, s + len);
+	}
+	void send_name(const char* name)
+	{
+		auto it = names.find(name);
+		if (it != names.end())
+		{
+			send_uleb(it->second + 1);
+			return;
+		}
+		send_uleb(0);
+		send_str(name);
+		u32 id = names.size();
+		names.emplace(name, id);
+	}
+	// called after each record, batches only contain whole records
+	void end_record()
+	{
+		if (batch.size() >= SEND_BATCH_SIZE)
+			flush();
+	}
+	// thrown out of Parse when the host cancels
+	struct cancelled {};
+	void flush()
+	{
+		if (batch.empty())
+			return;
+		u32 size = batch.size();
+		if (host)
+		{
+			host->write(host->userdata, batch.data(), size);
+			batch.clear();
+			if (host->cancel(host->userdata))
+				throw cancelled();
+			return;
+		}
+		write_(&size, sizeof(size));
+		write_(batch.data(), batch.size());
+		batch.clear();
 	}
-	void send_buf(const void* data, size_t size)
+	void write_(const void* data, size_t size)
 	{
 		auto* p = static_cast<const char*>(data);
-		::send(s, p, size, 0);
+		if (fp)
+		{
+			// e.g. the reader was closed
+			if (fwrite(p, 1, size, fp) != size)
+			{
+				fprintf(stderr, "failed to write\n");
+				exit(EXIT_FAILURE);
+			}
+			return;
+		}
+		while (size)
+		{
+			int ret = ::send(s, p, size, 0);
+			if (ret <= 0)
+			{
+				fprintf(stderr, "failed to send\n");
+				exit(EXIT_FAILURE);
+			}
+			p += ret;
+			size -= ret;
+		}
 	}
 };
 
 struct Reader
 {
 	char* data_;
-	int size_ = 0;
-	int at = 0;
+	s64 size_ = 0;
+	s64 at = 0;
 	int level_ = 0;
 	int maxpreviewchars_ = 64;
 	char* previewbuf_;
 	
-	SendSocket socket_;
+	Sender out_;
 	
 	void read(char* out, size_t count) { readb(out, sizeof(*out) * count); }
 	void read(int16_t* out, size_t count) { readb(out, sizeof(*out) * count); }
@@ -234,7 +350,7 @@ struct Reader
 				previewbuf_[maxpreviewchars_ - 1 - i] = '.';
 			pchars = 0;
 		}
-		socket_.send_str(previewbuf_, maxpreviewchars_ - pchars);
+		out_.send_str(previewbuf_, maxpreviewchars_ - pchars);
 	}
 
 	void dump(const char* v, size_t count)
@@ -273,15 +389,16 @@ struct Reader
 	template <class T> void rnd_(const char* name, T* out, size_t size)
 	{
 		read(out, size);
-		if (socket_.on())
-		{
-			socket_.send_char('F');
-			socket_.send_char(typecode(out));
-			socket_.send_char('0' + sizeof(T));
-			socket_.send_uleb(at - size * sizeof(T));
-			socket_.send_uleb(size);
-			socket_.send_str(name);
+		if (out_.on())
+		{
+			out_.send_char('F');
+			out_.send_char(typecode(out));
+			out_.send_char('0' + sizeof(T));
+			out_.send_uleb(at - size * sizeof(T));
+			out_.send_uleb(size);
+			out_.send_name(name);
 			netdump(out, size);
+			out_.end_record();
 		}
 		else
 		{
@@ -291,23 +408,34 @@ struct Reader
 			puts("");
 		}
 	}
+	// the number of whole elements at `at` that are in the data (marked ranges can go past the end)
+	template <class T> size_t avail_(size_t size) const
+	{
+		if (at < 0 || at >= size_)
+			return 0;
+		u64 n = u64(size_ - at) / sizeof(T);
+		return n < size ? size_t(n) : size;
+	}
 	template <class T> void mark_(const char* name, size_t size)
 	{
-		if (socket_.on())
+		size_t avail = avail_<T>(size);
+		T* src = reinterpret_cast<T*>(avail ? &data_[at] : data_);
+		if (out_.on())
 		{
-			socket_.send_char('F');
-			socket_.send_char(typecode(static_cast<T*>(nullptr)));
-			socket_.send_char('0' + sizeof(T));
-			socket_.send_uleb(at);
-			socket_.send_uleb(size);
-			socket_.send_str(name);
-			netdump(reinterpret_cast<T*>(&data_[at]), size);
+			out_.send_char('F');
+			out_.send_char(typecode(static_cast<T*>(nullptr)));
+			out_.send_char('0' + sizeof(T));
+			out_.send_uleb(at);
+			out_.send_uleb(size);
+			out_.send_name(name);
+			netdump(src, avail);
+			out_.end_record();
 		}
 		else
 		{
 			printlev_();
 			printf("%s = ", name);
-			dump(reinterpret_cast<T*>(&data_[at]), size);
+			dump(src, avail);
 			puts("");
 		}
 		at += sizeof(T) * size;
@@ -318,15 +446,16 @@ struct Reader
 	}
 	template <class T> void parsed_(const char* name, const T* arr, size_t size)
 	{
-		if (socket_.on())
+		if (out_.on())
 		{
-			socket_.send_char('F');
-			socket_.send_char(typecode(static_cast<T*>(nullptr)));
-			socket_.send_char('0' + sizeof(T));
-			socket_.send_uleb(at);
-			socket_.send_uleb(size);
-			socket_.send_str(name);
+			out_.send_char('F');
+			out_.send_char(typecode(static_cast<T*>(nullptr)));
+			out_.send_char('0' + sizeof(T));
+			out_.send_uleb(at);
+			out_.send_uleb(size);
+			out_.send_name(name);
 			netdump(arr, size);
+			out_.end_record();
 		}
 		else
 		{
@@ -338,11 +467,12 @@ struct Reader
 	}
 	void INFO(const char* name, const char* info)
 	{
-		if (socket_.on())
+		if (out_.on())
 		{
-			socket_.send_char('I');
-			socket_.send_str(name);
-			socket_.send_str(info);
+			out_.send_char('I');
+			out_.send_name(name);
+			out_.send_str(info);
+			out_.end_record();
 		}
 		else
 		{
@@ -363,10 +493,11 @@ struct Reader
 
 	void PUSH(const char* name)
 	{
-		if (socket_.on())
+		if (out_.on())
 		{
-			socket_.send_char('{');
-			socket_.send_str(name);
+			out_.send_char('{');
+			out_.send_name(name);
+			out_.end_record();
 		}
 		else
 		{
@@ -377,9 +508,10 @@ struct Reader
 	}
 	void POP()
 	{
-		if (socket_.on())
+		if (out_.on())
 		{
-			socket_.send_char('}');
+			out_.send_char('}');
+			out_.end_record();
 		}
 		else
 		{
@@ -406,12 +538,14 @@ struct Reader
 		const char* filename = nullptr;
 		const char* type = nullptr;
 		int send_port = 0;
+		const char* out_path = nullptr;
 		for (int i = 1; i < argc; i++)
 		{
 			if (auto* a = _getopt(argc, argv, i, "-f", "--file")) { filename = a; continue; }
-			if (auto* a = _getopt(argc, argv, i, "-p", "--position")) { at = atoi(a); continue; }
+			if (auto* a = _getopt(argc, argv, i, "-p", "--position")) { at = strtoll(a, nullptr, 10); continue; }
 			if (auto* a = _getopt(argc, argv, i, "-t", "--type")) { type = a; continue; }
 			if (auto* a = _getopt(argc, argv, i, "-s", "--sendport")) { send_port = atoi(a); continue; }
+			if (auto* a = _getopt(argc, argv, i, "-o", "--output")) { out_path = a; continue; }
 		}
 		if (filename == nullptr)
 		{
@@ -421,12 +555,40 @@ struct Reader
 		data_ = get_file_contents(filename, size_);
 		if (send_port)
 		{
-			socket_.init(send_port);
+			out_.init(send_port);
+		}
+		else if (out_path)
+		{
+			out_.init(out_path);
 		}
 		previewbuf_ = new char[maxpreviewchars_];
 		Parse(type);
 		delete [] previewbuf_;
-		socket_.free();
+		out_.free();
+		return EXIT_SUCCESS;
+	}
+	int _run_(const FRETPluginHost* host)
+	{
+		if (host->version != FRET_PLUGIN_ABI_VERSION)
+			return EXIT_FAILURE;
+		// only read, same as the loaded file contents
+		data_ = const_cast<char*>(static_cast<const char*>(host->data));
+		size_ = host->size;
+		at = host->position;
+		out_.init(host);
+		previewbuf_ = new char[maxpreviewchars_];
+		try
+		{
+			Parse(host->type);
+			// the last flush can also be cancelled
+			out_.free();
+		}
+		catch (Sender::cancelled&)
+		{
+			// the batch was cleared before throwing so this doesn't call the host again
+			out_.free();
+		}
+		delete [] previewbuf_;
 		return EXIT_SUCCESS;
 	}
 	
@@ -434,5 +596,10 @@ struct Reader
 	virtual void Parse(const char* type) = 0;
 };
 
+#ifdef FRET_PLUGIN_DLL
+#define DEFINE_PLUGIN(cls) \
+	extern "C" __declspec(dllexport) int fret_plugin_parse(const FRETPluginHost* host) { cls inst; return inst._run_(host); }
+#else
 #define DEFINE_PLUGIN(cls) \
 	int main(int argc, char** argv) { cls inst; return inst._main_(argc, argv); }
+#endif
@@ -2,6 +2,8 @@
 #pragma once
 
 #include "Core/FileSystem.h"
+#include "Core/FontProvider.h"
+#include "Core/ImageCache.h"
 #include "Core/Math.h"
 #include "Core/RefCounted.h"
 #include "Core/String.h"
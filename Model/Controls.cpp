@@ -5,6 +5,8 @@
 #include "Native.h"
 #include "Theme.h"
 
+#include <algorithm>
+
 
 namespace ui {
 
@@ -1034,15 +1036,15 @@ void Textbox::OnPaint()
 			{
 				int minpos = startCursor < endCursor ? startCursor : endCursor;
 				int maxpos = startCursor > endCursor ? startCursor : endCursor;
-				float x0 = GetTextWidth(_text.c_str(), minpos);
-				float x1 = GetTextWidth(_text.c_str(), maxpos);
+				float x0 = _GetCursorX(minpos);
+				float x1 = _GetCursorX(maxpos);
 
 				draw::RectCol(r.x0 + x0, r.y0, r.x0 + x1, r.y1, Color4f(0.5f, 0.7f, 0.9f, 0.4f));
 			}
 
 			if (showCaretState)
 			{
-				float x = GetTextWidth(_text.c_str(), endCursor);
+				float x = _GetCursorX(endCursor);
 				draw::RectCol(r.x0 + x, r.y0, r.x0 + x + 1, r.y1, Color4b::White());
 			}
 		}
@@ -1345,6 +1347,7 @@ void Textbox::OnEvent(Event& e)
 						_text.erase(endCursor, to - endCursor);
 						break;
 					}
+					_InvalidateTextWidths();
 				}
 				e.context->OnChange(this);
 				break;
@@ -1374,6 +1377,7 @@ void Textbox::OnSerialize(IDataSerializer& s)
 	_text.resize(len);
 	if (len)
 		s.Process(&_text[0], len);
+	_InvalidateTextWidths();
 }
 
 StringView Textbox::GetSelectedText() const
@@ -1388,6 +1392,7 @@ void Textbox::EnterText(const char* str)
 	EraseSelection();
 	size_t num = strlen(str);
 	_text.insert(endCursor, str, num);
+	_InvalidateTextWidths();
 	startCursor = endCursor += num;
 	system->eventSystem.OnChange(this);
 }
@@ -1399,6 +1404,7 @@ void Textbox::EraseSelection()
 		int min = startCursor < endCursor ? startCursor : endCursor;
 		int max = startCursor > endCursor ? startCursor : endCursor;
 		_text.erase(min, max - min);
+		_InvalidateTextWidths();
 		startCursor = endCursor = min;
 	}
 }
@@ -1406,23 +1412,42 @@ void Textbox::EraseSelection()
 size_t Textbox::_FindCursorPos(float vpx)
 {
 	auto r = GetContentRect();
+	_UpdateTextWidths();
 	// TODO kerning
-	float x = r.x0;
-	for (size_t i = 0; i < _text.size(); i++)
-	{
-		float lw = GetTextWidth(&_text[i], 1);
-		if (vpx < x + lw * 0.5f)
-			return i;
-		x += lw;
-	}
-	return _text.size();
+	float x = vpx - r.x0;
+	// first character boundary at or after x, then pick the closer side of that character
+	size_t next = std::lower_bound(_textWidths.begin(), _textWidths.end(), x) - _textWidths.begin();
+	if (next == 0)
+		return 0;
+	if (next > _text.size())
+		return _text.size();
+	size_t prev = PrevChar(_text, next);
+	return x < (_textWidths[prev] + _textWidths[next]) * 0.5f ? prev : next;
+}
+
+float Textbox::_GetCursorX(size_t pos)
+{
+	_UpdateTextWidths();
+	return _textWidths[min(pos, _text.size())];
+}
+
+void Textbox::_UpdateTextWidths()
+{
+	if (_textWidthsValid)
+		return;
+	GetTextPrefixWidths(_text, _textWidths);
+	_textWidthsValid = true;
 }
 
 Textbox& Textbox::SetText(StringView s)
 {
 	if (InUse())
 		return *this;
-	_text.assign(s.data(), s.size());
+	if (StringView(_text) != s)
+	{
+		_text.assign(s.data(), s.size());
+		_InvalidateTextWidths();
+	}
 	if (startCursor > _text.size())
 		startCursor = _text.size();
 	if (endCursor > _text.size())
@@ -454,6 +454,9 @@ struct Textbox : UIElement
 	void EraseSelection();
 
 	size_t _FindCursorPos(float vpx);
+	float _GetCursorX(size_t pos);
+	void _UpdateTextWidths();
+	void _InvalidateTextWidths() { _textWidthsValid = false; }
 
 	const std::string& GetText() const { return _text; }
 	Textbox& SetText(StringView s);
@@ -482,6 +485,9 @@ struct Textbox : UIElement
 	bool _hadFocusOnFirstClick = false;
 	unsigned _lastPressRepeatCount = 0;
 	float accumulator = 0;
+	// x offset of each byte position in _text, rebuilt after edits
+	std::vector<float> _textWidths;
+	bool _textWidthsValid = false;
 };
 
 struct TextboxPlaceholder : Modifier
@@ -266,7 +266,7 @@ void HueSatPicker::_RegenerateBackground(int w)
 		}
 	}
 
-	_bgImage = draw::ImageCreateFromCanvas(c);
+	_bgImage = draw::ImageUpdateFromCanvas(_bgImage, c);
 }
 
 
@@ -373,7 +373,7 @@ void ColorCompPicker2D::_RegenerateBackground(int w, int h)
 		}
 	}
 
-	_bgImage = draw::ImageCreateFromCanvas(c);
+	_bgImage = draw::ImageUpdateFromCanvas(_bgImage, c);
 	_curImgSettings = _settings;
 }
 
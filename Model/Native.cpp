@@ -21,6 +21,7 @@
 #include "../Render/Render.h"
 #include "../Core/WindowsUtils.h"
 #include "../Core/FileSystem.h"
+#include "../Core/FontProvider.h"
 
 
 #define WINDOW_CLASS_NAME L"UIWindow"
@@ -1269,6 +1270,11 @@ Application::Application(int argc, char* argv[])
 
 	LoadDefaultCursors();
 	SubscriptionTable_Init();
+
+	// shared by all apps (can be changed before the first window is created)
+	auto cacheDir = GetUserCacheDirectory();
+	if (!cacheDir.empty())
+		FontProviderSetIndexCachePath(PathJoin(cacheDir, "ui/fonts.txt"));
 }
 
 Application::~Application()
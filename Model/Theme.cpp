@@ -1,5 +1,6 @@
 
 #include "../Render/Render.h"
+#include "../Core/ImageCache.h"
 #include "Theme.h"
 
 namespace ui {
@@ -10,6 +11,8 @@ Theme* Theme::current;
 static unsigned char* LoadTGA(const char* img, int size[2])
 {
 	FILE* f = fopen(img, "rb");
+	if (!f)
+		return nullptr;
 	char idlen = getc(f);
 	assert(idlen == 0); // no id
 	char cmtype = getc(f);
@@ -37,6 +40,7 @@ static unsigned char* LoadTGA(const char* img, int size[2])
 		out[i * 4 + 0] = getc(f);
 		out[i * 4 + 3] = getc(f);
 	}
+	fclose(f);
 	return out;
 }
 
@@ -762,9 +766,25 @@ struct DefaultTheme : Theme
 
 void InitTheme()
 {
+	static const char* themeImagePath = "gui-theme2.tga";
 	int size[2];
-	auto* data = LoadTGA("gui-theme2.tga", size);
-	for (int i = 0; i < TE__COUNT; i++)
+	const unsigned char* data;
+	unsigned char* decoded = nullptr;
+	CachedImage cached;
+	if (ImageCacheLoad(themeImagePath, 0, cached))
+	{
+		size[0] = cached.width;
+		size[1] = cached.height;
+		data = reinterpret_cast<const unsigned char*>(cached.pixels);
+	}
+	else
+	{
+		data = decoded = LoadTGA(themeImagePath, size);
+		if (decoded)
+			ImageCacheStore(themeImagePath, 0, size[0], size[1], decoded);
+	}
+	// without the file the theme elements are not drawn
+	for (int i = 0; data && i < TE__COUNT; i++)
 	{
 		auto& s = g_themeSprites[i];
 		g_themeImages[i] = ui::draw::ImageCreateRGBA8(
@@ -774,7 +794,7 @@ void InitTheme()
 			&data[(s.ox0 + s.oy0 * size[0]) * 4],
 			draw::TexFlags::Packed);
 	}
-	delete[] data;
+	delete[] decoded;
 
 	Theme::current = new DefaultTheme;
 }
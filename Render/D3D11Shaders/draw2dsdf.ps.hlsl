@@ -0,0 +1,19 @@
+
+struct v2p
+{
+	float4 pos : SV_Position;
+	float2 tex : TEXCOORD0;
+	float4 col : COLOR0;
+};
+
+Texture2D curTex : register(t0);
+SamplerState curSmp : register(s0);
+
+// texture alpha is a distance field with the edge at 0.5
+float4 main(v2p input) : SV_Target0
+{
+	float4 t = curTex.Sample(curSmp, input.tex);
+	float w = fwidth(t.a) * 0.7;
+	t.a = smoothstep(0.5 - w, 0.5 + w, t.a);
+	return t * input.col;
+}
@@ -97,6 +97,10 @@ void CopyToMappedTextureRect(Texture2D* tex, const MapData& md, uint16_t x, uint
 void UnmapTexture(Texture2D* tex);
 
 void SetTexture(Texture2D* tex);
+// 2D drawing: interpret texture alpha as a distance field (edge at 0.5)
+void SetDistanceFieldMode(bool enabled);
+// false if the distance field mode can't antialias the edges
+bool HasSmoothDistanceField();
 void DrawTriangles(Vertex* verts, size_t num_verts);
 void DrawIndexedTriangles(Vertex* verts, size_t num_verts, uint16_t* indices, size_t num_indices);
 
@@ -136,6 +140,15 @@ enum VertexFormat         // position:   float3
 	VF_Color    = 1 << 2, // + color:    ubyte4
 };
 size_t GetVertexSize(unsigned vertexFormat);
+
+// persistent vertex/index data for the 3D drawing functions (size in bytes)
+struct Buffer;
+Buffer* CreateVertexBuffer(const void* data, size_t size);
+Buffer* CreateIndexBuffer(const void* data, size_t size);
+// replaces the contents, reallocating only if the buffer is too small
+void UpdateBuffer(Buffer* buf, const void* data, size_t size);
+void DestroyBuffer(Buffer* buf);
+
 void Draw(
 	const Mat4f& xf,
 	PrimitiveType primType,
@@ -151,6 +164,21 @@ void DrawIndexed(
 	const void* indices,
 	size_t numIndices,
 	bool i32 = false);
+void Draw(
+	const Mat4f& xf,
+	PrimitiveType primType,
+	unsigned vertexFormat,
+	Buffer* vertices,
+	size_t numVertices);
+void DrawIndexed(
+	const Mat4f& xf,
+	PrimitiveType primType,
+	unsigned vertexFormat,
+	Buffer* vertices,
+	size_t numVertices,
+	Buffer* indices,
+	size_t numIndices,
+	bool i32 = false);
 
 
 } // rhi
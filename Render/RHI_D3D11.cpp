@@ -17,6 +17,7 @@
 #include "clear.ps.h"
 #include "draw2d.vs.h"
 #include "draw2d.ps.h"
+#include "draw2dsdf.ps.h"
 #include "draw3dunlit.vs.h"
 #include "draw3dunlit.ps.h"
 
@@ -136,6 +137,44 @@ struct Texture2D
 };
 
 
+struct Buffer
+{
+	UINT _bindFlags;
+	ID3D11Buffer* buffer = nullptr;
+	size_t curSize = 0;
+
+	Buffer(UINT bindFlags, const void* data, size_t size) : _bindFlags(bindFlags)
+	{
+		Allocate(data, size);
+	}
+	~Buffer()
+	{
+		SAFE_RELEASE(buffer);
+	}
+	void Allocate(const void* data, size_t size)
+	{
+		SAFE_RELEASE(buffer);
+		curSize = 0;
+		if (size == 0)
+			return;
+
+		D3D11_BUFFER_DESC bd = {};
+		{
+			bd.ByteWidth = size;
+			bd.Usage = D3D11_USAGE_DEFAULT;
+			bd.BindFlags = _bindFlags;
+		}
+		D3D11_SUBRESOURCE_DATA srd = {};
+		{
+			srd.pSysMem = data;
+		}
+		D3DCHK(g_dev->CreateBuffer(&bd, data ? &srd : nullptr, &buffer));
+
+		curSize = size;
+	}
+};
+
+
 extern Stats g_stats;
 
 static TempBuffer* g_tmpVB = nullptr;
@@ -164,6 +203,8 @@ static ID3D11PixelShader* g_psClear = nullptr;
 
 static ID3D11VertexShader* g_vsDraw2D = nullptr;
 static ID3D11PixelShader* g_psDraw2D = nullptr;
+static ID3D11PixelShader* g_psDraw2DSDF = nullptr;
+static bool g_distanceFieldMode = false;
 
 static ID3D11VertexShader* g_vsDraw3DUnlit = nullptr;
 static ID3D11PixelShader* g_psDraw3DUnlit = nullptr;
@@ -304,6 +345,7 @@ static void Reset2DRender()
 	g_ctx->VSSetShader(g_vsDraw2D, nullptr, 0);
 	g_ctx->VSSetConstantBuffers(0, 1, &g_tmpCB->buffer);
 	g_ctx->PSSetShader(g_psDraw2D, nullptr, 0);
+	g_distanceFieldMode = false;
 	g_ctx->IASetInputLayout(g_inputLayout2D);
 }
 
@@ -521,6 +563,7 @@ void GlobalInit()
 
 	D3DCHK(g_dev->CreateVertexShader(g_shobj_vs_draw2d, sizeof(g_shobj_vs_draw2d), nullptr, &g_vsDraw2D));
 	D3DCHK(g_dev->CreatePixelShader(g_shobj_ps_draw2d, sizeof(g_shobj_ps_draw2d), nullptr, &g_psDraw2D));
+	D3DCHK(g_dev->CreatePixelShader(g_shobj_ps_draw2dsdf, sizeof(g_shobj_ps_draw2dsdf), nullptr, &g_psDraw2DSDF));
 
 	D3DCHK(g_dev->CreateVertexShader(g_shobj_vs_draw3dunlit, sizeof(g_shobj_vs_draw3dunlit), nullptr, &g_vsDraw3DUnlit));
 	D3DCHK(g_dev->CreatePixelShader(g_shobj_ps_draw3dunlit, sizeof(g_shobj_ps_draw3dunlit), nullptr, &g_psDraw3DUnlit));
@@ -539,6 +582,7 @@ void GlobalFree()
 	SAFE_RELEASE(g_psDraw3DUnlit);
 	SAFE_RELEASE(g_vsDraw3DUnlit);
 
+	SAFE_RELEASE(g_psDraw2DSDF);
 	SAFE_RELEASE(g_psDraw2D);
 	SAFE_RELEASE(g_vsDraw2D);
 	
@@ -782,6 +826,19 @@ void SetTexture(Texture2D* tex)
 	g_ctx->PSSetSamplers(0, 1, &g_samplers[tex->_flags]);
 }
 
+void SetDistanceFieldMode(bool enabled)
+{
+	if (g_distanceFieldMode == enabled)
+		return;
+	g_distanceFieldMode = enabled;
+	g_ctx->PSSetShader(enabled ? g_psDraw2DSDF : g_psDraw2D, nullptr, 0);
+}
+
+bool HasSmoothDistanceField()
+{
+	return true;
+}
+
 void DrawTriangles(Vertex* verts, size_t num_verts)
 {
 	g_stats.num_DrawTriangles++;
@@ -894,11 +951,36 @@ static D3D11_PRIMITIVE_TOPOLOGY ConvertPrimitiveType(PrimitiveType t)
 	}
 }
 
-static void ApplyVertexData(unsigned vertexFormat, const void* vertices, size_t numVertices)
+Buffer* CreateVertexBuffer(const void* data, size_t size)
+{
+	return new Buffer(D3D11_BIND_VERTEX_BUFFER, data, size);
+}
+
+Buffer* CreateIndexBuffer(const void* data, size_t size)
+{
+	return new Buffer(D3D11_BIND_INDEX_BUFFER, data, size);
+}
+
+void UpdateBuffer(Buffer* buf, const void* data, size_t size)
+{
+	if (size > buf->curSize)
+		return buf->Allocate(data, size);
+	// without data the contents are left as they are
+	if (size == 0 || !data)
+		return;
+	D3D11_BOX box = { 0U, 0U, 0U, UINT(size), 1U, 1U };
+	g_ctx->UpdateSubresource(buf->buffer, 0, &box, data, 0, 0);
+}
+
+void DestroyBuffer(Buffer* buf)
+{
+	delete buf;
+}
+
+static void ApplyVertexBuffer(unsigned vertexFormat, ID3D11Buffer* vb)
 {
 	size_t size = GetVertexSize(vertexFormat);
-	g_tmpVB->Write(vertices, size * numVertices);
-	ID3D11Buffer* buffers[2] = { g_tmpVB->buffer, (g_drawFlags & DF_ForceColor ? g_defVBCC : g_defVB)->buffer };
+	ID3D11Buffer* buffers[2] = { vb, (g_drawFlags & DF_ForceColor ? g_defVBCC : g_defVB)->buffer };
 	UINT strides[2] = { size, 0 };
 	UINT offsets[2] = {};
 	g_ctx->IASetVertexBuffers(0, 2, buffers, strides, offsets);
@@ -907,6 +989,12 @@ static void ApplyVertexData(unsigned vertexFormat, const void* vertices, size_t
 	g_ctx->IASetInputLayout(g_inputLayouts3D[vertexFormat & 0x7]);
 }
 
+static void ApplyVertexData(unsigned vertexFormat, const void* vertices, size_t numVertices)
+{
+	g_tmpVB->Write(vertices, GetVertexSize(vertexFormat) * numVertices);
+	ApplyVertexBuffer(vertexFormat, g_tmpVB->buffer);
+}
+
 struct CBuf3D
 {
 	Mat4f worldViewProjMtx;
@@ -974,6 +1062,45 @@ void DrawIndexed(
 	g_ctx->DrawIndexed(numIndices, 0, 0);
 }
 
+void Draw(
+	const Mat4f& xf,
+	PrimitiveType primType,
+	unsigned vertexFormat,
+	Buffer* vertices,
+	size_t numVertices)
+{
+	if (!vertices->buffer)
+		return;
+
+	g_ctx->IASetPrimitiveTopology(ConvertPrimitiveType(primType));
+	ApplyVertexBuffer(vertexFormat, vertices->buffer);
+	UploadShaderData(xf);
+
+	g_ctx->Draw(numVertices, 0);
+}
+
+void DrawIndexed(
+	const Mat4f& xf,
+	PrimitiveType primType,
+	unsigned vertexFormat,
+	Buffer* vertices,
+	size_t numVertices,
+	Buffer* indices,
+	size_t numIndices,
+	bool i32)
+{
+	if (!vertices->buffer || !indices->buffer)
+		return;
+
+	g_ctx->IASetPrimitiveTopology(ConvertPrimitiveType(primType));
+	ApplyVertexBuffer(vertexFormat, vertices->buffer);
+	UploadShaderData(xf);
+
+	g_ctx->IASetIndexBuffer(indices->buffer, i32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT, 0);
+
+	g_ctx->DrawIndexed(numIndices, 0, 0);
+}
+
 
 } // rhi
 } // ui
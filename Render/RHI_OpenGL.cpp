@@ -1,6 +1,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <vector>
 
 #include "RHI.h"
 #include "Render.h"
@@ -329,6 +331,28 @@ void SetTexture(Texture2D* tex)
 		GLCHK(glDisable(GL_TEXTURE_2D));
 }
 
+static bool g_distanceFieldMode = false;
+void SetDistanceFieldMode(bool enabled)
+{
+	if (g_distanceFieldMode == enabled)
+		return;
+	g_distanceFieldMode = enabled;
+	// fixed function fallback, no edge antialiasing
+	if (enabled)
+	{
+		GLCHK(glEnable(GL_ALPHA_TEST));
+		GLCHK(glAlphaFunc(GL_GEQUAL, 0.5f));
+	}
+	else
+		GLCHK(glDisable(GL_ALPHA_TEST));
+}
+
+bool HasSmoothDistanceField()
+{
+	// the alpha tested edges are jagged, bitmap glyphs look better
+	return false;
+}
+
 void DrawTriangles(Vertex* verts, size_t num_verts)
 {
 	g_stats.num_DrawTriangles++;
@@ -448,6 +472,7 @@ AABB2i End3DMode()
 	GLCHK(glEnableClientState(GL_COLOR_ARRAY));
 
 	SetRenderState(DF_AlphaBlended | DF_ZTestOff | DF_ZWriteOff);
+	g_distanceFieldMode = false; // alpha test was reset by the render state
 
 	auto r = g_viewport;
 	int x0 = r.left, x1 = r.right, y0 = r.top, y1 = r.bottom;
@@ -568,5 +593,58 @@ void DrawIndexed(
 	GLCHK(glDrawElements(ConvertPrimitiveType(primType), numIndices, i32 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT, indices));
 }
 
+// buffer objects are not available without loading extensions, so the data is kept in memory
+struct Buffer
+{
+	std::vector<char> data;
+};
+
+Buffer* CreateVertexBuffer(const void* data, size_t size)
+{
+	auto* buf = new Buffer;
+	UpdateBuffer(buf, data, size);
+	return buf;
+}
+
+Buffer* CreateIndexBuffer(const void* data, size_t size)
+{
+	return CreateVertexBuffer(data, size);
+}
+
+void UpdateBuffer(Buffer* buf, const void* data, size_t size)
+{
+	buf->data.resize(size);
+	if (data && size)
+		memcpy(buf->data.data(), data, size);
+}
+
+void DestroyBuffer(Buffer* buf)
+{
+	delete buf;
+}
+
+void Draw(
+	const Mat4f& xf,
+	PrimitiveType primType,
+	unsigned vertexFormat,
+	Buffer* vertices,
+	size_t numVertices)
+{
+	Draw(xf, primType, vertexFormat, static_cast<const void*>(vertices->data.data()), numVertices);
+}
+
+void DrawIndexed(
+	const Mat4f& xf,
+	PrimitiveType primType,
+	unsigned vertexFormat,
+	Buffer* vertices,
+	size_t numVertices,
+	Buffer* indices,
+	size_t numIndices,
+	bool i32)
+{
+	DrawIndexed(xf, primType, vertexFormat, static_cast<const void*>(vertices->data.data()), numVertices, static_cast<const void*>(indices->data.data()), numIndices, i32);
+}
+
 } // rhi
 } // ui
@@ -5,6 +5,7 @@
 
 #include "../Core/FileSystem.h"
 #include "../Core/HashTable.h"
+#include "../Core/ImageCache.h"
 
 #define STB_RECT_PACK_IMPLEMENTATION
 #include "../ThirdParty/stb_rect_pack.h"
@@ -183,6 +184,18 @@ struct TextureStorage
 
 		numPendingAllocs = 0;
 	}
+	void UploadRect(TextureNode* node, int x, int y, int w, int h, const uint8_t* src, int srcPitch)
+	{
+		auto& buf = uploadBuffer;
+		buf.resize(w * h * 4);
+		for (int row = 0; row < h; row++)
+			memcpy(&buf[row * w * 4], &src[(y + row) * srcPitch + x * 4], w * 4);
+
+		auto* tex = pages[node->page]->rhiTex;
+		rhi::MapData md = rhi::MapTexture(tex);
+		rhi::CopyToMappedTextureRect(tex, md, node->x - 1 + x, node->y - 1 + y, w, h, buf.data(), false);
+		rhi::UnmapTexture(tex);
+	}
 	static void RemapUVs(rhi::Vertex* verts, size_t num_verts, TextureNode* node)
 	{
 		if (!node || node->page < 0)
@@ -215,6 +228,8 @@ struct TextureStorage
 			page = nullptr;
 		}
 		numPages = 0;
+
+		uploadBuffer = {};
 	}
 
 	TexturePage* pages[MAX_TEXTURE_PAGES] = {};
@@ -222,6 +237,8 @@ struct TextureStorage
 	TextureNode* pendingAllocs[MAX_PENDING_ALLOCS] = {};
 	ImageHandle pendingImages[MAX_PENDING_ALLOCS];
 	int numPendingAllocs = 0;
+	// the rows of a rect are gathered here before uploading (the texture copy is done immediately so it can be reused)
+	std::vector<uint8_t> uploadBuffer;
 }
 g_textureStorage;
 
@@ -255,13 +272,14 @@ struct ImageImpl : IImage
 	uint16_t height = 0;
 	uint8_t* data = nullptr;
 	TexFlags flags = TexFlags::None;
+	bool a8 = false;
 	rhi::Texture2D* rhiTex = nullptr;
 	TextureNode* atlasNode = nullptr;
 
 	std::string path;
 
-	ImageImpl(int w, int h, int pitch, const void* d, bool a8, TexFlags flg) :
-		width(w), height(h), flags(flg)
+	ImageImpl(int w, int h, int pitch, const void* d, bool isA8, TexFlags flg) :
+		width(w), height(h), flags(flg), a8(isA8)
 	{
 		if (auto* n = g_textureStorage.AllocNode(w, h, flg, this))
 		{
@@ -323,6 +341,11 @@ struct ImageImpl : IImage
 			g_imageTextures.erase(path);
 		}
 	}
+	// the references other than the one kept by the texture atlas for its images
+	int GetUserRefCount() const
+	{
+		return refcount - (atlasNode ? 1 : 0);
+	}
 	rhi::Texture2D* GetRHITex() const
 	{
 		return rhiTex ? rhiTex : atlasNode && atlasNode->page >= 0 ? g_textureStorage.pages[atlasNode->page]->rhiTex : nullptr;
@@ -349,6 +372,82 @@ struct ImageImpl : IImage
 	{
 		return rhiTex;
 	}
+	void UpdateRect(int x, int y, int w, int h, const void* d) override
+	{
+		int srcPitch = w * (a8 ? 1 : 4);
+		// clip to image
+		if (x < 0) { d = (const char*)d - x * (a8 ? 1 : 4); w += x; x = 0; }
+		if (y < 0) { d = (const char*)d - y * srcPitch; h += y; y = 0; }
+		if (x + w > width) w = width - x;
+		if (y + h > height) h = height - y;
+		if (w <= 0 || h <= 0)
+			return;
+
+		if (rhiTex)
+		{
+			const void* src = d;
+			if (w * (a8 ? 1 : 4) != srcPitch)
+			{
+				auto& buf = g_textureStorage.uploadBuffer;
+				buf.resize(w * h * (a8 ? 1 : 4));
+				for (int row = 0; row < h; row++)
+					memcpy(&buf[row * w * (a8 ? 1 : 4)], (const char*)d + row * srcPitch, w * (a8 ? 1 : 4));
+				src = buf.data();
+			}
+			rhi::MapData md = rhi::MapTexture(rhiTex);
+			rhi::CopyToMappedTextureRect(rhiTex, md, x, y, w, h, src, a8);
+			rhi::UnmapTexture(rhiTex);
+			return;
+		}
+
+		// update the padded copy, including the duplicated border if the rect touches it
+		int dstw = width + 2;
+		for (int row = 0; row < h; row++)
+		{
+			uint8_t* dst = &data[((y + row + 1) * dstw + x + 1) * 4];
+			if (!a8)
+			{
+				memcpy(dst, (const char*)d + row * srcPitch, w * 4);
+			}
+			else
+			{
+				for (int col = 0; col < w; col++)
+				{
+					dst[col * 4 + 0] = 255;
+					dst[col * 4 + 1] = 255;
+					dst[col * 4 + 2] = 255;
+					dst[col * 4 + 3] = ((const uint8_t*)d)[col + row * srcPitch];
+				}
+			}
+		}
+		int x0 = x + 1, y0 = y + 1, x1 = x + w + 1, y1 = y + h + 1;
+		if (x == 0)
+		{
+			for (int py = y0; py < y1; py++)
+				memcpy(&data[py * dstw * 4], &data[(py * dstw + 1) * 4], 4);
+			x0 = 0;
+		}
+		if (x + w == width)
+		{
+			for (int py = y0; py < y1; py++)
+				memcpy(&data[(py * dstw + dstw - 1) * 4], &data[(py * dstw + dstw - 2) * 4], 4);
+			x1 = dstw;
+		}
+		if (y == 0)
+		{
+			memcpy(&data[x0 * 4], &data[(dstw + x0) * 4], (x1 - x0) * 4);
+			y0 = 0;
+		}
+		if (y + h == height)
+		{
+			memcpy(&data[((height + 1) * dstw + x0) * 4], &data[(height * dstw + x0) * 4], (x1 - x0) * 4);
+			y1 = height + 2;
+		}
+
+		// nodes that are still pending will be uploaded from the updated copy
+		if (atlasNode->page >= 0)
+			g_textureStorage.UploadRect(atlasNode, x0, y0, x1 - x0, y1 - y0, data, dstw * 4);
+	}
 };
 
 
@@ -372,6 +471,24 @@ ImageHandle ImageCreateFromCanvas(const Canvas& c, TexFlags flags)
 	return ImageCreateRGBA8(c.GetWidth(), c.GetHeight(), c.GetPixels(), flags);
 }
 
+ImageHandle ImageUpdateFromCanvas(IImage* img, const Canvas& c, TexFlags flags)
+{
+	auto* impl = static_cast<ImageImpl*>(img);
+	// other users of the image keep the old contents
+	if (impl &&
+		impl->GetUserRefCount() <= 1 &&
+		impl->path.empty() &&
+		!impl->a8 &&
+		impl->flags == flags &&
+		impl->width == c.GetWidth() &&
+		impl->height == c.GetHeight())
+	{
+		impl->UpdateRect(0, 0, c.GetWidth(), c.GetHeight(), c.GetPixels());
+		return impl;
+	}
+	return ImageCreateFromCanvas(c, flags);
+}
+
 
 ImageHandle ImageLoadFromFile(StringView path, TexFlags flags)
 {
@@ -382,17 +499,27 @@ ImageHandle ImageLoadFromFile(StringView path, TexFlags flags)
 	if (flags != TexFlags::Packed)
 		flags = flags & ~TexFlags::Packed;
 
-	auto fileData = ReadBinaryFile(path);
-	if (fileData.empty())
-		return nullptr; // TODO return default?
+	ImageHandle img;
+	CachedImage cached;
+	if (ImageCacheLoad(path, uint32_t(flags), cached))
+	{
+		img = ImageCreateRGBA8(cached.width, cached.height, cached.pixels, flags);
+	}
+	else
+	{
+		auto fileData = ReadBinaryFile(path);
+		if (fileData.empty())
+			return nullptr; // TODO return default?
 
-	int w = 0, h = 0, n = 0;
-	auto* imgData = stbi_load_from_memory((const stbi_uc*)fileData.data(), fileData.size(), &w, &h, &n, 4);
-	if (!imgData)
-		return nullptr;
-	UI_DEFER(stbi_image_free(imgData));
+		int w = 0, h = 0, n = 0;
+		auto* imgData = stbi_load_from_memory((const stbi_uc*)fileData.data(), fileData.size(), &w, &h, &n, 4);
+		if (!imgData)
+			return nullptr;
+		UI_DEFER(stbi_image_free(imgData));
 
-	auto img = ImageCreateRGBA8(w, h, imgData, flags);
+		ImageCacheStore(path, uint32_t(flags), w, h, imgData);
+		img = ImageCreateRGBA8(w, h, imgData, flags);
+	}
 	if (!img)
 		return nullptr;
 
@@ -412,6 +539,7 @@ static int g_numVertices;
 static int g_numIndices;
 static ImageHandle g_whiteTex;
 static ImageHandle g_curTex;
+static bool g_curDistanceField;
 static rhi::Texture2D* g_curTexRHI;
 static rhi::Texture2D* g_appliedTex;
 
@@ -443,6 +571,7 @@ void _Flush()
 	if (!g_numIndices)
 		return;
 	ApplyRHITex(GetRHITex(g_curTex));
+	rhi::SetDistanceFieldMode(g_curDistanceField);
 	rhi::DrawIndexedTriangles(g_bufVertices, g_numVertices, g_bufIndices, g_numIndices);
 	g_numVertices = 0;
 	g_numIndices = 0;
@@ -494,7 +623,7 @@ float YOFF = 0;
 float SCALE = 4;
 #endif
 
-void IndexedTriangles(IImage* tex, rhi::Vertex* verts, size_t num_vertices, uint16_t* indices, size_t num_indices)
+void IndexedTriangles(IImage* tex, rhi::Vertex* verts, size_t num_vertices, uint16_t* indices, size_t num_indices, bool distanceField = false)
 {
 #if DEBUG_SUBPIXEL
 	DebugOffScale(verts, num_vertices, XOFF, YOFF, SCALE);//10, 200, 4);
@@ -504,15 +633,20 @@ void IndexedTriangles(IImage* tex, rhi::Vertex* verts, size_t num_vertices, uint
 	// TODO limit this for faster JIT glyph uploads
 	g_textureStorage.FlushPendingAllocs();
 #if 1
-	if (GetRHITex(g_curTex) != GetRHITex(tex) || g_numVertices + num_vertices > MAX_VERTICES || g_numIndices + num_indices > MAX_INDICES)
+	if (GetRHITex(g_curTex) != GetRHITex(tex) ||
+		g_curDistanceField != distanceField ||
+		g_numVertices + num_vertices > MAX_VERTICES ||
+		g_numIndices + num_indices > MAX_INDICES)
 	{
 		_Flush();
 	}
+	g_curDistanceField = distanceField;
 	if (num_vertices > MAX_VERTICES || num_indices > MAX_INDICES)
 	{
 		_Flush();
 		g_curTex = tex;
 		ApplyRHITex(GetRHITex(g_curTex));
+		rhi::SetDistanceFieldMode(g_curDistanceField);
 		rhi::DrawIndexedTriangles(verts, num_vertices, indices, num_indices);
 		return;
 	}
@@ -862,6 +996,25 @@ void RectColTex(float x0, float y0, float x1, float y1, Color4b col, IImage* tex
 	IndexedTriangles(tex, verts, 4, indices, 6);
 }
 
+bool CanDrawSmoothDistanceField()
+{
+	return rhi::HasSmoothDistanceField();
+}
+
+void RectColTexDistanceField(float x0, float y0, float x1, float y1, Color4b col, IImage* tex, float u0, float v0, float u1, float v1)
+{
+	rhi::Vertex verts[4] =
+	{
+		{ x0, y0, u0, v0, col },
+		{ x1, y0, u1, v0, col },
+		{ x1, y1, u1, v1, col },
+		{ x0, y1, u0, v1, col },
+	};
+	uint16_t indices[6] = { 0, 1, 2, 2, 3, 0 };
+
+	IndexedTriangles(tex, verts, 4, indices, 6, true);
+}
+
 void RectColTex9Slice(const AABB2f& outer, const AABB2f& inner, Color4b col, IImage* tex, const AABB2f& texouter, const AABB2f& texinner)
 {
 	//  0  1  2  3
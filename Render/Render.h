@@ -49,6 +49,8 @@ struct IImage : IRefCounted
 	virtual uint16_t GetHeight() const = 0;
 	virtual StringView GetPath() const = 0;
 	virtual rhi::Texture2D* GetInternalExclusive() const = 0;
+	// overwrites a part of the image, data must be tightly packed in the format it was created with (RGBA8/A8)
+	virtual void UpdateRect(int x, int y, int w, int h, const void* data) = 0;
 };
 using ImageHandle = RCHandle<IImage>;
 
@@ -56,6 +58,9 @@ ImageHandle ImageCreateRGBA8(int w, int h, const void* data, TexFlags flags = Te
 ImageHandle ImageCreateRGBA8(int w, int h, int pitch, const void* data, TexFlags flags = TexFlags::None);
 ImageHandle ImageCreateA8(int w, int h, const void* data, TexFlags flags = TexFlags::None);
 ImageHandle ImageCreateFromCanvas(const Canvas& c, TexFlags flags = TexFlags::None);
+// reuses the image storage if size and flags match and the caller's handle is the only reference to it,
+// otherwise creates a new image
+ImageHandle ImageUpdateFromCanvas(IImage* img, const Canvas& c, TexFlags flags = TexFlags::None);
 
 ImageHandle ImageLoadFromFile(StringView path, TexFlags flags = TexFlags::Packed);
 
@@ -81,6 +86,10 @@ void RectTex(float x0, float y0, float x1, float y1, IImage* tex);
 void RectTex(float x0, float y0, float x1, float y1, IImage* tex, float u0, float v0, float u1, float v1);
 void RectColTex(float x0, float y0, float x1, float y1, Color4b col, IImage* tex);
 void RectColTex(float x0, float y0, float x1, float y1, Color4b col, IImage* tex, float u0, float v0, float u1, float v1);
+// tex alpha is a distance field with the edge at 0.5
+// (if !CanDrawSmoothDistanceField, the edges are not antialiased)
+bool CanDrawSmoothDistanceField();
+void RectColTexDistanceField(float x0, float y0, float x1, float y1, Color4b col, IImage* tex, float u0, float v0, float u1, float v1);
 void RectColTex9Slice(const AABB2f& outer, const AABB2f& inner, Color4b col, IImage* tex, const AABB2f& texouter, const AABB2f& texinner);
 void RectCutoutCol(const AABB2f& rect, const AABB2f& cutout, Color4b col);
 
@@ -355,7 +355,7 @@ struct RenderView : ui::Buildable
 
 					ui::Application::PushEvent(this, [this, canvas]()
 					{
-						image = ui::draw::ImageCreateFromCanvas(canvas);
+						image = ui::draw::ImageUpdateFromCanvas(image, canvas);
 						Rebuild();
 					});
 				}
@@ -0,0 +1,717 @@
+
+#include "pch.h"
+#include "Benchmarks.h"
+
+#include "HexViewer.h"
+#include "ImageParsers.h"
+#include "InstanceExpander.h"
+
+#include <float.h>
+
+
+namespace ui {
+double hqtime();
+} // ui
+
+
+void BenchmarkWindowNode::Build()
+{
+	ui::PushBox();
+
+	if (ui::imm::Button("Highlight"))
+		results = BenchmarkHighlight(highlightSettings ? *highlightSettings : HighlightSettings());
+	if (ui::imm::Button("Instance expansion"))
+		results = BenchmarkExpandAllInstances();
+	if (ui::imm::Button("Image decoding"))
+		results = BenchmarkImageFormats();
+	if (ui::imm::Button("File reads"))
+		results = BenchmarkFileReads();
+	for (const auto& line : results)
+		ui::Text(line) + ui::SetPadding(5);
+
+	ui::Pop();
+}
+
+
+static bool IsASCII(uint8_t v)
+{
+	return v >= 0x20 && v < 0x7f;
+}
+
+// the previous scalar implementation with full marker/instance scans, the baseline for BenchmarkHighlight
+static void HighlightReference(HighlightSettings* hs, DataDesc* desc, DDFile* file, uint64_t basePos, ByteColors* outColors, const uint8_t* bytes, size_t numBytes)
+{
+	for (auto& M : file->markerData.markers)
+	{
+		uint64_t start = M.at;
+		uint64_t end = M.GetEnd();
+		size_t ss = start > basePos ? start - basePos : 0;
+		size_t se = end > basePos ? end - basePos : 0;
+		if (ss > numBytes)
+			ss = numBytes;
+		if (se > numBytes)
+			se = numBytes;
+		for (size_t i = ss; i < se; i++)
+		{
+			if (unsigned flags = M.ContainInfo(basePos + i))
+			{
+				auto mc = M.GetColor();
+				auto& oc = outColors[i];
+				oc.asciiColor.BlendOver(mc);
+				oc.hexColor.BlendOver(mc);
+				ui::Color4f mc2 = { sqrtf(mc.r), sqrtf(mc.g), sqrtf(mc.b), sqrtf(mc.a) };
+				if (flags & 2)
+					oc.leftBracketColor.BlendOver(mc2);
+				if (flags & 4)
+					oc.rightBracketColor.BlendOver(mc2);
+			}
+		}
+	}
+
+	for (auto* SI : desc->instances)
+	{
+		if (SI->file != file)
+			continue;
+		if (SI->off >= int64_t(basePos) && SI->off < int64_t(basePos + numBytes))
+		{
+			outColors[SI->off - basePos].leftBracketColor.BlendOver(SI == desc->curInst ? colorCurInst : colorInst);
+		}
+	}
+
+	// auto highlights
+	if (hs->enableNearFileSize64)
+	{
+		for (size_t i = 0; i + 8 < numBytes; i++)
+		{
+			if (outColors[i].hexColor.a ||
+				outColors[i + 1].hexColor.a ||
+				outColors[i + 2].hexColor.a ||
+				outColors[i + 3].hexColor.a ||
+				outColors[i + 4].hexColor.a ||
+				outColors[i + 5].hexColor.a ||
+				outColors[i + 6].hexColor.a ||
+				outColors[i + 7].hexColor.a)
+				continue;
+			if (hs->excludeZeroes &&
+				bytes[i] == 0 &&
+				bytes[i + 1] == 0 &&
+				bytes[i + 2] == 0 &&
+				bytes[i + 3] == 0 &&
+				bytes[i + 4] == 0 &&
+				bytes[i + 5] == 0 &&
+				bytes[i + 6] == 0 &&
+				bytes[i + 7] == 0)
+				continue;
+
+			if (hs->enableNearFileSize64)
+			{
+				uint64_t v;
+				memcpy(&v, &bytes[i], 8);
+				auto fsz = file->dataSource->GetSize();
+				if (v >= fsz * (hs->nearFileSizePercent * 0.01f) && v <= fsz)
+				{
+					for (int j = 0; j < 8; j++)
+						outColors[i + j].hexColor.BlendOver(colorNearFileSize32);
+				}
+			}
+		}
+	}
+
+	if (hs->enableFloat32 || hs->enableInt32 || hs->enableNearFileSize32 || !hs->customInt32.empty())
+	{
+		for (size_t i = 0; i + 4 < numBytes; i++)
+		{
+			if (outColors[i].hexColor.a ||
+				outColors[i + 1].hexColor.a ||
+				outColors[i + 2].hexColor.a ||
+				outColors[i + 3].hexColor.a)
+				continue;
+			if (hs->excludeZeroes && bytes[i] == 0 && bytes[i + 1] == 0 && bytes[i + 2] == 0 && bytes[i + 3] == 0)
+				continue;
+
+			bool detected = false;
+
+			int32_t i32v;
+			memcpy(&i32v, &bytes[i], 4);
+
+			if (!hs->customInt32.empty())
+			{
+				for (const auto& h : hs->customInt32)
+				{
+					if (!h.enabled)
+						continue;
+					if (!h.range ? h.vspec == i32v :
+						h.vmin <= i32v && i32v <= h.vmax)
+					{
+						for (int j = 0; j < 4; j++)
+							outColors[i + j].hexColor.BlendOver(h.color);
+						detected = true;
+						break;
+					}
+				}
+			}
+
+			if (detected)
+				continue;
+
+			if (hs->enableFloat32)
+			{
+				float v;
+				memcpy(&v, &bytes[i], 4);
+				if ((v >= hs->minFloat32 && v <= hs->maxFloat32) || (v >= -hs->maxFloat32 && v <= -hs->minFloat32))
+				{
+					for (int j = 0; j < 4; j++)
+						outColors[i + j].hexColor.BlendOver(colorFloat32);
+				}
+			}
+
+			if (hs->enableNearFileSize32)
+			{
+				uint32_t v;
+				memcpy(&v, &bytes[i], 4);
+				auto fsz = file->dataSource->GetSize();
+				if (v >= fsz * (hs->nearFileSizePercent * 0.01f) && v <= fsz)
+				{
+					for (int j = 0; j < 4; j++)
+						outColors[i + j].hexColor.BlendOver(colorNearFileSize32);
+				}
+			}
+
+			if (hs->enableInt32)
+			{
+				if (i32v >= hs->minInt32 && i32v <= hs->maxInt32)
+				{
+					for (int j = 0; j < 4; j++)
+						outColors[i + j].hexColor.BlendOver(colorInt32);
+				}
+			}
+		}
+	}
+
+	if (hs->enableInt16)
+	{
+		for (size_t i = 0; i + 2 < numBytes; i++)
+		{
+			if (outColors[i].hexColor.a ||
+				outColors[i + 1].hexColor.a)
+				continue;
+			if (hs->excludeZeroes && bytes[i] == 0 && bytes[i + 1] == 0)
+				continue;
+
+			int16_t v;
+			memcpy(&v, &bytes[i], 2);
+			if (v >= hs->minInt16 && v <= hs->maxInt16)
+			{
+				outColors[i].hexColor.BlendOver(colorInt32);
+				outColors[i + 1].hexColor.BlendOver(colorInt32);
+			}
+		}
+	}
+
+	if (hs->enableASCII && hs->minASCIIChars > 0)
+	{
+		size_t start = SIZE_MAX;
+		bool prev = false;
+		for (size_t i = 0; i < numBytes; i++)
+		{
+			bool cur = outColors[i].asciiColor.a == 0 && IsASCII(bytes[i]);
+			if (cur && !prev)
+				start = i;
+			else if (prev && !cur && i - start >= hs->minASCIIChars)
+			{
+				for (size_t j = start; j < i; j++)
+					outColors[j].asciiColor.BlendOver(colorASCII);
+			}
+			prev = cur;
+		}
+		if (prev && numBytes - start >= hs->minASCIIChars)
+		{
+			for (size_t j = start; j < numBytes; j++)
+				outColors[j].asciiColor.BlendOver(colorASCII);
+		}
+	}
+}
+
+std::vector<std::string> BenchmarkHighlight(const HighlightSettings& settings)
+{
+	constexpr size_t FILE_SIZE = 64 * 1024 * 1024;
+	constexpr size_t NUM_MARKERS = 10000;
+	constexpr size_t NUM_INSTANCES = 100000;
+	constexpr int NUM_WINDOWS = 1000;
+	constexpr int NUM_ROWS = 64;
+
+	uint64_t rng = 0x9e3779b97f4a7c15ULL;
+	auto rand64 = [&rng]()
+	{
+		// xorshift64
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+		return rng;
+	};
+
+	// a mix of everything the auto highlights look for
+	std::vector<uint8_t> mem(FILE_SIZE);
+	for (size_t i = 0; i < FILE_SIZE; i += 4)
+	{
+		uint32_t v;
+		switch (rand64() % 8)
+		{
+		case 0: case 1: v = 0; break;
+		case 2: v = uint32_t(rand64() % 4000) - 2000; break;
+		case 3: { float f = (int(rand64() % 200000) - 100000) * 0.01f; memcpy(&v, &f, 4); break; }
+		case 4: v = uint32_t(FILE_SIZE - rand64() % (FILE_SIZE / 50)); break;
+		case 5: v = 0x61616161 + uint32_t(rand64() & 0x0f0f0f0f); break;
+		default: v = uint32_t(rand64()); break;
+		}
+		memcpy(&mem[i], &v, 4);
+	}
+	MemoryDataSource ds(mem.data(), mem.size(), false);
+
+	DataDesc desc;
+	DDFile* file = desc.CreateNewFile();
+	file->dataSource = &ds;
+	for (size_t i = 0; i < NUM_MARKERS; i++)
+	{
+		Marker M;
+		M.type = DataType(rand64() % DT__COUNT);
+		M.count = 1 + rand64() % 16;
+		M.repeats = 1 + rand64() % 8;
+		M.stride = M.repeats > 1 ? M.count * 8 + rand64() % 64 : 0;
+		M.at = rand64() % (FILE_SIZE - M.stride * M.repeats - 256);
+		file->markerData.markers.push_back(M);
+	}
+	file->markerData.OnEdit();
+	for (size_t i = 0; i < NUM_INSTANCES; i++)
+	{
+		auto* SI = new DDStructInst;
+		SI->desc = &desc;
+		SI->file = file;
+		SI->off = rand64() % FILE_SIZE;
+		desc.instances.push_back(SI);
+	}
+	desc.curInst = desc.instances[0];
+	desc.instIndex.Rebuild();
+	desc.instanceListVersion++;
+
+	std::vector<std::string> results;
+	HighlightSettings hs = settings;
+
+	std::vector<DDStructInst*> insts;
+	double t0 = ui::hqtime();
+	UpdateMarkerTree(file);
+	// the instance tree is built on first use
+	desc.instIndex.QueryRange(file, 0, 1, insts);
+	results.push_back(ui::Format("Index build: %.2f ms (%zu markers, %zu instances)",
+		(ui::hqtime() - t0) * 1000, NUM_MARKERS, NUM_INSTANCES));
+
+	std::vector<ByteColors> colorsRef(256 * NUM_ROWS);
+	std::vector<ByteColors> colorsNew(256 * NUM_ROWS);
+	std::vector<uint64_t> positions(NUM_WINDOWS);
+	for (int width : { 16, 64 })
+	{
+		size_t numBytes = width * NUM_ROWS;
+		for (auto& pos : positions)
+			pos = rand64() % (FILE_SIZE - numBytes) / width * width;
+
+		double timeRef = 0;
+		double timeNew = 0;
+		int mismatches = 0;
+		for (uint64_t pos : positions)
+		{
+			auto* bytes = static_cast<const uint8_t*>(ds.GetSpan(pos, numBytes));
+
+			double t1 = ui::hqtime();
+			memset(colorsRef.data(), 0, numBytes * sizeof(ByteColors));
+			HighlightReference(&hs, &desc, file, pos, colorsRef.data(), bytes, numBytes);
+			double t2 = ui::hqtime();
+			memset(colorsNew.data(), 0, numBytes * sizeof(ByteColors));
+			Highlight(&hs, &desc, file, pos, colorsNew.data(), bytes, numBytes);
+			double t3 = ui::hqtime();
+
+			timeRef += t2 - t1;
+			timeNew += t3 - t2;
+			if (memcmp(colorsRef.data(), colorsNew.data(), numBytes * sizeof(ByteColors)) != 0)
+				mismatches++;
+		}
+		results.push_back(ui::Format("%d x %d bytes: %.1f us -> %.1f us per window (%.1fx), %d mismatches",
+			width, NUM_ROWS, timeRef / NUM_WINDOWS * 1e6, timeNew / NUM_WINDOWS * 1e6, timeRef / timeNew, mismatches));
+	}
+
+	for (auto* SI : desc.instances)
+		delete SI;
+	desc.instances.clear();
+	desc.instIndex.Rebuild();
+	file->dataSource = nullptr;
+	return results;
+}
+
+std::vector<std::string> BenchmarkExpandAllInstances()
+{
+	constexpr size_t NUM_ROOTS = 500000;
+	constexpr size_t RECORD_SIZE = 32;
+	constexpr size_t PAYLOAD_SPACING = 64;
+	constexpr size_t PAYLOAD_BASE = NUM_ROOTS * RECORD_SIZE;
+	constexpr size_t FILE_SIZE = PAYLOAD_BASE + NUM_ROOTS * PAYLOAD_SPACING;
+
+	uint64_t rng = 0x9e3779b97f4a7c15ULL;
+	auto rand64 = [&rng]()
+	{
+		// xorshift64
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+		return rng;
+	};
+
+	// records with a type, flags and a pointer to a payload
+	std::vector<uint8_t> mem(FILE_SIZE);
+	for (size_t i = PAYLOAD_BASE; i < FILE_SIZE; i++)
+		mem[i] = uint8_t(rand64());
+	for (size_t i = 0; i < NUM_ROOTS; i++)
+	{
+		// odd types so that every record has a payload (500k -> 1M instances)
+		uint32_t rec[3] = { uint32_t(rand64() % 16) | 1, uint32_t(rand64()), uint32_t(PAYLOAD_BASE + i * PAYLOAD_SPACING) };
+		memcpy(&mem[i * RECORD_SIZE], rec, sizeof(rec));
+	}
+	MemoryDataSource ds(mem.data(), mem.size(), false);
+
+	DataDesc desc;
+	DDFile* file = desc.CreateNewFile();
+	file->dataSource = &ds;
+
+	auto addField = [](DDStruct* S, const char* type, const char* name, int64_t off) -> DDField&
+	{
+		S->fields.emplace_back();
+		auto& F = S->fields.back();
+		F.type = type;
+		F.name = name;
+		F.off = off;
+		return F;
+	};
+
+	auto* P = desc.CreateNewStruct("Payload");
+	P->size = 8;
+	addField(P, "u32", "a", 0);
+	addField(P, "u32", "b", 4);
+
+	auto* R = desc.CreateNewStruct("Record");
+	R->size = RECORD_SIZE;
+	R->fields.reserve(5);
+	addField(R, "u32", "type", 0);
+	addField(R, "u32", "flags", 4);
+	addField(R, "u32", "dataOff", 8);
+	addField(R, "i32", "tag", 0).valueExpr.SetExpr(
+		"(($u8(@flags)) | (($u8(@flags + 1)) << 8) | (($u8(@flags + 2)) << 16)) & ((1 << 12) - 1)");
+	auto& FP = addField(R, "Payload", "payload", 0);
+	FP.offExpr.SetExpr("dataOff + (tag & (8 - 1)) * (4 * 2)");
+	FP.condition.SetExpr("(type & 3) != 0");
+
+	for (size_t i = 0; i < NUM_ROOTS; i++)
+	{
+		auto* SI = new DDStructInst;
+		SI->id = desc.instIDAlloc++;
+		SI->desc = &desc;
+		SI->def = R;
+		SI->file = file;
+		SI->off = i * RECORD_SIZE;
+		desc.instances.push_back(SI);
+	}
+	desc.instIndex.Rebuild();
+	desc.instanceListVersion++;
+
+	std::vector<std::string> results;
+	// the expressions are recompiled for either the tree evaluation or bytecode
+	auto setBytecode = [R, P](bool bytecode)
+	{
+		for (auto* S : { R, P })
+		{
+			for (auto& F : S->fields)
+			{
+				for (auto* E : { &F.valueExpr, &F.offExpr, &F.condition, &F.elementCondition })
+				{
+					E->bytecode = bytecode;
+					E->Recompile();
+				}
+			}
+			S->OnEdit();
+		}
+	};
+
+	// expression evaluation alone (the field values are cached by the first pass)
+	const MathExprObj* exprs[] = { &R->fields[3].valueExpr, &R->fields[4].offExpr, &R->fields[4].condition };
+	int64_t sums[2] = {};
+	double times[2] = {};
+	for (int pass = -1; pass < 2; pass++)
+	{
+		setBytecode(pass != 0);
+		double t0 = ui::hqtime();
+		int64_t sum = 0;
+		for (size_t i = 0; i < NUM_ROOTS; i++)
+		{
+			VariableSource vs;
+			{
+				vs.desc = &desc;
+				vs.root = desc.instances[i];
+			}
+			for (auto* E : exprs)
+				sum = sum * 31 + E->Evaluate(vs);
+		}
+		if (pass >= 0)
+		{
+			times[pass] = ui::hqtime() - t0;
+			sums[pass] = sum;
+		}
+	}
+	results.push_back(ui::Format("Expressions (%zu x %zu): tree %.1f ms -> bytecode %.1f ms (%.1fx), results %s",
+		NUM_ROOTS, sizeof(exprs) / sizeof(exprs[0]), times[0] * 1000, times[1] * 1000, times[0] / times[1],
+		sums[0] == sums[1] ? "match" : "DIFFER"));
+
+	// full expansion starting from empty caches: tree, bytecode, bytecode + parallel
+	std::vector<int64_t> childOffsets[3];
+	double expandTimes[3] = {};
+	for (int pass = 0; pass < 3; pass++)
+	{
+		setBytecode(pass != 0);
+		double t0 = ui::hqtime();
+		InstanceExpander ie;
+		ie.allowParallel = pass == 2;
+		ie.Start(&desc);
+		ie.Step(std::numeric_limits<double>::max());
+		expandTimes[pass] = ui::hqtime() - t0;
+
+		for (size_t i = NUM_ROOTS; i < desc.instances.size(); i++)
+			childOffsets[pass].push_back(desc.instances[i]->off);
+		desc.DeleteAllInstances();
+	}
+	results.push_back(ui::Format("ExpandAllInstances (%zu -> %zu instances): tree %.1f ms -> bytecode %.1f ms -> parallel %.1f ms (%.1fx), results %s",
+		NUM_ROOTS, NUM_ROOTS + childOffsets[2].size(), expandTimes[0] * 1000, expandTimes[1] * 1000, expandTimes[2] * 1000,
+		expandTimes[0] / expandTimes[2],
+		childOffsets[0] == childOffsets[1] && childOffsets[0] == childOffsets[2] ? "match" : "DIFFER"));
+
+	// struct edits with all caches filled, only the fields after the edited one (and the ones reading them) are dropped
+	{
+		InstanceExpander ie;
+		ie.Start(&desc);
+		ie.Step(std::numeric_limits<double>::max());
+
+		auto refresh = [&desc]()
+		{
+			size_t sum = 0;
+			for (auto* SI : desc.instances)
+			{
+				sum += SI->GetSize();
+				for (size_t i = 0; i < SI->def->fields.size(); i++)
+					sum += SI->GetFieldPreview(i).size();
+			}
+			return sum;
+		};
+		refresh();
+
+		struct EditCase
+		{
+			const char* name;
+			DDStruct* S;
+			size_t field;
+		};
+		EditCase cases[] =
+		{
+			{ "Record.payload", R, 4 },
+			{ "Payload.b", P, 1 },
+			{ "Record (whole struct)", R, 0 },
+		};
+		for (const auto& EC : cases)
+		{
+			double t0 = ui::hqtime();
+			EC.S->OnEdit(EC.field);
+			size_t kept = 0;
+			size_t total = 0;
+			for (auto* SI : desc.instances)
+			{
+				SI->_CheckFieldCache();
+				kept += SI->cachedFields.size();
+				total += SI->def->fields.size();
+			}
+			double t1 = ui::hqtime();
+			refresh();
+			double t2 = ui::hqtime();
+			results.push_back(ui::Format("Edit %s (%zu instances): invalidation %.1f ms, %zu/%zu cached fields kept, refresh %.1f ms",
+				EC.name, desc.instances.size(), (t1 - t0) * 1000, kept, total, (t2 - t1) * 1000));
+		}
+		desc.DeleteAllInstances();
+	}
+
+	setBytecode(true);
+	for (auto* SI : desc.instances)
+		delete SI;
+	desc.instances.clear();
+	desc.instIndex.Rebuild();
+	file->dataSource = nullptr;
+	return results;
+}
+
+std::vector<std::string> BenchmarkImageFormats()
+{
+	constexpr uint32_t WIDTH = 2048;
+	constexpr uint32_t HEIGHT = 2048;
+	constexpr int NUM_RUNS = 3;
+
+	uint64_t rng = 0x9e3779b97f4a7c15ULL;
+	std::vector<uint8_t> mem(1024 + WIDTH * HEIGHT * 4);
+	for (auto& b : mem)
+	{
+		// xorshift64
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+		b = uint8_t(rng);
+	}
+	MemoryDataSource ds(mem.data(), mem.size(), false);
+	ImageInfo info = { 1024, 0, WIDTH, HEIGHT };
+
+	ui::Canvas serial(WIDTH, HEIGHT);
+	ui::Canvas parallel(WIDTH, HEIGHT);
+	std::vector<std::string> results;
+	for (size_t i = 0, count = GetImageFormatCount(); i < count; i++)
+	{
+		auto cat = GetImageFormatCategory(i);
+		auto name = GetImageFormatName(i);
+		double times[2] = { DBL_MAX, DBL_MAX };
+		for (int p = 0; p < 2; p++)
+		{
+			auto& c = p ? parallel : serial;
+			for (int r = 0; r < NUM_RUNS; r++)
+			{
+				double t0 = ui::hqtime();
+				DecodeImage(&ds, name, info, c, p != 0);
+				times[p] = std::min(times[p], ui::hqtime() - t0);
+			}
+		}
+
+		double mpx = WIDTH * HEIGHT / 1000000.0;
+		bool same = memcmp(serial.GetBytes(), parallel.GetBytes(), WIDTH * HEIGHT * 4) == 0;
+		results.push_back(ui::Format("%.*s/%.*s: %.0f MPixels/s (serial %.0f MPixels/s)%s",
+			int(cat.size()), cat.data(),
+			int(name.size()), name.data(),
+			mpx / times[1],
+			mpx / times[0],
+			same ? "" : " - MISMATCH"));
+	}
+	return results;
+}
+
+std::vector<std::string> BenchmarkFileReads()
+{
+	constexpr size_t FILE_SIZE = 32 * 1024 * 1024;
+	constexpr uint64_t STRIDE = 64;
+	constexpr uint64_t COUNT = FILE_SIZE / STRIDE;
+	constexpr int NUM_RUNS = 3;
+
+	std::vector<std::string> results;
+
+	uint64_t rng = 0x9e3779b97f4a7c15ULL;
+	std::vector<uint8_t> mem(FILE_SIZE);
+	for (auto& b : mem)
+	{
+		// xorshift64
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+		b = uint8_t(rng);
+	}
+	uint64_t expected = 0;
+	for (uint64_t i = 0; i < COUNT; i++)
+	{
+		uint32_t v;
+		memcpy(&v, &mem[i * STRIDE], sizeof(v));
+		expected += v;
+	}
+
+	auto cacheDir = ui::GetUserCacheDirectory();
+	auto path = ui::PathJoin(cacheDir.empty() ? ui::GetWorkingDirectory() : cacheDir, "fret/read-benchmark.bin");
+	if (!ui::CreateMissingParentDirectories(path) || !ui::WriteBinaryFile(path, mem.data(), mem.size()))
+	{
+		results.push_back("Failed to write " + path);
+		return results;
+	}
+	mem = {};
+
+	results.push_back(ui::Format("%llu x u32 at a %llu byte stride in a %zu MB file (in the OS cache after writing it)",
+		(unsigned long long)COUNT, (unsigned long long)STRIDE, FILE_SIZE / (1024 * 1024)));
+	{
+		FileDataSource fileDS(path.c_str());
+		CachedDataSource cachedDS(new FileDataSource(path.c_str()));
+		MMapDataSource mmapDS(path.c_str());
+		struct Source
+		{
+			const char* name;
+			IDataSource* ds;
+		};
+		Source sources[] =
+		{
+			{ "File (before)", &fileDS },
+			{ "Cached file", &cachedDS },
+			{ "Mapped file", &mmapDS },
+		};
+
+		std::vector<uint32_t> values(COUNT);
+		for (const auto& S : sources)
+		{
+			if (S.ds == &mmapDS && !mmapDS.IsValid())
+			{
+				results.push_back(ui::Format("%s: could not be mapped", S.name));
+				continue;
+			}
+
+			double times[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+			uint64_t sums[3] = {};
+			for (int r = 0; r < NUM_RUNS; r++)
+			{
+				// one Read per value, as the marker analysis and mesh reads did before
+				double t0 = ui::hqtime();
+				uint64_t sum = 0;
+				for (uint64_t i = 0; i < COUNT; i++)
+				{
+					uint32_t v = 0;
+					S.ds->Read(i * STRIDE, sizeof(v), &v);
+					sum += v;
+				}
+				times[0] = std::min(times[0], ui::hqtime() - t0);
+				sums[0] = sum;
+
+				t0 = ui::hqtime();
+				S.ds->ReadStrided(0, STRIDE, COUNT, sizeof(uint32_t), values.data());
+				sum = 0;
+				for (uint32_t v : values)
+					sum += v;
+				times[1] = std::min(times[1], ui::hqtime() - t0);
+				sums[1] = sum;
+
+				// what the readers do when a span is available
+				t0 = ui::hqtime();
+				sum = 0;
+				if (auto* span = static_cast<const uint8_t*>(S.ds->GetSpan(0, FILE_SIZE)))
+				{
+					for (uint64_t i = 0; i < COUNT; i++)
+					{
+						uint32_t v;
+						memcpy(&v, span + i * STRIDE, sizeof(v));
+						sum += v;
+					}
+					times[2] = std::min(times[2], ui::hqtime() - t0);
+				}
+				sums[2] = sum;
+			}
+
+			bool match = sums[0] == expected && sums[1] == expected && (times[2] == DBL_MAX || sums[2] == expected);
+			std::string spanText = times[2] == DBL_MAX ? "no span" : ui::Format("span %.1f ms", times[2] * 1000);
+			results.push_back(ui::Format("%s: Read %.1f ms, ReadStrided %.1f ms, %s%s",
+				S.name, times[0] * 1000, times[1] * 1000, spanText.c_str(), match ? "" : " - MISMATCH"));
+		}
+		auto stats = cachedDS.GetStats();
+		results.push_back(ui::Format("Cached file blocks: %llu hits, %llu misses, %llu read ahead",
+			(unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.readAheads));
+	}
+	remove(path.c_str());
+	return results;
+}
@@ -0,0 +1,34 @@
+
+#pragma once
+#include "pch.h"
+
+struct HighlightSettings;
+
+
+// runs the benchmarks of the optimized code paths, opened from the debug menu
+struct BenchmarkWindowNode : ui::Buildable
+{
+	void OnInit() override
+	{
+		GetNativeWindow()->SetTitle("Benchmarks");
+		GetNativeWindow()->SetSize(800, 400);
+	}
+	void Build() override;
+
+	// the settings of the current file (the defaults are used if null)
+	HighlightSettings* highlightSettings = nullptr;
+	std::vector<std::string> results;
+};
+
+// times the highlighting of 64-row windows against the previous scalar implementation
+// (synthetic data with 10k markers and 100k instances), returns one line per result
+std::vector<std::string> BenchmarkHighlight(const HighlightSettings& settings);
+// times the expansion of 500k instances (to 1M) and their expressions with and without MathExpr bytecode
+// and parallel expansion, and the cost of struct edits afterwards (synthetic data), returns one line per result
+std::vector<std::string> BenchmarkExpandAllInstances();
+// times the decoding of a 2048x2048 image (random data) in each format, with and without parallel decoding
+// returns one line per format
+std::vector<std::string> BenchmarkImageFormats();
+// times strided u32 reads (one Read per value, ReadStrided and direct spans) from a 32 MB temporary file
+// through the plain file source used before mapping, the cached file source and the mapped file source
+std::vector<std::string> BenchmarkFileReads();
@@ -3,6 +3,7 @@
 #include "DataDesc.h"
 #include "FileReaders.h"
 #include "ImageParsers.h"
+#include "InstanceExpander.h"
 
 
 ui::DataCategoryTag DCT_Struct[1];
@@ -144,9 +145,17 @@ void DataDesc::EditInstance()
 		{
 			del = true;
 		}
-		ui::imm::PropEditString("Notes", SI->notes.c_str(), [&SI](const char* s) { SI->notes = s; });
-		ui::imm::PropEditBool("Allow auto expand", SI->allowAutoExpand);
-		ui::imm::PropEditInt("Offset", SI->off);
+		ui::imm::PropEditString("Notes", SI->notes.c_str(), [this, &SI](const char* s) { SI->notes = s; instanceListVersion++; });
+		if (ui::imm::PropEditBool("Allow auto expand", SI->allowAutoExpand))
+			instanceListVersion++;
+		int64_t prevOff = SI->off;
+		if (ui::imm::PropEditInt("Offset", SI->off))
+		{
+			instIndex.OnMoved(SI, prevOff);
+			instanceListVersion++;
+			SI->OnEdit();
+			SI->def->OnInstanceEdit();
+		}
 		if (ui::imm::PropButton("Edit struct:", SI->def->name.c_str()))
 		{
 			editMode = 1;
@@ -155,15 +164,18 @@ void DataDesc::EditInstance()
 
 		if (advancedAccess)
 		{
-			EditCreationReason("Creation reason", SI->creationReason);
-			ui::imm::PropEditBool("Use remaining size", SI->remainingCountIsSize);
-			ui::imm::PropEditInt(SI->remainingCountIsSize ? "Remaining size" : "Remaining count", SI->remainingCount);
+			bool chg = false;
+			chg |= EditCreationReason("Creation reason", SI->creationReason);
+			chg |= ui::imm::PropEditBool("Use remaining size", SI->remainingCountIsSize);
+			chg |= ui::imm::PropEditInt(SI->remainingCountIsSize ? "Remaining size" : "Remaining count", SI->remainingCount);
 
 			ui::Property::Begin();
 			auto& lbl = ui::Property::Label("Size override");
-			ui::imm::EditBool(SI->sizeOverrideEnable, nullptr);
-			ui::imm::EditInt(&lbl, SI->sizeOverrideValue);
+			chg |= ui::imm::EditBool(SI->sizeOverrideEnable, nullptr);
+			chg |= ui::imm::EditInt(&lbl, SI->sizeOverrideValue);
 			ui::Property::End();
+			if (chg)
+				instanceListVersion++;
 		}
 
 		ui::Text("Arguments") + ui::SetPadding(5);
@@ -179,10 +191,19 @@ void DataDesc::EditInstance()
 			ui::imm::PropEditString("\bName", A.name.c_str(), [&A](const char* v) { A.name = v; });
 			ui::imm::PropEditInt("\bValue", A.intVal);
 		};
+		argEditor.HandleEvent(ui::EventType::Change) = [this, SI](ui::Event&)
+		{
+			SI->OnEdit();
+			SI->def->OnInstanceEdit();
+			instanceListVersion++;
+		};
 
 		if (ui::imm::Button("Add"))
 		{
 			SI->args.push_back({ "unnamed", 0 });
+			SI->OnEdit();
+			SI->def->OnInstanceEdit();
+			instanceListVersion++;
 			ui::RebuildCurrent();
 		}
 		ui::Pop();
@@ -390,6 +411,7 @@ void DataDesc::EditStruct()
 					structs[rd.newName] = SI->def;
 					structs.erase(SI->def->name);
 					SI->def->name = rd.newName;
+					SI->def->OnEdit();
 				}
 				break;
 			}
@@ -400,10 +422,12 @@ void DataDesc::EditStruct()
 		if (it != structs.end())
 		{
 			auto& S = *it->second;
-			ui::imm::PropEditBool("Is serialized?", S.serialized);
+			if (ui::imm::PropEditBool("Is serialized?", S.serialized))
+				S.OnEdit();
 
-			ui::imm::PropEditInt("Size", S.size);
-			ui::imm::PropEditString("Size source", S.sizeSrc.c_str(), [&S](const char* v) { S.sizeSrc = v; });
+			if (ui::imm::PropEditInt("Size", S.size))
+				S.OnEdit();
+			ui::imm::PropEditString("Size source", S.sizeSrc.c_str(), [&S](const char* v) { S.sizeSrc = v; S.OnEdit(); });
 
 			ui::Text("Parameters") + ui::SetPadding(5);
 			ui::Push<ui::Panel>();
@@ -418,10 +442,12 @@ void DataDesc::EditStruct()
 				ui::imm::PropEditString("\bName", P.name.c_str(), [&P](const char* v) { P.name = v; });
 				ui::imm::PropEditInt("\bValue", P.intVal);
 			};
+			paramEditor.HandleEvent(ui::EventType::Change) = [&S](ui::Event&) { S.OnEdit(); };
 
 			if (ui::imm::Button("Add"))
 			{
 				S.params.push_back({ "unnamed", 0 });
+				S.OnEdit();
 				ui::RebuildCurrent();
 			}
 			ui::Pop();
@@ -457,9 +483,13 @@ void DataDesc::EditStruct()
 				}
 			};
 
+			// reordered or removed fields
+			fieldEditor.HandleEvent(ui::EventType::Change) = [&S](ui::Event&) { S.OnEdit(); };
+
 			if (ui::imm::Button("Add"))
 			{
 				S.fields.push_back({ "i32", "unnamed" });
+				S.OnEdit(S.fields.size() - 1);
 				editMode = 2;
 				curField = S.fields.size() - 1;
 				ui::RebuildCurrent();
@@ -511,18 +541,28 @@ void DataDesc::EditField()
 			if (curField < S.fields.size())
 			{
 				auto& F = S.fields[curField];
-				ui::imm::PropEditString("Value expr.", F.valueExpr.expr.c_str(), [&F](const char* v) { F.valueExpr.SetExpr(v); });
+				size_t fi = curField;
+				ui::imm::PropEditString("Value expr.", F.valueExpr.expr.c_str(), [&F, &S, fi](const char* v) { F.valueExpr.SetExpr(v); S.OnEdit(fi); });
 				if (!S.serialized)
-					ui::imm::PropEditInt("Offset", F.off);
-				ui::imm::PropEditString("Off.expr.", F.offExpr.expr.c_str(), [&F](const char* v) { F.offExpr.SetExpr(v); });
-				ui::imm::PropEditString("Name", F.name.c_str(), [&F](const char* s) { F.name = s; });
-				ui::imm::PropEditString("Type", F.type.c_str(), [&F](const char* s) { F.type = s; });
-				ui::imm::PropEditInt("Count", F.count, {}, 1);
-				ui::imm::PropEditString("Count source", F.countSrc.c_str(), [&F](const char* s) { F.countSrc = s; });
-				ui::imm::PropEditBool("Count is max. size", F.countIsMaxSize);
-				ui::imm::PropEditBool("Individual computed offsets", F.individualComputedOffsets);
-				ui::imm::PropEditBool("Read until 0", F.readUntil0);
-
+				{
+					if (ui::imm::PropEditInt("Offset", F.off))
+						S.OnEdit(fi);
+				}
+				ui::imm::PropEditString("Off.expr.", F.offExpr.expr.c_str(), [&F, &S, fi](const char* v) { F.offExpr.SetExpr(v); S.OnEdit(fi); });
+				// the earlier fields may have read the field by its previous name
+				ui::imm::PropEditString("Name", F.name.c_str(), [&F, &S](const char* s) { F.name = s; S.OnEdit(); });
+				ui::imm::PropEditString("Type", F.type.c_str(), [&F, &S, fi](const char* s) { F.type = s; S.OnEdit(fi); });
+				if (ui::imm::PropEditInt("Count", F.count, {}, 1))
+					S.OnEdit(fi);
+				ui::imm::PropEditString("Count source", F.countSrc.c_str(), [&F, &S, fi](const char* s) { F.countSrc = s; S.OnEdit(fi); });
+				if (ui::imm::PropEditBool("Count is max. size", F.countIsMaxSize))
+					S.OnEdit(fi);
+				if (ui::imm::PropEditBool("Individual computed offsets", F.individualComputedOffsets))
+					S.OnEdit(fi);
+				if (ui::imm::PropEditBool("Read until 0", F.readUntil0))
+					S.OnEdit(fi);
+
+				// arguments and element conditions are only used to create instances (not cached)
 				ui::Text("Struct arguments") + ui::SetPadding(5);
 				ui::Push<ui::Panel>();
 				for (size_t i = 0; i < F.structArgs.size(); i++)
@@ -544,7 +584,7 @@ void DataDesc::EditField()
 				}
 				ui::Pop();
 
-				ui::imm::PropEditString("Condition", F.condition.expr.c_str(), [&F](const char* v) { F.condition.SetExpr(v); });
+				ui::imm::PropEditString("Condition", F.condition.expr.c_str(), [&F, &S, fi](const char* v) { F.condition.SetExpr(v); S.OnEdit(fi); });
 				ui::imm::PropEditString("Elem.cond.",
 					F.elementCondition.expr.c_str(),
 					[&F](const char* v) { F.elementCondition.SetExpr(v); },
@@ -579,30 +619,53 @@ void DataDesc::EditImageItems()
 
 DDStructInst* DataDesc::AddInstance(const DDStructInst& src)
 {
-	printf("trying to create %s @ %" PRId64 "\n", src.def->name.c_str(), src.off);
-	for (size_t i = 0, num = instances.size(); i < num; i++)
+	if (auto* I = instIndex.FindAt(src.file, src.def, src.off))
 	{
-		auto* I = instances[i];
-		if (I->off == src.off && I->def == src.def && I->file == src.file)
-		{
-			I->creationReason = ui::min(I->creationReason, src.creationReason);
-			I->remainingCount = src.remainingCount;
-			I->remainingCountIsSize = src.remainingCountIsSize;
-			return I;
-		}
+		I->creationReason = ui::min(I->creationReason, src.creationReason);
+		I->remainingCount = src.remainingCount;
+		I->remainingCountIsSize = src.remainingCountIsSize;
+		instanceListVersion++;
+		return I;
 	}
 	auto* copy = new DDStructInst(src);
 	copy->id = instIDAlloc++;
 	copy->OnEdit();
 	instances.push_back(copy);
+	instIndex.OnAdded(copy);
+	instanceListVersion++;
+	_OnInstanceEdit(copy->def);
 	return copy;
 }
 
+void DataDesc::EndInstanceBatch()
+{
+	if (--_instanceBatchDepth > 0)
+		return;
+	for (auto* S : _batchEditedStructs)
+		S->OnInstanceEdit();
+	_batchEditedStructs.clear();
+}
+
+void DataDesc::_OnInstanceEdit(DDStruct* S)
+{
+	if (_instanceBatchDepth == 0)
+		S->OnInstanceEdit();
+	else if (std::find(_batchEditedStructs.begin(), _batchEditedStructs.end(), S) == _batchEditedStructs.end())
+		_batchEditedStructs.push_back(S);
+}
+
 void DataDesc::DeleteInstance(DDStructInst* inst)
 {
+	inst->def->OnInstanceEdit();
+	auto it = std::find(instances.begin(), instances.end(), inst);
+	if (it != instances.end())
+	{
+		instIndex.OnRemoved(inst);
+		instances.erase(it);
+	}
 	delete inst;
 	_OnDeleteInstance(inst);
-	instances.erase(std::remove_if(instances.begin(), instances.end(), [inst](DDStructInst* SI) { return inst == SI; }), instances.end());
+	instanceListVersion++;
 }
 
 void DataDesc::SetCurrentInstance(DDStructInst* inst)
@@ -619,21 +682,9 @@ void DataDesc::_OnDeleteInstance(DDStructInst* inst)
 
 void DataDesc::ExpandAllInstances(DDFile* filterFile)
 {
-	for (size_t i = 0; i < instances.size(); i++)
-	{
-		if (filterFile && instances[i]->file != filterFile)
-			continue;
-		auto* SI = instances[i];
-		if (!SI->allowAutoExpand)
-			continue;
-		auto& S = *SI->def;
-
-		SI->CreateNextInstance(CreationReason::AutoExpand);
-
-		for (size_t j = 0, jn = S.fields.size(); j < jn; j++)
-			if (SI->IsFieldPresent(j) && structs.count(S.fields[j].type))
-				SI->CreateFieldInstances(j, SIZE_MAX, CreationReason::AutoExpand);
-	}
+	InstanceExpander ie;
+	ie.Start(this, filterFile);
+	ie.Step(std::numeric_limits<double>::max());
 }
 
 void DataDesc::DeleteAllInstances(DDFile* filterFile, DDStruct* filterStruct)
@@ -646,10 +697,13 @@ void DataDesc::DeleteAllInstances(DDFile* filterFile, DDStruct* filterStruct)
 			return false;
 		if (filterStruct && SI->def != filterStruct)
 			return false;
+		SI->def->OnInstanceEdit();
 		_OnDeleteInstance(SI);
 		delete SI;
 		return true;
 	}), instances.end());
+	instIndex.Rebuild();
+	instanceListVersion++;
 }
 
 DataDesc::Image DataDesc::GetInstanceImage(const DDStructInst& SI)
@@ -697,6 +751,8 @@ void DataDesc::Clear()
 	structs.clear();
 
 	instances.clear();
+	instIndex.Rebuild();
+	instanceListVersion++;
 
 	images.clear();
 }
@@ -725,6 +781,7 @@ DDStruct* DataDesc::CreateNewStruct(const std::string& name)
 	auto* S = new DDStruct;
 	S->name = name;
 	structs[name] = S;
+	S->OnEdit();
 	return S;
 }
 
@@ -738,10 +795,7 @@ DDStruct* DataDesc::FindStructByName(const std::string& name)
 
 DDStructInst* DataDesc::FindInstanceByID(int64_t id)
 {
-	for (auto* SI : instances)
-		if (SI->id == id)
-			return SI;
-	return nullptr;
+	return instIndex.FindByID(id);
 }
 
 void DataDesc::DeleteImage(size_t id)
@@ -839,6 +893,8 @@ void DataDesc::Load(const char* key, NamedTextSerializeReader& r)
 		r.EndEntry();
 	}
 	r.EndArray();
+	instIndex.Rebuild();
+	instanceListVersion++;
 
 	r.BeginArray("images");
 	for (auto E : r.GetCurrentRange())
@@ -987,7 +1043,7 @@ enum COLS_DDI
 size_t DataDescInstanceSource::GetNumRows()
 {
 	_Refilter();
-	return _indices.size();
+	return _instances.size();
 }
 
 size_t DataDescInstanceSource::GetNumCols()
@@ -1038,16 +1094,16 @@ std::string DataDescInstanceSource::GetText(size_t row, size_t col)
 		col++;
 	switch (col)
 	{
-	case DDI_COL_ID: return std::to_string(_indices[row]);
-	case DDI_COL_IID: return std::to_string(dataDesc->instances[_indices[row]]->id);
-	case DDI_COL_CR: return CreationReasonToStringShort(dataDesc->instances[_indices[row]]->creationReason);
-	case DDI_COL_File: return dataDesc->instances[_indices[row]]->file->name;
-	case DDI_COL_Offset: return std::to_string(dataDesc->instances[_indices[row]]->off);
-	case DDI_COL_Struct: return dataDesc->instances[_indices[row]]->def->name;
+	case DDI_COL_ID: return std::to_string(row);
+	case DDI_COL_IID: return std::to_string(_instances[row]->id);
+	case DDI_COL_CR: return CreationReasonToStringShort(_instances[row]->creationReason);
+	case DDI_COL_File: return _instances[row]->file->name;
+	case DDI_COL_Offset: return std::to_string(_instances[row]->off);
+	case DDI_COL_Struct: return _instances[row]->def->name;
 	case DDI_COL_Bytes: {
 		uint32_t nbytes = std::min(showBytes, 128U);
 		uint8_t buf[128];
-		auto* inst = dataDesc->instances[_indices[row]];
+		auto* inst = _instances[row];
 		inst->file->dataSource->Read(inst->off, nbytes, buf);
 		std::string text;
 		for (uint32_t i = 0; i < nbytes; i++)
@@ -1060,7 +1116,7 @@ std::string DataDescInstanceSource::GetText(size_t row, size_t col)
 		}
 		return text;
 	} break;
-	default: return dataDesc->instances[_indices[row]]->GetFieldPreview(col - DDI_COL_FirstField);
+	default: return _instances[row]->GetFieldPreview(col - DDI_COL_FirstField);
 	}
 }
 
@@ -1071,13 +1127,13 @@ void DataDescInstanceSource::ClearSelection()
 
 bool DataDescInstanceSource::GetSelectionState(uintptr_t item)
 {
-	return dataDesc->curInst == dataDesc->instances[_indices[item]];
+	return dataDesc->curInst == _instances[item];
 }
 
 void DataDescInstanceSource::SetSelectionState(uintptr_t item, bool sel)
 {
 	if (sel)
-		dataDesc->SetCurrentInstance(dataDesc->instances[_indices[item]]);
+		dataDesc->SetCurrentInstance(_instances[item]);
 	else if (GetSelectionState(item))
 		dataDesc->SetCurrentInstance(nullptr);
 }
@@ -1208,11 +1264,23 @@ void DataDescInstanceSource::_Refilter()
 	if (!refilter)
 		return;
 
-	_indices.clear();
-	_indices.reserve(dataDesc->instances.size());
-	for (size_t i = 0; i < dataDesc->instances.size(); i++)
+	// start from the smallest indexed list that the filters allow
+	const std::vector<DDStructInst*>* candidates = nullptr;
+	if (filterStructEnable && filterStruct)
+		candidates = &dataDesc->instIndex.GetStructInstances(filterStruct);
+	if (filterFileEnable && filterFile)
 	{
-		auto* I = dataDesc->instances[i];
+		const auto& fileInsts = dataDesc->instIndex.GetFileInstances(filterFile);
+		if (!candidates || fileInsts.size() < candidates->size())
+			candidates = &fileInsts;
+	}
+	size_t count = candidates ? candidates->size() : dataDesc->instances.size();
+
+	_instances.clear();
+	_instances.reserve(count);
+	for (size_t n = 0; n < count; n++)
+	{
+		auto* I = candidates ? (*candidates)[n] : dataDesc->instances[n];
 		if (filterStructEnable && filterStruct && filterStruct != I->def)
 			continue;
 		else if (filterHideStructsEnable && filterHideStructs.count(I->def))
@@ -1221,7 +1289,7 @@ void DataDescInstanceSource::_Refilter()
 			continue;
 		if (I->creationReason > filterCreationReason)
 			continue;
-		_indices.push_back(i);
+		_instances.push_back(I);
 	}
 
 	refilter = false;
@@ -6,6 +6,8 @@
 #include "ImageParsers.h"
 #include "Markers.h"
 #include "DataDescStruct.h"
+#include "IntervalTree.h"
+#include "InstanceIndex.h"
 
 
 extern ui::Color4f colorFloat32;
@@ -26,6 +28,10 @@ struct DDFile
 	struct IDataSource* dataSource = nullptr;
 	MarkerData markerData;
 	MarkerDataSource mdSrc;
+
+	// overlap lookup for highlighting, rebuilt when the version changes
+	IntervalTree markerTree;
+	uint32_t markerTreeVersion = 0;
 };
 
 
@@ -50,6 +56,12 @@ struct DataDesc
 	std::unordered_map<std::string, DDStruct*> structs;
 	std::vector<DDStructInst*> instances;
 	std::vector<Image> images;
+	// incremented when instances are added, removed, moved or their saved properties are edited
+	CacheVersion instanceListVersion = 1;
+	// kept up to date by AddInstance/DeleteInstance/DeleteAllInstances/Load
+	InstanceIndex instIndex;
+	int _instanceBatchDepth = 0;
+	std::vector<DDStruct*> _batchEditedStructs;
 
 	// ID allocation
 	uint64_t fileIDAlloc = 0;
@@ -70,12 +82,20 @@ struct DataDesc
 
 	DDStructInst* AddInstance(const DDStructInst& src);
 	void DeleteInstance(DDStructInst* inst);
+	// the structs of the instances added until the end of the batch are marked as edited once
+	void BeginInstanceBatch() { _instanceBatchDepth++; }
+	void EndInstanceBatch();
+	void _OnInstanceEdit(DDStruct* S);
 	void SetCurrentInstance(DDStructInst* inst);
 	void _OnDeleteInstance(DDStructInst* inst);
 	void ExpandAllInstances(DDFile* filterFile = nullptr);
 	void DeleteAllInstances(DDFile* filterFile = nullptr, DDStruct* filterStruct = nullptr);
 	DataDesc::Image GetInstanceImage(const DDStructInst& SI);
 
+	DataDesc()
+	{
+		instIndex.instances = &instances;
+	}
 	~DataDesc();
 	void Clear();
 	DDFile* CreateNewFile();
@@ -107,7 +127,7 @@ struct DataDescInstanceSource : ui::TableDataSource, ui::ISelectionStorage
 
 	void _Refilter();
 
-	std::vector<size_t> _indices;
+	std::vector<DDStructInst*> _instances;
 	bool refilter = true;
 
 	DataDesc* dataDesc = nullptr;
@@ -268,6 +268,215 @@ void DDStruct::Save(NamedTextSerializeWriter& w)
 	w.WriteString("sizeSrc", sizeSrc);
 }
 
+// older edits invalidate all fields
+static constexpr size_t MAX_STRUCT_EDITS = 32;
+
+CacheVersion DDStruct::lastEditVersion = 1;
+CacheVersion DDStruct::lastInstEditVersion = 1;
+
+void DDStruct::OnEdit(size_t firstField)
+{
+	editVersionS = ++lastEditVersion;
+	if (_edits.size() >= MAX_STRUCT_EDITS)
+	{
+		_droppedEditVersion = _edits.front().version;
+		_edits.erase(_edits.begin());
+	}
+	_edits.push_back({ editVersionS, firstField });
+}
+
+size_t DDStruct::_GetUnchangedFieldCount(DataDesc* desc, CacheVersion since, CacheVersion instSince)
+{
+	// most instances were checked at the same version so the last result is usually reused
+	if (_unchangedSince == since && _unchangedInstSince == instSince &&
+		_unchangedAt == lastEditVersion && _unchangedInstAt == lastInstEditVersion)
+		return _unchangedCount;
+
+	_UpdateDependencies(desc);
+
+	size_t count = fields.size();
+	if (editVersionS > since)
+	{
+		if (_droppedEditVersion > since)
+			count = 0;
+		for (const auto& E : _edits)
+			if (E.version > since)
+				count = std::min(count, E.firstField);
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		const auto& FD = _fieldDeps[i];
+		bool changed = FD.anyStruct;
+		for (auto* S : FD.structs)
+			if (S->editVersionS > since)
+				changed = true;
+		for (auto* S : FD.queried)
+			if (S->instEditVersionS > instSince)
+				changed = true;
+		if (changed)
+		{
+			count = i;
+			break;
+		}
+	}
+	// the unchanged fields that read the changed ones
+	for (bool again = true; again;)
+	{
+		again = false;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (_fieldDeps[i].lastUsedField >= count)
+			{
+				count = i;
+				again = true;
+				break;
+			}
+		}
+	}
+
+	_unchangedSince = since;
+	_unchangedInstSince = instSince;
+	_unchangedAt = lastEditVersion;
+	_unchangedInstAt = lastInstEditVersion;
+	_unchangedCount = count;
+	return count;
+}
+
+static void GetFieldExprDeps(const DDField& F, MathExprDeps& out)
+{
+	for (auto* E : { &F.valueExpr, &F.offExpr, &F.condition, &F.elementCondition })
+		if (E->inst)
+			E->inst->GetDependencies(out);
+}
+
+static void AddUniqueStruct(std::vector<DDStruct*>& out, DDStruct* S)
+{
+	if (std::find(out.begin(), out.end(), S) == out.end())
+		out.push_back(S);
+}
+
+// adds S and all structs that may be used to read its instances
+static void AddStructClosure(DataDesc* desc, DDStruct* S, DDFieldDeps& out)
+{
+	if (std::find(out.structs.begin(), out.structs.end(), S) != out.structs.end())
+		return;
+	out.structs.push_back(S);
+
+	for (const auto& F : S->fields)
+	{
+		if (auto* FS = desc->FindStructByName(F.type))
+			AddStructClosure(desc, FS, out);
+
+		MathExprDeps deps;
+		GetFieldExprDeps(F, deps);
+		if (deps.unknownQueries)
+			out.anyStruct = true;
+		for (const auto& name : deps.queriedStructs)
+		{
+			if (auto* QS = desc->FindStructByName(name))
+			{
+				AddUniqueStruct(out.queried, QS);
+				AddStructClosure(desc, QS, out);
+			}
+			else
+				out.anyStruct = true;
+		}
+	}
+}
+
+void DDStruct::_UpdateDependencies(DataDesc* desc)
+{
+	// any struct edit can change how the names are resolved
+	if (_depsVersion == lastEditVersion)
+		return;
+	_depsVersion = lastEditVersion;
+
+	_fieldDeps.clear();
+	_fieldDeps.resize(fields.size());
+	for (size_t i = 0; i < fields.size(); i++)
+	{
+		const auto& F = fields[i];
+		auto& FD = _fieldDeps[i];
+		FD.lastUsedField = i;
+
+		// only the size of fixed size structs is used, serialized ones are read to find it
+		if (auto* FS = desc->FindStructByName(F.type))
+		{
+			if (FS->serialized)
+				AddStructClosure(desc, FS, FD);
+			else
+				AddUniqueStruct(FD.structs, FS);
+		}
+
+		MathExprDeps deps;
+		GetFieldExprDeps(F, deps);
+		if (deps.unknownQueries)
+			FD.anyStruct = true;
+		for (const auto& name : deps.rootFields)
+		{
+			size_t fid = FindFieldByName(name);
+			if (fid != SIZE_MAX)
+				FD.lastUsedField = std::max(FD.lastUsedField, fid);
+		}
+		for (const auto& name : deps.queriedStructs)
+		{
+			if (auto* QS = desc->FindStructByName(name))
+			{
+				AddUniqueStruct(FD.queried, QS);
+				AddStructClosure(desc, QS, FD);
+			}
+			else
+				FD.anyStruct = true; // may be created later
+		}
+		for (const auto& name : deps.queriedFields)
+		{
+			size_t fid = FindFieldByName(name);
+			if (fid == SIZE_MAX)
+				continue;
+			FD.lastUsedField = std::max(FD.lastUsedField, fid);
+			if (auto* FS = desc->FindStructByName(fields[fid].type))
+				AddStructClosure(desc, FS, FD);
+		}
+	}
+}
+
+// constants that are set differently for each evaluation of the field expressions
+static const std::vector<std::string> g_fieldConstantNames = { "i", "off", "orig" };
+
+void DDStruct::_UpdateSharedSubexprs()
+{
+	if (_sharedSubexprVersion == editVersionS)
+		return;
+	_sharedSubexprVersion = editVersionS;
+
+	// the conditions are evaluated while the fields are enumerated (with only the previous ones available) so they're not included
+	std::unordered_map<std::string, unsigned> exprCounts;
+	std::vector<std::string> keys;
+	for (auto& F : fields)
+	{
+		for (auto* E : { &F.valueExpr, &F.offExpr, &F.elementCondition })
+		{
+			if (!E->inst)
+				continue;
+			keys.clear();
+			E->inst->GetSharableSubexprs(g_fieldConstantNames, keys);
+			for (const auto& key : keys)
+				exprCounts[key]++;
+		}
+	}
+
+	std::unordered_map<std::string, uint8_t> slots;
+	for (const auto& EC : exprCounts)
+		if (EC.second > 1 && slots.size() < MathExprSharedValues::MAX_VALUES)
+			slots[EC.first] = uint8_t(slots.size());
+	_numSharedSubexprs = slots.size();
+
+	for (auto& F : fields)
+		for (auto* E : { &F.valueExpr, &F.offExpr, &F.elementCondition })
+			if (E->inst)
+				E->inst->SetSharedSubexprs(slots);
+}
+
 
 std::string DDStructInst::GetFieldDescLazy(size_t i, bool* incomplete) const
 {
@@ -318,14 +527,9 @@ std::string DDStructInst::GetFieldDescLazy(size_t i, bool* incomplete) const
 
 int64_t DDStructInst::GetSize(bool lazy) const
 {
-	if (cachedSize == F_NO_VALUE ||
-		cacheSizeVersionSI != editVersionSI ||
-		cacheSizeVersionS != def->editVersionS)
-	{
+	_CheckFieldCache();
+	if (cachedSize == F_NO_VALUE)
 		cachedSize = _CalcSize(lazy);
-		cacheSizeVersionSI = editVersionSI;
-		cacheSizeVersionS = def->editVersionS;
-	}
 	return cachedSize;
 }
 
@@ -425,6 +629,7 @@ int64_t DDStructInst::GetFieldOffset(size_t i, bool lazy) const
 					vs.desc = desc;
 					vs.root = this;
 					vs.constants = constants;
+					vs.sharedValues = &sharedValues;
 					vs.constantCount = sizeof(constants) / sizeof(constants[0]);
 				}
 				CF.off = F.offExpr.inst->Evaluate(&vs);
@@ -568,6 +773,7 @@ DDStructInst* DDStructInst::CreateFieldInstances(size_t i, size_t upToN, Creatio
 					vs.desc = desc;
 					vs.root = this;
 					vs.constants = constants;
+					vs.sharedValues = &sharedValues;
 					vs.constantCount = sizeof(constants) / sizeof(constants[0]);
 				}
 				newSI.off = F.offExpr.Evaluate(vs);
@@ -588,6 +794,7 @@ DDStructInst* DDStructInst::CreateFieldInstances(size_t i, size_t upToN, Creatio
 					vs.desc = desc;
 					vs.root = this;
 					vs.constants = constants;
+					vs.sharedValues = &sharedValues;
 					vs.constantCount = sizeof(constants) / sizeof(constants[0]);
 				}
 				if (!F.elementCondition.Evaluate(vs))
@@ -689,13 +896,36 @@ DDStructInst* DDStructInst::CreateNextInstance(CreationReason cr) const
 
 void DDStructInst::_CheckFieldCache() const
 {
-	if (cacheFieldsVersionSI != editVersionSI ||
-		cacheFieldsVersionS != def->editVersionS)
+	if (cacheFieldsVersionSI != editVersionSI)
 	{
 		cachedFields.clear();
 		cachedReadOff = off;
+		cachedSize = F_NO_VALUE;
+		def->_UpdateSharedSubexprs();
+		sharedValues.Reset(def->_numSharedSubexprs);
 		cacheFieldsVersionSI = editVersionSI;
-		cacheFieldsVersionS = def->editVersionS;
+		cacheFieldsVersionS = DDStruct::lastEditVersion;
+		cacheFieldsVersionIE = DDStruct::lastInstEditVersion;
+	}
+	else if (cacheFieldsVersionS != DDStruct::lastEditVersion || cacheFieldsVersionIE != DDStruct::lastInstEditVersion)
+	{
+		// only the fields after the first affected one are dropped
+		if (cachedFields.size() || cachedSize != F_NO_VALUE)
+		{
+			size_t keep = def->_GetUnchangedFieldCount(desc, cacheFieldsVersionS, cacheFieldsVersionIE);
+			if (keep < cachedFields.size())
+			{
+				cachedReadOff = cachedFields[keep].origOff;
+				cachedFields.resize(keep);
+			}
+			if (keep < def->fields.size())
+				cachedSize = F_NO_VALUE;
+		}
+		// which fields the shared values depend on is not known
+		def->_UpdateSharedSubexprs();
+		sharedValues.Reset(def->_numSharedSubexprs);
+		cacheFieldsVersionS = DDStruct::lastEditVersion;
+		cacheFieldsVersionIE = DDStruct::lastInstEditVersion;
 	}
 }
 
@@ -851,6 +1081,7 @@ bool DDStructInst::_ReadFieldValues(size_t i, size_t n) const
 				vs.desc = desc;
 				vs.root = this;
 				vs.constants = constants;
+				vs.sharedValues = &sharedValues;
 				vs.constantCount = sizeof(constants) / sizeof(constants[0]);
 			}
 			int64_t value = F.valueExpr.Evaluate(vs);
@@ -86,6 +86,25 @@ struct DDStructResource
 	void Load(NamedTextSerializeReader& r);
 	void Save(NamedTextSerializeWriter& w);
 };
+struct DDStruct;
+struct DDStructEdit
+{
+	CacheVersion version;
+	// the fields before this one were not changed
+	size_t firstField;
+};
+// what the cached values of a field depend on, other than the instance itself
+struct DDFieldDeps
+{
+	// structs whose definitions are used (field types, queried structs and the structs they use)
+	std::vector<DDStruct*> structs;
+	// structs whose instances are searched by queries
+	std::vector<DDStruct*> queried;
+	// last field of the same instance that is read (expressions may read the later fields)
+	size_t lastUsedField = 0;
+	// queries whose struct types are not known
+	bool anyStruct = false;
+};
 struct DDStruct
 {
 	std::string name;
@@ -97,15 +116,42 @@ struct DDStruct
 	DDStructResource resource;
 
 	CacheVersion editVersionS = 1;
-
-	void OnEdit()
+	// changed when instances of the struct are edited or deleted (affects the queries that find them)
+	CacheVersion instEditVersionS = 1;
+
+	std::vector<DDStructEdit> _edits;
+	CacheVersion _droppedEditVersion = 0;
+	std::vector<DDFieldDeps> _fieldDeps;
+	CacheVersion _depsVersion = 0;
+	CacheVersion _unchangedSince = 0;
+	CacheVersion _unchangedInstSince = 0;
+	CacheVersion _unchangedAt = 0;
+	CacheVersion _unchangedInstAt = 0;
+	size_t _unchangedCount = 0;
+	// the subexpressions used by more than one field expression get a slot in DDStructInst::sharedValues
+	size_t _numSharedSubexprs = 0;
+	CacheVersion _sharedSubexprVersion = 0;
+
+	// edits of all structs are numbered in order, instances compare it to the version of their caches
+	static CacheVersion lastEditVersion;
+	// instance edits are numbered separately, they don't change what depends only on the struct definitions
+	static CacheVersion lastInstEditVersion;
+
+	// `firstField` - the first field that was changed (or added/removed), 0 if the struct itself was changed
+	void OnEdit(size_t firstField = 0);
+	void OnInstanceEdit()
 	{
-		editVersionS++;
+		instEditVersionS = ++lastInstEditVersion;
 	}
 	size_t GetFieldCount() const { return fields.size(); }
 	size_t FindFieldByName(ui::StringView name);
 	void Load(NamedTextSerializeReader& r);
 	void Save(NamedTextSerializeWriter& w);
+
+	// the number of leading fields whose cached values are not affected by the edits made after `since`
+	size_t _GetUnchangedFieldCount(DataDesc* desc, CacheVersion since, CacheVersion instSince);
+	void _UpdateDependencies(DataDesc* desc);
+	void _UpdateSharedSubexprs();
 };
 struct DDArg
 {
@@ -159,13 +205,14 @@ struct DDStructInst
 	std::vector<DDArg> args;
 
 	CacheVersion editVersionSI = 1;
-	mutable CacheVersion cacheSizeVersionSI = 0;
-	mutable CacheVersion cacheSizeVersionS = 0;
 	mutable int64_t cachedSize = F_NO_VALUE;
 	mutable CacheVersion cacheFieldsVersionSI = 0;
+	// DDStruct::lastEditVersion/lastInstEditVersion when the caches were last checked
 	mutable CacheVersion cacheFieldsVersionS = 0;
+	mutable CacheVersion cacheFieldsVersionIE = 0;
 	mutable int64_t cachedReadOff = F_NO_VALUE;
 	mutable std::vector<DDReadField> cachedFields;
+	mutable MathExprSharedValues sharedValues;
 
 	std::string GetFieldDescLazy(size_t i, bool* incomplete = nullptr) const;
 	int64_t GetSize(bool lazy = false) const;
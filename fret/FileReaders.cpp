@@ -2,6 +2,9 @@
 #include "pch.h"
 #include "FileReaders.h"
 
+#include <list>
+#include <mutex>
+
 
 void IDataSource::GetASCIIText(char* buf, size_t bufsz, uint64_t pos)
 {
@@ -78,6 +81,45 @@ void IDataSource::GetFloat64Text(char* buf, size_t bufsz, uint64_t pos)
 	snprintf(buf, bufsz, "%g", v);
 }
 
+void IDataSource::ReadStrided(uint64_t at, uint64_t stride, uint64_t count, size_t elemSize, void* out)
+{
+	if (!count)
+		return;
+	char* dst = (char*)out;
+	if (const char* span = (const char*)GetSpan(at, stride * (count - 1) + elemSize))
+	{
+		for (uint64_t i = 0; i < count; i++)
+			memcpy(dst + i * elemSize, span + i * stride, elemSize);
+		return;
+	}
+
+	constexpr uint64_t CHUNK_SIZE = 64 * 1024;
+	uint64_t elemsPerChunk = 1;
+	if (stride == 0)
+		elemsPerChunk = count;
+	else if (elemSize <= CHUNK_SIZE)
+		elemsPerChunk = (CHUNK_SIZE - elemSize) / stride + 1;
+
+	if (elemsPerChunk < 2)
+	{
+		for (uint64_t i = 0; i < count; i++)
+			Read(at + i * stride, elemSize, dst + i * elemSize);
+		return;
+	}
+
+	std::vector<char> chunk;
+	for (uint64_t i = 0; i < count; )
+	{
+		uint64_t n = std::min(elemsPerChunk, count - i);
+		size_t len = size_t(stride * (n - 1) + elemSize);
+		chunk.resize(len);
+		Read(at + i * stride, len, chunk.data());
+		for (uint64_t j = 0; j < n; j++)
+			memcpy(dst + (i + j) * elemSize, &chunk[j * stride], elemSize);
+		i += n;
+	}
+}
+
 
 MemoryDataSource::MemoryDataSource(void* mem, size_t size, bool own) : _mem(mem), _size(size), _own(own)
 {
@@ -105,6 +147,13 @@ uint64_t MemoryDataSource::GetSize()
 	return _size;
 }
 
+const void* MemoryDataSource::GetSpan(uint64_t at, uint64_t size)
+{
+	if (at > _size || size > _size - at)
+		return nullptr;
+	return (char*)_mem + at;
+}
+
 
 FileDataSource::FileDataSource(const char* path)
 {
@@ -128,6 +177,7 @@ size_t FileDataSource::Read(uint64_t at, size_t size, void* out)
 	size_t rd = 0;
 	if (_fp)
 	{
+		std::lock_guard<std::mutex> g(_mutex);
 		if (_pos != at)
 		{
 			if (at > _size)
@@ -149,6 +199,197 @@ uint64_t FileDataSource::GetSize()
 }
 
 
+MMapDataSource::MMapDataSource(const char* path) : _file(path)
+{
+}
+
+size_t MMapDataSource::Read(uint64_t at, size_t size, void* out)
+{
+	size_t from = std::min(at, _file.size);
+	size_t end = std::min(at + size, _file.size);
+	size_t nw = end - from;
+	memcpy(out, (const char*)_file.data + from, nw);
+	if (nw < size)
+		memset((char*)out + nw, 0, size - nw);
+	return nw;
+}
+
+uint64_t MMapDataSource::GetSize()
+{
+	return _file.size;
+}
+
+const void* MMapDataSource::GetSpan(uint64_t at, uint64_t size)
+{
+	if (at > _file.size || size > _file.size - at)
+		return nullptr;
+	return (const char*)_file.data + at;
+}
+
+
+struct CachedBlock
+{
+	uint64_t index;
+	std::vector<char> data;
+};
+
+struct CachedDataSourceImpl
+{
+	IDataSource* src;
+	uint64_t size;
+	size_t maxBlocks;
+
+	// guards the block list/map, stats and access pattern
+	std::mutex mutex;
+	// most recently used first
+	std::list<CachedBlock> blocks;
+	std::unordered_map<uint64_t, std::list<CachedBlock>::iterator> blockMap;
+	std::unordered_set<uint64_t> pendingReadAheads;
+	uint64_t lastBlock = UINT64_MAX;
+	uint32_t sequentialCount = 0;
+	CachedDataSource::Stats stats;
+
+	ui::WorkerQueue readAheadQueue;
+
+	void LoadBlock(uint64_t index, std::vector<char>& out)
+	{
+		uint64_t at = index * CachedDataSource::BLOCK_SIZE;
+		out.resize(size_t(std::min(uint64_t(CachedDataSource::BLOCK_SIZE), size - at)));
+		src->Read(at, out.size(), out.data());
+	}
+
+	// expects `mutex` to be locked
+	CachedBlock& InsertBlock(uint64_t index, std::vector<char>&& data)
+	{
+		auto it = blockMap.find(index);
+		if (it != blockMap.end())
+		{
+			// loaded in the meantime
+			blocks.splice(blocks.begin(), blocks, it->second);
+			return *it->second;
+		}
+		while (blocks.size() >= maxBlocks)
+		{
+			blockMap.erase(blocks.back().index);
+			blocks.pop_back();
+		}
+		blocks.push_front({ index, std::move(data) });
+		blockMap[index] = blocks.begin();
+		return blocks.front();
+	}
+
+	// expects `mutex` to be locked
+	void OnBlockAccess(uint64_t index)
+	{
+		if (index == lastBlock)
+			return;
+		sequentialCount = index == lastBlock + 1 ? sequentialCount + 1 : 0;
+		lastBlock = index;
+		if (sequentialCount < 2)
+			return;
+
+		uint64_t numBlocks = (size + CachedDataSource::BLOCK_SIZE - 1) / CachedDataSource::BLOCK_SIZE;
+		for (uint64_t i = index + 1; i <= index + CachedDataSource::READ_AHEAD_BLOCKS && i < numBlocks; i++)
+		{
+			if (blockMap.count(i) || pendingReadAheads.count(i))
+				continue;
+			pendingReadAheads.insert(i);
+			readAheadQueue.Push([this, i]()
+			{
+				if (readAheadQueue.IsQuitting())
+					return;
+				std::vector<char> data;
+				LoadBlock(i, data);
+				std::lock_guard<std::mutex> g(mutex);
+				pendingReadAheads.erase(i);
+				InsertBlock(i, std::move(data));
+				stats.readAheads++;
+			});
+		}
+	}
+};
+
+CachedDataSource::CachedDataSource(IDataSource* src, size_t maxBlocks)
+{
+	_impl = new CachedDataSourceImpl;
+	_impl->src = src;
+	_impl->size = src->GetSize();
+	_impl->maxBlocks = std::max(maxBlocks, size_t(READ_AHEAD_BLOCKS + 2));
+}
+
+CachedDataSource::~CachedDataSource()
+{
+	_impl->readAheadQueue.Clear();
+	auto* src = _impl->src;
+	delete _impl;
+	delete src;
+}
+
+size_t CachedDataSource::Read(uint64_t at, size_t size, void* out)
+{
+	size_t from = std::min(at, _impl->size);
+	size_t end = std::min(at + size, _impl->size);
+	size_t nw = end - from;
+
+	char* dst = (char*)out;
+	for (uint64_t pos = from; pos < end; )
+	{
+		uint64_t index = pos / BLOCK_SIZE;
+		uint64_t blockStart = index * BLOCK_SIZE;
+		size_t n = size_t(std::min(end, blockStart + BLOCK_SIZE) - pos);
+
+		std::unique_lock<std::mutex> lock(_impl->mutex);
+		_impl->OnBlockAccess(index);
+		CachedBlock* block;
+		auto it = _impl->blockMap.find(index);
+		if (it != _impl->blockMap.end())
+		{
+			_impl->stats.hits++;
+			_impl->blocks.splice(_impl->blocks.begin(), _impl->blocks, it->second);
+			block = &*it->second;
+		}
+		else
+		{
+			_impl->stats.misses++;
+			lock.unlock();
+			std::vector<char> data;
+			_impl->LoadBlock(index, data);
+			lock.lock();
+			block = &_impl->InsertBlock(index, std::move(data));
+		}
+		memcpy(dst, block->data.data() + (pos - blockStart), n);
+
+		dst += n;
+		pos += n;
+	}
+
+	if (nw < size)
+		memset((char*)out + nw, 0, size - nw);
+	return nw;
+}
+
+uint64_t CachedDataSource::GetSize()
+{
+	return _impl->size;
+}
+
+CachedDataSource::Stats CachedDataSource::GetStats()
+{
+	std::lock_guard<std::mutex> g(_impl->mutex);
+	return _impl->stats;
+}
+
+
+IDataSource* OpenFileDataSource(const char* path)
+{
+	auto* mds = new MMapDataSource(path);
+	if (mds->IsValid())
+		return mds;
+	delete mds;
+	return new CachedDataSource(new FileDataSource(path));
+}
+
+
 SliceDataSource::SliceDataSource(IDataSource* src, uint64_t off, uint64_t size) : _src(src), _off(off), _size(size)
 {
 }
@@ -172,3 +413,10 @@ uint64_t SliceDataSource::GetSize()
 	return _size;
 }
 
+const void* SliceDataSource::GetSpan(uint64_t at, uint64_t size)
+{
+	if (at > _size || size > _size - at)
+		return nullptr;
+	return _src->GetSpan(at + _off, size);
+}
+
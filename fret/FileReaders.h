@@ -2,12 +2,20 @@
 #pragma once
 #include "pch.h"
 
+#include <mutex>
 
+
+// all sources can be read from multiple threads at once
 struct IDataSource
 {
 	virtual ~IDataSource() {}
 	virtual size_t Read(uint64_t at, size_t size, void* out) = 0;
 	virtual uint64_t GetSize() = 0;
+	// direct pointer to [at; at + size) if the whole range is in memory, nullptr otherwise (use Read)
+	virtual const void* GetSpan(uint64_t at, uint64_t size) { return nullptr; }
+	// reads `count` elements of `elemSize` bytes located `stride` bytes apart into a packed array
+	// nearby elements are read together in 64 KB chunks
+	virtual void ReadStrided(uint64_t at, uint64_t stride, uint64_t count, size_t elemSize, void* out);
 
 	void GetASCIIText(char* buf, size_t bufsz, uint64_t pos);
 	void GetInt8Text(char* buf, size_t bufsz, uint64_t pos, bool sign);
@@ -25,6 +33,7 @@ struct MemoryDataSource : IDataSource
 
 	size_t Read(uint64_t at, size_t size, void* out) override;
 	uint64_t GetSize() override;
+	const void* GetSpan(uint64_t at, uint64_t size) override;
 
 	void* _mem;
 	size_t _size;
@@ -39,11 +48,53 @@ struct FileDataSource : IDataSource
 	size_t Read(uint64_t at, size_t size, void* out) override;
 	uint64_t GetSize() override;
 
+	// the position of the file is shared by the reads
+	std::mutex _mutex;
 	FILE* _fp;
 	uint64_t _pos = 0;
 	uint64_t _size = 0;
 };
 
+struct MMapDataSource : IDataSource
+{
+	MMapDataSource(const char* path);
+
+	bool IsValid() const { return _file.IsValid(); }
+	size_t Read(uint64_t at, size_t size, void* out) override;
+	uint64_t GetSize() override;
+	const void* GetSpan(uint64_t at, uint64_t size) override;
+
+	ui::MappedFile _file;
+};
+
+// LRU cache of fixed size blocks over another (slow) source, which it takes ownership of
+// sequential access triggers read-ahead of the next blocks on a worker thread
+struct CachedDataSource : IDataSource
+{
+	static constexpr uint32_t BLOCK_SIZE = 64 * 1024;
+	static constexpr uint32_t READ_AHEAD_BLOCKS = 4;
+
+	struct Stats
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t readAheads = 0;
+	};
+
+	CachedDataSource(IDataSource* src, size_t maxBlocks = 256);
+	~CachedDataSource();
+
+	size_t Read(uint64_t at, size_t size, void* out) override;
+	uint64_t GetSize() override;
+
+	Stats GetStats();
+
+	struct CachedDataSourceImpl* _impl;
+};
+
+// memory mapped if possible, cached FileDataSource otherwise (e.g. empty files cannot be mapped)
+IDataSource* OpenFileDataSource(const char* path);
+
 struct SliceDataSource : IDataSource
 {
 	SliceDataSource(IDataSource* src, uint64_t off, uint64_t size);
@@ -51,6 +102,7 @@ struct SliceDataSource : IDataSource
 
 	size_t Read(uint64_t at, size_t size, void* out) override;
 	uint64_t GetSize() override;
+	const void* GetSpan(uint64_t at, uint64_t size) override;
 
 	IDataSource* _src;
 	uint64_t _off;
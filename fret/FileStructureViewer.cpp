@@ -3,6 +3,18 @@
 #include "FileStructureViewer.h"
 
 
+// larger batches are not expected from the plugins (they send 64K at a time)
+static constexpr uint32_t STRUCTURE_MAX_BATCH_SIZE = 64 * 1024 * 1024;
+// min. time between the notifications while loading
+static constexpr double STRUCTURE_NOTIFY_INTERVAL = 0.1;
+
+namespace ui {
+double hqtime();
+} // ui
+
+ui::DataCategoryTag DCT_FileStructure[1];
+
+
 uint64_t ISyncReadStream::ReadULEB()
 {
 	uint64_t result = 0;
@@ -21,236 +33,488 @@ uint64_t ISyncReadStream::ReadULEB()
 }
 
 
-SocketSyncReadStream::SocketSyncReadStream(int port)
+PipeSyncReadStream::PipeSyncReadStream(const std::string& exePath, const std::string& args, const char* dir)
 {
-	WSADATA wsadata;
-	if (WSAStartup(MAKEWORD(2, 2), &wsadata) != 0)
+	SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, TRUE };
+	HANDLE writePipe = nullptr;
+	if (!CreatePipe(&_pipe, &writePipe, &sa, 0))
 	{
-		fprintf(stderr, "failed to initialize Windows Sockets\n");
-		exit(EXIT_FAILURE);
+		_pipe = nullptr;
+		return;
 	}
+	// only the write end is inherited
+	SetHandleInformation(_pipe, HANDLE_FLAG_INHERIT, 0);
 
-	s = socket(PF_INET, SOCK_STREAM, 0);
-	if (s == -1)
+	STARTUPINFOA si = { sizeof(si) };
+	si.dwFlags = STARTF_USESTDHANDLES;
+	si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+	si.hStdOutput = writePipe;
+	si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+	PROCESS_INFORMATION pi = {};
+	// started directly (not through cmd) so that it's the plugin that gets killed
+	std::string cmdLine = "\"" + exePath + "\" " + args;
+	if (CreateProcessA(exePath.c_str(), &cmdLine[0], nullptr, nullptr, TRUE, CREATE_NO_WINDOW, nullptr, dir, &si, &pi))
 	{
-		fprintf(stderr, "failed to create socket\n");
-		exit(EXIT_FAILURE);
+		CloseHandle(pi.hThread);
+		_process = pi.hProcess;
 	}
+	// the reads end when the process closes its copy
+	CloseHandle(writePipe);
+}
 
-	sockaddr_in my_addr;
-	my_addr.sin_family = AF_INET;
-	my_addr.sin_port = htons(port);
-	my_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
-	memset(my_addr.sin_zero, 0, sizeof my_addr.sin_zero);
-	if (bind(s, (sockaddr*)&my_addr, sizeof(my_addr)) == -1)
+PipeSyncReadStream::~PipeSyncReadStream()
+{
+	if (_process)
 	{
-		fprintf(stderr, "failed to bind to port %d\n", port);
-		exit(EXIT_FAILURE);
+		if (!_done)
+			TerminateProcess(_process, EXIT_FAILURE);
+		WaitForSingleObject(_process, INFINITE);
+		CloseHandle(_process);
 	}
-
-	listen(s, 1);
+	if (_pipe)
+		CloseHandle(_pipe);
 }
 
-SocketSyncReadStream::~SocketSyncReadStream()
+int PipeSyncReadStream::Read(void* buf, int size)
 {
-	if (rs != -1)
-	{
-		closesocket(rs);
-		rs = -1;
-	}
-	if (s != -1)
+	if (!_process)
+		return 0;
+	auto p = (char*)buf;
+	int left = size;
+	while (left)
 	{
-		closesocket(s);
-		s = -1;
+		DWORD numRead = 0;
+		if (!ReadFile(_pipe, p, DWORD(left), &numRead, nullptr) || numRead == 0)
+		{
+			_done = true;
+			break;
+		}
+		p += numRead;
+		left -= int(numRead);
 	}
-	WSACleanup();
+	return size - left;
 }
 
-void SocketSyncReadStream::Accept()
+struct NameRef
 {
-	sockaddr_storage oaddr;
-	int addr_size = sizeof(oaddr);
-	rs = ::accept(s, (sockaddr*)&oaddr, &addr_size);
-}
+	uint64_t index;
+	ui::StringView str;
+};
 
-int SocketSyncReadStream::Read(void* buf, int size)
+// reads from a buffer that may end in the middle of a record
+struct RecordReader
 {
-	if (done)
-		return 0;
-	int s = size;
-	auto p = (char*)buf;
-	while (s)
+	const char* pos;
+	const char* end;
+	bool ok = true;
+
+	char ReadByte()
 	{
-		int ret = ::recv(rs, p, s, 0);
-		if (ret == 0)
+		if (pos == end)
 		{
-			done = true;
-			break;
+			ok = false;
+			return 0;
 		}
-		if (ret == -1)
+		return *pos++;
+	}
+	uint64_t ReadULEB()
+	{
+		uint64_t result = 0;
+		int shift = 0;
+		for (;;)
+		{
+			uint8_t b = uint8_t(ReadByte());
+			if (!ok)
+				return 0;
+			result |= uint64_t(b & 0x7f) << shift;
+			if (!(b & 0x80))
+				break;
+			shift += 7;
+		}
+		return result;
+	}
+	ui::StringView ReadString()
+	{
+		uint64_t len = ReadULEB();
+		if (!ok || len > uint64_t(end - pos))
 		{
-			fprintf(stderr, "failed to recv\n");
-			continue;
+			ok = false;
+			return {};
 		}
-		p += ret;
-		s -= ret;
+		ui::StringView s(pos, size_t(len));
+		pos += len;
+		return s;
 	}
-	return size - s;
+	// 0 + a new name or the index of a previous one + 1
+	NameRef ReadName()
+	{
+		NameRef n = { ReadULEB(), {} };
+		if (ok && n.index == 0)
+			n.str = ReadString();
+		return n;
+	}
+};
+
+
+size_t FileStructureTable::PoolHash::operator () (uint64_t off) const
+{
+	return std::hash<ui::StringView>()(table->GetString(off));
 }
 
+bool FileStructureTable::PoolEqual::operator () (uint64_t a, uint64_t b) const
+{
+	return table->GetString(a) == table->GetString(b);
+}
 
-char StructureParser::ReadNext(ISyncReadStream* s)
+FileStructureTable::FileStructureTable() : _stringSet(64, PoolHash{ this }, PoolEqual{ this })
 {
-	char type;
-	if (!s->Read(&type, 1))
-		return 0;
+	// the empty string is at 0
+	Intern({});
 
-	if (type == '{')
+	Node root = {};
+	root.kind = '{';
+	root.parent = UINT32_MAX;
+	nodes.push_back(root);
+	_openNodes = { ROOT };
+	_openChildren.emplace_back();
+}
+
+void FileStructureTable::Feed(const void* data, size_t size)
+{
+	_pending.insert(_pending.end(), (const char*)data, (const char*)data + size);
+	size_t pos = 0;
+	while (pos < _pending.size())
 	{
-		name.resize((size_t)s->ReadULEB());
-		if (s->Read(&name[0], name.size()) != name.size())
-			return 0; // failed to read the whole string
+		size_t used = _ParseRecord(_pending.data() + pos, _pending.size() - pos);
+		if (!used)
+			break;
+		pos += used;
 	}
-	else if (type == 'F')
+	_pending.erase(_pending.begin(), _pending.begin() + pos);
+}
+
+void FileStructureTable::Finish()
+{
+	while (!_openNodes.empty())
+		_CloseNode();
+	_pending.clear();
+	finished = true;
+}
+
+size_t FileStructureTable::_ParseRecord(const char* data, size_t size)
+{
+	RecordReader r = { data, data + size };
+	char type = r.ReadByte();
+	switch (type)
 	{
-		if (!s->Read(&typeCode, 1))
+	case '{': {
+		auto name = r.ReadName();
+		if (!r.ok)
+			return 0;
+		uint32_t id = _AddNode('{');
+		nodes[id].name = _ResolveName(name.index, name.str);
+		// children are collected until the node is closed
+		nodes[id].childStart = uint32_t(_openNodes.size());
+		_openNodes.push_back(id);
+		_openChildren.emplace_back();
+		break; }
+	case '}':
+		// the root is only closed by Finish
+		if (_openNodes.size() > 1)
+			_CloseNode();
+		break;
+	case 'F': {
+		char typeCode = r.ReadByte();
+		char typeSize = r.ReadByte();
+		uint64_t fileOffset = r.ReadULEB();
+		uint64_t arraySize = r.ReadULEB();
+		auto name = r.ReadName();
+		auto preview = r.ReadString();
+		if (!r.ok)
 			return 0;
-		if (!s->Read(&typeSizeBytes, 1))
+		uint32_t id = _AddNode('F');
+		auto& N = nodes[id];
+		N.typeCode = typeCode;
+		N.typeSizeBits = uint8_t((typeSize - '0') * 8);
+		N.fileOffset = fileOffset;
+		N.arraySize = arraySize;
+		N.name = _ResolveName(name.index, name.str);
+		N.preview = Append(preview);
+		break; }
+	case 'I': {
+		auto name = r.ReadName();
+		auto preview = r.ReadString();
+		if (!r.ok)
 			return 0;
-		typeSizeBytes = (typeSizeBytes - '0') * 8;
-		fileOffset = s->ReadULEB();
-		arraySize = s->ReadULEB();
+		uint32_t id = _AddNode('I');
+		nodes[id].name = _ResolveName(name.index, name.str);
+		nodes[id].preview = Append(preview);
+		break; }
+	default:
+		if (!r.ok)
+			return 0;
+		// other records have no data
+		break;
+	}
+	return r.pos - data;
+}
 
-		name.resize((size_t)s->ReadULEB());
-		if (s->Read(&name[0], name.size()) != name.size())
-			return 0; // failed to read the whole string
+uint32_t FileStructureTable::_AddNode(char kind)
+{
+	uint32_t id = uint32_t(nodes.size());
+	Node N = {};
+	N.kind = kind;
+	N.parent = _openNodes.back();
+	N.closed = kind != '{';
+	nodes.push_back(N);
+	nodes[N.parent].numChildren++;
+	_openChildren.back().push_back(id);
+	return id;
+}
 
-		preview.resize((size_t)s->ReadULEB());
-		if (s->Read(&preview[0], preview.size()) != preview.size())
-			return 0; // failed to read the whole string
-	}
-	else if (type == 'I')
+void FileStructureTable::_CloseNode()
+{
+	auto& N = nodes[_openNodes.back()];
+	N.childStart = uint32_t(childIndices.size());
+	childIndices.insert(childIndices.end(), _openChildren.back().begin(), _openChildren.back().end());
+	N.closed = true;
+	_openNodes.pop_back();
+	_openChildren.pop_back();
+}
+
+uint64_t FileStructureTable::_ResolveName(uint64_t index, ui::StringView str)
+{
+	if (index == 0)
 	{
-		name.resize((size_t)s->ReadULEB());
-		if (s->Read(&name[0], name.size()) != name.size())
-			return 0; // failed to read the whole string
+		uint64_t off = Intern(str);
+		_names.push_back(off);
+		return off;
+	}
+	// unknown indices get an empty name
+	return index <= _names.size() ? _names[size_t(index - 1)] : 0;
+}
+
+uint32_t FileStructureTable::GetChild(uint32_t id, size_t which) const
+{
+	const auto& N = nodes[id];
+	if (N.closed)
+		return childIndices[N.childStart + which];
+	return _openChildren[N.childStart][which];
+}
+
+ui::StringView FileStructureTable::GetString(uint64_t off) const
+{
+	uint32_t len;
+	memcpy(&len, &_strings[size_t(off)], sizeof(len));
+	return { &_strings[size_t(off) + sizeof(len)], len };
+}
 
-		preview.resize((size_t)s->ReadULEB());
-		if (s->Read(&preview[0], preview.size()) != preview.size())
-			return 0; // failed to read the whole string
+uint64_t FileStructureTable::Append(ui::StringView s)
+{
+	uint64_t off = _strings.size();
+	uint32_t len = uint32_t(s.size());
+	_strings.insert(_strings.end(), (const char*)&len, (const char*)&len + sizeof(len));
+	_strings.insert(_strings.end(), s.data(), s.data() + s.size());
+	return off;
+}
+
+uint64_t FileStructureTable::Intern(ui::StringView s)
+{
+	// added at the end to be looked up, removed if it is already there
+	uint64_t off = Append(s);
+	auto it = _stringSet.find(off);
+	if (it != _stringSet.end())
+	{
+		_strings.resize(size_t(off));
+		return *it;
 	}
-	// no data for }
-	return type;
+	_stringSet.insert(off);
+	return off;
 }
 
+std::string FileStructureTable::GetTypeText(uint32_t id) const
+{
+	const auto& N = nodes[id];
+	if (N.kind != 'F')
+		return {};
+	if (N.arraySize > 1)
+		return ui::Format("%c%d[%" PRIu64 "]", N.typeCode, int(N.typeSizeBits), N.arraySize);
+	return ui::Format("%c%d", N.typeCode, int(N.typeSizeBits));
+}
 
-void FileStructureViewer::Build()
+
+// adds the batches to the table, notifying DCT_FileStructure at most every STRUCTURE_NOTIFY_INTERVAL
+struct StructureFeeder
 {
-	FileSyncReadStream fsrs("sockdump.txt");
-	StructureParser sp;
-	int curLevel = 0;
-	int openLevel = 0;
-	size_t idalloc = 0;
-	bool hasOpenData = !openness.empty();
-	for (;;)
+	FileStructureTable& table;
+	double lastNotify = 0;
+
+	StructureFeeder(FileStructureTable& t) : table(t) {}
+	void Add(const void* data, size_t size)
 	{
-		char type = sp.ReadNext(&fsrs);
-		if (type == 0)
-			break;
-		switch (type)
 		{
-		case '{':
+			std::lock_guard<std::mutex> g(table.mutex);
+			table.Feed(data, size);
+		}
+		double t = ui::hqtime();
+		if (t - lastNotify >= STRUCTURE_NOTIFY_INTERVAL)
 		{
-			size_t id = idalloc++;
-			if (!hasOpenData)
-				openness.push_back(false);
-			if (curLevel == openLevel)
-			{
-				auto& item = ui::Push<ui::CollapsibleTreeNode>();
-				if (ui::LastIsNew())
-					item.open = openness[id];
-				else
-					openness[id] = item.open;
-
-				if (item.open)
-					openLevel++;
-				ui::Text(sp.name.c_str());
-			}
-			curLevel++;
-			break;
+			lastNotify = t;
+			Notify();
+		}
+	}
+	void End()
+	{
+		{
+			std::lock_guard<std::mutex> g(table.mutex);
+			table.Finish();
 		}
-		case '}':
-			if (curLevel - 1 == openLevel)
-			{
-				ui::Pop();
-			}
-			else if (curLevel == openLevel)
-			{
-				ui::Pop();
-				openLevel--;
-			}
-			curLevel--;
+		Notify();
+	}
+	void Notify()
+	{
+		// only the address is used, the table may be gone by the time the event runs
+		uintptr_t at = reinterpret_cast<uintptr_t>(&table);
+		ui::Application::PushEvent([at]() { ui::Notify(DCT_FileStructure, at); });
+	}
+};
+
+void LoadFileStructure(ISyncReadStream* s, FileStructureTable& table, ui::WorkerQueue& queue)
+{
+	StructureFeeder feeder(table);
+	std::vector<char> batch;
+	while (!queue.IsQuitting())
+	{
+		// each batch is a 32-bit size followed by whole records
+		uint32_t size = 0;
+		if (s->Read(&size, sizeof(size)) != sizeof(size) || size > STRUCTURE_MAX_BATCH_SIZE)
 			break;
-		case 'F':
-			if (curLevel == openLevel)
-			{
-				std::stringstream text;
-				text << sp.name << " (" << sp.typeCode << int(sp.typeSizeBytes);
-				if (sp.arraySize > 1)
-				{
-					text << "[" << sp.arraySize << "]";
-				}
-				text << ") = " << sp.preview;
-				ui::Text(text.str().c_str());
-			}
+		batch.resize(size);
+		if (s->Read(batch.data(), int(size)) != int(size))
 			break;
-		}
+		feeder.Add(batch.data(), batch.size());
 	}
+	feeder.End();
 }
 
+struct PluginRunContext
+{
+	StructureFeeder feeder;
+	ui::WorkerQueue& queue;
+};
 
-void FileStructureDataSource::Parse(ISyncReadStream* srs, StructureParser& sp, Node* parent)
+static void PluginWrite(void* userdata, const void* batch, uint32_t size)
 {
-	for (;;)
+	static_cast<PluginRunContext*>(userdata)->feeder.Add(batch, size);
+}
+
+static int PluginCancel(void* userdata)
+{
+	return static_cast<PluginRunContext*>(userdata)->queue.IsQuitting();
+}
+
+bool RunStructurePlugin(const char* dllPath, IDataSource* ds, FileStructureTable& table, ui::WorkerQueue& queue)
+{
+	// the plugins expect the whole file in memory, copying it could take too much so the executable reads it instead
+	uint64_t size = ds->GetSize();
+	const void* data = ds->GetSpan(0, size);
+	if (!data && size)
+		return false;
+
+	HMODULE lib = LoadLibraryA(dllPath);
+	if (!lib)
+		return false;
+	auto* parse = (FRETPluginParseFunc*)GetProcAddress(lib, "fret_plugin_parse");
+	if (!parse)
 	{
-		char type = sp.ReadNext(srs);
-		if (type == 0)
-			break;
-		switch (type)
-		{
-		case '{':
-		{
-			auto* n = new Node;
-			n->name = sp.name;
-			parent->children.push_back(n);
-			Parse(srs, sp, n);
-			break;
-		}
-		case '}':
-			return;
-		case 'F':
-		{
-			auto* n = new Node;
-			n->name = sp.name;
-			std::stringstream text;
-			text << sp.typeCode << int(sp.typeSizeBytes);
-			if (sp.arraySize > 1)
-			{
-				text << "[" << sp.arraySize << "]";
-			}
-			n->type = text.str();
-			n->preview = sp.preview;
-			parent->children.push_back(n);
-			break;
-		}
-		case 'I':
+		FreeLibrary(lib);
+		return false;
+	}
+
+	PluginRunContext ctx = { { table }, queue };
+	FRETPluginHost host = {};
+	host.version = FRET_PLUGIN_ABI_VERSION;
+	host.data = data;
+	host.size = size;
+	host.position = 0;
+	host.type = nullptr;
+	host.write = PluginWrite;
+	host.cancel = PluginCancel;
+	host.userdata = &ctx;
+	if (parse(&host) != 0)
+	{
+		// only fails before sending anything (e.g. the version is different)
+		FreeLibrary(lib);
+		return false;
+	}
+	ctx.feeder.End();
+
+	FreeLibrary(lib);
+	return true;
+}
+
+void RunStructurePluginForFile(const std::string& path, FileStructureTable& table, ui::WorkerQueue& queue)
+{
+	auto ext = strrchr(path.c_str(), '.');
+	std::string plugin = ext ? ext + 1 : "";
+	std::string dllPath = "FRET_Plugins/" + plugin + ".dll";
+	std::string filePath = path;
+	if (filePath.size() < 2 || filePath[1] != ':')
+		filePath = "FRET_Plugins/" + filePath;
+	IDataSource* ds = OpenFileDataSource(filePath.c_str());
+	bool ran = RunStructurePlugin(dllPath.c_str(), ds, table, queue);
+	delete ds;
+	if (ran)
+		return;
+
+	PipeSyncReadStream psrs("FRET_Plugins/" + plugin + ".exe", "-f \"" + path + "\" -o -", "FRET_Plugins");
+	LoadFileStructure(&psrs, table, queue);
+}
+
+
+void FileStructureViewer::ParseAll(const char* path)
+{
+	_queue.Push([this, path{ std::string(path) }]()
+	{
+		RunStructurePluginForFile(path, table, _queue);
+	});
+}
+
+void FileStructureViewer::Build()
+{
+	Subscribe(DCT_FileStructure, &table);
+
+	std::lock_guard<std::mutex> g(table.mutex);
+	openness.resize(table.nodes.size(), false);
+	const auto& root = table.nodes[FileStructureTable::ROOT];
+	for (uint32_t i = 0; i < root.numChildren; i++)
+		BuildNode(table.GetChild(FileStructureTable::ROOT, i));
+}
+
+void FileStructureViewer::BuildNode(uint32_t id)
+{
+	const auto& N = table.nodes[id];
+	if (N.kind == '{')
+	{
+		auto& item = ui::Push<ui::CollapsibleTreeNode>();
+		if (ui::LastIsNew())
+			item.open = openness[id];
+		else
+			openness[id] = item.open;
+		ui::Text(table.GetString(N.name));
+
+		if (item.open)
 		{
-			auto* n = new Node;
-			n->name = sp.name;
-			n->preview = sp.preview;
-			parent->children.push_back(n);
-			break;
-		}
+			for (uint32_t i = 0; i < N.numChildren; i++)
+				BuildNode(table.GetChild(id, i));
 		}
+		ui::Pop();
+	}
+	else if (N.kind == 'F')
+	{
+		ui::Text(ui::Format("%s (%s) = %s",
+			ui::to_string(table.GetString(N.name)).c_str(),
+			table.GetTypeText(id).c_str(),
+			ui::to_string(table.GetString(N.preview)).c_str()));
 	}
 }
@@ -3,6 +3,9 @@
 #include "pch.h"
 #include "FileReaders.h"
 
+#include <mutex>
+#include <unordered_set>
+
 
 struct ISyncReadStream
 {
@@ -30,79 +33,152 @@ struct FileSyncReadStream : ISyncReadStream
 	}
 };
 
-struct SocketSyncReadStream : ISyncReadStream
+// the output of a process (the plugins can write to stdout instead of a socket)
+// the process is killed if it's still writing when the stream is destroyed (e.g. the loading was cancelled)
+struct PipeSyncReadStream : ISyncReadStream
 {
-	SOCKET s = -1;
-	SOCKET rs = -1;
-	bool done = false;
-
-	SocketSyncReadStream(int port);
-	~SocketSyncReadStream();
-	void Accept();
+	// `exePath` is relative to the current directory, `dir` is the working directory of the process
+	PipeSyncReadStream(const std::string& exePath, const std::string& args, const char* dir);
+	~PipeSyncReadStream();
 	int Read(void* buf, int size);
+
+	HANDLE _process = nullptr;
+	HANDLE _pipe = nullptr;
+	// the whole output was read
+	bool _done = false;
 };
 
-struct StructureParser
+extern ui::DataCategoryTag DCT_FileStructure[1];
+
+// the parsed structure stream: nodes in stream order, children listed by index and strings stored once
+// records are added by Feed as they arrive (a batch at a time), incomplete ones wait for more data
+struct FileStructureTable
+{
+	static constexpr uint32_t ROOT = 0;
+
+	struct Node
+	{
+		uint32_t parent;
+		// closed nodes: the first in childIndices, open groups: the depth in _openChildren
+		uint32_t childStart;
+		uint32_t numChildren;
+		// offsets in the string pool
+		uint64_t name;
+		uint64_t preview;
+		// '{' (group), 'F' (field) or 'I' (info)
+		char kind;
+		char typeCode;
+		uint8_t typeSizeBits;
+		bool closed;
+		uint64_t fileOffset;
+		uint64_t arraySize;
+	};
+
+	FileStructureTable();
+	FileStructureTable(const FileStructureTable&) = delete;
+
+	void Feed(const void* data, size_t size);
+	// closes the nodes that are still open
+	void Finish();
+	size_t _ParseRecord(const char* data, size_t size);
+	uint32_t _AddNode(char kind);
+	void _CloseNode();
+	uint64_t _ResolveName(uint64_t index, ui::StringView str);
+
+	uint32_t GetChild(uint32_t id, size_t which) const;
+	ui::StringView GetString(uint64_t off) const;
+	// adds the string without looking for a copy (for the previews, which rarely repeat)
+	uint64_t Append(ui::StringView s);
+	uint64_t Intern(ui::StringView s);
+	// e.g. "u32[4]", empty for groups and info
+	std::string GetTypeText(uint32_t id) const;
+
+	// locked by the loader while feeding
+	std::mutex mutex;
+	bool finished = false;
+	std::vector<Node> nodes;
+	std::vector<uint32_t> childIndices;
+
+	struct PoolHash
+	{
+		const FileStructureTable* table;
+		size_t operator () (uint64_t off) const;
+	};
+	struct PoolEqual
+	{
+		const FileStructureTable* table;
+		bool operator () (uint64_t a, uint64_t b) const;
+	};
+	// each string is stored as a 32-bit length followed by the bytes
+	std::vector<char> _strings;
+	// the interned strings
+	std::unordered_set<uint64_t, PoolHash, PoolEqual> _stringSet;
+	// the path to the last added group and the children of each
+	std::vector<uint32_t> _openNodes;
+	std::vector<std::vector<uint32_t>> _openChildren;
+	std::vector<char> _pending;
+	// the names sent so far (string pool offsets), later records refer to them by index
+	std::vector<uint64_t> _names;
+};
+
+// reads the stream until the end a batch at a time, notifying DCT_FileStructure (with the table) as it grows
+void LoadFileStructure(ISyncReadStream* s, FileStructureTable& table, ui::WorkerQueue& queue);
+
+// the interface of the plugins built as DLLs (must match the copy in FRET_Plugins/plugin.hpp)
+#define FRET_PLUGIN_ABI_VERSION 1
+struct FRETPluginHost
 {
-	char ReadNext(ISyncReadStream* s);
-
-	std::string name;
-	std::string preview;
-	char typeCode;
-	char typeSizeBytes;
-	uint64_t fileOffset;
-	uint64_t arraySize;
+	uint32_t version;
+	const void* data;
+	uint64_t size;
+	uint64_t position;
+	const char* type;
+	// receives the same batches as LoadFileStructure
+	void (*write)(void* userdata, const void* batch, uint32_t size);
+	int (*cancel)(void* userdata);
+	void* userdata;
 };
+typedef int FRETPluginParseFunc(const FRETPluginHost* host);
+
+// runs the parser of a plugin DLL on this thread, directly on the mapped data
+// the batches are added to the table as with LoadFileStructure
+// returns false if the plugin could not be loaded or the data is not mapped
+bool RunStructurePlugin(const char* dllPath, IDataSource* ds, FileStructureTable& table, ui::WorkerQueue& queue);
+
+// parses the file with the plugin for its extension on this thread
+// the DLL version of the plugin is used if there is one, otherwise its output is read through a pipe
+void RunStructurePluginForFile(const std::string& path, FileStructureTable& table, ui::WorkerQueue& queue);
 
 struct FileStructureViewer : ui::Buildable
 {
-	FileStructureViewer()
-	{
-		::system("cd FRET_Plugins && set RAW=1 && a > ../sockdump.txt");
-	}
+	// the nodes are added as the plugin sends them
+	void ParseAll(const char* path);
 	void Build() override;
+	// only the children of open nodes are created
+	void BuildNode(uint32_t id);
 
+	FileStructureTable table;
 	std::vector<bool> openness;
+
+	// last so that the worker is stopped first
+	ui::WorkerQueue _queue;
 };
 
 struct FileStructureDataSource : ui::TreeDataSource
 {
-	struct Node
-	{
-		~Node()
-		{
-			for (auto* ch : children)
-				delete ch;
-		}
-
-		std::string name, type, preview;
-		std::vector<Node*> children;
-	};
-
 	FileStructureDataSource(const char* path)
 	{
 		ParseAll(path);
 	}
 
-	static DWORD __stdcall func(void* arg)
-	{
-		auto path = (const char*)arg;
-		auto ext = strrchr(path, '.');
-		char buf[256];
-		sprintf(buf, "cd FRET_Plugins && %s.exe -f \"%s\" -s 12345", ext + 1, path);
-		::system(buf);
-		return 0;
-	}
+	// the nodes are added as the plugin sends them
 	void ParseAll(const char* path)
 	{
-		SocketSyncReadStream ssrs(12345);
-		HANDLE h = CreateThread(NULL, 1024 * 64, func, (void*)path, 0, NULL);
-		ssrs.Accept();
-		StructureParser sp;
-		Parse(&ssrs, sp, &root);
-		WaitForSingleObject(h, INFINITE);
+		_queue.Push([this, path{ std::string(path) }]()
+		{
+			RunStructurePluginForFile(path, table, _queue);
+		});
 	}
-	void Parse(ISyncReadStream* srs, StructureParser& sp, Node* parent);
 
 	size_t GetNumCols() override { return 3; }
 	std::string GetColName(size_t col) override
@@ -117,32 +193,41 @@ struct FileStructureDataSource : ui::TreeDataSource
 	}
 	size_t GetChildCount(uintptr_t id) override
 	{
-		if (id == ROOT) id = uintptr_t(&root);
-		return reinterpret_cast<Node*>(id)->children.size();
+		if (id == ROOT) id = FileStructureTable::ROOT;
+		std::lock_guard<std::mutex> g(table.mutex);
+		return table.nodes[id].numChildren;
 	}
 	uintptr_t GetChild(uintptr_t id, size_t which) override
 	{
-		if (id == ROOT) id = uintptr_t(&root);
-		return uintptr_t(reinterpret_cast<Node*>(id)->children[which]);
+		if (id == ROOT) id = FileStructureTable::ROOT;
+		std::lock_guard<std::mutex> g(table.mutex);
+		return table.GetChild(uint32_t(id), which);
 	}
 	std::string GetText(uintptr_t id, size_t col) override
 	{
+		std::lock_guard<std::mutex> g(table.mutex);
+		const auto& N = table.nodes[id];
 		switch (col)
 		{
-		case 0: return reinterpret_cast<Node*>(id)->name;
-		case 1: return reinterpret_cast<Node*>(id)->type;
-		case 2: return reinterpret_cast<Node*>(id)->preview;
+		case 0: return ui::to_string(table.GetString(N.name));
+		case 1: return table.GetTypeText(uint32_t(id));
+		case 2: return ui::to_string(table.GetString(N.preview));
 		default: return "";
 		}
 	}
 
-	Node root;
+	FileStructureTable table;
+
+	// last so that the worker is stopped first
+	ui::WorkerQueue _queue;
 };
 
 struct FileStructureViewer2 : ui::Buildable
 {
 	void Build() override
 	{
+		Subscribe(DCT_FileStructure, &ds->table);
+
 		auto& trv = ui::Make<ui::TreeView>();
 		trv.GetStyle().SetHeight(ui::Coord::Percent(100));
 		trv.SetDataSource(ds);
@@ -52,9 +52,12 @@ void FileView::Build()
 	}
 	ui::Pop(); // end tree stabilization box
 
+	of->patternIndexer.Update();
+	Subscribe(DCT_PatternIndex, &of->patternIndexer);
+
 	auto& hv = ui::Make<HexViewer>();
 	curHexViewer = &hv;
-	hv.Init(&workspace->desc, of->ddFile, &of->hexViewerState, &of->highlightSettings);
+	hv.Init(&workspace->desc, of->ddFile, &of->hexViewerState, &of->highlightSettings, &of->patternIndexer);
 	hv.HandleEvent(ui::EventType::ButtonUp) = [this](ui::Event& e)
 	{
 		if (e.GetButton() == ui::MouseButton::Right)
@@ -179,6 +182,7 @@ DDStruct* FileView::CreateBlankStruct(int64_t pos)
 		ns->size = abs(int(of->hexViewerState.selectionEnd - of->hexViewerState.selectionStart)) + 1;
 	}
 	workspace->desc.structs[ns->name] = ns;
+	ns->OnEdit();
 	workspace->desc.SetCurrentInstance(workspace->desc.AddInstance({ -1LL, &workspace->desc, ns, of->ddFile, off, "", CreationReason::UserDefined }));
 	return ns;
 }
@@ -201,6 +205,7 @@ DDStruct* FileView::CreateStructFromMarkers(int64_t pos)
 			ns->fields.push_back(f),
 			false;);
 	}
+	ns->OnEdit();
 	return ns;
 }
 
@@ -2,6 +2,12 @@
 #include "pch.h"
 #include "HexViewer.h"
 
+#include "PatternIndex.h"
+#include "SimdHelpers.h"
+
+
+static constexpr float MINIMAP_CLASS_WIDTH = 3;
+
 
 void HexViewerState::GoToPos(int64_t pos)
 {
@@ -170,10 +176,59 @@ static bool IsASCII(uint8_t v)
 	return v >= 0x20 && v < 0x7f;
 }
 
-static void Highlight(HighlightSettings* hs, DataDesc* desc, DDFile* file, uint64_t basePos, ByteColors* outColors, uint8_t* bytes, size_t numBytes)
+struct HighlightScratch
+{
+	// padded copy of the bytes so that the classifiers can load past the end
+	std::vector<uint8_t> bytes;
+	// nonzero if the hex/ASCII color is already set
+	std::vector<uint8_t> hexUsed;
+	std::vector<uint8_t> asciiUsed;
+	std::vector<uint16_t> candidates;
+	std::vector<uint16_t> customInt32;
+	std::vector<uint16_t> float32;
+	std::vector<uint16_t> nearFileSize32;
+	std::vector<uint16_t> int32;
+	std::vector<uint32_t> ids;
+	std::vector<DDStructInst*> insts;
+};
+static HighlightScratch g_highlightScratch;
+
+static void BlendHex(ByteColors* outColors, uint8_t* hexUsed, size_t at, size_t size, const ui::Color4f& col)
+{
+	for (size_t i = at; i < at + size; i++)
+	{
+		outColors[i].hexColor.BlendOver(col);
+		hexUsed[i] = outColors[i].hexColor.a != 0;
+	}
+}
+
+void UpdateMarkerTree(DDFile* file)
+{
+	const auto& markers = file->markerData.markers;
+	if (file->markerTreeVersion != file->markerData.editVersion || file->markerTree.Size() != markers.size())
+	{
+		file->markerTree.Clear();
+		for (size_t i = 0; i < markers.size(); i++)
+			file->markerTree.Add(markers[i].at, markers[i].GetEnd(), uint32_t(i));
+		file->markerTree.Build();
+		file->markerTreeVersion = file->markerData.editVersion;
+	}
+}
+
+void Highlight(HighlightSettings* hs, DataDesc* desc, DDFile* file, uint64_t basePos, ByteColors* outColors, const uint8_t* bytes, size_t numBytes)
 {
-	for (auto& M : file->markerData.markers)
+	auto& S = g_highlightScratch;
+	size_t numBlocks = (numBytes + 15) / 16;
+
+	UpdateMarkerTree(file);
+
+	// markers and instances are blended in list order
+	S.ids.clear();
+	file->markerTree.Query(basePos, basePos + numBytes, S.ids);
+	std::sort(S.ids.begin(), S.ids.end());
+	for (uint32_t id : S.ids)
 	{
+		const auto& M = file->markerData.markers[id];
 		uint64_t start = M.at;
 		uint64_t end = M.GetEnd();
 		size_t ss = start > basePos ? start - basePos : 0;
@@ -199,153 +254,213 @@ static void Highlight(HighlightSettings* hs, DataDesc* desc, DDFile* file, uint6
 		}
 	}
 
-	for (auto* SI : desc->instances)
+	// instances are marked at their start
+	S.insts.clear();
+	desc->instIndex.QueryRange(file, basePos, basePos + numBytes, S.insts);
+	std::sort(S.insts.begin(), S.insts.end(), [](const DDStructInst* a, const DDStructInst* b) { return a->id < b->id; });
+	for (auto* SI : S.insts)
 	{
-		if (SI->file != file)
+		if (SI->off < int64_t(basePos))
 			continue;
-		if (SI->off >= int64_t(basePos) && SI->off < int64_t(basePos + numBytes))
-		{
-			outColors[SI->off - basePos].leftBracketColor.BlendOver(SI == desc->curInst ? colorCurInst : colorInst);
-		}
+		outColors[SI->off - basePos].leftBracketColor.BlendOver(SI == desc->curInst ? colorCurInst : colorInst);
 	}
 
 	// auto highlights
-	if (hs->enableNearFileSize64)
+	// candidates are classified 16 offsets at a time, then applied in order since each one blocks the following overlapping ones
+	S.bytes.resize(numBlocks * 16 + 32);
+	memcpy(S.bytes.data(), bytes, numBytes);
+	memset(S.bytes.data() + numBytes, 0, S.bytes.size() - numBytes);
+	S.hexUsed.resize(numBlocks * 16 + 16);
+	S.asciiUsed.resize(numBlocks * 16 + 16);
+	for (size_t i = 0; i < numBytes; i++)
 	{
-		for (size_t i = 0; i + 8 < numBytes; i++)
-		{
-			if (outColors[i].hexColor.a ||
-				outColors[i + 1].hexColor.a ||
-				outColors[i + 2].hexColor.a ||
-				outColors[i + 3].hexColor.a ||
-				outColors[i + 4].hexColor.a ||
-				outColors[i + 5].hexColor.a ||
-				outColors[i + 6].hexColor.a ||
-				outColors[i + 7].hexColor.a)
-				continue;
-			if (hs->excludeZeroes &&
-				bytes[i] == 0 &&
-				bytes[i + 1] == 0 &&
-				bytes[i + 2] == 0 &&
-				bytes[i + 3] == 0 &&
-				bytes[i + 4] == 0 &&
-				bytes[i + 5] == 0 &&
-				bytes[i + 6] == 0 &&
-				bytes[i + 7] == 0)
-				continue;
+		S.hexUsed[i] = outColors[i].hexColor.a != 0;
+		S.asciiUsed[i] = outColors[i].asciiColor.a != 0;
+	}
+	memset(S.hexUsed.data() + numBytes, 0, S.hexUsed.size() - numBytes);
+	memset(S.asciiUsed.data() + numBytes, 1, S.asciiUsed.size() - numBytes);
+	S.candidates.resize(numBlocks);
 
-			if (hs->enableNearFileSize64)
+	const uint8_t* data = S.bytes.data();
+	uint8_t* hexUsed = S.hexUsed.data();
+	const __m128i zero = _mm_setzero_si128();
+	uint64_t fsz = file->dataSource->GetSize();
+	uint64_t minNearFileSize = GetMinIntNotBelow(fsz * (hs->nearFileSizePercent * 0.01f));
+
+	if (hs->enableNearFileSize64 && numBytes > 8 && minNearFileSize <= fsz)
+	{
+		size_t end = numBytes - 8;
+		__m128i vmin = _mm_set1_epi64x(int64_t(minNearFileSize));
+		__m128i vmax = _mm_set1_epi64x(int64_t(fsz));
+		for (size_t b = 0; b < numBlocks; b++)
+		{
+			unsigned match = 0;
+			unsigned nonzero = 0;
+			for (int k = 0; k < 8; k++)
 			{
-				uint64_t v;
-				memcpy(&v, &bytes[i], 8);
-				auto fsz = file->dataSource->GetSize();
-				if (v >= fsz * (hs->nearFileSizePercent * 0.01f) && v <= fsz)
-				{
-					for (int j = 0; j < 8; j++)
-						outColors[i + j].hexColor.BlendOver(colorNearFileSize32);
-				}
+				__m128i v = _mm_loadu_si128((const __m128i*)(data + b * 16 + k));
+				match |= SpreadLanes2(MoveMask64(InRangeU64(v, vmin, vmax))) << k;
+				nonzero |= SpreadLanes2(MoveMask64(IsZero64(v)) ^ 3) << k;
 			}
+			if (hs->excludeZeroes)
+				match &= nonzero;
+			S.candidates[b] = uint16_t(match & GetBlockLimitMask(b, end));
 		}
+
+		ForEachSetBit(S.candidates.data(), numBlocks, [&](size_t i)
+		{
+			uint64_t used;
+			memcpy(&used, &hexUsed[i], 8);
+			if (!used)
+				BlendHex(outColors, hexUsed, i, 8, colorNearFileSize32);
+		});
 	}
 
 	if (hs->enableFloat32 || hs->enableInt32 || hs->enableNearFileSize32 || !hs->customInt32.empty())
 	{
-		for (size_t i = 0; i + 4 < numBytes; i++)
+		size_t end = numBytes > 4 ? numBytes - 4 : 0;
+		bool anyCustom = false;
+		for (const auto& h : hs->customInt32)
+			anyCustom |= h.enabled;
+		uint64_t maxNearFileSize32 = std::min(fsz, uint64_t(UINT32_MAX));
+		bool nearFileSize32 = hs->enableNearFileSize32 && minNearFileSize <= maxNearFileSize32;
+
+		__m128 fmin = _mm_set1_ps(hs->minFloat32);
+		__m128 fmax = _mm_set1_ps(hs->maxFloat32);
+		__m128 nfmin = _mm_set1_ps(-hs->minFloat32);
+		__m128 nfmax = _mm_set1_ps(-hs->maxFloat32);
+		__m128i nfsmin = _mm_set1_epi32(int32_t(uint32_t(minNearFileSize)));
+		__m128i nfsmax = _mm_set1_epi32(int32_t(uint32_t(maxNearFileSize32)));
+		__m128i imin = _mm_set1_epi32(hs->minInt32);
+		__m128i imax = _mm_set1_epi32(hs->maxInt32);
+
+		S.customInt32.resize(numBlocks);
+		S.float32.resize(numBlocks);
+		S.nearFileSize32.resize(numBlocks);
+		S.int32.resize(numBlocks);
+		for (size_t b = 0; b < numBlocks; b++)
 		{
-			if (outColors[i].hexColor.a ||
-				outColors[i + 1].hexColor.a ||
-				outColors[i + 2].hexColor.a ||
-				outColors[i + 3].hexColor.a)
-				continue;
-			if (hs->excludeZeroes && bytes[i] == 0 && bytes[i + 1] == 0 && bytes[i + 2] == 0 && bytes[i + 3] == 0)
-				continue;
-
-			bool detected = false;
-
-			int32_t i32v;
-			memcpy(&i32v, &bytes[i], 4);
-
-			if (!hs->customInt32.empty())
+			unsigned mCustom = 0, mFloat = 0, mNearFileSize = 0, mInt = 0, mNonzero = 0;
+			for (int k = 0; k < 4; k++)
 			{
-				for (const auto& h : hs->customInt32)
+				__m128i v = _mm_loadu_si128((const __m128i*)(data + b * 16 + k));
+				if (anyCustom)
 				{
-					if (!h.enabled)
-						continue;
-					if (!h.range ? h.vspec == i32v :
-						h.vmin <= i32v && i32v <= h.vmax)
+					__m128i m = zero;
+					for (const auto& h : hs->customInt32)
 					{
-						for (int j = 0; j < 4; j++)
-							outColors[i + j].hexColor.BlendOver(h.color);
-						detected = true;
-						break;
+						if (!h.enabled)
+							continue;
+						m = _mm_or_si128(m, h.range ?
+							InRangeI32(v, _mm_set1_epi32(h.vmin), _mm_set1_epi32(h.vmax)) :
+							_mm_cmpeq_epi32(v, _mm_set1_epi32(h.vspec)));
 					}
+					mCustom |= SpreadLanes4(MoveMask32(m)) << k;
 				}
-			}
-
-			if (detected)
-				continue;
-
-			if (hs->enableFloat32)
-			{
-				float v;
-				memcpy(&v, &bytes[i], 4);
-				if ((v >= hs->minFloat32 && v <= hs->maxFloat32) || (v >= -hs->maxFloat32 && v <= -hs->minFloat32))
+				if (hs->enableFloat32)
 				{
-					for (int j = 0; j < 4; j++)
-						outColors[i + j].hexColor.BlendOver(colorFloat32);
+					__m128 f = _mm_castsi128_ps(v);
+					__m128 pos = _mm_and_ps(_mm_cmpge_ps(f, fmin), _mm_cmple_ps(f, fmax));
+					__m128 neg = _mm_and_ps(_mm_cmpge_ps(f, nfmax), _mm_cmple_ps(f, nfmin));
+					mFloat |= SpreadLanes4(_mm_movemask_ps(_mm_or_ps(pos, neg))) << k;
 				}
+				if (nearFileSize32)
+					mNearFileSize |= SpreadLanes4(MoveMask32(InRangeU32(v, nfsmin, nfsmax))) << k;
+				if (hs->enableInt32)
+					mInt |= SpreadLanes4(MoveMask32(InRangeI32(v, imin, imax))) << k;
+				mNonzero |= SpreadLanes4(MoveMask32(_mm_cmpeq_epi32(v, zero)) ^ 15) << k;
 			}
+			unsigned match = mCustom | mFloat | mNearFileSize | mInt;
+			if (hs->excludeZeroes)
+				match &= mNonzero;
+			S.candidates[b] = uint16_t(match & GetBlockLimitMask(b, end));
+			S.customInt32[b] = uint16_t(mCustom);
+			S.float32[b] = uint16_t(mFloat);
+			S.nearFileSize32[b] = uint16_t(mNearFileSize);
+			S.int32[b] = uint16_t(mInt);
+		}
 
-			if (hs->enableNearFileSize32)
-			{
-				uint32_t v;
-				memcpy(&v, &bytes[i], 4);
-				auto fsz = file->dataSource->GetSize();
-				if (v >= fsz * (hs->nearFileSizePercent * 0.01f) && v <= fsz)
-				{
-					for (int j = 0; j < 4; j++)
-						outColors[i + j].hexColor.BlendOver(colorNearFileSize32);
-				}
-			}
+		ForEachSetBit(S.candidates.data(), numBlocks, [&](size_t i)
+		{
+			uint32_t used;
+			memcpy(&used, &hexUsed[i], 4);
+			if (used)
+				return;
 
-			if (hs->enableInt32)
+			unsigned bit = 1U << (i % 16);
+			if (S.customInt32[i / 16] & bit)
 			{
-				if (i32v >= hs->minInt32 && i32v <= hs->maxInt32)
+				int32_t i32v;
+				memcpy(&i32v, &data[i], 4);
+				for (const auto& h : hs->customInt32)
 				{
-					for (int j = 0; j < 4; j++)
-						outColors[i + j].hexColor.BlendOver(colorInt32);
+					if (!h.enabled)
+						continue;
+					if (!h.range ? h.vspec == i32v :
+						h.vmin <= i32v && i32v <= h.vmax)
+					{
+						BlendHex(outColors, hexUsed, i, 4, h.color);
+						return;
+					}
 				}
 			}
-		}
+
+			if (S.float32[i / 16] & bit)
+				BlendHex(outColors, hexUsed, i, 4, colorFloat32);
+			if (S.nearFileSize32[i / 16] & bit)
+				BlendHex(outColors, hexUsed, i, 4, colorNearFileSize32);
+			if (S.int32[i / 16] & bit)
+				BlendHex(outColors, hexUsed, i, 4, colorInt32);
+		});
 	}
 
-	if (hs->enableInt16)
+	int32_t minInt16 = std::max(hs->minInt16, int32_t(INT16_MIN));
+	int32_t maxInt16 = std::min(hs->maxInt16, int32_t(INT16_MAX));
+	if (hs->enableInt16 && numBytes > 2 && minInt16 <= maxInt16)
 	{
-		for (size_t i = 0; i + 2 < numBytes; i++)
+		size_t end = numBytes - 2;
+		__m128i vmin = _mm_set1_epi16(int16_t(minInt16));
+		__m128i vmax = _mm_set1_epi16(int16_t(maxInt16));
+		for (size_t b = 0; b < numBlocks; b++)
 		{
-			if (outColors[i].hexColor.a ||
-				outColors[i + 1].hexColor.a)
-				continue;
-			if (hs->excludeZeroes && bytes[i] == 0 && bytes[i + 1] == 0)
-				continue;
-
-			int16_t v;
-			memcpy(&v, &bytes[i], 2);
-			if (v >= hs->minInt16 && v <= hs->maxInt16)
+			unsigned match = 0;
+			unsigned nonzero = 0;
+			for (int k = 0; k < 2; k++)
 			{
-				outColors[i].hexColor.BlendOver(colorInt32);
-				outColors[i + 1].hexColor.BlendOver(colorInt32);
+				__m128i v = _mm_loadu_si128((const __m128i*)(data + b * 16 + k));
+				match |= SpreadLanes8(MoveMask16(InRangeI16(v, vmin, vmax))) << k;
+				nonzero |= SpreadLanes8(MoveMask16(_mm_cmpeq_epi16(v, zero)) ^ 0xff) << k;
 			}
+			if (hs->excludeZeroes)
+				match &= nonzero;
+			S.candidates[b] = uint16_t(match & GetBlockLimitMask(b, end));
 		}
+
+		ForEachSetBit(S.candidates.data(), numBlocks, [&](size_t i)
+		{
+			uint16_t used;
+			memcpy(&used, &hexUsed[i], 2);
+			if (!used)
+				BlendHex(outColors, hexUsed, i, 2, colorInt32);
+		});
 	}
 
 	if (hs->enableASCII && hs->minASCIIChars > 0)
 	{
+		// bytes that are printable and not colored yet
+		for (size_t b = 0; b < numBlocks; b++)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(data + b * 16));
+			__m128i isASCII = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1f)), _mm_cmplt_epi8(v, _mm_set1_epi8(0x7f)));
+			__m128i isFree = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(S.asciiUsed.data() + b * 16)), zero);
+			S.candidates[b] = uint16_t(_mm_movemask_epi8(_mm_and_si128(isASCII, isFree)));
+		}
+
 		size_t start = SIZE_MAX;
 		bool prev = false;
 		for (size_t i = 0; i < numBytes; i++)
 		{
-			bool cur = outColors[i].asciiColor.a == 0 && IsASCII(bytes[i]);
+			bool cur = (S.candidates[i / 16] >> (i % 16)) & 1;
 			if (cur && !prev)
 				start = i;
 			else if (prev && !cur && i - start >= hs->minASCIIChars)
@@ -368,6 +483,16 @@ void HexViewer::OnEvent(ui::Event& e)
 {
 	int W = state->byteWidth;
 
+	if (e.type == ui::EventType::ButtonDown && e.GetButton() == ui::MouseButton::Left &&
+		patternIndexer && patternIndexer->index && GetMinimapRect().Contains(e.position))
+	{
+		auto r = GetMinimapRect();
+		float q = (e.position.y - r.y0) / r.GetHeight();
+		state->GoToPos(int64_t(q * patternIndexer->index->fileSize));
+		Rebuild();
+		return;
+	}
+
 	if (e.type == ui::EventType::ButtonDown)
 	{
 		if (e.GetButton() == ui::MouseButton::Left)
@@ -543,6 +668,57 @@ void HexViewer::OnPaint()
 		str[1] = IsASCII(v) ? v : '.';
 		ui::draw::TextLine(font, 12, x2 + xoff / 2, y + yoff, str + 1, colWhite);
 	}
+
+	PaintMinimap();
+}
+
+ui::UIRect HexViewer::GetMinimapRect()
+{
+	auto r = finalRectC;
+	r.x0 = r.x1 - MINIMAP_CLASS_WIDTH * PC__COUNT;
+	return r;
+}
+
+void HexViewer::PaintMinimap()
+{
+	auto* PI = patternIndexer ? patternIndexer->index.get() : nullptr;
+	if (!PI || !PI->fileSize)
+		return;
+
+	auto r = GetMinimapRect();
+	int rows = int(r.GetHeight());
+	if (rows <= 0)
+		return;
+	ui::draw::RectCol(r.x0, r.y0, r.x1, r.y1, ui::Color4b(0, 127));
+
+	// one column per class, rows show the highest density in their range
+	for (int pc = 0; pc < PC__COUNT; pc++)
+	{
+		const auto& D = PI->density[pc];
+		if (D.empty())
+			continue;
+		ui::Color4f col = GetPatternClassColor(PatternClass(pc));
+		float x0 = r.x0 + pc * MINIMAP_CLASS_WIDTH;
+		for (int y = 0; y < rows; y++)
+		{
+			size_t b0 = size_t(y) * D.size() / rows;
+			size_t b1 = std::max(b0 + 1, size_t(y + 1) * D.size() / rows);
+			float d = 0;
+			for (size_t b = b0; b < b1; b++)
+				d = std::max(d, D[b]);
+			if (d <= 0)
+				continue;
+			col.a = std::min(1.0f, 0.2f + d);
+			ui::draw::RectCol(x0, r.y0 + y, x0 + MINIMAP_CLASS_WIDTH, r.y0 + y + 1, col);
+		}
+	}
+
+	// visible part of the file
+	float fsz = float(PI->fileSize);
+	float vy0 = r.y0 + r.GetHeight() * std::min(1.0f, GetBasePos() / fsz);
+	float vy1 = r.y0 + r.GetHeight() * std::min(1.0f, (GetBasePos() + state->byteWidth * 64) / fsz);
+	vy1 = std::max(vy1, vy0 + 3);
+	ui::draw::RectCutoutCol({ r.x0, vy0, r.x1, vy1 }, { r.x0 + 1, vy0 + 1, r.x1 - 1, vy1 - 1 }, ui::Color4b::White());
 }
 
 ui::UIRect HexViewer::GetByteRect(uint64_t pos)
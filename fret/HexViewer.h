@@ -4,6 +4,8 @@
 #include "FileReaders.h"
 #include "DataDesc.h"
 
+struct PatternIndexer;
+
 
 struct Int32Highlight
 {
@@ -82,18 +84,22 @@ struct HexViewer : ui::UIElement
 	void OnPaint() override;
 
 	ui::UIRect GetByteRect(uint64_t pos);
+	// pattern index density overview along the right edge
+	ui::UIRect GetMinimapRect();
+	void PaintMinimap();
 
 	uint64_t GetBasePos()
 	{
 		return state->basePos;
 	}
 
-	void Init(DataDesc* dd, DDFile* f, HexViewerState* hvs, HighlightSettings* hs)
+	void Init(DataDesc* dd, DDFile* f, HexViewerState* hvs, HighlightSettings* hs, PatternIndexer* pix = nullptr)
 	{
 		dataDesc = dd;
 		file = f;
 		state = hvs;
 		highlightSettings = hs;
+		patternIndexer = pix;
 	}
 
 	// input data
@@ -101,4 +107,10 @@ struct HexViewer : ui::UIElement
 	DDFile* file = nullptr;
 	HexViewerState* state = nullptr;
 	HighlightSettings* highlightSettings = nullptr;
+	PatternIndexer* patternIndexer = nullptr;
 };
+
+// rebuilds the marker interval tree of the file if the markers have changed
+void UpdateMarkerTree(DDFile* file);
+// colors the bytes [basePos; basePos + numBytes) of the file
+void Highlight(HighlightSettings* hs, DataDesc* desc, DDFile* file, uint64_t basePos, ByteColors* outColors, const uint8_t* bytes, size_t numBytes);
@@ -0,0 +1,337 @@
+
+#include "pch.h"
+#include "ImageDetection.h"
+
+#include "DataDesc.h"
+#include "FileReaders.h"
+#include "ImageParsers.h"
+#include "SimdHelpers.h"
+
+#include <future>
+#include <math.h>
+
+
+namespace ui {
+double hqtime();
+} // ui
+
+
+// the palette is copied to the start of the data, followed by the image
+static constexpr uint32_t DETECT_PALETTE_AREA = 1024;
+// pairs of adjacent rows that are decoded for each candidate
+static constexpr uint32_t DETECT_SAMPLE_PAIRS = 16;
+// candidates per parallel step (progress is published after each)
+static constexpr size_t DETECT_BATCH_SIZE = 256;
+
+ui::DataCategoryTag DCT_ImageDetection[1];
+
+
+void ImageDetectionSettings::EditUI()
+{
+	ui::imm::PropEditInt("Min. width", minWidth, {}, {}, { 1, 65536 });
+	ui::imm::PropEditInt("Max. width", maxWidth, {}, {}, { 1, 65536 });
+	ui::imm::PropEditInt("Width alignment", widthAlign, {}, {}, { 1, 256 });
+	ui::imm::PropEditInt("Max. height", maxHeight, {}, {}, { 8, 65536 });
+	ui::imm::PropEditInt("Scan size", scanSize, {}, {}, { 1024, 64 * 1024 * 1024 });
+	ui::imm::PropEditInt("Max. results", maxResults, {}, {}, { 1, 256 });
+}
+
+
+static uint64_t SumAbsDiff(const uint8_t* a, const uint8_t* b, size_t size)
+{
+	__m128i sum = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16)
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))));
+	uint64_t parts[2];
+	_mm_storeu_si128((__m128i*)parts, sum);
+	uint64_t total = parts[0] + parts[1];
+	for (; i < size; i++)
+		total += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+	return total;
+}
+
+// counts the bytes of b - a (wrapping)
+static void AddDiffHistogram(const uint8_t* a, const uint8_t* b, size_t size, uint32_t hist[256])
+{
+	alignas(16) uint8_t diff[16];
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16)
+	{
+		_mm_store_si128((__m128i*)diff, _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(b + i)), _mm_loadu_si128((const __m128i*)(a + i))));
+		for (int j = 0; j < 16; j++)
+			hist[diff[j]]++;
+	}
+	for (; i < size; i++)
+		hist[uint8_t(b[i] - a[i])]++;
+}
+
+static float GetEntropy(const uint32_t hist[256])
+{
+	uint64_t total = 0;
+	for (int i = 0; i < 256; i++)
+		total += hist[i];
+	if (!total)
+		return 0;
+	double e = 0;
+	for (int i = 0; i < 256; i++)
+	{
+		if (!hist[i])
+			continue;
+		double p = double(hist[i]) / total;
+		e -= p * log2(p);
+	}
+	return float(e);
+}
+
+static float GetPaletteScore(IDataSource* ds, ui::StringView fmt)
+{
+	std::vector<uint32_t> colors;
+	if (!DecodeImagePalette(ds, fmt, 0, colors))
+		return 1;
+
+	// real palettes tend to use few alpha values, random data does not
+	uint32_t alphas[256] = {};
+	size_t numAlphas = 0;
+	bool allSame = true;
+	for (uint32_t c : colors)
+	{
+		if (alphas[c >> 24]++ == 0)
+			numAlphas++;
+		if (c != colors[0])
+			allSame = false;
+	}
+	float score = 1;
+	if (numAlphas > 4)
+		score *= 0.5f;
+	if (allSame)
+		score *= 0.25f;
+	return score;
+}
+
+struct CandidateScore
+{
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	float score;
+	float correlation;
+	float entropy;
+	float palette;
+};
+
+static void ScoreCandidate(IDataSource* ds, CandidateScore& C)
+{
+	ui::StringView fmt = GetImageFormatName(C.format);
+	ImageInfo info = { DETECT_PALETTE_AREA, 0, C.width, C.height };
+	uint32_t stripRows = GetImageFormatStripRows(C.format);
+
+	// pairs are on strip boundaries, the rows of a block (strip) always look alike
+	uint32_t numStrips = C.height / stripRows;
+	ui::Canvas pairs[DETECT_SAMPLE_PAIRS];
+	for (uint32_t k = 0; k < DETECT_SAMPLE_PAIRS; k++)
+	{
+		uint32_t strip = 1 + (numStrips - 2) * k / (DETECT_SAMPLE_PAIRS - 1);
+		if (!DecodeImageRows(ds, fmt, info, strip * stripRows - 1, 2, pairs[k]))
+		{
+			C.score = 0;
+			return;
+		}
+	}
+
+	size_t rowBytes = size_t(C.width) * 4;
+	size_t hShift = size_t(stripRows) * 4;
+	uint64_t vSum = 0;
+	uint64_t hSum = 0;
+	uint64_t farSum = 0;
+	uint32_t diffHist[256] = {};
+	uint32_t valueHist[256] = {};
+	for (uint32_t k = 0; k < DETECT_SAMPLE_PAIRS; k++)
+	{
+		auto* row0 = pairs[k].GetBytes();
+		auto* row1 = row0 + rowBytes;
+		auto* farRow = pairs[(k + DETECT_SAMPLE_PAIRS / 2) % DETECT_SAMPLE_PAIRS].GetBytes();
+		vSum += SumAbsDiff(row0, row1, rowBytes);
+		farSum += SumAbsDiff(row0, farRow, rowBytes);
+		if (rowBytes > hShift)
+			hSum += SumAbsDiff(row0, row0 + hShift, rowBytes - hShift);
+		AddDiffHistogram(row0, row1, rowBytes, diffHist);
+		for (size_t i = 0; i < rowBytes; i++)
+			valueHist[row0[i]]++;
+	}
+
+	double vDiff = double(vSum) / (DETECT_SAMPLE_PAIRS * rowBytes);
+	double farDiff = double(farSum) / (DETECT_SAMPLE_PAIRS * rowBytes);
+	double hDiff = rowBytes > hShift ? double(hSum) / (DETECT_SAMPLE_PAIRS * (rowBytes - hShift)) : vDiff;
+	double vScore = std::max(0.0, 1 - vDiff / (farDiff + 1));
+	double hScore = std::max(0.0, 1 - hDiff / (farDiff + 1));
+	C.correlation = float(vScore * hScore);
+	C.entropy = GetEntropy(diffHist);
+	// (nearly) uniform data is not an image in any format
+	float flat = std::min(1.0f, GetEntropy(valueHist));
+	// the entropy of 256 bins is at most 8 bits
+	C.score = C.correlation * (1 - C.entropy / 8) * flat * C.palette;
+}
+
+
+void ImageFormatDetector::Start(DDFile* F, int64_t offImg, int64_t offPal)
+{
+	Cancel();
+	results.clear();
+	time = 0;
+	file = F;
+	offImage = offImg;
+	offPalette = offPal;
+
+	auto* ds = F ? F->dataSource : nullptr;
+	uint64_t fileSize = ds ? ds->GetSize() : 0;
+	if (offImg < 0 || uint64_t(offImg) >= fileSize)
+		return;
+
+	uint64_t size = std::min<uint64_t>(settings.scanSize, fileSize - offImg);
+	uint64_t palSize = offPal >= 0 && uint64_t(offPal) < fileSize ? std::min<uint64_t>(DETECT_PALETTE_AREA, fileSize - offPal) : 0;
+
+	uint32_t runID;
+	{
+		std::lock_guard<std::mutex> g(_pendingMutex);
+		runID = _runID;
+	}
+	progress = 0;
+	_queue.Push([this, runID, S{ settings }, ds, offImg, offPal, size, palSize]()
+	{
+		// the rows are sampled many times by each candidate, so the data is read once
+		std::vector<uint8_t> data(DETECT_PALETTE_AREA + size);
+		if (palSize)
+			ds->Read(offPal, palSize, data.data());
+		ds->Read(offImg, size, data.data() + DETECT_PALETTE_AREA);
+		_Run(runID, S, data);
+	}, true);
+}
+
+void ImageFormatDetector::Stop()
+{
+	Cancel();
+	// the data sources may be deleted after this, so wait until the running job is stopped
+	std::promise<void> stopped;
+	_queue.Push([&stopped]() { stopped.set_value(); }, true);
+	stopped.get_future().wait();
+}
+
+void ImageFormatDetector::Cancel()
+{
+	{
+		std::lock_guard<std::mutex> g(_pendingMutex);
+		_runID++;
+		_pendingResults.clear();
+		_hasPending = false;
+		_hasPendingResults = false;
+	}
+	progress = 1;
+}
+
+void ImageFormatDetector::Update()
+{
+	std::lock_guard<std::mutex> g(_pendingMutex);
+	if (!_hasPending)
+		return;
+	if (_hasPendingResults)
+	{
+		results = std::move(_pendingResults);
+		_pendingResults.clear();
+		for (auto& C : results)
+			if (C.preview.GetNumPixels())
+				C.previewImage = ui::draw::ImageCreateFromCanvas(C.preview, ui::draw::TexFlags::NoFilter);
+	}
+	progress = _pendingProgress;
+	time = _pendingTime;
+	_hasPending = false;
+	_hasPendingResults = false;
+}
+
+bool ImageFormatDetector::_IsCurrent(uint32_t runID)
+{
+	std::lock_guard<std::mutex> g(_pendingMutex);
+	return runID == _runID;
+}
+
+void ImageFormatDetector::_Publish(uint32_t runID, std::vector<ImageCandidate>* found, float p, double t)
+{
+	{
+		std::lock_guard<std::mutex> g(_pendingMutex);
+		if (runID != _runID)
+			return;
+		if (found)
+		{
+			_pendingResults = std::move(*found);
+			_hasPendingResults = true;
+		}
+		_pendingProgress = p;
+		_pendingTime = t;
+		_hasPending = true;
+	}
+	// only the address is used, the detector may be gone by the time the event runs
+	uintptr_t at = reinterpret_cast<uintptr_t>(this);
+	ui::Application::PushEvent([at]() { ui::Notify(DCT_ImageDetection, at); });
+}
+
+void ImageFormatDetector::_Run(uint32_t runID, const ImageDetectionSettings& S, const std::vector<uint8_t>& data)
+{
+	double t0 = ui::hqtime();
+	MemoryDataSource ds(const_cast<uint8_t*>(data.data()), data.size(), false);
+	uint64_t imageSize = data.size() - DETECT_PALETTE_AREA;
+
+	std::vector<CandidateScore> candidates;
+	uint32_t align = std::max(S.widthAlign, 1U);
+	for (size_t fid = 0, count = GetImageFormatCount(); fid < count; fid++)
+	{
+		float palette = GetPaletteScore(&ds, GetImageFormatName(fid));
+		uint32_t stripRows = GetImageFormatStripRows(fid);
+		for (uint32_t w = (std::max(S.minWidth, 1U) + align - 1) / align * align; w <= S.maxWidth; w += align)
+		{
+			uint64_t stripSize = GetImageDataSize(fid, w, stripRows);
+			if (!stripSize)
+				continue;
+			uint64_t h = std::min<uint64_t>(imageSize / stripSize * stripRows, S.maxHeight);
+			// at least a few strips to sample
+			if (h < stripRows * 4)
+				continue;
+			candidates.push_back({ uint32_t(fid), w, uint32_t(h), 0, 0, 0, palette });
+		}
+	}
+
+	for (size_t c0 = 0; c0 < candidates.size(); c0 += DETECT_BATCH_SIZE)
+	{
+		if (_queue.HasItems() || _queue.IsQuitting() || !_IsCurrent(runID))
+			return;
+
+		size_t nc = std::min(DETECT_BATCH_SIZE, candidates.size() - c0);
+		ui::ParallelFor(nc, [&](size_t i)
+		{
+			ScoreCandidate(&ds, candidates[c0 + i]);
+		});
+		_Publish(runID, nullptr, float(c0 + nc) / float(candidates.size() + 1), ui::hqtime() - t0);
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const CandidateScore& a, const CandidateScore& b)
+	{
+		return a.score > b.score;
+	});
+	if (candidates.size() > S.maxResults)
+		candidates.resize(S.maxResults);
+
+	std::vector<ImageCandidate> found(candidates.size());
+	ui::ParallelFor(candidates.size(), [&](size_t i)
+	{
+		auto& C = candidates[i];
+		auto& R = found[i];
+		R.format = ui::to_string(GetImageFormatName(C.format));
+		R.width = C.width;
+		R.height = C.height;
+		R.score = C.score;
+		R.correlation = C.correlation;
+		R.entropy = C.entropy;
+		R.palette = C.palette;
+		DecodeImageThumbnail(&ds, R.format, { DETECT_PALETTE_AREA, 0, C.width, C.height }, 128, R.preview);
+	});
+	_Publish(runID, &found, 1, ui::hqtime() - t0);
+}
@@ -0,0 +1,83 @@
+
+#pragma once
+#include "pch.h"
+
+#include <mutex>
+
+
+struct DDFile;
+
+struct ImageCandidate
+{
+	std::string format;
+	uint32_t width;
+	uint32_t height;
+	// higher is better, the product of the others
+	float score;
+	// how much closer the adjacent pixels (vertically and horizontally) are than the pixels of distant rows (0-1)
+	float correlation;
+	// of the differences between vertically adjacent bytes (0-8 bits)
+	float entropy;
+	// 1 for plausible palettes and formats without one, lower otherwise
+	float palette;
+
+	ui::Canvas preview;
+	ui::draw::ImageHandle previewImage;
+};
+
+struct ImageDetectionSettings
+{
+	uint32_t minWidth = 8;
+	uint32_t maxWidth = 1024;
+	// only widths that are multiples of this are tried
+	uint32_t widthAlign = 4;
+	// bytes from the image offset that are used, the height of the candidates is limited by this
+	uint32_t scanSize = 256 * 1024;
+	uint32_t maxHeight = 1024;
+	uint32_t maxResults = 16;
+
+	void EditUI();
+};
+
+extern ui::DataCategoryTag DCT_ImageDetection[1];
+
+// finds the likely formats and widths of an image at the given offset on a worker thread
+// each format is tried with each width in the range, candidates are scored in parallel
+// using a few sampled pairs of rows (only those are decoded)
+struct ImageFormatDetector
+{
+	// the worker reads the data, the file must stay open until the detector is stopped
+	void Start(DDFile* file, int64_t offImage, int64_t offPalette);
+	void Cancel();
+	// cancels and waits until the worker doesn't use the file anymore
+	void Stop();
+	// takes over the results (DCT_ImageDetection is notified when there are new ones)
+	void Update();
+	bool IsRunning() const { return progress < 1; }
+
+	bool _IsCurrent(uint32_t runID);
+	void _Publish(uint32_t runID, std::vector<ImageCandidate>* found, float p, double t);
+	void _Run(uint32_t runID, const ImageDetectionSettings& settings, const std::vector<uint8_t>& data);
+
+	ImageDetectionSettings settings;
+
+	// where the results are from
+	DDFile* file = nullptr;
+	int64_t offImage = 0;
+	int64_t offPalette = 0;
+	std::vector<ImageCandidate> results;
+	// 1 if not running
+	float progress = 1;
+	double time = 0;
+
+	std::mutex _pendingMutex;
+	uint32_t _runID = 0;
+	std::vector<ImageCandidate> _pendingResults;
+	float _pendingProgress = 1;
+	double _pendingTime = 0;
+	bool _hasPending = false;
+	bool _hasPendingResults = false;
+
+	// last so that the worker is stopped first
+	ui::WorkerQueue _queue;
+};
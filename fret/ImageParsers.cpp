@@ -2,6 +2,12 @@
 #include "pch.h"
 #include "ImageParsers.h"
 
+#include "SimdHelpers.h"
+
+
+// pixels per chunk of rows decoded by one worker
+static constexpr uint64_t DECODE_CHUNK_PIXELS = 64 * 1024;
+
 
 static uint32_t divup(uint32_t x, uint32_t d)
 {
@@ -27,6 +33,82 @@ static uint32_t RGB565_to_RGBA8(uint16_t v)
 }
 
 
+// 8 pixels at a time, the same as RGB5A1_to_RGBA8
+static void RGB5A1_to_RGBA8_N(const uint8_t* src, uint32_t* dst, size_t count)
+{
+	const __m128i mask5 = _mm_set1_epi16(0x1f);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+		__m128i r = _mm_slli_epi16(_mm_and_si128(v, mask5), 3);
+		__m128i g = _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(v, 5), mask5), 3);
+		__m128i b = _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(v, 10), mask5), 3);
+		__m128i a = _mm_srai_epi16(v, 15);
+		__m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+		__m128i ba = _mm_or_si128(b, _mm_slli_epi16(a, 8));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(rg, ba));
+		_mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(rg, ba));
+	}
+	for (; i < count; i++)
+	{
+		uint16_t v;
+		memcpy(&v, src + i * 2, 2);
+		dst[i] = RGB5A1_to_RGBA8(v);
+	}
+}
+
+// 8 pixels at a time, the same as RGB565_to_RGBA8
+static void RGB565_to_RGBA8_N(const uint16_t* src, uint32_t* dst, size_t count)
+{
+	const __m128i mask5 = _mm_set1_epi16(0x1f);
+	const __m128i mask6 = _mm_set1_epi16(0x3f);
+	const __m128i alpha = _mm_set1_epi16(int16_t(0xff00));
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i b = _mm_slli_epi16(_mm_and_si128(v, mask5), 3);
+		__m128i g = _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(v, 5), mask6), 2);
+		__m128i r = _mm_slli_epi16(_mm_srli_epi16(v, 11), 3);
+		__m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+		__m128i ba = _mm_or_si128(b, alpha);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(rg, ba));
+		_mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(rg, ba));
+	}
+	for (; i < count; i++)
+		dst[i] = RGB565_to_RGBA8(src[i]);
+}
+
+// decodes [y0; y1) rows of the image (or rows of blocks), in parallel unless disabled
+template <class F> static void DecodeRows(bool parallel, uint32_t numRows, uint64_t pixelsPerRow, F&& f)
+{
+	uint32_t chunkRows = uint32_t(std::max<uint64_t>(1, DECODE_CHUNK_PIXELS / std::max<uint64_t>(1, pixelsPerRow)));
+	uint32_t numChunks = divup(numRows, chunkRows);
+	if (numChunks <= 1 || !parallel)
+	{
+		f(0, numRows);
+		return;
+	}
+	ui::ParallelFor(numChunks, [&](size_t i)
+	{
+		uint32_t y0 = uint32_t(i) * chunkRows;
+		f(y0, std::min(y0 + chunkRows, numRows));
+	});
+}
+
+// the whole image data, directly from the data source if it's in memory
+static const uint8_t* GetImageData(IDataSource* ds, int64_t off, uint64_t size, std::vector<uint8_t>& buf)
+{
+	if (off >= 0)
+		if (const void* span = ds->GetSpan(off, size))
+			return static_cast<const uint8_t*>(span);
+	buf.assign(size, 0);
+	ds->Read(off, size, buf.data());
+	return buf.data();
+}
+
+
 struct ReadImageIO
 {
 	ui::Canvas& canvas;
@@ -34,6 +116,8 @@ struct ReadImageIO
 	uint32_t* pixels;
 	IDataSource* ds;
 	bool error;
+	// only disabled to compare with serial decoding
+	bool parallel = true;
 };
 
 typedef void ReadImage(ReadImageIO& io, const ImageInfo& info);
@@ -42,178 +126,219 @@ struct ImageFormat
 	ui::StringView category;
 	ui::StringView name;
 	ReadImage* readFunc;
+	// layout of the data, used to decode only some of the rows (rows are stored in strips of 1 or 4 (blocks))
+	uint8_t bitsPerPixel;
+	uint8_t stripRows;
+	// size of the palette at ImageInfo::offPal, 0 if there is none
+	uint16_t paletteBytes;
+
+	uint64_t GetStripSize(uint32_t width) const
+	{
+		if (stripRows > 1)
+			return uint64_t(divup(width, stripRows)) * stripRows * stripRows * bitsPerPixel / 8;
+		if (bitsPerPixel == 1)
+			return divup(width, 8);
+		return uint64_t(width) * bitsPerPixel / 8;
+	}
 };
 
 
 static void ReadImage_RGBA8(ReadImageIO& io, const ImageInfo& info)
 {
-	io.ds->Read(info.offImg, info.width * info.height * 4, io.bytes);
+	io.ds->Read(info.offImg, uint64_t(info.width) * info.height * 4, io.bytes);
 }
 
 static void ReadImage_RGBX8(ReadImageIO& io, const ImageInfo& info)
 {
-	io.ds->Read(info.offImg, info.width * info.height * 4, io.bytes);
-	for (uint32_t px = 0; px < info.width * info.height; px++)
+	io.ds->Read(info.offImg, uint64_t(info.width) * info.height * 4, io.bytes);
+	DecodeRows(io.parallel, info.height, info.width, [&](uint32_t y0, uint32_t y1)
 	{
-		io.bytes[px * 4 + 3] = 0xff;
-	}
+		const __m128i alpha = _mm_set1_epi32(int32_t(0xff000000UL));
+		uint32_t* P = io.pixels + uint64_t(y0) * info.width;
+		size_t count = uint64_t(y1 - y0) * info.width;
+		size_t px = 0;
+		for (; px + 4 <= count; px += 4)
+			_mm_storeu_si128((__m128i*)(P + px), _mm_or_si128(_mm_loadu_si128((const __m128i*)(P + px)), alpha));
+		for (; px < count; px++)
+			P[px] |= 0xff000000UL;
+	});
 }
 
 static void ReadImage_RGBo8(ReadImageIO& io, const ImageInfo& info)
 {
-	io.ds->Read(info.offImg, info.width * info.height * 4, io.bytes);
-	for (uint32_t px = 0; px < info.width * info.height; px++)
+	io.ds->Read(info.offImg, uint64_t(info.width) * info.height * 4, io.bytes);
+	DecodeRows(io.parallel, info.height, info.width, [&](uint32_t y0, uint32_t y1)
 	{
-		io.bytes[px * 4 + 3] = io.bytes[px * 4 + 3] ? 0xff : 0;
-	}
+		const __m128i alpha = _mm_set1_epi32(int32_t(0xff000000UL));
+		uint32_t* P = io.pixels + uint64_t(y0) * info.width;
+		size_t count = uint64_t(y1 - y0) * info.width;
+		size_t px = 0;
+		for (; px + 4 <= count; px += 4)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(P + px));
+			__m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(v, alpha), _mm_setzero_si128());
+			v = _mm_or_si128(_mm_andnot_si128(alpha, v), _mm_andnot_si128(transparent, alpha));
+			_mm_storeu_si128((__m128i*)(P + px), v);
+		}
+		for (; px < count; px++)
+			P[px] = (P[px] & 0xffffff) | (P[px] & 0xff000000UL ? 0xff000000UL : 0);
+	});
 }
 
 static void ReadImage_G8(ReadImageIO& io, const ImageInfo& info)
 {
-	if (info.width > 4096)
-	{
-		io.error = true;
-		return;
-	}
-
-	uint8_t tmp[4096];
-	for (uint32_t y = 0; y < info.height; y++)
+	std::vector<uint8_t> buf;
+	const uint8_t* src = GetImageData(io.ds, info.offImg, uint64_t(info.width) * info.height, buf);
+	DecodeRows(io.parallel, info.height, info.width, [&](uint32_t y0, uint32_t y1)
 	{
-		io.ds->Read(info.offImg + y * info.width, info.width, tmp);
-		for (uint32_t x = 0; x < info.width; x++)
-			io.pixels[y * info.width + x] = tmp[x] | (tmp[x] << 8) | (tmp[x] << 16) | 0xff000000UL;
-	}
+		const __m128i alpha = _mm_set1_epi32(int32_t(0xff000000UL));
+		const uint8_t* S = src + uint64_t(y0) * info.width;
+		uint32_t* P = io.pixels + uint64_t(y0) * info.width;
+		size_t count = uint64_t(y1 - y0) * info.width;
+		size_t px = 0;
+		for (; px + 16 <= count; px += 16)
+		{
+			__m128i g = _mm_loadu_si128((const __m128i*)(S + px));
+			__m128i gg0 = _mm_unpacklo_epi8(g, g);
+			__m128i gg1 = _mm_unpackhi_epi8(g, g);
+			_mm_storeu_si128((__m128i*)(P + px), _mm_or_si128(_mm_unpacklo_epi16(gg0, gg0), alpha));
+			_mm_storeu_si128((__m128i*)(P + px + 4), _mm_or_si128(_mm_unpackhi_epi16(gg0, gg0), alpha));
+			_mm_storeu_si128((__m128i*)(P + px + 8), _mm_or_si128(_mm_unpacklo_epi16(gg1, gg1), alpha));
+			_mm_storeu_si128((__m128i*)(P + px + 12), _mm_or_si128(_mm_unpackhi_epi16(gg1, gg1), alpha));
+		}
+		for (; px < count; px++)
+			P[px] = S[px] | (S[px] << 8) | (S[px] << 16) | 0xff000000UL;
+	});
 }
 
 static void ReadImage_G1(ReadImageIO& io, const ImageInfo& info)
 {
-	if (info.width > 4096)
+	uint32_t w = divup(info.width, 8);
+	std::vector<uint8_t> buf;
+	const uint8_t* src = GetImageData(io.ds, info.offImg, uint64_t(w) * info.height, buf);
+	DecodeRows(io.parallel, info.height, info.width, [&](uint32_t y0, uint32_t y1)
 	{
-		io.error = true;
-		return;
-	}
-
-	int w = divup(info.width, 8);
-	uint8_t tmp[4096 / 8];
-	for (uint32_t y = 0; y < info.height; y++)
-	{
-		io.ds->Read(info.offImg + y * w, w, tmp);
-		for (uint32_t x = 0; x < info.width; x++)
+		for (uint32_t y = y0; y < y1; y++)
 		{
-			bool set = (tmp[x / 8] & (1 << (x % 8))) != 0;
-			io.pixels[y * info.width + x] = set ? 0xffffffffUL : 0xff000000UL;
+			const uint8_t* line = src + uint64_t(y) * w;
+			uint32_t* P = io.pixels + uint64_t(y) * info.width;
+			for (uint32_t x = 0; x < info.width; x++)
+			{
+				bool set = (line[x / 8] & (1 << (x % 8))) != 0;
+				P[x] = set ? 0xffffffffUL : 0xff000000UL;
+			}
 		}
-	}
+	});
 }
 
 static void ReadImage_8BPP_RGBA8(ReadImageIO& io, const ImageInfo& info)
 {
-	if (info.width > 4096)
-	{
-		io.error = true;
-		return;
-	}
-
 	uint32_t pal[256];
 	io.ds->Read(info.offPal, 256 * 4, pal);
 
-	uint8_t line[4096];
-	for (uint32_t y = 0; y < info.height; y++)
+	std::vector<uint8_t> buf;
+	const uint8_t* src = GetImageData(io.ds, info.offImg, uint64_t(info.width) * info.height, buf);
+	DecodeRows(io.parallel, info.height, info.width, [&](uint32_t y0, uint32_t y1)
 	{
-		io.ds->Read(info.offImg + info.width * y, info.width, line);
-		for (uint32_t x = 0; x < info.width; x++)
+		const uint8_t* S = src + uint64_t(y0) * info.width;
+		uint32_t* P = io.pixels + uint64_t(y0) * info.width;
+		size_t count = uint64_t(y1 - y0) * info.width;
+		size_t px = 0;
+		for (; px + 4 <= count; px += 4)
 		{
-			io.pixels[x + y * info.width] = pal[line[x]];
+			P[px + 0] = pal[S[px + 0]];
+			P[px + 1] = pal[S[px + 1]];
+			P[px + 2] = pal[S[px + 2]];
+			P[px + 3] = pal[S[px + 3]];
 		}
-	}
+		for (; px < count; px++)
+			P[px] = pal[S[px]];
+	});
 }
 
 static void ReadImage_RGB5A1(ReadImageIO& io, const ImageInfo& info)
 {
-	if (info.width > 4096)
+	std::vector<uint8_t> buf;
+	const uint8_t* src = GetImageData(io.ds, info.offImg, uint64_t(info.width) * info.height * 2, buf);
+	DecodeRows(io.parallel, info.height, info.width, [&](uint32_t y0, uint32_t y1)
 	{
-		io.error = true;
-		return;
-	}
+		RGB5A1_to_RGBA8_N(
+			src + uint64_t(y0) * info.width * 2,
+			io.pixels + uint64_t(y0) * info.width,
+			uint64_t(y1 - y0) * info.width);
+	});
+}
 
-	uint16_t tmp[4096];
-	for (uint32_t y = 0; y < info.height; y++)
+// one lookup per byte (two pixels) instead of per pixel (SSE2 has no gather for the palette lookups)
+static void Read4BPP(ReadImageIO& io, const ImageInfo& info, const uint32_t pal[16])
+{
+	uint64_t pal2[256];
+	for (int i = 0; i < 256; i++)
+		pal2[i] = pal[i & 0xf] | (uint64_t(pal[i >> 4]) << 32);
+
+	uint32_t w = info.width / 2;
+	std::vector<uint8_t> buf;
+	const uint8_t* src = GetImageData(io.ds, info.offImg, uint64_t(w) * info.height, buf);
+	DecodeRows(io.parallel, info.height, info.width, [&](uint32_t y0, uint32_t y1)
 	{
-		io.ds->Read(info.offImg + y * info.width * 2, info.width * 2, tmp);
-		for (uint32_t x = 0; x < info.width; x++)
-			io.pixels[y * info.width + x] = RGB5A1_to_RGBA8(tmp[x]);
-	}
+		for (uint32_t y = y0; y < y1; y++)
+		{
+			const uint8_t* line = src + uint64_t(y) * w;
+			uint32_t* P = io.pixels + uint64_t(y) * info.width;
+			for (uint32_t x = 0; x < w; x++)
+				memcpy(P + x * 2, &pal2[line[x]], 8);
+		}
+	});
 }
 
 static void ReadImage_4BPP_RGB5A1(ReadImageIO& io, const ImageInfo& info)
 {
-	if (info.width > 4096)
-	{
-		io.error = true;
-		return;
-	}
-
-	uint16_t palo[16];
+	uint8_t palo[32];
 	io.ds->Read(info.offPal, 32, palo);
 
 	uint32_t palc[16];
-	for (int i = 0; i < 16; i++)
-		palc[i] = RGB5A1_to_RGBA8(palo[i]);
+	RGB5A1_to_RGBA8_N(palo, palc, 16);
 
-	uint8_t line[2048];
-	for (uint32_t y = 0; y < info.height; y++)
-	{
-		io.ds->Read(info.offImg + info.width / 2 * y, info.width / 2, line);
-		for (uint32_t x = 0; x < info.width / 2; x++)
-		{
-			uint8_t v1 = line[x] & 0xf;
-			uint8_t v2 = line[x] >> 4;
-
-			uint32_t px = x * 2 + y * info.width;
-			io.pixels[px] = palc[v1];
-			px++;
-			io.pixels[px] = palc[v2];
-		}
-	}
+	Read4BPP(io, info, palc);
 }
 
 static void ReadImage_4BPP_RGBo8(ReadImageIO& io, const ImageInfo& info)
 {
-	if (info.width > 4096)
-	{
-		io.error = true;
-		return;
-	}
-
-	uint32_t pal[16 * 4];
+	uint32_t pal[16];
 	io.ds->Read(info.offPal, 64, pal);
 	for (uint32_t i = 0; i < 16; i++)
 		if (pal[i] & 0xff000000)
 			pal[i] |= 0xff000000;
 
-	uint8_t line[2048];
-	for (uint32_t y = 0; y < info.height; y++)
-	{
-		io.ds->Read(info.offImg + info.width / 2 * y, info.width / 2, line);
-		for (uint32_t x = 0; x < info.width / 2; x++)
-		{
-			uint8_t v1 = line[x] & 0xf;
-			uint8_t v2 = line[x] >> 4;
-
-			uint32_t px = x * 2 + y * info.width;
-			io.pixels[px] = pal[v1];
-			px++;
-			io.pixels[px] = pal[v2];
-		}
-	}
+	Read4BPP(io, info, pal);
 }
 
+static const uint8_t g_DXT3AlphaTable[16] =
+{
+	255 * 0 / 15,
+	255 * 1 / 15,
+	255 * 2 / 15,
+	255 * 3 / 15,
+	255 * 4 / 15,
+	255 * 5 / 15,
+	255 * 6 / 15,
+	255 * 7 / 15,
+	255 * 8 / 15,
+	255 * 9 / 15,
+	255 * 10 / 15,
+	255 * 11 / 15,
+	255 * 12 / 15,
+	255 * 13 / 15,
+	255 * 14 / 15,
+	255 * 15 / 15,
+};
+
 struct DXT1Block
 {
 	uint16_t c0, c1;
 	uint32_t pixels;
 
-	void GenerateColors(uint32_t c[4])
+	static void GenerateColors(uint32_t c[4])
 	{
 		uint8_t r0 = (c[0] >> 0) & 0xff;
 		uint8_t g0 = (c[0] >> 8) & 0xff;
@@ -230,9 +355,9 @@ struct DXT1Block
 		c[2] = r2 | (g2 << 8) | (b2 << 16) | 0xff000000UL;
 		c[3] = r3 | (g3 << 8) | (b3 << 16) | 0xff000000UL;
 	}
-	uint32_t GetColor(int x, int y)
+	// c[0] and c[1] are the converted c0 and c1
+	void GetColorsDXT1(uint32_t c[4]) const
 	{
-		uint32_t c[4] = { RGB565_to_RGBA8(c0), RGB565_to_RGBA8(c1) };
 		if (c0 > c1)
 		{
 			GenerateColors(c);
@@ -242,123 +367,104 @@ struct DXT1Block
 			c[2] = (c[0] >> 1) + (c[1] >> 1);
 			c[3] = 0;
 		}
-
-		int at = y * 4 + x;
-		int idx = (pixels >> (at * 2)) & 0x3;
-		return c[idx];
 	}
-	uint32_t GetColorDXT3(int x, int y, uint8_t alpha)
+	// writes the visible part of the block
+	void Write(uint32_t* dst, uint32_t stride, uint32_t w, uint32_t h, const uint32_t c[4]) const
 	{
-		uint32_t c[4] = { RGB565_to_RGBA8(c0), RGB565_to_RGBA8(c1) };
-		GenerateColors(c);
-
-		int at = y * 4 + x;
-		int idx = (pixels >> (at * 2)) & 0x3;
-		auto cc = c[idx];
-		return (cc & 0xffffff) | (uint32_t(alpha) << 24);
+		for (uint32_t y = 0; y < h; y++)
+		{
+			for (uint32_t x = 0; x < w; x++)
+			{
+				int at = y * 4 + x;
+				dst[y * stride + x] = c[(pixels >> (at * 2)) & 0x3];
+			}
+		}
 	}
-};
-
-static const uint8_t g_DXT3AlphaTable[16] =
-{
-	255 * 0 / 15,
-	255 * 1 / 15,
-	255 * 2 / 15,
-	255 * 3 / 15,
-	255 * 4 / 15,
-	255 * 5 / 15,
-	255 * 6 / 15,
-	255 * 7 / 15,
-	255 * 8 / 15,
-	255 * 9 / 15,
-	255 * 10 / 15,
-	255 * 11 / 15,
-	255 * 12 / 15,
-	255 * 13 / 15,
-	255 * 14 / 15,
-	255 * 15 / 15,
-};
-
-struct DXT3AlphaBlock
-{
-	uint64_t pixels;
-
-	uint8_t GetAlpha(int x, int y)
+	void WriteDXT3(uint32_t* dst, uint32_t stride, uint32_t w, uint32_t h, const uint32_t c[4], uint64_t alpha) const
 	{
-		int at = y * 4 + x;
-		int idx = (pixels >> (at * 4)) & 0xf;
-		return g_DXT3AlphaTable[idx];
+		for (uint32_t y = 0; y < h; y++)
+		{
+			for (uint32_t x = 0; x < w; x++)
+			{
+				int at = y * 4 + x;
+				uint32_t cc = c[(pixels >> (at * 2)) & 0x3];
+				dst[y * stride + x] = (cc & 0xffffff) | (uint32_t(g_DXT3AlphaTable[(alpha >> (at * 4)) & 0xf]) << 24);
+			}
+		}
 	}
 };
 
-static void ReadImage_DXT1(ReadImageIO& io, const ImageInfo& info)
+// decodes block rows, `blockSize` bytes per block with the color block at `colorOff`
+template <class F> static void ReadDXT(ReadImageIO& io, const ImageInfo& info, uint32_t blockSize, uint32_t colorOff, F&& decodeBlock)
 {
 	uint32_t nbx = divup(info.width, 4);
 	uint32_t nby = divup(info.height, 4);
 
-	uint64_t at = info.offImg;
-	for (uint32_t by = 0; by < nby; by++)
+	std::vector<uint8_t> buf;
+	const uint8_t* src = GetImageData(io.ds, info.offImg, uint64_t(nbx) * nby * blockSize, buf);
+	DecodeRows(io.parallel, nby, uint64_t(info.width) * 4, [&](uint32_t by0, uint32_t by1)
 	{
-		for (uint32_t bx = 0; bx < nbx; bx++)
+		std::vector<uint16_t> ends(nbx * 2);
+		std::vector<uint32_t> colors(nbx * 2);
+		for (uint32_t by = by0; by < by1; by++)
 		{
-			DXT1Block block;
-			io.ds->Read(at, sizeof(block), &block);
-			at += sizeof(block);
-
-			for (uint32_t y = by * 4; y < std::min((by + 1) * 4, info.height); y++)
+			const uint8_t* row = src + uint64_t(by) * nbx * blockSize;
+			// the endpoints of the whole row are converted together
+			for (uint32_t bx = 0; bx < nbx; bx++)
+				memcpy(&ends[bx * 2], row + bx * blockSize + colorOff, 4);
+			RGB565_to_RGBA8_N(ends.data(), colors.data(), nbx * 2);
+
+			uint32_t h = std::min(4U, info.height - by * 4);
+			for (uint32_t bx = 0; bx < nbx; bx++)
 			{
-				for (uint32_t x = bx * 4; x < std::min((bx + 1) * 4, info.width); x++)
-				{
-					io.pixels[x + info.width * y] = block.GetColor(x - bx * 4, y - by * 4);
-				}
+				uint32_t w = std::min(4U, info.width - bx * 4);
+				uint32_t* dst = io.pixels + uint64_t(by) * 4 * info.width + bx * 4;
+				decodeBlock(row + bx * blockSize, &colors[bx * 2], dst, w, h);
 			}
 		}
-	}
+	});
 }
 
-static void ReadImage_DXT3(ReadImageIO& io, const ImageInfo& info)
+static void ReadImage_DXT1(ReadImageIO& io, const ImageInfo& info)
 {
-	uint32_t nbx = divup(info.width, 4);
-	uint32_t nby = divup(info.height, 4);
+	ReadDXT(io, info, 8, 0, [&info](const uint8_t* data, const uint32_t* ends, uint32_t* dst, uint32_t w, uint32_t h)
+	{
+		DXT1Block block;
+		memcpy(&block, data, sizeof(block));
+		uint32_t c[4] = { ends[0], ends[1] };
+		block.GetColorsDXT1(c);
+		block.Write(dst, info.width, w, h, c);
+	});
+}
 
-	uint64_t at = info.offImg;
-	for (uint32_t by = 0; by < nby; by++)
+static void ReadImage_DXT3(ReadImageIO& io, const ImageInfo& info)
+{
+	ReadDXT(io, info, 16, 8, [&info](const uint8_t* data, const uint32_t* ends, uint32_t* dst, uint32_t w, uint32_t h)
 	{
-		for (uint32_t bx = 0; bx < nbx; bx++)
-		{
-			DXT1Block block;
-			DXT3AlphaBlock ablock;
-			io.ds->Read(at, sizeof(ablock), &ablock);
-			at += sizeof(ablock);
-			io.ds->Read(at, sizeof(block), &block);
-			at += sizeof(block);
-
-			for (uint32_t y = by * 4; y < std::min((by + 1) * 4, info.height); y++)
-			{
-				for (uint32_t x = bx * 4; x < std::min((bx + 1) * 4, info.width); x++)
-				{
-					uint8_t alpha = ablock.GetAlpha(x - bx * 4, y - by * 4);
-					io.pixels[x + info.width * y] = block.GetColorDXT3(x - bx * 4, y - by * 4, alpha);
-				}
-			}
-		}
-	}
+		uint64_t alpha;
+		memcpy(&alpha, data, sizeof(alpha));
+		DXT1Block block;
+		memcpy(&block, data + 8, sizeof(block));
+		uint32_t c[4] = { ends[0], ends[1] };
+		DXT1Block::GenerateColors(c);
+		block.WriteDXT3(dst, info.width, w, h, c, alpha);
+	});
 }
 
 
 static const ImageFormat g_imageFormats[] =
 {
-	{ "Basic", "RGBA8", ReadImage_RGBA8 },
-	{ "Basic", "RGBX8", ReadImage_RGBX8 },
-	{ "Basic", "RGBo8", ReadImage_RGBo8 },
-	{ "Basic", "G8", ReadImage_G8 },
-	{ "Basic", "G1", ReadImage_G1 },
-	{ "Basic", "8BPP_RGBA8", ReadImage_8BPP_RGBA8 },
-	{ "PSX", "RGB5A1", ReadImage_RGB5A1 },
-	{ "PSX", "4BPP_RGB5A1", ReadImage_4BPP_RGB5A1 },
-	{ "PSX", "4BPP_RGBo8", ReadImage_4BPP_RGBo8 },
-	{ "S3TC", "DXT1", ReadImage_DXT1 },
-	{ "S3TC", "DXT3", ReadImage_DXT3 },
+	{ "Basic", "RGBA8", ReadImage_RGBA8, 32, 1, 0 },
+	{ "Basic", "RGBX8", ReadImage_RGBX8, 32, 1, 0 },
+	{ "Basic", "RGBo8", ReadImage_RGBo8, 32, 1, 0 },
+	{ "Basic", "G8", ReadImage_G8, 8, 1, 0 },
+	{ "Basic", "G1", ReadImage_G1, 1, 1, 0 },
+	{ "Basic", "8BPP_RGBA8", ReadImage_8BPP_RGBA8, 8, 1, 1024 },
+	{ "PSX", "RGB5A1", ReadImage_RGB5A1, 16, 1, 0 },
+	{ "PSX", "4BPP_RGB5A1", ReadImage_4BPP_RGB5A1, 4, 1, 32 },
+	{ "PSX", "4BPP_RGBo8", ReadImage_4BPP_RGBo8, 4, 1, 64 },
+	{ "S3TC", "DXT1", ReadImage_DXT1, 4, 4, 0 },
+	{ "S3TC", "DXT3", ReadImage_DXT3, 8, 4, 0 },
 };
 
 
@@ -377,25 +483,144 @@ ui::StringView GetImageFormatName(size_t fid)
 	return g_imageFormats[fid].name;
 }
 
-ui::draw::ImageHandle CreateImageFrom(IDataSource* ds, ui::StringView fmt, const ImageInfo& info)
+uint32_t GetImageFormatStripRows(size_t fid)
+{
+	return g_imageFormats[fid].stripRows;
+}
+
+uint64_t GetImageDataSize(size_t fid, uint32_t width, uint32_t height)
+{
+	auto& F = g_imageFormats[fid];
+	return divup(height, F.stripRows) * F.GetStripSize(width);
+}
+
+bool ImageFormatHasPalette(size_t fid)
+{
+	return g_imageFormats[fid].paletteBytes != 0;
+}
+
+static const ImageFormat* FindImageFormat(ui::StringView fmt)
+{
+	for (const auto& F : g_imageFormats)
+		if (fmt == F.name)
+			return &F;
+	return nullptr;
+}
+
+bool DecodeImage(IDataSource* ds, ui::StringView fmt, const ImageInfo& info, ui::Canvas& out, bool parallel)
+{
+	auto* F = FindImageFormat(fmt);
+	if (!F)
+		return false;
+
+	out.SetSize(info.width, info.height);
+	ReadImageIO io = { out, out.GetBytes(), out.GetPixels(), ds, false, parallel };
+	F->readFunc(io, info);
+	return !io.error;
+}
+
+bool DecodeImageRows(IDataSource* ds, ui::StringView fmt, const ImageInfo& info, uint32_t y, uint32_t count, ui::Canvas& out)
+{
+	auto* F = FindImageFormat(fmt);
+	if (!F || y + count > info.height)
+		return false;
+
+	uint32_t s0 = y / F->stripRows;
+	uint32_t s1 = divup(y + count, F->stripRows);
+	ImageInfo stripInfo = info;
+	stripInfo.offImg += s0 * F->GetStripSize(info.width);
+	stripInfo.height = std::min(s1 * F->stripRows, info.height) - s0 * F->stripRows;
+	if (stripInfo.height == count)
+	{
+		out.SetSize(info.width, count);
+		ReadImageIO io = { out, out.GetBytes(), out.GetPixels(), ds, false };
+		F->readFunc(io, stripInfo);
+		return !io.error;
+	}
+
+	ui::Canvas strips(info.width, stripInfo.height);
+	ReadImageIO io = { strips, strips.GetBytes(), strips.GetPixels(), ds, false };
+	F->readFunc(io, stripInfo);
+	if (io.error)
+		return false;
+	out.SetSize(info.width, count);
+	memcpy(out.GetPixels(), strips.GetPixels() + uint64_t(y - s0 * F->stripRows) * info.width, uint64_t(count) * info.width * 4);
+	return true;
+}
+
+bool DecodeImagePalette(IDataSource* ds, ui::StringView fmt, int64_t offPal, std::vector<uint32_t>& colors)
 {
-	ui::Canvas c(info.width, info.height);
-	auto* B = c.GetBytes();
-	auto* P = c.GetPixels();
-	ReadImageIO io = { c, c.GetBytes(), c.GetPixels(), ds, false };
+	auto* F = FindImageFormat(fmt);
+	if (!F || !F->paletteBytes)
+		return false;
+
+	// decodes an image that uses each palette entry once
+	uint32_t numColors = 1U << F->bitsPerPixel;
+	std::vector<uint8_t> mem(F->paletteBytes + numColors * F->bitsPerPixel / 8);
+	ds->Read(offPal, F->paletteBytes, mem.data());
+	for (uint32_t i = 0; i < numColors; i++)
+	{
+		uint32_t bit = i * F->bitsPerPixel;
+		mem[F->paletteBytes + bit / 8] |= i << (bit % 8);
+	}
+	MemoryDataSource pds(mem.data(), mem.size(), false);
+
+	ui::Canvas c;
+	if (!DecodeImage(&pds, fmt, { F->paletteBytes, 0, numColors, 1 }, c))
+		return false;
+	colors.assign(c.GetPixels(), c.GetPixels() + numColors);
+	return true;
+}
 
-	bool done = false;
-	for (size_t i = 0, count = GetImageFormatCount(); i < count; i++)
+bool DecodeImageThumbnail(IDataSource* ds, ui::StringView fmt, const ImageInfo& info, uint32_t maxSize, ui::Canvas& out)
+{
+	if (info.width <= maxSize && info.height <= maxSize)
+		return DecodeImage(ds, fmt, info, out);
+
+	auto* F = FindImageFormat(fmt);
+	if (!F)
+		return false;
+
+	uint32_t maxSide = std::max(info.width, info.height);
+	uint32_t tw = std::max(1U, uint32_t(uint64_t(info.width) * maxSize / maxSide));
+	uint32_t th = std::max(1U, uint32_t(uint64_t(info.height) * maxSize / maxSide));
+	out.SetSize(tw, th);
+
+	// nearest sampling, only the strips containing the sampled rows are decoded
+	std::vector<uint32_t> srcX(tw);
+	for (uint32_t x = 0; x < tw; x++)
+		srcX[x] = uint32_t((uint64_t(x) * 2 + 1) * info.width / (uint64_t(tw) * 2));
+
+	uint64_t stripSize = F->GetStripSize(info.width);
+	ui::Canvas strip(info.width, F->stripRows);
+	uint32_t curStrip = UINT32_MAX;
+	for (uint32_t y = 0; y < th; y++)
 	{
-		if (fmt == g_imageFormats[i].name)
+		uint32_t sy = uint32_t((uint64_t(y) * 2 + 1) * info.height / (uint64_t(th) * 2));
+		if (sy / F->stripRows != curStrip)
 		{
-			g_imageFormats[i].readFunc(io, info);
-			done = !io.error;
-			break;
+			curStrip = sy / F->stripRows;
+			ImageInfo stripInfo = info;
+			stripInfo.offImg += curStrip * stripSize;
+			stripInfo.height = std::min<uint32_t>(F->stripRows, info.height - curStrip * F->stripRows);
+			ReadImageIO io = { strip, strip.GetBytes(), strip.GetPixels(), ds, false };
+			F->readFunc(io, stripInfo);
+			if (io.error)
+				return false;
 		}
+
+		const uint32_t* src = strip.GetPixels() + uint64_t(sy % F->stripRows) * info.width;
+		uint32_t* dst = out.GetPixels() + uint64_t(y) * tw;
+		for (uint32_t x = 0; x < tw; x++)
+			dst[x] = src[srcX[x]];
 	}
+	return true;
+}
 
-	if (!done)
+ui::draw::ImageHandle CreateImageFrom(IDataSource* ds, ui::StringView fmt, const ImageInfo& info)
+{
+	ui::Canvas c;
+	if (!DecodeImage(ds, fmt, info, c))
 		return nullptr;
 
 	return ui::draw::ImageCreateFromCanvas(c, ui::draw::TexFlags::Repeat | ui::draw::TexFlags::NoFilter);
@@ -15,4 +15,17 @@ struct ImageInfo
 size_t GetImageFormatCount();
 ui::StringView GetImageFormatCategory(size_t fid);
 ui::StringView GetImageFormatName(size_t fid);
+// rows are stored in strips of this many rows (e.g. 4 for block compressed formats)
+uint32_t GetImageFormatStripRows(size_t fid);
+uint64_t GetImageDataSize(size_t fid, uint32_t width, uint32_t height);
+bool ImageFormatHasPalette(size_t fid);
+// decodes the image into `out` (resized to the image size), returns false if the format is not known
+// - `parallel` splits the rows between the workers
+bool DecodeImage(IDataSource* ds, ui::StringView fmt, const ImageInfo& info, ui::Canvas& out, bool parallel = true);
+// decodes only the rows [y; y + count) of the image (and the strips they're in)
+bool DecodeImageRows(IDataSource* ds, ui::StringView fmt, const ImageInfo& info, uint32_t y, uint32_t count, ui::Canvas& out);
+// decodes the palette colors of palettized formats, returns false if the format has no palette
+bool DecodeImagePalette(IDataSource* ds, ui::StringView fmt, int64_t offPal, std::vector<uint32_t>& colors);
+// decodes the image scaled down to fit in maxSize x maxSize, only the rows that are sampled are read
+bool DecodeImageThumbnail(IDataSource* ds, ui::StringView fmt, const ImageInfo& info, uint32_t maxSize, ui::Canvas& out);
 ui::draw::ImageHandle CreateImageFrom(IDataSource* ds, ui::StringView fmt, const ImageInfo& info);
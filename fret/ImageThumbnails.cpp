@@ -0,0 +1,288 @@
+
+#include "pch.h"
+#include "ImageThumbnails.h"
+
+#include <future>
+
+
+ui::DataCategoryTag DCT_ImageThumbnails[1];
+
+
+size_t ImageThumbnailKeyHash::operator () (const ImageThumbnailKey& k) const
+{
+	size_t h = std::hash<std::string>()(k.format);
+	for (uint64_t v : { uint64_t(uintptr_t(k.file)), uint64_t(k.offImage), uint64_t(k.offPalette), (uint64_t(k.width) << 32) | k.height })
+		h = (h ^ size_t(v)) * size_t(0x9e3779b97f4a7c15ULL);
+	return h;
+}
+
+
+ImageThumbnailKey ImageThumbnailCache::GetKey(const DataDesc::Image& img)
+{
+	return { img.file, img.offImage, img.offPalette, img.format, img.width, img.height };
+}
+
+ui::draw::ImageHandle ImageThumbnailCache::Get(const ImageThumbnailKey& key)
+{
+	auto it = _entryMap.find(key);
+	if (it == _entryMap.end())
+		return nullptr;
+	_entries.splice(_entries.begin(), _entries, it->second);
+	return it->second->image;
+}
+
+void ImageThumbnailCache::Request(std::vector<ImageThumbnailKey>&& keys)
+{
+	if (keys == _lastRequest)
+		return;
+	_lastRequest = keys;
+	if (keys.empty())
+	{
+		_queue.Clear();
+		return;
+	}
+
+	// data sources are accessed from the worker in the same way as by the search
+	std::vector<IDataSource*> sources;
+	for (const auto& K : keys)
+		sources.push_back(K.file->dataSource);
+
+	_queue.Push([this, keys{ std::move(keys) }, sources{ std::move(sources) }]()
+	{
+		for (size_t i = 0; i < keys.size(); i++)
+		{
+			// a newer request replaces this one
+			if (_queue.HasItems() || _queue.IsQuitting())
+				return;
+
+			const auto& K = keys[i];
+			Decoded D = { K };
+			D.valid = DecodeImageThumbnail(sources[i], K.format, { K.offImage, K.offPalette, K.width, K.height }, THUMBNAIL_SIZE, D.canvas);
+			bool notify;
+			{
+				std::lock_guard<std::mutex> g(_pendingMutex);
+				_pending.push_back(std::move(D));
+				// the thumbnails decoded until the next Update are picked up by one notification
+				notify = !_notifyQueued;
+				_notifyQueued = true;
+			}
+			if (!notify)
+				continue;
+			// only the address is used, the cache may be gone by the time the event runs
+			uintptr_t at = reinterpret_cast<uintptr_t>(this);
+			ui::Application::PushEvent([at]() { ui::Notify(DCT_ImageThumbnails, at); });
+		}
+	}, true);
+}
+
+void ImageThumbnailCache::Update()
+{
+	std::vector<Decoded> decoded;
+	{
+		std::lock_guard<std::mutex> g(_pendingMutex);
+		decoded.swap(_pending);
+		_notifyQueued = false;
+	}
+	if (decoded.empty())
+		return;
+
+	for (auto& D : decoded)
+	{
+		if (_entryMap.count(D.key))
+			continue;
+		// failed decodes are cached too, as empty entries, so that they are not requested again
+		ui::draw::ImageHandle image;
+		if (D.valid && D.canvas.GetNumPixels())
+			image = ui::draw::ImageCreateFromCanvas(D.canvas, ui::draw::TexFlags::NoFilter);
+		_entries.push_front({ D.key, image, std::max(D.canvas.GetSizeBytes(), size_t(64)) });
+		_entryMap[D.key] = _entries.begin();
+		_bytes += _entries.front().bytes;
+	}
+	_Evict();
+	// the decoded ones are not missing anymore
+	_lastRequest.clear();
+}
+
+void ImageThumbnailCache::Clear()
+{
+	// the data sources may be deleted after this, so wait until the running request is stopped
+	std::promise<void> stopped;
+	_queue.Push([&stopped]() { stopped.set_value(); }, true);
+	stopped.get_future().wait();
+	{
+		std::lock_guard<std::mutex> g(_pendingMutex);
+		_pending.clear();
+		_notifyQueued = false;
+	}
+	_entries.clear();
+	_entryMap.clear();
+	_bytes = 0;
+	_lastRequest.clear();
+}
+
+void ImageThumbnailCache::_Evict()
+{
+	// the most recently used one is always kept
+	while (_bytes > maxBytes && _entries.size() > 1)
+	{
+		_bytes -= _entries.back().bytes;
+		_entryMap.erase(_entries.back().key);
+		_entries.pop_back();
+	}
+}
+
+
+ui::UIRect ImageThumbnailGrid::GetGridRect()
+{
+	auto r = finalRectC;
+	r.x1 -= ResolveUnits(scrollbar.GetWidth(), r.GetWidth());
+	return r;
+}
+
+float ImageThumbnailGrid::GetContentHeight()
+{
+	float cellHeight = ImageThumbnailCache::THUMBNAIL_SIZE + CELL_PADDING * 2 + LABEL_HEIGHT;
+	size_t numRows = (imgSrc->GetNumRows() + GetNumColumns() - 1) / GetNumColumns();
+	return numRows * cellHeight;
+}
+
+int ImageThumbnailGrid::GetNumColumns()
+{
+	float cellWidth = ImageThumbnailCache::THUMBNAIL_SIZE + CELL_PADDING * 2;
+	return std::max(1, int(GetGridRect().GetWidth() / cellWidth));
+}
+
+ui::UIRect ImageThumbnailGrid::GetCellRect(size_t pos)
+{
+	float cellWidth = ImageThumbnailCache::THUMBNAIL_SIZE + CELL_PADDING * 2;
+	float cellHeight = cellWidth + LABEL_HEIGHT;
+	int cols = GetNumColumns();
+	float x = finalRectC.x0 + (pos % cols) * cellWidth;
+	float y = finalRectC.y0 + (pos / cols) * cellHeight - *scrollPos;
+	return { x, y, x + cellWidth, y + cellHeight };
+}
+
+size_t ImageThumbnailGrid::GetCellAt(ui::Point2f pos)
+{
+	auto gridRect = GetGridRect();
+	if (!gridRect.Contains(pos))
+		return SIZE_MAX;
+	float cellWidth = ImageThumbnailCache::THUMBNAIL_SIZE + CELL_PADDING * 2;
+	float cellHeight = cellWidth + LABEL_HEIGHT;
+	int cols = GetNumColumns();
+	int col = int((pos.x - gridRect.x0) / cellWidth);
+	if (col >= cols)
+		return SIZE_MAX;
+	size_t row = size_t((pos.y - gridRect.y0 + *scrollPos) / cellHeight);
+	size_t cell = row * cols + col;
+	return cell < imgSrc->GetNumRows() ? cell : SIZE_MAX;
+}
+
+void ImageThumbnailGrid::OnEvent(ui::Event& e)
+{
+	auto gridRect = GetGridRect();
+	auto sbRect = finalRectC;
+	sbRect.x0 = gridRect.x1;
+	float prevScroll = *scrollPos;
+	scrollbar.OnEvent({ this, sbRect, gridRect.GetHeight(), GetContentHeight(), *scrollPos }, e);
+	if (*scrollPos != prevScroll)
+	{
+		hoverCell = GetCellAt(e.position);
+		GetNativeWindow()->InvalidateAll();
+	}
+	if (e.type == ui::EventType::MouseScroll)
+		e.StopPropagation();
+	if (e.IsPropagationStopped())
+		return;
+
+	if (e.type == ui::EventType::MouseMove)
+	{
+		size_t cell = GetCellAt(e.position);
+		if (cell != hoverCell)
+		{
+			hoverCell = cell;
+			GetNativeWindow()->InvalidateAll();
+		}
+	}
+	else if (e.type == ui::EventType::MouseLeave)
+	{
+		if (hoverCell != SIZE_MAX)
+		{
+			hoverCell = SIZE_MAX;
+			GetNativeWindow()->InvalidateAll();
+		}
+	}
+	else if (e.type == ui::EventType::ButtonDown && e.GetButton() == ui::MouseButton::Left)
+	{
+		size_t cell = GetCellAt(e.position);
+		if (cell != SIZE_MAX && !imgSrc->GetSelectionState(cell))
+		{
+			imgSrc->ClearSelection();
+			imgSrc->SetSelectionState(cell, true);
+			ui::Event selev(e.context, this, ui::EventType::SelectionChange);
+			e.context->BubblingEvent(selev);
+			GetNativeWindow()->InvalidateAll();
+		}
+	}
+}
+
+void ImageThumbnailGrid::OnPaint()
+{
+	cache->Update();
+
+	auto& images = imgSrc->dataDesc->images;
+	size_t count = imgSrc->GetNumRows();
+	auto gridRect = GetGridRect();
+	float cellWidth = ImageThumbnailCache::THUMBNAIL_SIZE + CELL_PADDING * 2;
+	float cellHeight = cellWidth + LABEL_HEIGHT;
+	int cols = GetNumColumns();
+	// the row count may have been reduced by filtering or a wider grid
+	float contentHeight = GetContentHeight();
+	*scrollPos = ui::min(*scrollPos, std::max(0.0f, contentHeight - gridRect.GetHeight()));
+	size_t firstRow = size_t(*scrollPos / cellHeight);
+	size_t lastRow = size_t((*scrollPos + gridRect.GetHeight()) / cellHeight);
+	size_t first = std::min(firstRow * cols, count);
+	size_t end = std::min((lastRow + 1) * cols, count);
+
+	ui::draw::PushScissorRect(gridRect.Cast<int>());
+
+	ui::Font* font = ui::GetFontByFamily(ui::FONT_FAMILY_SANS_SERIF);
+	ui::Color4b colSelect(255, 179, 166, 127);
+	ui::Color4b colHover(255, 77);
+	ui::Color4b colText(255, 200);
+	std::vector<ImageThumbnailKey> missing;
+	for (size_t i = first; i < end; i++)
+	{
+		auto& IMG = images[imgSrc->_indices[i]];
+		auto r = GetCellRect(i);
+		if (imgSrc->GetSelectionState(i))
+			ui::draw::RectCol(r.x0, r.y0, r.x1, r.y1, colSelect);
+		else if (i == hoverCell)
+			ui::draw::RectCol(r.x0, r.y0, r.x1, r.y1, colHover);
+
+		auto key = ImageThumbnailCache::GetKey(IMG);
+		if (auto img = cache->Get(key))
+		{
+			// fit the thumbnail in the cell, keeping the aspect ratio
+			float iw = img->GetWidth();
+			float ih = img->GetHeight();
+			float scale = ImageThumbnailCache::THUMBNAIL_SIZE / std::max(iw, ih);
+			float x = (r.x0 + r.x1 - iw * scale) * 0.5f;
+			float y = r.y0 + CELL_PADDING + (ImageThumbnailCache::THUMBNAIL_SIZE - ih * scale) * 0.5f;
+			ui::draw::RectTex(x, y, x + iw * scale, y + ih * scale, img);
+		}
+		else if (!cache->_entryMap.count(key))
+			missing.push_back(key);
+
+		auto label = ui::Format("%zu: %ux%u %s", imgSrc->_indices[i], IMG.width, IMG.height, IMG.format.c_str());
+		ui::draw::TextLine(font, 11, r.x0 + CELL_PADDING, r.y1 - 4, label, colText);
+	}
+
+	ui::draw::PopScissorRect();
+
+	auto sbRect = finalRectC;
+	sbRect.x0 = gridRect.x1;
+	scrollbar.OnPaint({ this, sbRect, gridRect.GetHeight(), contentHeight, *scrollPos });
+
+	cache->Request(std::move(missing));
+}
@@ -0,0 +1,120 @@
+
+#pragma once
+#include "pch.h"
+#include "DataDesc.h"
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+
+struct ImageThumbnailKey
+{
+	DDFile* file;
+	int64_t offImage;
+	int64_t offPalette;
+	std::string format;
+	uint32_t width;
+	uint32_t height;
+
+	bool operator == (const ImageThumbnailKey& o) const
+	{
+		return file == o.file
+			&& offImage == o.offImage
+			&& offPalette == o.offPalette
+			&& format == o.format
+			&& width == o.width
+			&& height == o.height;
+	}
+};
+
+struct ImageThumbnailKeyHash
+{
+	size_t operator () (const ImageThumbnailKey& k) const;
+};
+
+extern ui::DataCategoryTag DCT_ImageThumbnails[1];
+
+// LRU cache of image thumbnails limited by the size of their pixels
+// thumbnails are decoded on a worker thread, only the ones requested by the last Request call
+struct ImageThumbnailCache
+{
+	static constexpr uint32_t THUMBNAIL_SIZE = 128;
+
+	static ImageThumbnailKey GetKey(const DataDesc::Image& img);
+
+	// returns nullptr if the thumbnail has not been decoded yet
+	ui::draw::ImageHandle Get(const ImageThumbnailKey& key);
+	// replaces the thumbnails waiting to be decoded, in order (e.g. the missing ones on screen)
+	void Request(std::vector<ImageThumbnailKey>&& keys);
+	// creates the images of the decoded thumbnails (DCT_ImageThumbnails is notified once when there are new ones)
+	void Update();
+	void Clear();
+
+	void _Evict();
+
+	size_t maxBytes = 64 * 1024 * 1024;
+
+	struct Entry
+	{
+		ImageThumbnailKey key;
+		ui::draw::ImageHandle image;
+		size_t bytes;
+	};
+	// most recently used first
+	std::list<Entry> _entries;
+	std::unordered_map<ImageThumbnailKey, std::list<Entry>::iterator, ImageThumbnailKeyHash> _entryMap;
+	size_t _bytes = 0;
+	std::vector<ImageThumbnailKey> _lastRequest;
+
+	struct Decoded
+	{
+		ImageThumbnailKey key;
+		ui::Canvas canvas;
+		bool valid;
+	};
+	std::mutex _pendingMutex;
+	std::vector<Decoded> _pending;
+	// a notification was sent for the pending thumbnails
+	bool _notifyQueued = false;
+
+	// last so that the worker is stopped first
+	ui::WorkerQueue _queue;
+};
+
+// scrollable grid of the thumbnails of the filtered images, only the visible ones are requested
+// hovering and scrolling only repaint it, selecting a cell sends SelectionChange
+struct ImageThumbnailGrid : ui::UIElement
+{
+	static constexpr float CELL_PADDING = 4;
+	static constexpr float LABEL_HEIGHT = 16;
+
+	ImageThumbnailGrid()
+	{
+		GetStyle().SetWidth(ui::Coord::Percent(100));
+		GetStyle().SetHeight(ui::Coord::Percent(100));
+	}
+	void OnEvent(ui::Event& e) override;
+	void OnPaint() override;
+
+	// index in the filtered list, SIZE_MAX if none
+	size_t GetCellAt(ui::Point2f pos);
+	ui::UIRect GetCellRect(size_t pos);
+	int GetNumColumns();
+	// the content rect without the scrollbar
+	ui::UIRect GetGridRect();
+	float GetContentHeight();
+
+	void Init(DataDescImageSource* src, ImageThumbnailCache* c, float* scroll)
+	{
+		imgSrc = src;
+		cache = c;
+		scrollPos = scroll;
+	}
+
+	DataDescImageSource* imgSrc = nullptr;
+	ImageThumbnailCache* cache = nullptr;
+	float* scrollPos = nullptr;
+	size_t hoverCell = SIZE_MAX;
+	ui::ScrollbarV scrollbar;
+};
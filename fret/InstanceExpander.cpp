@@ -0,0 +1,348 @@
+
+#include "pch.h"
+#include "InstanceExpander.h"
+
+#include "DataDesc.h"
+
+
+namespace ui {
+double hqtime();
+} // ui
+
+
+// instances per batch, the new instances of a batch are added before the next one is evaluated
+static constexpr size_t EXPANSION_BATCH_SIZE = 4096;
+// time spent in one Update
+static constexpr double EXPANSION_STEP_TIME = 0.05;
+
+ui::DataCategoryTag DCT_InstanceExpansion[1];
+
+
+struct PlannedInstance
+{
+	DDStructInst inst;
+	// position in the array that the instance belongs to, -1 if not an array element
+	int64_t arrayPos;
+	int64_t arraySize;
+};
+
+struct ExpansionPlan
+{
+	bool valid = false;
+	// merging the earlier instances may change these, in which case the plan is not used
+	int64_t remainingCount = 0;
+	bool remainingCountIsSize = false;
+	std::vector<PlannedInstance> insts;
+};
+
+static bool SameArgs(const std::vector<DDArg>& a, const std::vector<DDArg>& b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); i++)
+		if (a[i].name != b[i].name || a[i].intVal != b[i].intVal)
+			return false;
+	return true;
+}
+
+// the same as DDStructInst::CreateNextInstance without adding the instance
+static bool PlanNextInstance(const DDStructInst& SI, DDStructInst& out)
+{
+	int64_t structSize = SI.GetSize();
+	if (structSize == 0)
+		return false;
+	int64_t remSizeSub = SI.remainingCountIsSize ? (SI.sizeOverrideEnable ? SI.sizeOverrideValue : structSize) : 1;
+	if (SI.remainingCount - remSizeSub <= 0)
+		return false;
+	out = SI;
+	out.off += SI.sizeOverrideEnable ? SI.sizeOverrideValue : structSize;
+	out.remainingCount -= remSizeSub;
+	out.sizeOverrideEnable = false;
+	out.sizeOverrideValue = 0;
+	out.creationReason = CreationReason::AutoExpand;
+	// the cached layout was copied from the previous element (the same is done by AddInstance)
+	out.OnEdit();
+	return true;
+}
+
+// the same as DDStructInst::CreateFieldInstances(i, SIZE_MAX, CreationReason::AutoExpand) without adding the instances
+static void PlanFieldInstances(const DDStructInst& SI, size_t i, ExpansionPlan& plan)
+{
+	auto& F = SI.def->fields[i];
+	auto* desc = SI.desc;
+	auto* file = SI.file;
+	auto cr = CreationReason::AutoExpand;
+
+	if (!F.valueExpr.expr.empty())
+		return;
+
+	int64_t numElements = SI.GetFieldElementCount(i);
+	if (F.IsComputed() && F.individualComputedOffsets)
+	{
+		SI._EnumerateFields(i + 1);
+		DDStructInst newSI = { -1, desc, desc->structs.find(F.type)->second, file, 0, "", cr };
+		for (size_t n = 0; n < numElements; n++)
+		{
+			{
+				PredefinedConstant constants[] =
+				{
+					{ "i", n },
+					{ "orig", SI.cachedFields[i].origOff },
+				};
+				VariableSource vs;
+				{
+					vs.desc = desc;
+					vs.root = &SI;
+					vs.constants = constants;
+					vs.sharedValues = &SI.sharedValues;
+					vs.constantCount = sizeof(constants) / sizeof(constants[0]);
+				}
+				newSI.off = F.offExpr.Evaluate(vs);
+				if (newSI.off >= file->dataSource->GetSize())
+					continue;
+			}
+
+			if (F.elementCondition.inst)
+			{
+				PredefinedConstant constants[] =
+				{
+					{ "i", n },
+					{ "off", newSI.off },
+					{ "orig", SI.cachedFields[i].origOff },
+				};
+				VariableSource vs;
+				{
+					vs.desc = desc;
+					vs.root = &SI;
+					vs.constants = constants;
+					vs.sharedValues = &SI.sharedValues;
+					vs.constantCount = sizeof(constants) / sizeof(constants[0]);
+				}
+				if (!F.elementCondition.Evaluate(vs))
+					continue;
+			}
+
+			// arguments only end up on new instances, same as when they're added after creation
+			plan.insts.push_back({ newSI, -1, 0 });
+			for (auto& SA : F.structArgs)
+				plan.insts.back().inst.args.push_back({ SA.name, SI.GetCompArgValue(SA) });
+		}
+	}
+	else
+	{
+		DDStructInst newSI = { -1, desc, desc->structs.find(F.type)->second, file, SI.GetFieldOffset(i), "", cr };
+		newSI.remainingCountIsSize = F.countIsMaxSize;
+		newSI.remainingCount = numElements;
+		for (auto& SA : F.structArgs)
+			newSI.args.push_back({ SA.name, SI.GetCompArgValue(SA) });
+		plan.insts.push_back({ newSI, 0, numElements });
+
+		size_t n = 0;
+		while (n < numElements && plan.insts.back().inst.CanCreateNextInstance() == OptionalBool::True)
+		{
+			DDStructInst next;
+			if (!PlanNextInstance(plan.insts.back().inst, next))
+				break;
+			n++;
+			plan.insts.push_back({ std::move(next), int64_t(n), numElements });
+		}
+	}
+}
+
+// evaluates the instance (and the planned array elements) without changing any other instances
+static void PlanExpansion(const DDStructInst& SI, ExpansionPlan& plan)
+{
+	plan.valid = true;
+	plan.remainingCount = SI.remainingCount;
+	plan.remainingCountIsSize = SI.remainingCountIsSize;
+
+	DDStructInst next;
+	if (PlanNextInstance(SI, next))
+		plan.insts.push_back({ std::move(next), -1, 0 });
+
+	auto& S = *SI.def;
+	for (size_t j = 0, jn = S.fields.size(); j < jn; j++)
+		if (SI.IsFieldPresent(j) && SI.desc->structs.count(S.fields[j].type))
+			PlanFieldInstances(SI, j, plan);
+}
+
+static void ExpandSerially(DataDesc* desc, DDStructInst* SI)
+{
+	auto& S = *SI->def;
+
+	SI->CreateNextInstance(CreationReason::AutoExpand);
+
+	for (size_t j = 0, jn = S.fields.size(); j < jn; j++)
+		if (SI->IsFieldPresent(j) && desc->structs.count(S.fields[j].type))
+			SI->CreateFieldInstances(j, SIZE_MAX, CreationReason::AutoExpand);
+}
+
+static void ExpandPlanned(DataDesc* desc, DDStructInst* SI, ExpansionPlan& plan)
+{
+	if (!plan.valid ||
+		SI->remainingCount != plan.remainingCount ||
+		SI->remainingCountIsSize != plan.remainingCountIsSize)
+	{
+		ExpandSerially(desc, SI);
+		return;
+	}
+
+	for (size_t k = 0; k < plan.insts.size(); k++)
+	{
+		auto& PI = plan.insts[k];
+		size_t prevSize = desc->instances.size();
+		DDStructInst* NI = desc->AddInstance(PI.inst);
+		if (PI.arrayPos < 0 || prevSize != desc->instances.size())
+			continue;
+
+		// an existing array element was found, the rest of the array is based on it instead
+		if (NI->sizeOverrideEnable || !SameArgs(NI->args, PI.inst.args))
+		{
+			size_t n = size_t(PI.arrayPos);
+			while (n < PI.arraySize && NI && NI->CanCreateNextInstance() == OptionalBool::True)
+			{
+				NI = NI->CreateNextInstance(CreationReason::AutoExpand);
+				n++;
+			}
+			while (k + 1 < plan.insts.size() && plan.insts[k + 1].arrayPos > PI.arrayPos)
+				k++;
+		}
+	}
+}
+
+
+bool IsStructEvaluationLocal(DataDesc* desc, DDStruct* S)
+{
+	// all structs that may be evaluated along with the instances of S
+	std::vector<DDStruct*> stack = { S };
+	std::unordered_set<DDStruct*> visited = { S };
+	bool safe = true;
+	while (safe && !stack.empty())
+	{
+		auto* CS = stack.back();
+		stack.pop_back();
+		for (auto& F : CS->fields)
+		{
+			for (auto* E : { &F.valueExpr, &F.offExpr, &F.condition, &F.elementCondition })
+				if (E->inst && !E->inst->IsLocal())
+					safe = false;
+			if (auto* FS = desc->FindStructByName(F.type))
+			{
+				// sizes of serialized fields are found by creating their instances
+				if (CS->serialized && FS->serialized)
+					safe = false;
+				if (visited.insert(FS).second)
+					stack.push_back(FS);
+			}
+		}
+	}
+	return safe;
+}
+
+void InstanceExpander::Start(DataDesc* desc, DDFile* filterFile)
+{
+	_desc = desc;
+	_filterFile = filterFile;
+	_next = 0;
+	_parallelSafe.clear();
+	_parallelSafeVersion = 0;
+	progress = 0;
+	numExpanded = 0;
+	numCreated = 0;
+	time = 0;
+}
+
+void InstanceExpander::Cancel()
+{
+	_desc = nullptr;
+	progress = 1;
+}
+
+bool InstanceExpander::Step(double maxTime)
+{
+	if (!_desc)
+		return true;
+
+	double t0 = ui::hqtime();
+	auto& instances = _desc->instances;
+	std::vector<DDStructInst*> batch;
+	std::vector<bool> canPlan;
+	std::vector<ExpansionPlan> plans;
+	while (_next < instances.size())
+	{
+		size_t end = std::min(_next + EXPANSION_BATCH_SIZE, instances.size());
+		batch.clear();
+		canPlan.clear();
+		for (size_t i = _next; i < end; i++)
+		{
+			auto* SI = instances[i];
+			if (_filterFile && SI->file != _filterFile)
+				continue;
+			if (!SI->allowAutoExpand)
+				continue;
+			// struct edits are applied to the caches here, the workers must not update the shared dependency data
+			SI->_CheckFieldCache();
+			batch.push_back(SI);
+			canPlan.push_back(allowParallel && _IsParallelSafe(SI->def));
+		}
+
+		plans.clear();
+		plans.resize(batch.size());
+		ui::ParallelFor(batch.size(), [&](size_t i)
+		{
+			if (canPlan[i])
+				PlanExpansion(*batch[i], plans[i]);
+		});
+
+		size_t prevCount = instances.size();
+		_desc->BeginInstanceBatch();
+		for (size_t i = 0; i < batch.size(); i++)
+			ExpandPlanned(_desc, batch[i], plans[i]);
+		_desc->EndInstanceBatch();
+
+		numCreated += instances.size() - prevCount;
+		numExpanded += batch.size();
+		_next = end;
+		if (ui::hqtime() - t0 >= maxTime)
+			break;
+	}
+	time += ui::hqtime() - t0;
+
+	if (_next >= instances.size())
+	{
+		Cancel();
+		return true;
+	}
+	progress = float(_next) / float(instances.size());
+	return false;
+}
+
+void InstanceExpander::Update()
+{
+	if (!_desc)
+		return;
+	Step(EXPANSION_STEP_TIME);
+	// only the address is used, the expander may be gone by the time the event runs
+	uintptr_t at = reinterpret_cast<uintptr_t>(this);
+	ui::Application::PushEvent([at]() { ui::Notify(DCT_InstanceExpansion, at); });
+}
+
+bool InstanceExpander::_IsParallelSafe(DDStruct* S)
+{
+	// any struct may be a field of S, so all results are dropped after an edit
+	if (_parallelSafeVersion != DDStruct::lastEditVersion)
+	{
+		_parallelSafe.clear();
+		_parallelSafeVersion = DDStruct::lastEditVersion;
+		// the workers may fill the caches of any struct's instances, which must not recompile the shared subexpressions
+		for (auto& S : _desc->structs)
+			S.second->_UpdateSharedSubexprs();
+	}
+	auto it = _parallelSafe.find(S);
+	if (it != _parallelSafe.end())
+		return it->second;
+
+	bool safe = IsStructEvaluationLocal(_desc, S);
+	_parallelSafe[S] = safe;
+	return safe;
+}
@@ -0,0 +1,51 @@
+
+#pragma once
+#include "pch.h"
+
+#include <unordered_map>
+
+
+struct DataDesc;
+struct DDFile;
+struct DDStruct;
+struct DDStructInst;
+
+extern ui::DataCategoryTag DCT_InstanceExpansion[1];
+
+// true if the instances of S can be evaluated without looking at or creating other instances
+// (the structs of its fields are checked as well)
+bool IsStructEvaluationLocal(DataDesc* desc, DDStruct* S);
+
+// expands instances like DataDesc::ExpandAllInstances, in steps so that it can run alongside the UI
+// the instances that were added by the previous steps form the frontier, which is processed in batches:
+// - the new instances of each are found in parallel (the struct layouts are evaluated by the workers)
+// - they are added in order, so the result is the same as expanding one instance at a time
+// instances are only evaluated in parallel if their structs don't query other instances
+struct InstanceExpander
+{
+	void Start(DataDesc* desc, DDFile* filterFile = nullptr);
+	void Cancel();
+	// expands for at least `maxTime` seconds or until done, returns true if done
+	bool Step(double maxTime);
+	// runs a step and schedules the next one (DCT_InstanceExpansion is notified)
+	void Update();
+	bool IsRunning() const { return _desc != nullptr; }
+
+	bool _IsParallelSafe(DDStruct* S);
+
+	bool allowParallel = true;
+
+	// 1 if not running
+	float progress = 1;
+	size_t numExpanded = 0;
+	size_t numCreated = 0;
+	double time = 0;
+
+	DataDesc* _desc = nullptr;
+	DDFile* _filterFile = nullptr;
+	// first instance that hasn't been expanded yet
+	size_t _next = 0;
+	std::unordered_map<DDStruct*, bool> _parallelSafe;
+	// DDStruct::lastEditVersion when _parallelSafe was filled
+	uint32_t _parallelSafeVersion = 0;
+};
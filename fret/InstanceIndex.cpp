@@ -0,0 +1,176 @@
+#include "pch.h"
+#include "InstanceIndex.h"
+
+
+static const std::vector<DDStructInst*> g_noInstances;
+
+
+void InstanceIndex::Rebuild()
+{
+	_byID.clear();
+	_byStruct.clear();
+	_byFile.clear();
+	for (auto* SI : *instances)
+		OnAdded(SI);
+}
+
+void InstanceIndex::OnAdded(DDStructInst* SI)
+{
+	_byID[SI->id] = { SI, UINT32_MAX };
+	_byStruct[SI->def].push_back(SI);
+	auto& FE = _byFile[SI->file];
+	FE.instances.push_back(SI);
+	FE.byOffset.emplace(SI->off, SI);
+	if (FE.treeBuilt)
+		FE.treePending.push_back(SI);
+}
+
+static void EraseInstance(std::vector<DDStructInst*>& list, DDStructInst* SI)
+{
+	auto it = std::find(list.begin(), list.end(), SI);
+	if (it != list.end())
+		list.erase(it);
+}
+
+static void EraseAtOffset(std::unordered_multimap<int64_t, DDStructInst*>& byOffset, int64_t off, DDStructInst* SI)
+{
+	auto range = byOffset.equal_range(off);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second == SI)
+		{
+			byOffset.erase(it);
+			break;
+		}
+	}
+}
+
+void InstanceIndex::OnRemoved(DDStructInst* SI)
+{
+	auto it = _byID.find(SI->id);
+	if (it == _byID.end() || it->second.inst != SI)
+		return;
+
+	auto& FE = _byFile[SI->file];
+	_RemoveFromTree(FE, it->second);
+	EraseInstance(FE.instances, SI);
+	EraseAtOffset(FE.byOffset, SI->off, SI);
+	EraseInstance(_byStruct[SI->def], SI);
+	_byID.erase(it);
+}
+
+void InstanceIndex::OnMoved(DDStructInst* SI, int64_t prevOff)
+{
+	auto it = _byID.find(SI->id);
+	if (it == _byID.end() || it->second.inst != SI)
+		return;
+
+	auto& FE = _byFile[SI->file];
+	EraseAtOffset(FE.byOffset, prevOff, SI);
+	FE.byOffset.emplace(SI->off, SI);
+	_RemoveFromTree(FE, it->second);
+	if (FE.treeBuilt)
+		FE.treePending.push_back(SI);
+}
+
+DDStructInst* InstanceIndex::FindByID(int64_t id) const
+{
+	auto it = _byID.find(id);
+	return it != _byID.end() ? it->second.inst : nullptr;
+}
+
+DDStructInst* InstanceIndex::FindAt(DDFile* file, DDStruct* def, int64_t off) const
+{
+	auto fit = _byFile.find(file);
+	if (fit == _byFile.end())
+		return nullptr;
+	auto range = fit->second.byOffset.equal_range(off);
+	for (auto it = range.first; it != range.second; ++it)
+		if (it->second->def == def)
+			return it->second;
+	return nullptr;
+}
+
+const std::vector<DDStructInst*>& InstanceIndex::GetStructInstances(DDStruct* def) const
+{
+	auto it = _byStruct.find(def);
+	return it != _byStruct.end() ? it->second : g_noInstances;
+}
+
+const std::vector<DDStructInst*>& InstanceIndex::GetFileInstances(DDFile* file) const
+{
+	auto it = _byFile.find(file);
+	return it != _byFile.end() ? it->second.instances : g_noInstances;
+}
+
+void InstanceIndex::QueryRange(DDFile* file, uint64_t start, uint64_t end, std::vector<DDStructInst*>& out)
+{
+	auto fit = _byFile.find(file);
+	if (fit == _byFile.end())
+		return;
+	auto& FE = fit->second;
+
+	_UpdateTree(FE);
+	_queryIDs.clear();
+	FE.tree.Query(start, end, _queryIDs);
+	for (uint32_t slot : _queryIDs)
+		if (auto* SI = FE.treeSlots[slot])
+			out.push_back(SI);
+}
+
+void InstanceIndex::_UpdateTree(FileEntry& FE)
+{
+	// a new tree is built if the sizes may have changed or too much of it would be updated
+	if (!FE.treeBuilt ||
+		FE.treeStructVersion != DDStruct::lastEditVersion ||
+		FE.numFreeSlots > FE.treeSlots.size() / 2 ||
+		FE.treePending.size() > FE.treeSlots.size())
+	{
+		for (auto* SI : FE.treeSlots)
+			if (SI)
+				_byID[SI->id].treeSlot = UINT32_MAX;
+		FE.tree.Clear();
+		FE.treeSlots.clear();
+		FE.numFreeSlots = 0;
+		FE.treePending.clear();
+		for (auto* SI : FE.instances)
+			_AddToTree(FE, SI, false);
+		FE.tree.Build();
+		FE.treeBuilt = true;
+		FE.treeStructVersion = DDStruct::lastEditVersion;
+		return;
+	}
+
+	for (auto* SI : FE.treePending)
+		_AddToTree(FE, SI, true);
+	FE.treePending.clear();
+}
+
+void InstanceIndex::_AddToTree(FileEntry& FE, DDStructInst* SI, bool built)
+{
+	if (SI->off < 0)
+		return;
+	// sizes that can't be determined without reading more of the file count as 1 byte
+	int64_t size = SI->def ? SI->GetSize(true) : 1;
+	uint64_t start = SI->off;
+	uint64_t end = start + std::max(size, int64_t(1));
+	uint32_t slot = uint32_t(FE.treeSlots.size());
+	FE.treeSlots.push_back(SI);
+	_byID[SI->id].treeSlot = slot;
+	if (built)
+		FE.tree.Insert(start, end, slot);
+	else
+		FE.tree.Add(start, end, slot);
+}
+
+void InstanceIndex::_RemoveFromTree(FileEntry& FE, InstanceEntry& E)
+{
+	if (E.treeSlot != UINT32_MAX)
+	{
+		FE.treeSlots[E.treeSlot] = nullptr;
+		FE.numFreeSlots++;
+		E.treeSlot = UINT32_MAX;
+	}
+	else if (FE.treeBuilt)
+		EraseInstance(FE.treePending, E.inst);
+}
@@ -0,0 +1,63 @@
+
+#pragma once
+#include "pch.h"
+#include "DataDescStruct.h"
+#include "IntervalTree.h"
+
+
+struct DDFile;
+
+// lookup structures over a list of struct instances (which is only appended to or erased from, so the lists here are in its order)
+// the lookups are updated in place as instances are added, removed or moved,
+// only the range tree of a file is rebuilt (on first use) when the struct sizes may have changed
+struct InstanceIndex
+{
+	struct FileEntry
+	{
+		std::vector<DDStructInst*> instances;
+		std::unordered_multimap<int64_t, DDStructInst*> byOffset;
+		// [off, off + size) of each instance, the ids are indices in treeSlots (cleared when the instance is removed or moved)
+		IntervalTree tree;
+		std::vector<DDStructInst*> treeSlots;
+		size_t numFreeSlots = 0;
+		// added or moved since the tree was built, inserted on the next query
+		std::vector<DDStructInst*> treePending;
+		bool treeBuilt = false;
+		// sizes depend on the struct definitions
+		CacheVersion treeStructVersion = 0;
+	};
+	struct InstanceEntry
+	{
+		DDStructInst* inst;
+		// in FileEntry::treeSlots, UINT32_MAX if not in the tree
+		uint32_t treeSlot;
+	};
+
+	void Rebuild();
+	// to be called after an instance is appended to the list
+	void OnAdded(DDStructInst* SI);
+	// to be called before an instance is erased from the list
+	void OnRemoved(DDStructInst* SI);
+	// to be called after the offset of an instance is changed
+	void OnMoved(DDStructInst* SI, int64_t prevOff);
+
+	DDStructInst* FindByID(int64_t id) const;
+	// the instance of `def` at `off` in `file`, nullptr if there is none
+	DDStructInst* FindAt(DDFile* file, DDStruct* def, int64_t off) const;
+	// in list order
+	const std::vector<DDStructInst*>& GetStructInstances(DDStruct* def) const;
+	const std::vector<DDStructInst*>& GetFileInstances(DDFile* file) const;
+	// appends the instances in `file` overlapping [start, end), in no particular order
+	void QueryRange(DDFile* file, uint64_t start, uint64_t end, std::vector<DDStructInst*>& out);
+
+	void _UpdateTree(FileEntry& FE);
+	void _AddToTree(FileEntry& FE, DDStructInst* SI, bool built);
+	void _RemoveFromTree(FileEntry& FE, InstanceEntry& E);
+
+	const std::vector<DDStructInst*>* instances = nullptr;
+
+	std::unordered_map<int64_t, InstanceEntry> _byID;
+	std::unordered_map<DDStruct*, std::vector<DDStructInst*>> _byStruct;
+	std::unordered_map<DDFile*, FileEntry> _byFile;
+	std::vector<uint32_t> _queryIDs;
+};
@@ -0,0 +1,94 @@
+
+#include "pch.h"
+#include "IntervalTree.h"
+
+
+// inserted ranges are merged when there are this many or 1/8 of the tree size
+static constexpr size_t MIN_MERGE_SIZE = 64;
+
+static bool EntryLess(const IntervalTree::Entry& a, const IntervalTree::Entry& b)
+{
+	return a.start != b.start ? a.start < b.start : a.id < b.id;
+}
+
+void IntervalTree::Clear()
+{
+	_entries.clear();
+	_maxEnd.clear();
+	_inserted.clear();
+}
+
+void IntervalTree::Add(uint64_t start, uint64_t end, uint32_t id)
+{
+	_entries.push_back({ start, end, id });
+}
+
+void IntervalTree::Build()
+{
+	_entries.insert(_entries.end(), _inserted.begin(), _inserted.end());
+	_inserted.clear();
+	std::sort(_entries.begin(), _entries.end(), EntryLess);
+	_maxEnd.resize(_entries.size());
+	_Build(0, _entries.size());
+}
+
+void IntervalTree::Insert(uint64_t start, uint64_t end, uint32_t id)
+{
+	_inserted.push_back({ start, end, id });
+	if (_inserted.size() >= std::max(MIN_MERGE_SIZE, _entries.size() / 8))
+		_MergeInserted();
+}
+
+void IntervalTree::Query(uint64_t start, uint64_t end, std::vector<uint32_t>& outIDs) const
+{
+	if (start >= end)
+		return;
+	_Query(0, _entries.size(), start, end, outIDs);
+	for (const auto& E : _inserted)
+		if (E.end > start && E.start < end && E.start < E.end)
+			outIDs.push_back(E.id);
+}
+
+void IntervalTree::_MergeInserted()
+{
+	std::sort(_inserted.begin(), _inserted.end(), EntryLess);
+	size_t mid = _entries.size();
+	_entries.insert(_entries.end(), _inserted.begin(), _inserted.end());
+	_inserted.clear();
+	std::inplace_merge(_entries.begin(), _entries.begin() + mid, _entries.end(), EntryLess);
+	_maxEnd.resize(_entries.size());
+	_Build(0, _entries.size());
+}
+
+uint64_t IntervalTree::_Build(size_t from, size_t to)
+{
+	if (from >= to)
+		return 0;
+	size_t mid = (from + to) / 2;
+	uint64_t maxEnd = _entries[mid].end;
+	maxEnd = std::max(maxEnd, _Build(from, mid));
+	maxEnd = std::max(maxEnd, _Build(mid + 1, to));
+	_maxEnd[mid] = maxEnd;
+	return maxEnd;
+}
+
+void IntervalTree::_Query(size_t from, size_t to, uint64_t start, uint64_t end, std::vector<uint32_t>& outIDs) const
+{
+	if (from >= to)
+		return;
+	size_t mid = (from + to) / 2;
+	// nothing in this subtree reaches the queried range
+	if (_maxEnd[mid] <= start)
+		return;
+
+	_Query(from, mid, start, end, outIDs);
+
+	// this and everything to the right starts after the queried range
+	const auto& E = _entries[mid];
+	if (E.start >= end)
+		return;
+	if (E.end > start && E.start < E.end)
+		outIDs.push_back(E.id);
+
+	_Query(mid + 1, to, start, end, outIDs);
+}
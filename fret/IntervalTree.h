@@ -0,0 +1,36 @@
+
+#pragma once
+#include "pch.h"
+
+
+// set of [start, end) ranges
+// (implicit balanced tree over the start-sorted ranges, each node keeps the max. end of its subtree)
+// ranges inserted after building are kept in a short unsorted list until there are enough of them to merge into the tree
+struct IntervalTree
+{
+	struct Entry
+	{
+		uint64_t start;
+		uint64_t end;
+		uint32_t id;
+	};
+
+	void Clear();
+	// adds a range before Build
+	void Add(uint64_t start, uint64_t end, uint32_t id);
+	void Build();
+	// adds a range to the built tree
+	void Insert(uint64_t start, uint64_t end, uint32_t id);
+	// appends the ids of all ranges overlapping [start, end), in no particular order
+	void Query(uint64_t start, uint64_t end, std::vector<uint32_t>& outIDs) const;
+	size_t Size() const { return _entries.size() + _inserted.size(); }
+
+	void _MergeInserted();
+	uint64_t _Build(size_t from, size_t to);
+	void _Query(size_t from, size_t to, uint64_t start, uint64_t end, std::vector<uint32_t>& outIDs) const;
+
+	std::vector<Entry> _entries;
+	std::vector<uint64_t> _maxEnd;
+	// not in the tree yet
+	std::vector<Entry> _inserted;
+};
@@ -0,0 +1,606 @@
+
+#include "pch.h"
+#include "MarkerAnalysis.h"
+
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+namespace ui {
+double hqtime();
+} // ui
+
+
+// values per chunk
+static constexpr uint64_t ANALYSIS_CHUNK_SIZE = 64 * 1024;
+// min. time between partial results
+static constexpr double ANALYSIS_PROGRESS_INTERVAL = 0.1;
+
+
+static int CountLeadingZeros64(uint64_t x)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	return _BitScanReverse64(&idx, x) ? 63 - int(idx) : 64;
+#else
+	return x ? __builtin_clzll(x) : 64;
+#endif
+}
+
+static uint64_t HashValueBits(uint64_t x)
+{
+	// splitmix64 finalizer
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+// exact set of values until it gets too big, HyperLogLog estimate after that
+struct UniqueCounter
+{
+	static constexpr int HLL_BITS = 12;
+	static constexpr size_t HLL_REGISTERS = size_t(1) << HLL_BITS;
+	static constexpr size_t EXACT_LIMIT = 16384;
+
+	// open addressing hash set, 0 marks empty slots (stored separately)
+	std::vector<uint64_t> exact;
+	size_t exactCount = 0;
+	bool hasZero = false;
+	bool isExact = true;
+	std::vector<uint8_t> registers = std::vector<uint8_t>(HLL_REGISTERS, 0);
+
+	void Add(uint64_t bits)
+	{
+		uint64_t h = HashValueBits(bits);
+		// the extra bit limits the rank to the remaining hash bits
+		uint8_t rank = uint8_t(CountLeadingZeros64((h << HLL_BITS) | (1ULL << (HLL_BITS - 1))) + 1);
+		uint8_t& reg = registers[size_t(h >> (64 - HLL_BITS))];
+		if (rank > reg)
+			reg = rank;
+
+		if (isExact)
+			AddExact(bits, h);
+	}
+	void AddExact(uint64_t bits, uint64_t h)
+	{
+		if (bits == 0)
+		{
+			hasZero = true;
+			return;
+		}
+		if (exactCount * 2 >= exact.size())
+		{
+			if (exactCount >= EXACT_LIMIT)
+			{
+				DropExact();
+				return;
+			}
+			Rehash(std::max(exact.size() * 2, size_t(64)));
+		}
+		size_t mask = exact.size() - 1;
+		for (size_t i = size_t(h) & mask; ; i = (i + 1) & mask)
+		{
+			if (exact[i] == bits)
+				return;
+			if (exact[i] == 0)
+			{
+				exact[i] = bits;
+				exactCount++;
+				return;
+			}
+		}
+	}
+	void Rehash(size_t size)
+	{
+		std::vector<uint64_t> prev(size, 0);
+		prev.swap(exact);
+		exactCount = 0;
+		for (uint64_t bits : prev)
+			if (bits)
+				AddExact(bits, HashValueBits(bits));
+	}
+	void Merge(const UniqueCounter& o)
+	{
+		for (size_t i = 0; i < HLL_REGISTERS; i++)
+			registers[i] = std::max(registers[i], o.registers[i]);
+
+		if (isExact && o.isExact)
+		{
+			hasZero |= o.hasZero;
+			for (uint64_t bits : o.exact)
+				if (bits && isExact)
+					AddExact(bits, HashValueBits(bits));
+		}
+		else if (isExact)
+			DropExact();
+	}
+	void DropExact()
+	{
+		isExact = false;
+		std::vector<uint64_t>().swap(exact);
+		exactCount = 0;
+	}
+	uint64_t Estimate() const
+	{
+		if (isExact)
+			return exactCount + (hasZero ? 1 : 0);
+
+		double m = double(HLL_REGISTERS);
+		double sum = 0;
+		size_t zeroes = 0;
+		for (uint8_t r : registers)
+		{
+			sum += ldexp(1.0, -int(r));
+			if (r == 0)
+				zeroes++;
+		}
+		double alpha = 0.7213 / (1 + 1.079 / m);
+		double est = alpha * m * m / sum;
+		// small range correction (linear counting)
+		if (est <= 2.5 * m && zeroes)
+			est = m * log(m / double(zeroes));
+		return uint64_t(est + 0.5);
+	}
+};
+
+template <class T> uint64_t GetValueBits(T v) { return uint64_t(typename std::make_unsigned<T>::type(v)); }
+static uint64_t GetValueBits(float v)
+{
+	uint32_t u = 0;
+	if (v != 0) // -0 == 0
+		memcpy(&u, &v, sizeof(v));
+	return u;
+}
+static uint64_t GetValueBits(double v)
+{
+	uint64_t u = 0;
+	if (v != 0)
+		memcpy(&u, &v, sizeof(v));
+	return u;
+}
+
+
+template<class T> struct get_signed : std::make_signed<T> {};
+template<> struct get_signed<float> { using type = float; };
+template<> struct get_signed<double> { using type = double; };
+
+// GCD is calculated from magnitudes so that the result does not depend on the chunk merge order
+template<class T> struct get_gcd_type : std::make_unsigned<T> {};
+template<> struct get_gcd_type<float> { using type = float; };
+template<> struct get_gcd_type<double> { using type = double; };
+
+template <class T> typename get_gcd_type<T>::type Magnitude(T v)
+{
+	using GT = typename get_gcd_type<T>::type;
+	return v < 0 ? GT(GT(0) - GT(v)) : GT(v);
+}
+
+template <class T> T modulus(T a, T b) { return a % b; }
+static float modulus(float a, float b) { return fmodf(a, b); }
+static double modulus(double a, double b) { return fmod(a, b); }
+template <class T> T greatest_common_divisor(T a, T b)
+{
+	while (b == b && b != 0)
+	{
+		T t = modulus(a, b);
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// signed difference, wrapping around for integers
+template <class T> typename get_signed<T>::type Delta(T cur, T prev)
+{
+	using ST = typename get_signed<T>::type;
+	using UT = typename std::make_unsigned<T>::type;
+	return ST(UT(UT(cur) - UT(prev)));
+}
+static float Delta(float cur, float prev) { return cur - prev; }
+static double Delta(double cur, double prev) { return cur - prev; }
+
+
+template <class T> struct SimdOps
+{
+	static constexpr bool enabled = false;
+};
+
+template <> struct SimdOps<float>
+{
+	static constexpr bool enabled = true;
+	static constexpr size_t N = 4;
+	typedef __m128 V;
+
+	static V Load(const float* p) { return _mm_loadu_ps(p); }
+	static void Store(float* p, V v) { _mm_storeu_ps(p, v); }
+	static V Splat(float x) { return _mm_set1_ps(x); }
+	static V SplatDelta(float x) { return _mm_set1_ps(x); }
+	// (a < b ? a : b) and (a > b ? a : b) per lane, like std::min/max with a = new value
+	static V Min(V a, V b) { return _mm_min_ps(a, b); }
+	static V Max(V a, V b) { return _mm_max_ps(a, b); }
+	static V Delta(V cur, V prev) { return _mm_sub_ps(cur, prev); }
+	static V DeltaMin(V a, V b) { return _mm_min_ps(a, b); }
+	static V DeltaMax(V a, V b) { return _mm_max_ps(a, b); }
+	static bool AnyNotEqual(V cur, V prev) { return _mm_movemask_ps(_mm_cmpneq_ps(cur, prev)) != 0; }
+	static bool AnyLessEqual(V cur, V prev) { return _mm_movemask_ps(_mm_cmple_ps(cur, prev)) != 0; }
+	static bool AnyLess(V cur, V prev) { return _mm_movemask_ps(_mm_cmplt_ps(cur, prev)) != 0; }
+};
+
+template <> struct SimdOps<double>
+{
+	static constexpr bool enabled = true;
+	static constexpr size_t N = 2;
+	typedef __m128d V;
+
+	static V Load(const double* p) { return _mm_loadu_pd(p); }
+	static void Store(double* p, V v) { _mm_storeu_pd(p, v); }
+	static V Splat(double x) { return _mm_set1_pd(x); }
+	static V SplatDelta(double x) { return _mm_set1_pd(x); }
+	static V Min(V a, V b) { return _mm_min_pd(a, b); }
+	static V Max(V a, V b) { return _mm_max_pd(a, b); }
+	static V Delta(V cur, V prev) { return _mm_sub_pd(cur, prev); }
+	static V DeltaMin(V a, V b) { return _mm_min_pd(a, b); }
+	static V DeltaMax(V a, V b) { return _mm_max_pd(a, b); }
+	static bool AnyNotEqual(V cur, V prev) { return _mm_movemask_pd(_mm_cmpneq_pd(cur, prev)) != 0; }
+	static bool AnyLessEqual(V cur, V prev) { return _mm_movemask_pd(_mm_cmple_pd(cur, prev)) != 0; }
+	static bool AnyLess(V cur, V prev) { return _mm_movemask_pd(_mm_cmplt_pd(cur, prev)) != 0; }
+};
+
+// SSE2 only has signed compares, unsigned values are compared with flipped sign bits
+template <size_t W> struct SimdIntWidth;
+template <> struct SimdIntWidth<1>
+{
+	static __m128i Set(int8_t x) { return _mm_set1_epi8(x); }
+	static __m128i Sub(__m128i a, __m128i b) { return _mm_sub_epi8(a, b); }
+	static __m128i CmpEq(__m128i a, __m128i b) { return _mm_cmpeq_epi8(a, b); }
+	static __m128i CmpGt(__m128i a, __m128i b) { return _mm_cmpgt_epi8(a, b); }
+};
+template <> struct SimdIntWidth<2>
+{
+	static __m128i Set(int16_t x) { return _mm_set1_epi16(x); }
+	static __m128i Sub(__m128i a, __m128i b) { return _mm_sub_epi16(a, b); }
+	static __m128i CmpEq(__m128i a, __m128i b) { return _mm_cmpeq_epi16(a, b); }
+	static __m128i CmpGt(__m128i a, __m128i b) { return _mm_cmpgt_epi16(a, b); }
+};
+template <> struct SimdIntWidth<4>
+{
+	static __m128i Set(int32_t x) { return _mm_set1_epi32(x); }
+	static __m128i Sub(__m128i a, __m128i b) { return _mm_sub_epi32(a, b); }
+	static __m128i CmpEq(__m128i a, __m128i b) { return _mm_cmpeq_epi32(a, b); }
+	static __m128i CmpGt(__m128i a, __m128i b) { return _mm_cmpgt_epi32(a, b); }
+};
+
+template <class T> struct SimdIntOps
+{
+	using W = SimdIntWidth<sizeof(T)>;
+	using ST = typename std::make_signed<T>::type;
+
+	static constexpr bool enabled = true;
+	static constexpr size_t N = 16 / sizeof(T);
+	typedef __m128i V;
+
+	static V Load(const T* p) { return _mm_loadu_si128((const __m128i*)p); }
+	static void Store(T* p, V v) { _mm_storeu_si128((__m128i*)p, v); }
+	static V Splat(T x) { return W::Set(ST(x)); }
+	static V SplatDelta(ST x) { return W::Set(x); }
+	static V Select(V mask, V a, V b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+	static V Bias(V v) { return std::is_signed<T>::value ? v : _mm_xor_si128(v, W::Set(std::numeric_limits<ST>::min())); }
+	static V Greater(V a, V b) { return W::CmpGt(Bias(a), Bias(b)); }
+	static V Min(V a, V b) { return Select(Greater(b, a), a, b); }
+	static V Max(V a, V b) { return Select(Greater(a, b), a, b); }
+	// deltas are always signed
+	static V Delta(V cur, V prev) { return W::Sub(cur, prev); }
+	static V DeltaMin(V a, V b) { return Select(W::CmpGt(b, a), a, b); }
+	static V DeltaMax(V a, V b) { return Select(W::CmpGt(a, b), a, b); }
+	static bool AnyNotEqual(V cur, V prev) { return _mm_movemask_epi8(W::CmpEq(cur, prev)) != 0xffff; }
+	static bool AnyLessEqual(V cur, V prev) { return _mm_movemask_epi8(Greater(cur, prev)) != 0xffff; }
+	static bool AnyLess(V cur, V prev) { return _mm_movemask_epi8(Greater(prev, cur)) != 0; }
+};
+template <> struct SimdOps<char> : SimdIntOps<char> {};
+template <> struct SimdOps<int8_t> : SimdIntOps<int8_t> {};
+template <> struct SimdOps<uint8_t> : SimdIntOps<uint8_t> {};
+template <> struct SimdOps<int16_t> : SimdIntOps<int16_t> {};
+template <> struct SimdOps<uint16_t> : SimdIntOps<uint16_t> {};
+template <> struct SimdOps<int32_t> : SimdIntOps<int32_t> {};
+template <> struct SimdOps<uint32_t> : SimdIntOps<uint32_t> {};
+// no 64-bit integer compares in SSE2, those use the scalar path
+
+
+template <class T> struct AnalysisStats
+{
+	using ST = typename get_signed<T>::type;
+	using GT = typename get_gcd_type<T>::type;
+	using GST = typename get_gcd_type<ST>::type;
+
+	uint64_t count = 0;
+	T first = 0;
+	T last = 0;
+	T min = std::numeric_limits<T>::max();
+	T max = std::numeric_limits<T>::min();
+	GT gcd = 0;
+	ST dmin = std::numeric_limits<ST>::max();
+	ST dmax = std::numeric_limits<ST>::min();
+	GST dgcd = 0;
+	bool eq = true;
+	bool asc = true;
+	bool asceq = true;
+	UniqueCounter unique;
+
+	void AddDelta(T cur, T prev)
+	{
+		ST d = Delta(cur, prev);
+		dmin = std::min(dmin, d);
+		dmax = std::max(dmax, d);
+		dgcd = greatest_common_divisor(dgcd, Magnitude(d));
+		if (cur != prev)
+			eq = false;
+		if (cur <= prev)
+			asc = false;
+		if (cur < prev)
+			asceq = false;
+	}
+
+	// `next` must contain the values that directly follow these
+	void Merge(AnalysisStats& next)
+	{
+		if (next.count == 0)
+			return;
+		if (count == 0)
+		{
+			*this = std::move(next);
+			return;
+		}
+
+		AddDelta(next.first, last);
+		count += next.count;
+		last = next.last;
+		min = std::min(min, next.min);
+		max = std::max(max, next.max);
+		gcd = greatest_common_divisor(gcd, next.gcd);
+		dmin = std::min(dmin, next.dmin);
+		dmax = std::max(dmax, next.dmax);
+		dgcd = greatest_common_divisor(dgcd, next.dgcd);
+		eq &= next.eq;
+		asc &= next.asc;
+		asceq &= next.asceq;
+		unique.Merge(next.unique);
+	}
+
+	AnalysisResult ToResult() const
+	{
+		AnalysisResult r;
+		r.count = count;
+		r.unique = unique.Estimate();
+		r.uniqueApprox = !unique.isExact;
+		if (r.count > 1)
+		{
+			if (eq)
+				r.flags |= AnalysisResult::Equal;
+			else if (asc)
+				r.flags |= AnalysisResult::Asc;
+			else if (asceq)
+				r.flags |= AnalysisResult::AscEq;
+		}
+		r.vmin = std::to_string(min);
+		r.vmax = std::to_string(max);
+		r.vgcd = std::to_string(gcd);
+		r.dmin = std::to_string(dmin);
+		r.dmax = std::to_string(dmax);
+		r.dgcd = std::to_string(dgcd);
+		return r;
+	}
+};
+
+// min/max, deltas and order flags
+template <class T> void ComputeOrderStats(const T* v, size_t n, AnalysisStats<T>& S, std::false_type)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		S.min = std::min(S.min, v[i]);
+		S.max = std::max(S.max, v[i]);
+	}
+	for (size_t i = 1; i < n; i++)
+		S.AddDelta(v[i], v[i - 1]);
+}
+
+template <class T> void ComputeOrderStats(const T* v, size_t n, AnalysisStats<T>& S, std::true_type)
+{
+	using Ops = SimdOps<T>;
+	using ST = typename get_signed<T>::type;
+	constexpr size_t N = Ops::N;
+
+	auto vmin = Ops::Splat(S.min);
+	auto vmax = Ops::Splat(S.max);
+	size_t i = 0;
+	for (; i + N <= n; i += N)
+	{
+		auto x = Ops::Load(v + i);
+		vmin = Ops::Min(x, vmin);
+		vmax = Ops::Max(x, vmax);
+	}
+	T lanes[N];
+	Ops::Store(lanes, vmin);
+	for (size_t l = 0; l < N; l++)
+		S.min = std::min(S.min, lanes[l]);
+	Ops::Store(lanes, vmax);
+	for (size_t l = 0; l < N; l++)
+		S.max = std::max(S.max, lanes[l]);
+	for (; i < n; i++)
+	{
+		S.min = std::min(S.min, v[i]);
+		S.max = std::max(S.max, v[i]);
+	}
+
+	auto vdmin = Ops::SplatDelta(S.dmin);
+	auto vdmax = Ops::SplatDelta(S.dmax);
+	bool neq = false, le = false, lt = false;
+	size_t j = 1;
+	for (; j + N <= n; j += N)
+	{
+		auto cur = Ops::Load(v + j);
+		auto prev = Ops::Load(v + j - 1);
+		auto d = Ops::Delta(cur, prev);
+		vdmin = Ops::DeltaMin(d, vdmin);
+		vdmax = Ops::DeltaMax(d, vdmax);
+		neq |= Ops::AnyNotEqual(cur, prev);
+		le |= Ops::AnyLessEqual(cur, prev);
+		lt |= Ops::AnyLess(cur, prev);
+	}
+	ST dlanes[N];
+	Ops::Store(lanes, vdmin);
+	memcpy(dlanes, lanes, sizeof(lanes));
+	for (size_t l = 0; l < N; l++)
+		S.dmin = std::min(S.dmin, dlanes[l]);
+	Ops::Store(lanes, vdmax);
+	memcpy(dlanes, lanes, sizeof(lanes));
+	for (size_t l = 0; l < N; l++)
+		S.dmax = std::max(S.dmax, dlanes[l]);
+	if (neq)
+		S.eq = false;
+	if (le)
+		S.asc = false;
+	if (lt)
+		S.asceq = false;
+
+	// GCD of the deltas is not vectorized
+	for (size_t k = 1; k < j && (std::is_floating_point<T>::value || S.dgcd != 1); k++)
+		S.dgcd = greatest_common_divisor(S.dgcd, Magnitude(Delta(v[k], v[k - 1])));
+	for (; j < n; j++)
+		S.AddDelta(v[j], v[j - 1]);
+}
+
+template <class T> void ComputeStats(const T* v, size_t n, AnalysisStats<T>& S)
+{
+	if (n == 0)
+		return;
+	S.count = n;
+	S.first = v[0];
+	S.last = v[n - 1];
+
+	ComputeOrderStats(v, n, S, std::integral_constant<bool, SimdOps<T>::enabled>());
+
+	for (size_t i = 0; i < n; i++)
+	{
+		// gcd(1, x) = 1 for integers
+		if (!std::is_floating_point<T>::value && S.gcd == 1)
+			break;
+		S.gcd = greatest_common_divisor(S.gcd, Magnitude(v[i]));
+	}
+
+	uint64_t prevBits = ~GetValueBits(v[0]);
+	for (size_t i = 0; i < n; i++)
+	{
+		// skip repeats of the same value, common in real data
+		uint64_t bits = GetValueBits(v[i]);
+		if (bits == prevBits)
+			continue;
+		prevBits = bits;
+		S.unique.Add(bits);
+	}
+}
+
+template <class T> void GatherFromSpan(const char* span, uint64_t stride, uint64_t first, size_t n, T* out)
+{
+	if (stride == sizeof(T))
+	{
+		memcpy(out, span + first * sizeof(T), n * sizeof(T));
+		return;
+	}
+	const char* p = span + first * stride;
+	for (size_t i = 0; i < n; i++, p += stride)
+		memcpy(&out[i], p, sizeof(T));
+}
+
+template <class T> AnalysisResult AnalyzeValuesImpl(
+	IDataSource* ds,
+	uint64_t off,
+	uint64_t stride,
+	uint64_t count,
+	uint8_t sb,
+	uint8_t eb,
+	bool excl0,
+	const AnalysisProgressFn& onProgress)
+{
+	const char* span = count ? (const char*)ds->GetSpan(off, stride * (count - 1) + sizeof(T)) : nullptr;
+	bool applyBits = !std::is_floating_point<T>::value && (sb != 0 || eb < 64);
+
+	uint64_t numChunks = (count + ANALYSIS_CHUNK_SIZE - 1) / ANALYSIS_CHUNK_SIZE;
+	size_t chunksPerStep = ui::GetParallelThreadCount() * 2;
+	std::vector<std::vector<T>> buffers(chunksPerStep);
+	std::vector<AnalysisStats<T>> stats(chunksPerStep);
+	AnalysisStats<T> total;
+
+	double lastProgressTime = ui::hqtime();
+	for (uint64_t c0 = 0; c0 < numChunks; c0 += chunksPerStep)
+	{
+		size_t nc = size_t(std::min<uint64_t>(chunksPerStep, numChunks - c0));
+
+		ui::ParallelFor(nc, [&](size_t i)
+		{
+			auto& buf = buffers[i];
+			uint64_t first = (c0 + i) * ANALYSIS_CHUNK_SIZE;
+			buf.resize(size_t(std::min(ANALYSIS_CHUNK_SIZE, count - first)));
+			if (span)
+				GatherFromSpan(span, stride, first, buf.size(), buf.data());
+			else
+				ds->ReadStrided(off + first * stride, stride, buf.size(), sizeof(T), buf.data());
+			if (applyBits)
+			{
+				for (auto& v : buf)
+					ApplyStartEndBits(v, sb, eb);
+			}
+			size_t n = buf.size();
+			if (excl0)
+				n = std::remove(buf.begin(), buf.end(), T(0)) - buf.begin();
+
+			stats[i] = AnalysisStats<T>();
+			ComputeStats(buf.data(), n, stats[i]);
+		});
+
+		for (size_t i = 0; i < nc; i++)
+			total.Merge(stats[i]);
+
+		if (onProgress && c0 + nc < numChunks && ui::hqtime() - lastProgressTime >= ANALYSIS_PROGRESS_INTERVAL)
+		{
+			if (!onProgress(total.ToResult(), float(c0 + nc) / float(numChunks)))
+				break;
+			lastProgressTime = ui::hqtime();
+		}
+	}
+	return total.ToResult();
+}
+
+typedef AnalysisResult AnalyzeValuesFunc(IDataSource*, uint64_t, uint64_t, uint64_t, uint8_t, uint8_t, bool, const AnalysisProgressFn&);
+static AnalyzeValuesFunc* analyzeValuesFuncs[] =
+{
+	AnalyzeValuesImpl<char>,
+	AnalyzeValuesImpl<int8_t>,
+	AnalyzeValuesImpl<uint8_t>,
+	AnalyzeValuesImpl<int16_t>,
+	AnalyzeValuesImpl<uint16_t>,
+	AnalyzeValuesImpl<int32_t>,
+	AnalyzeValuesImpl<uint32_t>,
+	AnalyzeValuesImpl<int64_t>,
+	AnalyzeValuesImpl<uint64_t>,
+	AnalyzeValuesImpl<float>,
+	AnalyzeValuesImpl<double>,
+};
+
+AnalysisResult AnalyzeValues(
+	DataType type,
+	IDataSource* ds,
+	uint64_t off,
+	uint64_t stride,
+	uint64_t count,
+	uint8_t sb,
+	uint8_t eb,
+	bool excl0,
+	const AnalysisProgressFn& onProgress)
+{
+	return analyzeValuesFuncs[type](ds, off, stride, count, sb, eb, excl0, onProgress);
+}
@@ -0,0 +1,21 @@
+
+#pragma once
+#include "pch.h"
+#include "Markers.h"
+
+
+// receives the merged result of the chunks processed so far, return false to stop
+typedef std::function<bool(const AnalysisResult& partial, float progress)> AnalysisProgressFn;
+
+// statistics of `count` values of `type` located `stride` bytes apart
+// the values are processed in chunks in parallel, then merged in order
+AnalysisResult AnalyzeValues(
+	DataType type,
+	IDataSource* ds,
+	uint64_t off,
+	uint64_t stride,
+	uint64_t count,
+	uint8_t sb,
+	uint8_t eb,
+	bool excl0,
+	const AnalysisProgressFn& onProgress = {});
@@ -1,6 +1,12 @@
 
 #include "pch.h"
 #include "Markers.h"
+#include "MarkerAnalysis.h"
+
+
+namespace ui {
+double hqtime();
+} // ui
 
 
 ui::DataCategoryTag DCT_Marker[1];
@@ -91,7 +97,7 @@ std::string AnalysisData::GetText(size_t row, size_t col)
 	switch (col)
 	{
 	case ADC_Count: return std::to_string(R.count);
-	case ADC_Unique: return std::to_string(R.unique);
+	case ADC_Unique: return (R.uniqueApprox ? "~" : "") + std::to_string(R.unique);
 	case ADC_Features: {
 		std::string ret;
 		if (R.flags & AnalysisResult::Equal)
@@ -114,114 +120,6 @@ std::string AnalysisData::GetText(size_t row, size_t col)
 }
 
 
-template <class T> T modulus(T a, T b) { return a % b; }
-float modulus(float a, float b) { return fmodf(a, b); }
-double modulus(double a, double b) { return fmod(a, b); }
-template <class T> T greatest_common_divisor(T a, T b)
-{
-	if (b != b || b == 0)
-		return a;
-	return greatest_common_divisor(b, modulus(a, b));
-}
-
-template<class T> struct get_signed : std::make_signed<T> {};
-template<> struct get_signed<float> { using type = float; };
-template<> struct get_signed<double> { using type = double; };
-template<> struct get_signed<bool> { using type = bool; };
-
-template<class T> void ApplyStartEndBits(T& r, int sb, int eb)
-{
-	uint64_t mask2 = (1ULL << sb) - 1ULL;
-	r = r & ~mask2;
-	if (eb < 64)
-	{
-		uint64_t mask = (1ULL << eb) - 1ULL;
-		r = (r & mask) | (r < 0 ? ~mask : 0);
-	}
-}
-void ApplyStartEndBits(float& r, int sb, int eb) {}
-void ApplyStartEndBits(double& r, int sb, int eb) {}
-
-typedef AnalysisResult AnalysisFunc(IDataSource* ds, uint64_t off, uint64_t stride, uint64_t count, uint8_t sb, uint8_t eb, bool excl0);
-template <class T> AnalysisResult AnalysisFuncImpl(IDataSource* ds, uint64_t off, uint64_t stride, uint64_t count, uint8_t sb, uint8_t eb, bool excl0)
-{
-	using ST = typename get_signed<T>::type;
-	T min = std::numeric_limits<T>::max();
-	T max = std::numeric_limits<T>::min();
-	T gcd = 0;
-	ST dmin = std::numeric_limits<ST>::max();
-	ST dmax = std::numeric_limits<ST>::min();
-	ST dgcd = 0;
-	T prev = 0;
-	bool eq = true;
-	bool asc = true;
-	bool asceq = true;
-	uint64_t numfound = 0;
-	std::unordered_map<T, uint64_t> counts;
-	for (uint64_t i = 0; i < count; i++)
-	{
-		T val;
-		ds->Read(off + stride * i, sizeof(val), &val);
-		ApplyStartEndBits(val, sb, eb);
-		if (excl0 && val == 0)
-			continue;
-		*counts.insert({ val, 0 }).first++;
-		min = std::min(min, val);
-		max = std::max(max, val);
-		gcd = greatest_common_divisor(gcd, val);
-		if (numfound > 0)
-		{
-			ST d = ST(val) - ST(prev);
-			dmin = std::min(dmin, d);
-			dmax = std::max(dmax, d);
-			dgcd = greatest_common_divisor<ST>(dgcd, d);
-			if (val != prev)
-				eq = false;
-			if (val <= prev)
-				asc = false;
-			if (val < prev)
-				asceq = false;
-		}
-		prev = val;
-		numfound++;
-	}
-	AnalysisResult r;
-	{
-		r.count = numfound;
-		r.unique = counts.size();
-		if (r.count > 1)
-		{
-			if (eq)
-				r.flags |= AnalysisResult::Equal;
-			else if (asc)
-				r.flags |= AnalysisResult::Asc;
-			else if (asceq)
-				r.flags |= AnalysisResult::AscEq;
-		}
-		r.vmin = std::to_string(min);
-		r.vmax = std::to_string(max);
-		r.vgcd = std::to_string(gcd);
-		r.dmin = std::to_string(dmin);
-		r.dmax = std::to_string(dmax);
-		r.dgcd = std::to_string(dgcd);
-	}
-	return r;
-}
-static AnalysisFunc* analysisFuncs[] =
-{
-	AnalysisFuncImpl<char>,
-	AnalysisFuncImpl<int8_t>,
-	AnalysisFuncImpl<uint8_t>,
-	AnalysisFuncImpl<int16_t>,
-	AnalysisFuncImpl<uint16_t>,
-	AnalysisFuncImpl<int32_t>,
-	AnalysisFuncImpl<uint32_t>,
-	AnalysisFuncImpl<int64_t>,
-	AnalysisFuncImpl<uint64_t>,
-	AnalysisFuncImpl<float>,
-	AnalysisFuncImpl<double>,
-};
-
 static const char* markerReadCodes[] =
 {
 	"%c",
@@ -395,12 +293,14 @@ void MarkerData::AddMarker(DataType dt, uint64_t from, uint64_t to)
 		m.stride = 0;
 	}
 	markers.push_back(m);
+	OnEdit();
 	ui::Notify(DCT_MarkedItems, this);
 }
 
 void MarkerData::Load(const char* key, NamedTextSerializeReader& r)
 {
 	markers.clear();
+	OnEdit();
 
 	r.BeginDict(key);
 
@@ -543,11 +443,14 @@ void MarkedItemEditor::Build()
 	ui::Text("Marker");
 
 	ui::Push<ui::Panel>();
-	ui::imm::DropdownMenuList(marker->type, ui::BuildAlloc<ui::CStrArrayOptionList>(typeNames));
-	ui::imm::PropEditInt("Offset", marker->at);
-	ui::imm::PropEditInt("Count", marker->count);
-	ui::imm::PropEditInt("Repeats", marker->repeats);
-	ui::imm::PropEditInt("Stride", marker->stride);
+	bool rangeEdited = false;
+	rangeEdited |= ui::imm::DropdownMenuList(marker->type, ui::BuildAlloc<ui::CStrArrayOptionList>(typeNames));
+	rangeEdited |= ui::imm::PropEditInt("Offset", marker->at);
+	rangeEdited |= ui::imm::PropEditInt("Count", marker->count);
+	rangeEdited |= ui::imm::PropEditInt("Repeats", marker->repeats);
+	rangeEdited |= ui::imm::PropEditInt("Stride", marker->stride);
+	if (rangeEdited && markerData)
+		markerData->OnEdit();
 	unsigned bs = marker->bitstart;
 	if (ui::imm::PropEditInt("Start bit", bs, {}, 1U, { 0U, 64U }))
 		marker->bitstart = bs;
@@ -560,24 +463,7 @@ void MarkedItemEditor::Build()
 
 	ui::Push<ui::Panel>();
 	if (ui::imm::Button("Analyze"))
-	{
-		analysisData.results.clear();
-		if (marker->repeats <= 1)
-		{
-			// analyze a single array
-			analysisData.results.push_back(analysisFuncs[marker->type](dataSource, marker->at, typeSizes[marker->type],
-				marker->count, marker->bitstart, marker->bitend, marker->excludeZeroes));
-		}
-		else
-		{
-			// analyze each array element separately
-			for (uint64_t i = 0; i < marker->count; i++)
-			{
-				analysisData.results.push_back(analysisFuncs[marker->type](dataSource, marker->at + i * typeSizes[marker->type],
-					marker->stride, marker->repeats, marker->bitstart, marker->bitend, marker->excludeZeroes));
-			}
-		}
-	}
+		StartAnalysis();
 	if (marker->type == DT_F32 && marker->count == 3 && marker->repeats > 1 && ui::imm::Button("Export points to .obj"))
 	{
 		if (FILE* fp = fopen("positions.obj", "w"))
@@ -627,6 +513,10 @@ void MarkedItemEditor::Build()
 			fclose(fp);
 		}
 	}
+	if (analysisData.progress < 1)
+		ui::MakeWithText<ui::ProgressBar>("Analyzing...").progress = analysisData.progress;
+	else if (analysisData.results.size())
+		ui::Text(ui::Format("Analysis time: %.2f ms", analysisData.time * 1000)) + ui::SetPadding(5);
 	if (analysisData.results.size())
 	{
 		auto& tbl = ui::Make<ui::TableView>();
@@ -637,6 +527,65 @@ void MarkedItemEditor::Build()
 	ui::Pop();
 }
 
+void MarkedItemEditor::StartAnalysis()
+{
+	analysisData.results.clear();
+	analysisData.progress = 0;
+	uint32_t id = ++analysisID;
+	Marker m = *marker;
+	IDataSource* ds = dataSource;
+	double t0 = ui::hqtime();
+	if (m.repeats > 1 && m.count == 0)
+	{
+		analysisData.progress = 1;
+		return;
+	}
+
+	auto postResult = [this, id](uint64_t i, const AnalysisResult& result, float progress, double time)
+	{
+		ui::Application::PushEvent(this, [this, id, i, result, progress, time]()
+		{
+			if (id != analysisID)
+				return;
+			if (analysisData.results.size() <= i)
+				analysisData.results.resize(size_t(i + 1));
+			analysisData.results[size_t(i)] = result;
+			analysisData.progress = progress;
+			analysisData.time = time;
+			Rebuild();
+		});
+	};
+	analysisQueue.Push([this, m, ds, t0, postResult]()
+	{
+		// analyze a single array or each array element separately
+		bool single = m.repeats <= 1;
+		uint64_t numResults = single ? 1 : m.count;
+		for (uint64_t i = 0; i < numResults; i++)
+		{
+			auto onProgress = [this, &postResult, i, numResults](const AnalysisResult& partial, float progress)
+			{
+				if (analysisQueue.HasItems() || analysisQueue.IsQuitting())
+					return false;
+				postResult(i, partial, (i + progress) / numResults, 0);
+				return true;
+			};
+			auto result = AnalyzeValues(
+				m.type,
+				ds,
+				single ? m.at : m.at + i * typeSizes[m.type],
+				single ? typeSizes[m.type] : m.stride,
+				single ? m.count : m.repeats,
+				m.bitstart,
+				m.bitend,
+				m.excludeZeroes,
+				onProgress);
+			if (analysisQueue.HasItems() || analysisQueue.IsQuitting())
+				return;
+			postResult(i, result, float(i + 1) / numResults, ui::hqtime() - t0);
+		}
+	}, true);
+}
+
 
 void MarkedItemsList::Build()
 {
@@ -645,11 +594,14 @@ void MarkedItemsList::Build()
 	for (auto& m : markerData->markers)
 	{
 		ui::Push<ui::Panel>();
-		ui::imm::PropDropdownMenuList("Type", m.type, ui::BuildAlloc<ui::CStrArrayOptionList>(typeNames));
-		ui::imm::PropEditInt("Offset", m.at);
-		ui::imm::PropEditInt("Count", m.count);
-		ui::imm::PropEditInt("Repeats", m.repeats);
-		ui::imm::PropEditInt("Stride", m.stride);
+		bool rangeEdited = false;
+		rangeEdited |= ui::imm::PropDropdownMenuList("Type", m.type, ui::BuildAlloc<ui::CStrArrayOptionList>(typeNames));
+		rangeEdited |= ui::imm::PropEditInt("Offset", m.at);
+		rangeEdited |= ui::imm::PropEditInt("Count", m.count);
+		rangeEdited |= ui::imm::PropEditInt("Repeats", m.repeats);
+		rangeEdited |= ui::imm::PropEditInt("Stride", m.stride);
+		if (rangeEdited)
+			markerData->OnEdit();
 		ui::Pop();
 	}
 }
@@ -23,6 +23,20 @@ enum DataType
 
 const char* GetDataTypeName(DataType t);
 
+// clears bits below `sb` and from `eb` up (set instead for negative values)
+template<class T> void ApplyStartEndBits(T& r, int sb, int eb)
+{
+	uint64_t mask2 = (1ULL << sb) - 1ULL;
+	r = r & ~mask2;
+	if (eb < 64)
+	{
+		uint64_t mask = (1ULL << eb) - 1ULL;
+		r = (r & mask) | (r < 0 ? ~mask : 0);
+	}
+}
+inline void ApplyStartEndBits(float& r, int sb, int eb) {}
+inline void ApplyStartEndBits(double& r, int sb, int eb) {}
+
 struct AnalysisResult
 {
 	enum Flags
@@ -34,6 +48,8 @@ struct AnalysisResult
 
 	uint64_t count = 0;
 	uint64_t unique = 0;
+	// estimated from a sketch (too many values to count exactly)
+	bool uniqueApprox = false;
 	uint32_t flags = 0;
 	// values
 	std::string vmin;
@@ -48,6 +64,9 @@ struct AnalysisResult
 struct AnalysisData : ui::TableDataSource
 {
 	std::vector<AnalysisResult> results;
+	double time = 0;
+	// < 1 while the analysis is running
+	float progress = 1;
 
 	size_t GetNumRows() override { return results.size(); }
 	size_t GetNumCols() override;
@@ -83,7 +102,14 @@ struct MarkerData
 	void Load(const char* key, NamedTextSerializeReader& r);
 	void Save(const char* key, NamedTextSerializeWriter& w);
 
+	// to be called after markers are added, removed or their ranges are changed
+	void OnEdit()
+	{
+		editVersion++;
+	}
+
 	std::vector<Marker> markers;
+	uint32_t editVersion = 1;
 };
 
 struct MarkerDataSource : ui::TableDataSource, ui::ISelectionStorage
@@ -106,10 +132,15 @@ struct MarkerDataSource : ui::TableDataSource, ui::ISelectionStorage
 struct MarkedItemEditor : ui::Buildable
 {
 	void Build() override;
+	// runs on a worker thread, partial results are shown as they come in
+	void StartAnalysis();
 
 	IDataSource* dataSource;
+	MarkerData* markerData = nullptr;
 	Marker* marker;
 	AnalysisData analysisData;
+	ui::WorkerQueue analysisQueue;
+	uint32_t analysisID = 0;
 };
 
 struct MarkedItemsList : ui::Buildable
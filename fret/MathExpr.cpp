@@ -4,14 +4,170 @@
 #include "DataDesc.h"
 
 
+// bytecode limits, expressions that need more stack are evaluated as a tree
+static constexpr int ME_MAX_STACK = 32;
+static constexpr int ME_MAX_LOCALS = 32;
+static constexpr int ME_MAX_BLOCKS = 8;
+static constexpr int ME_MAX_BLOCK_SIZE = 64;
+
+enum MEOp : uint8_t
+{
+	MEOP_Const, // push value
+	MEOP_Node, // push node->Eval (for nodes that are not compiled)
+	MEOP_Load, // push local a
+	MEOP_Store, // copy top to local a
+	MEOP_SharedLoad, // if shared value a is known, push it and skip the next value instructions
+	MEOP_SharedStore, // copy top to shared value a
+	MEOP_Read, // replace offset on top with the value of type a read from there
+	MEOP_LoadBlock, // pop offset, read b bytes at offset + value into block a
+	MEOP_BlockRead, // push value of type b at value in block a
+
+	MEOP_Negate,
+	MEOP_Invert,
+
+	MEOP_Add,
+	MEOP_Sub,
+	MEOP_Mul,
+	MEOP_Div,
+	MEOP_Mod,
+	MEOP_And,
+	MEOP_Or,
+	MEOP_Xor,
+	MEOP_LShift,
+	MEOP_RShift,
+	MEOP_Equal,
+	MEOP_NotEqual,
+	MEOP_LessThan,
+	MEOP_LessEqual,
+	MEOP_GreaterThan,
+	MEOP_GreaterEqual,
+};
+
+enum MEReadType : uint8_t
+{
+	MERT_i8,
+	MERT_i16,
+	MERT_i32,
+	MERT_i64,
+	MERT_u8,
+	MERT_u16,
+	MERT_u32,
+	MERT_u64,
+};
+static const uint8_t g_readTypeSizes[] = { 1, 2, 4, 8, 1, 2, 4, 8 };
+
+static int64_t DecodeValue(MEReadType type, const void* p)
+{
+	switch (type)
+	{
+#define DECODE_VALUE(t, sn) case MERT_##sn: { t v; memcpy(&v, p, sizeof(v)); return int64_t(v); }
+	DECODE_VALUE(int8_t, i8);
+	DECODE_VALUE(int16_t, i16);
+	DECODE_VALUE(int32_t, i32);
+	DECODE_VALUE(int64_t, i64);
+	DECODE_VALUE(uint8_t, u8);
+	DECODE_VALUE(uint16_t, u16);
+	DECODE_VALUE(uint32_t, u32);
+	DECODE_VALUE(uint64_t, u64);
+#undef DECODE_VALUE
+	}
+	return 0;
+}
+
+static int64_t ReadValue(IVariableSource* vs, int64_t off, MEReadType type)
+{
+	size_t size = g_readTypeSizes[type];
+	uint64_t buf = 0;
+	if (const void* span = vs->GetFileSpan(off, size))
+		memcpy(&buf, span, size);
+	else
+		vs->ReadFile(off, size, &buf);
+	return DecodeValue(type, &buf);
+}
+
+struct ValueNode;
+struct UnaryOpNode;
+struct BinaryOpNode;
+
+struct MEInstr
+{
+	MEOp op;
+	uint8_t a;
+	uint8_t b;
+	int64_t value;
+	const ValueNode* node;
+};
+
+// compiles the tree to straight-line stack code:
+// - constant subexpressions are folded
+// - repeated subexpressions are evaluated once and kept in locals
+// - subexpressions shared with the other expressions of a struct are kept in the instance's MathExprSharedValues
+// - reads at constant distances from the same offset are done with one block read
+// query-based nodes are not compiled, their Eval is called from the code
+struct ExprCodeGen
+{
+	struct SubexprInfo
+	{
+		unsigned count = 0;
+		int local = -1;
+		const ValueNode* node = nullptr;
+	};
+	struct ReadGroup
+	{
+		unsigned count = 0;
+		int64_t start = 0;
+		int64_t end = 0;
+		int block = -1;
+	};
+
+	// returns false if the code doesn't fit the limits
+	bool Compile(const ValueNode* root);
+	void Emit(const ValueNode* N);
+	void EmitUnary(const UnaryOpNode* N);
+	void EmitBinary(const BinaryOpNode* N);
+	void EmitRead(const ValueNode* srcOff, MEReadType type);
+	void Add(MEOp op, int64_t value = 0, uint8_t a = 0, uint8_t b = 0, const ValueNode* node = nullptr);
+
+	std::vector<MEInstr> code;
+	// the first pass only counts the subexpressions and read groups
+	bool counting = false;
+	std::unordered_map<std::string, SubexprInfo> subexprs;
+	std::unordered_map<std::string, ReadGroup> readGroups;
+	const std::unordered_map<std::string, uint8_t>* shared = nullptr;
+	// inside the code of a shared subexpression (skipped if the value is known, so it must not fill locals or blocks)
+	int inShared = 0;
+	int depth = 0;
+	int maxDepth = 0;
+	uint8_t numLocals = 0;
+	uint8_t numBlocks = 0;
+};
+
 struct ValueNode
 {
 	virtual ~ValueNode() {}
 	virtual int64_t Eval(IVariableSource*) const = 0;
 	virtual void Dump(int level) const = 0;
 	virtual std::string GenPyScript() const = 0;
+	virtual void Emit(ExprCodeGen& cg) const { cg.Add(MEOP_Node, 0, 0, 0, this); }
+	// appends a key that is equal only for identical subtrees (used to find the repeated subexpressions),
+	// returns false if the subtree must not be merged with others (errors, queries)
+	virtual bool AppendKey(std::string& out) const { return false; }
+	// only uses the root instance and the file (doesn't look at or create other instances)
+	virtual bool IsLocal() const { return false; }
+	virtual void GetDeps(MathExprDeps& out) const {}
 };
 
+static void AppendKeyValue(std::string& out, int64_t v)
+{
+	out.append((const char*)&v, sizeof(v));
+}
+
+static void AppendKeyString(std::string& out, const std::string& str)
+{
+	AppendKeyValue(out, int64_t(str.size()));
+	out += str;
+}
+
 static void DMPLEV(int level)
 {
 	for (int i = 0; i < level; i++)
@@ -23,6 +179,7 @@ struct ErrorNode : ValueNode
 	int64_t Eval(IVariableSource*) const override { return 0; }
 	void Dump(int level) const override { DMPLEV(level); fprintf(stderr, "ERROR\n"); }
 	std::string GenPyScript() const override { return "ERROR"; }
+	bool IsLocal() const override { return true; }
 };
 
 struct ConstantNode : ValueNode
@@ -30,6 +187,14 @@ struct ConstantNode : ValueNode
 	int64_t Eval(IVariableSource*) const override { return value; }
 	void Dump(int level) const override { DMPLEV(level); fprintf(stderr, "value = %" PRId64 "\n", value); }
 	std::string GenPyScript() const override { return "(" + std::to_string(value) + ")"; }
+	void Emit(ExprCodeGen& cg) const override { cg.Add(MEOP_Const, value); }
+	bool AppendKey(std::string& out) const override
+	{
+		out += 'c';
+		AppendKeyValue(out, value);
+		return true;
+	}
+	bool IsLocal() const override { return true; }
 
 	int64_t value = 0;
 };
@@ -38,7 +203,17 @@ struct UnaryOpNode : ValueNode
 {
 	~UnaryOpNode() { delete src; }
 	virtual int64_t Do(int64_t a) const = 0;
+	virtual MEOp Op() const = 0;
 	int64_t Eval(IVariableSource* vs) const override { return Do(src->Eval(vs)); }
+	void Emit(ExprCodeGen& cg) const override { cg.EmitUnary(this); }
+	bool AppendKey(std::string& out) const override
+	{
+		out += 'u';
+		out += char(Op());
+		return src->AppendKey(out);
+	}
+	bool IsLocal() const override { return src->IsLocal(); }
+	void GetDeps(MathExprDeps& out) const override { src->GetDeps(out); }
 
 	virtual const char* Name() const = 0;
 	void Dump(int level) const override
@@ -54,6 +229,7 @@ struct UnaryOpNode : ValueNode
 struct NegateNode : UnaryOpNode
 {
 	int64_t Do(int64_t a) const override { return -a; }
+	MEOp Op() const override { return MEOP_Negate; }
 	const char* Name() const override { return "negate"; }
 	std::string GenPyScript() const override { return "(-" + src->GenPyScript() + ")"; }
 };
@@ -61,6 +237,7 @@ struct NegateNode : UnaryOpNode
 struct BitwiseInvertNode : UnaryOpNode
 {
 	int64_t Do(int64_t a) const override { return ~a; }
+	MEOp Op() const override { return MEOP_Invert; }
 	const char* Name() const override { return "invert"; }
 	std::string GenPyScript() const override { return "(~" + src->GenPyScript() + ")"; }
 };
@@ -69,7 +246,21 @@ struct BinaryOpNode : ValueNode
 {
 	~BinaryOpNode() { delete srcA; delete srcB; }
 	virtual int64_t Do(int64_t a, int64_t b) const = 0;
+	virtual MEOp Op() const = 0;
 	int64_t Eval(IVariableSource* vs) const override { return Do(srcA->Eval(vs), srcB->Eval(vs)); }
+	void Emit(ExprCodeGen& cg) const override { cg.EmitBinary(this); }
+	bool AppendKey(std::string& out) const override
+	{
+		out += 'b';
+		out += char(Op());
+		return srcA->AppendKey(out) && srcB->AppendKey(out);
+	}
+	bool IsLocal() const override { return srcA->IsLocal() && srcB->IsLocal(); }
+	void GetDeps(MathExprDeps& out) const override
+	{
+		srcA->GetDeps(out);
+		srcB->GetDeps(out);
+	}
 	std::string GenPyScript() const override { return "(" + srcA->GenPyScript() + Name() + srcB->GenPyScript() + ")"; }
 
 	virtual const char* Name() const = 0;
@@ -88,96 +279,112 @@ struct BinaryOpNode : ValueNode
 struct AddNode : BinaryOpNode
 {
 	int64_t Do(int64_t a, int64_t b) const override { return a + b; }
+	MEOp Op() const override { return MEOP_Add; }
 	const char* Name() const override { return "+"; }
 };
 
 struct SubNode : BinaryOpNode
 {
 	int64_t Do(int64_t a, int64_t b) const override { return a - b; }
+	MEOp Op() const override { return MEOP_Sub; }
 	const char* Name() const override { return "-"; }
 };
 
 struct MulNode : BinaryOpNode
 {
 	int64_t Do(int64_t a, int64_t b) const override { return a * b; }
+	MEOp Op() const override { return MEOP_Mul; }
 	const char* Name() const override { return "*"; }
 };
 
 struct DivNode : BinaryOpNode
 {
 	int64_t Do(int64_t a, int64_t b) const override { return a / b; }
+	MEOp Op() const override { return MEOP_Div; }
 	const char* Name() const override { return "/"; }
 };
 
 struct ModNode : BinaryOpNode
 {
 	int64_t Do(int64_t a, int64_t b) const override { return a % b; }
+	MEOp Op() const override { return MEOP_Mod; }
 	const char* Name() const override { return "%"; }
 };
 
 struct AndNode : BinaryOpNode
 {
 	int64_t Do(int64_t a, int64_t b) const override { return a & b; }
+	MEOp Op() const override { return MEOP_And; }
 	const char* Name() const override { return "&"; }
 };
 
 struct OrNode : BinaryOpNode
 {
 	int64_t Do(int64_t a, int64_t b) const override { return a | b; }
+	MEOp Op() const override { return MEOP_Or; }
 	const char* Name() const override { return "|"; }
 };
 
 struct XorNode : BinaryOpNode
 {
 	int64_t Do(int64_t a, int64_t b) const override { return a ^ b; }
+	MEOp Op() const override { return MEOP_Xor; }
 	const char* Name() const override { return "^"; }
 };
 
 struct LShiftNode : BinaryOpNode
 {
 	int64_t Do(int64_t a, int64_t b) const override { return a << b; }
+	MEOp Op() const override { return MEOP_LShift; }
 	const char* Name() const override { return "<<"; }
 };
 
 struct RShiftNode : BinaryOpNode
 {
 	int64_t Do(int64_t a, int64_t b) const override { return a >> b; }
+	MEOp Op() const override { return MEOP_RShift; }
 	const char* Name() const override { return ">>"; }
 };
 
 struct EqualNode : BinaryOpNode
 {
 	int64_t Do(int64_t a, int64_t b) const override { return a == b; }
+	MEOp Op() const override { return MEOP_Equal; }
 	const char* Name() const override { return "=="; }
 };
 
 struct NotEqualNode : BinaryOpNode
 {
 	int64_t Do(int64_t a, int64_t b) const override { return a != b; }
+	MEOp Op() const override { return MEOP_NotEqual; }
 	const char* Name() const override { return "!="; }
 };
 
 struct LessThanNode : BinaryOpNode
 {
 	int64_t Do(int64_t a, int64_t b) const override { return a < b; }
+	MEOp Op() const override { return MEOP_LessThan; }
 	const char* Name() const override { return "<"; }
 };
 
 struct LessEqualNode : BinaryOpNode
 {
 	int64_t Do(int64_t a, int64_t b) const override { return a <= b; }
+	MEOp Op() const override { return MEOP_LessEqual; }
 	const char* Name() const override { return "<="; }
 };
 
 struct GreaterThanNode : BinaryOpNode
 {
 	int64_t Do(int64_t a, int64_t b) const override { return a > b; }
+	MEOp Op() const override { return MEOP_GreaterThan; }
 	const char* Name() const override { return ">"; }
 };
 
 struct GreaterEqualNode : BinaryOpNode
 {
 	int64_t Do(int64_t a, int64_t b) const override { return a >= b; }
+	MEOp Op() const override { return MEOP_GreaterEqual; }
 	const char* Name() const override { return ">="; }
 };
 
@@ -189,11 +396,24 @@ struct ReadNodeBase : ValueNode
 	{
 		int64_t off = srcOff->Eval(vs);
 		T val = 0;
-		vs->ReadFile(off, sizeof(val), &val);
+		if (const void* span = vs->GetFileSpan(off, sizeof(val)))
+			memcpy(&val, span, sizeof(val));
+		else
+			vs->ReadFile(off, sizeof(val), &val);
 		return int64_t(val);
 	}
+	void Emit(ExprCodeGen& cg) const override { cg.EmitRead(srcOff, ReadType()); }
+	bool AppendKey(std::string& out) const override
+	{
+		out += 'r';
+		out += char(ReadType());
+		return srcOff->AppendKey(out);
+	}
+	bool IsLocal() const override { return srcOff->IsLocal(); }
+	void GetDeps(MathExprDeps& out) const override { srcOff->GetDeps(out); }
 
 	virtual const char* Name() const = 0;
+	virtual MEReadType ReadType() const = 0;
 	void Dump(int level) const override
 	{
 		DMPLEV(level);
@@ -204,7 +424,11 @@ struct ReadNodeBase : ValueNode
 
 	ValueNode* srcOff = nullptr;
 };
-#define DEFINE_READ_NODE(t, sn) struct ReadNode_##sn : ReadNodeBase<t> { const char* Name() const override { return #sn; } }
+#define DEFINE_READ_NODE(t, sn) struct ReadNode_##sn : ReadNodeBase<t> \
+{ \
+	const char* Name() const override { return #sn; } \
+	MEReadType ReadType() const override { return MERT_##sn; } \
+}
 DEFINE_READ_NODE(int8_t, i8);
 DEFINE_READ_NODE(int16_t, i16);
 DEFINE_READ_NODE(int32_t, i32);
@@ -311,6 +535,15 @@ struct StructQueryNodeFilters
 		return ret;
 	}
 
+	void GetDeps(MathExprDeps& out) const
+	{
+		for (auto& C : exprConds)
+			if (C.expected)
+				C.expected->GetDeps(out);
+		if (which)
+			which->GetDeps(out);
+	}
+
 	StructQueryFilter Eval(IVariableSource* vs)
 	{
 		StructQueryFilter sqf = { conditions };
@@ -336,6 +569,7 @@ struct StructQueryNode
 	virtual StructQueryResults Query(IVariableSource* vs) = 0;
 	virtual void Dump(int level) const = 0;
 	virtual std::string GenPyScript() const = 0;
+	virtual void GetDeps(MathExprDeps& out) const { filters.GetDeps(out); }
 
 	StructQueryNodeFilters filters;
 };
@@ -360,6 +594,12 @@ struct RootQueryNode : StructQueryNode
 		filters.Dump(level);
 	}
 	virtual std::string GenPyScript() const override { return "vs.root_query(\"" + typeName + "\", " + filters.GenPyScript() + ")"; }
+	void GetDeps(MathExprDeps& out) const override
+	{
+		if (typeName != "")
+			out.queriedStructs.push_back(typeName);
+		filters.GetDeps(out);
+	}
 
 	std::string typeName;
 	bool global = false;
@@ -384,6 +624,17 @@ struct SubQueryNode : StructQueryNode
 	{
 		return "vs.subquery(" + (query ? query->GenPyScript() : "[self]") + ", \"" + name + "\", " + filters.GenPyScript() + ")";
 	}
+	void GetDeps(MathExprDeps& out) const override
+	{
+		if (query)
+		{
+			query->GetDeps(out);
+			out.unknownQueries = true;
+		}
+		else
+			out.queriedFields.push_back(name);
+		filters.GetDeps(out);
+	}
 
 	StructQueryNode* query = nullptr;
 	std::string name;
@@ -416,6 +667,30 @@ struct MemberFieldNode : ValueNode
 			+ "\", " + (index ? index->GenPyScript() : "0")
 			+ ", " + (isOffset ? "True" : "False") + ")";
 	}
+	bool IsLocal() const override { return !query && (!index || index->IsLocal()); }
+	bool AppendKey(std::string& out) const override
+	{
+		if (query)
+			return false;
+		out += isOffset ? 'O' : 'm';
+		AppendKeyString(out, name);
+		if (!index)
+		{
+			out += '0';
+			return true;
+		}
+		out += 'i';
+		return index->AppendKey(out);
+	}
+	void GetDeps(MathExprDeps& out) const override
+	{
+		if (query)
+			query->GetDeps(out);
+		else
+			out.rootFields.push_back(name);
+		if (index)
+			index->GetDeps(out);
+	}
 
 	StructQueryNode* query = nullptr;
 	ValueNode* index = nullptr;
@@ -442,6 +717,19 @@ struct StructOffsetNode : ValueNode
 			query->Dump(level + 1);
 	}
 	std::string GenPyScript() const override { return "bdat.me_structoff(vs, " + (query ? query->GenPyScript() : "[self]") + ")"; }
+	bool IsLocal() const override { return !query; }
+	bool AppendKey(std::string& out) const override
+	{
+		if (query)
+			return false;
+		out += 's';
+		return true;
+	}
+	void GetDeps(MathExprDeps& out) const override
+	{
+		if (query)
+			query->GetDeps(out);
+	}
 
 	StructQueryNode* query = nullptr;
 };
@@ -479,6 +767,23 @@ struct FieldPreviewEqualsStringNode : ValueNode
 	{
 		return "bdat.me_fpeqs(vs, " + (query ? query->GenPyScript() : "[self]") + ", \"" + fieldName + "\", b\"" + text + "\"" + (invert ? "True" : "False") + ")";
 	}
+	bool IsLocal() const override { return !query; }
+	bool AppendKey(std::string& out) const override
+	{
+		if (query)
+			return false;
+		out += invert ? 'P' : 'p';
+		AppendKeyString(out, fieldName);
+		AppendKeyString(out, text);
+		return true;
+	}
+	void GetDeps(MathExprDeps& out) const override
+	{
+		if (query)
+			query->GetDeps(out);
+		else
+			out.rootFields.push_back(fieldName);
+	}
 
 	StructQueryNode* query;
 	std::string fieldName;
@@ -505,7 +810,12 @@ struct InstanceIDNode : ValueNode
 	}
 	std::string GenPyScript() const override
 	{
-		return "TODO";
+		return "bdat.me_iid(vs, " + (query ? query->GenPyScript() : "[self]") + ")";
+	}
+	void GetDeps(MathExprDeps& out) const override
+	{
+		if (query)
+			query->GetDeps(out);
 	}
 
 	StructQueryNode* query;
@@ -518,10 +828,319 @@ struct CompiledMathExpr
 	{
 		delete root;
 	}
+	int64_t Run(IVariableSource* vs) const;
 
 	ValueNode* root;
+	// empty if the expression is too complex, the tree is evaluated instead
+	std::vector<MEInstr> code;
 };
 
+int64_t CompiledMathExpr::Run(IVariableSource* vs) const
+{
+	int64_t stack[ME_MAX_STACK];
+	int64_t locals[ME_MAX_LOCALS];
+	struct Block
+	{
+		const uint8_t* data;
+		int64_t start;
+	}
+	blocks[ME_MAX_BLOCKS];
+	uint8_t blockMem[ME_MAX_BLOCKS][ME_MAX_BLOCK_SIZE];
+
+	MathExprSharedValues* shared = vs->GetSharedValues();
+
+	int64_t* sp = stack;
+	for (size_t ip = 0; ip < code.size(); ip++)
+	{
+		const auto& I = code[ip];
+		switch (I.op)
+		{
+		case MEOP_Const: *sp++ = I.value; break;
+		case MEOP_Node: *sp++ = I.node->Eval(vs); break;
+		case MEOP_Load: *sp++ = locals[I.a]; break;
+		case MEOP_Store: locals[I.a] = sp[-1]; break;
+		case MEOP_SharedLoad:
+			if (shared && I.a < shared->values.size() && (shared->validMask & (1ULL << I.a)))
+			{
+				*sp++ = shared->values[I.a];
+				ip += I.value;
+			}
+			break;
+		case MEOP_SharedStore:
+			if (shared && I.a < shared->values.size())
+			{
+				shared->values[I.a] = sp[-1];
+				shared->validMask |= 1ULL << I.a;
+			}
+			break;
+		case MEOP_Read: sp[-1] = ReadValue(vs, sp[-1], MEReadType(I.a)); break;
+		case MEOP_LoadBlock:
+		{
+			auto& B = blocks[I.a];
+			B.start = *--sp + I.value;
+			B.data = nullptr;
+			// negative offsets are left to the individual reads
+			if (B.start >= 0)
+			{
+				B.data = static_cast<const uint8_t*>(vs->GetFileSpan(B.start, I.b));
+				if (!B.data)
+				{
+					memset(blockMem[I.a], 0, I.b);
+					vs->ReadFile(B.start, I.b, blockMem[I.a]);
+					B.data = blockMem[I.a];
+				}
+			}
+			break;
+		}
+		case MEOP_BlockRead:
+		{
+			auto& B = blocks[I.a];
+			*sp++ = B.data ? DecodeValue(MEReadType(I.b), B.data + I.value) : ReadValue(vs, B.start + I.value, MEReadType(I.b));
+			break;
+		}
+
+		case MEOP_Negate: sp[-1] = -sp[-1]; break;
+		case MEOP_Invert: sp[-1] = ~sp[-1]; break;
+
+#define BINARY_OP(name, op) case MEOP_##name: sp--; sp[-1] = sp[-1] op sp[0]; break
+		BINARY_OP(Add, +);
+		BINARY_OP(Sub, -);
+		BINARY_OP(Mul, *);
+		BINARY_OP(Div, /);
+		BINARY_OP(Mod, %);
+		BINARY_OP(And, &);
+		BINARY_OP(Or, |);
+		BINARY_OP(Xor, ^);
+		BINARY_OP(LShift, <<);
+		BINARY_OP(RShift, >>);
+		BINARY_OP(Equal, ==);
+		BINARY_OP(NotEqual, !=);
+		BINARY_OP(LessThan, <);
+		BINARY_OP(LessEqual, <=);
+		BINARY_OP(GreaterThan, >);
+		BINARY_OP(GreaterEqual, >=);
+#undef BINARY_OP
+		}
+	}
+	return sp[-1];
+}
+
+
+bool ExprCodeGen::Compile(const ValueNode* root)
+{
+	counting = true;
+	Emit(root);
+
+	code.clear();
+	depth = 0;
+	maxDepth = 0;
+	counting = false;
+	Emit(root);
+	return maxDepth <= ME_MAX_STACK;
+}
+
+void ExprCodeGen::Emit(const ValueNode* N)
+{
+	std::string key;
+	if (!N->AppendKey(key))
+	{
+		N->Emit(*this);
+		return;
+	}
+	bool isShared = false;
+	uint8_t slot = 0;
+	if (shared)
+	{
+		auto it = shared->find(key);
+		if (it != shared->end())
+		{
+			isShared = true;
+			slot = it->second;
+		}
+	}
+	auto& SE = subexprs[key];
+	if (counting)
+	{
+		// the repeats are loaded from a local so only the first one is counted inside
+		if (SE.count++ == 0)
+		{
+			SE.node = N;
+			if (!isShared)
+				N->Emit(*this);
+		}
+		return;
+	}
+	if (SE.local >= 0)
+	{
+		Add(MEOP_Load, 0, SE.local);
+		return;
+	}
+
+	size_t start = code.size();
+	inShared += isShared;
+	N->Emit(*this);
+	inShared -= isShared;
+	bool trivial = code.size() == start + 1 && (code.back().op == MEOP_Const || code.back().op == MEOP_Load);
+	if (isShared && !trivial)
+	{
+		code.insert(code.begin() + start, { MEOP_SharedLoad, slot, 0, 0, nullptr });
+		Add(MEOP_SharedStore, 0, slot);
+		code[start].value = int64_t(code.size() - start - 1);
+	}
+	if (SE.count > 1 && !trivial && numLocals < ME_MAX_LOCALS && !inShared)
+	{
+		SE.local = numLocals++;
+		Add(MEOP_Store, 0, SE.local);
+	}
+}
+
+void ExprCodeGen::EmitUnary(const UnaryOpNode* N)
+{
+	size_t start = code.size();
+	Emit(N->src);
+	if (code.size() == start + 1 && code.back().op == MEOP_Const)
+	{
+		code.back().value = N->Do(code.back().value);
+		return;
+	}
+	Add(N->Op());
+}
+
+void ExprCodeGen::EmitBinary(const BinaryOpNode* N)
+{
+	size_t start = code.size();
+	Emit(N->srcA);
+	size_t startB = code.size();
+	Emit(N->srcB);
+	if (startB == start + 1 && code.size() == startB + 1 &&
+		code[start].op == MEOP_Const && code[startB].op == MEOP_Const)
+	{
+		int64_t a = code[start].value;
+		int64_t b = code[startB].value;
+		// leave the division errors to the evaluation
+		bool isDiv = N->Op() == MEOP_Div || N->Op() == MEOP_Mod;
+		if (!isDiv || (b != 0 && !(b == -1 && a == INT64_MIN)))
+		{
+			code.resize(start);
+			depth -= 2;
+			Add(MEOP_Const, N->Do(a, b));
+			return;
+		}
+	}
+	Add(N->Op());
+}
+
+// splits the offset into base + rel where rel is a small constant (base is null if the whole offset is constant)
+static void SplitOffset(const ValueNode* off, const ValueNode*& base, int64_t& rel)
+{
+	constexpr int64_t MAX_REL = INT32_MAX;
+	base = off;
+	rel = 0;
+	if (auto* C = dynamic_cast<const ConstantNode*>(off))
+	{
+		if (C->value >= -MAX_REL && C->value <= MAX_REL)
+		{
+			base = nullptr;
+			rel = C->value;
+		}
+	}
+	else if (auto* A = dynamic_cast<const AddNode*>(off))
+	{
+		auto* CA = dynamic_cast<const ConstantNode*>(A->srcA);
+		auto* CB = dynamic_cast<const ConstantNode*>(A->srcB);
+		if (CB && CB->value >= -MAX_REL && CB->value <= MAX_REL)
+		{
+			base = A->srcA;
+			rel = CB->value;
+		}
+		else if (CA && CA->value >= -MAX_REL && CA->value <= MAX_REL)
+		{
+			base = A->srcB;
+			rel = CA->value;
+		}
+	}
+	else if (auto* S = dynamic_cast<const SubNode*>(off))
+	{
+		auto* CB = dynamic_cast<const ConstantNode*>(S->srcB);
+		if (CB && CB->value >= -MAX_REL && CB->value <= MAX_REL)
+		{
+			base = S->srcA;
+			rel = -CB->value;
+		}
+	}
+}
+
+void ExprCodeGen::EmitRead(const ValueNode* srcOff, MEReadType type)
+{
+	const ValueNode* base;
+	int64_t rel;
+	SplitOffset(srcOff, base, rel);
+	// an empty key is the group of the constant offsets
+	std::string key;
+	if (base && !base->AppendKey(key))
+	{
+		Emit(srcOff);
+		Add(MEOP_Read, 0, type);
+		return;
+	}
+	auto& G = readGroups[key];
+	int64_t size = g_readTypeSizes[type];
+
+	if (counting)
+	{
+		G.start = G.count ? std::min(G.start, rel) : rel;
+		G.end = G.count ? std::max(G.end, rel + size) : rel + size;
+		G.count++;
+	}
+	else if (G.count > 1 && G.end - G.start <= ME_MAX_BLOCK_SIZE)
+	{
+		// code is executed in order so the first read in the group can load the block for all of them
+		if (G.block < 0 && numBlocks < ME_MAX_BLOCKS && !inShared)
+		{
+			G.block = numBlocks++;
+			if (base)
+				Emit(base);
+			else
+				Add(MEOP_Const, 0);
+			Add(MEOP_LoadBlock, G.start, G.block, uint8_t(G.end - G.start));
+		}
+		// the reads in repeated subtrees are not counted so they may be outside the block
+		if (G.block >= 0 && rel >= G.start && rel + size <= G.end)
+		{
+			Add(MEOP_BlockRead, rel - G.start, G.block, type);
+			return;
+		}
+	}
+
+	Emit(srcOff);
+	Add(MEOP_Read, 0, type);
+}
+
+void ExprCodeGen::Add(MEOp op, int64_t value, uint8_t a, uint8_t b, const ValueNode* node)
+{
+	code.push_back({ op, a, b, value, node });
+	switch (op)
+	{
+	case MEOP_Const:
+	case MEOP_Node:
+	case MEOP_Load:
+	case MEOP_BlockRead:
+		depth++;
+		break;
+	case MEOP_Store:
+	case MEOP_SharedLoad:
+	case MEOP_SharedStore:
+	case MEOP_Read:
+	case MEOP_Negate:
+	case MEOP_Invert:
+		break;
+	default: // block loads and binary operators
+		depth--;
+		break;
+	}
+	maxDepth = std::max(maxDepth, depth);
+}
+
 
 enum METokenType
 {
@@ -1289,9 +1908,9 @@ StructQueryResults VariableSource::RootQuery(const std::string& typeName, bool g
 	auto* S = desc->FindStructByName(typeName);
 	if (!S)
 		return res;
-	for (auto* SI : desc->instances)
+	for (auto* SI : desc->instIndex.GetStructInstances(S))
 	{
-		if (SI->def != S || (!global && SI->file != F))
+		if (!global && SI->file != F)
 			continue;
 		if (!Matches(filter, desc, SI))
 			continue;
@@ -1308,6 +1927,11 @@ size_t VariableSource::ReadFile(int64_t off, size_t size, void* outbuf)
 	return root->file->dataSource->Read(off, size, outbuf);
 }
 
+const void* VariableSource::GetFileSpan(int64_t off, size_t size)
+{
+	return off >= 0 ? root->file->dataSource->GetSpan(off, size) : nullptr;
+}
+
 
 bool InParseVariableSource::GetVariable(const DDStructInst* inst, const std::string& field, int64_t pos, bool offset, int64_t& outVal)
 {
@@ -1355,13 +1979,18 @@ size_t InParseVariableSource::ReadFile(int64_t off, size_t size, void* outbuf)
 	return root->file->dataSource->Read(off, size, outbuf);
 }
 
+const void* InParseVariableSource::GetFileSpan(int64_t off, size_t size)
+{
+	return off >= 0 ? root->file->dataSource->GetSpan(off, size) : nullptr;
+}
+
 
 MathExpr::~MathExpr()
 {
 	delete _impl;
 }
 
-void MathExpr::Compile(const char* expr)
+void MathExpr::Compile(const char* expr, bool bytecode)
 {
 	delete _impl;
 
@@ -1372,15 +2001,142 @@ void MathExpr::Compile(const char* expr)
 	//c.Dump();
 	_impl = new CompiledMathExpr;
 	_impl->root = c.root;
+
+	ExprCodeGen cg;
+	if (bytecode && c.root && cg.Compile(c.root))
+		_impl->code = std::move(cg.code);
 }
 
 int64_t MathExpr::Evaluate(IVariableSource* vsrc)
 {
 	if (!_impl || !_impl->root)
 		return 0;
+	if (!_impl->code.empty())
+		return _impl->Run(vsrc);
 	return _impl->root->Eval(vsrc);
 }
 
+void MathExpr::GetSharableSubexprs(const std::vector<std::string>& contextNames, std::vector<std::string>& outKeys) const
+{
+	// only the bytecode uses the shared values
+	if (!_impl || !_impl->root || _impl->code.empty())
+		return;
+
+	ExprCodeGen cg;
+	cg.counting = true;
+	cg.Emit(_impl->root);
+	for (const auto& SE : cg.subexprs)
+	{
+		if (dynamic_cast<const ConstantNode*>(SE.second.node))
+			continue;
+		MathExprDeps deps;
+		SE.second.node->GetDeps(deps);
+		bool usesContext = false;
+		for (const auto& name : deps.rootFields)
+			if (std::find(contextNames.begin(), contextNames.end(), name) != contextNames.end())
+				usesContext = true;
+		if (!usesContext)
+			outKeys.push_back(SE.first);
+	}
+}
+
+void MathExpr::SetSharedSubexprs(const std::unordered_map<std::string, uint8_t>& slots)
+{
+	if (!_impl || !_impl->root || _impl->code.empty())
+		return;
+
+	// the previous code may use slots that now belong to other subexpressions
+	ExprCodeGen cg;
+	cg.shared = &slots;
+	if (!cg.Compile(_impl->root))
+	{
+		cg = {};
+		if (!cg.Compile(_impl->root))
+			cg.code.clear();
+	}
+	_impl->code = std::move(cg.code);
+}
+
+bool MathExpr::IsLocal() const
+{
+	return !_impl || !_impl->root || _impl->root->IsLocal();
+}
+
+void MathExpr::GetDependencies(MathExprDeps& out) const
+{
+	if (_impl && _impl->root)
+		_impl->root->GetDeps(out);
+}
+
+static const MemberFieldNode* GetRootField(const ValueNode* N)
+{
+	auto* MF = dynamic_cast<const MemberFieldNode*>(N);
+	if (MF && !MF->query && !MF->index && !MF->isOffset)
+		return MF;
+	return nullptr;
+}
+
+static void GetRequiredChecks(const ValueNode* N, std::vector<MathExprFieldCheck>& out)
+{
+	if (auto* MF = GetRootField(N))
+	{
+		out.push_back({ MF->name, MathExprFieldCheck::NotEqual, 0 });
+		return;
+	}
+	auto* B = dynamic_cast<const BinaryOpNode*>(N);
+	if (!B)
+		return;
+
+	MEOp op = B->Op();
+	if (op == MEOP_And)
+	{
+		// a nonzero result requires both operands to be nonzero
+		GetRequiredChecks(B->srcA, out);
+		GetRequiredChecks(B->srcB, out);
+		return;
+	}
+
+	MathExprFieldCheck::Op cop;
+	switch (op)
+	{
+	case MEOP_Equal: cop = MathExprFieldCheck::Equal; break;
+	case MEOP_NotEqual: cop = MathExprFieldCheck::NotEqual; break;
+	case MEOP_LessThan: cop = MathExprFieldCheck::Less; break;
+	case MEOP_LessEqual: cop = MathExprFieldCheck::LessEqual; break;
+	case MEOP_GreaterThan: cop = MathExprFieldCheck::Greater; break;
+	case MEOP_GreaterEqual: cop = MathExprFieldCheck::GreaterEqual; break;
+	default: return;
+	}
+
+	if (auto* MF = GetRootField(B->srcA))
+	{
+		if (auto* C = dynamic_cast<const ConstantNode*>(B->srcB))
+			out.push_back({ MF->name, cop, C->value });
+	}
+	else if (auto* MF = GetRootField(B->srcB))
+	{
+		if (auto* C = dynamic_cast<const ConstantNode*>(B->srcA))
+		{
+			// constant on the left side, the same check with the operands swapped
+			switch (cop)
+			{
+			case MathExprFieldCheck::Less: cop = MathExprFieldCheck::Greater; break;
+			case MathExprFieldCheck::LessEqual: cop = MathExprFieldCheck::GreaterEqual; break;
+			case MathExprFieldCheck::Greater: cop = MathExprFieldCheck::Less; break;
+			case MathExprFieldCheck::GreaterEqual: cop = MathExprFieldCheck::LessEqual; break;
+			default: break;
+			}
+			out.push_back({ MF->name, cop, C->value });
+		}
+	}
+}
+
+void MathExpr::GetRequiredFieldChecks(std::vector<MathExprFieldCheck>& out) const
+{
+	if (_impl && _impl->root)
+		GetRequiredChecks(_impl->root, out);
+}
+
 std::string MathExpr::GenPyScript()
 {
 	if (!_impl || !_impl->root)
@@ -61,6 +61,21 @@ struct StructQueryResults : std::vector<const DDStructInst*>
 	using vector::vector;
 };
 
+// values of the subexpressions shared by the field expressions of a struct, kept by each instance until its caches are dropped
+struct MathExprSharedValues
+{
+	static constexpr size_t MAX_VALUES = 64;
+
+	std::vector<int64_t> values;
+	uint64_t validMask = 0;
+
+	void Reset(size_t count)
+	{
+		values.resize(count);
+		validMask = 0;
+	}
+};
+
 struct IVariableSource
 {
 	virtual bool GetVariable(const DDStructInst* inst, const std::string& field, int64_t pos, bool offset, int64_t& outVal) = 0;
@@ -68,6 +83,10 @@ struct IVariableSource
 	virtual StructQueryResults Subquery(const StructQueryResults& src, const std::string& field, const StructQueryFilter& filter) = 0;
 	virtual StructQueryResults RootQuery(const std::string& typeName, bool global, const StructQueryFilter& filter) = 0;
 	virtual size_t ReadFile(int64_t off, size_t size, void* outbuf) = 0;
+	// direct pointer to file data if available, nullptr otherwise (use ReadFile)
+	virtual const void* GetFileSpan(int64_t off, size_t size) { return nullptr; }
+	// values shared with the other expressions evaluated for the same instance, nullptr if there are none
+	virtual MathExprSharedValues* GetSharedValues() { return nullptr; }
 };
 
 struct PredefinedConstant
@@ -83,11 +102,15 @@ struct VariableSource : IVariableSource
 	StructQueryResults Subquery(const StructQueryResults& src, const std::string& field, const StructQueryFilter& filter) override;
 	StructQueryResults RootQuery(const std::string& typeName, bool global, const StructQueryFilter& filter) override;
 	size_t ReadFile(int64_t off, size_t size, void* outbuf) override;
+	const void* GetFileSpan(int64_t off, size_t size) override;
+	MathExprSharedValues* GetSharedValues() override { return sharedValues; }
 
 	DataDesc* desc = nullptr;
 	const DDStructInst* root = nullptr;
 	const PredefinedConstant* constants = nullptr;
 	size_t constantCount = 0;
+	// only for the expressions of root's struct, evaluated with the same constant names
+	MathExprSharedValues* sharedValues = nullptr;
 };
 
 struct InParseVariableSource : IVariableSource
@@ -97,20 +120,62 @@ struct InParseVariableSource : IVariableSource
 	StructQueryResults Subquery(const StructQueryResults& src, const std::string& field, const StructQueryFilter& filter) override;
 	StructQueryResults RootQuery(const std::string& typeName, bool global, const StructQueryFilter& filter) override;
 	size_t ReadFile(int64_t off, size_t size, void* outbuf) override;
+	const void* GetFileSpan(int64_t off, size_t size) override;
 
 	const DDStructInst* root = nullptr;
 	size_t untilField = 0;
 };
 
+// what an expression reads besides the file and the constants
+struct MathExprDeps
+{
+	// fields/arguments of the root instance
+	std::vector<std::string> rootFields;
+	// structs searched by root queries (#struct)
+	std::vector<std::string> queriedStructs;
+	// fields of the root instance whose instances are created by subqueries (field.subfield)
+	std::vector<std::string> queriedFields;
+	// subqueries of other queries, the struct types are only known when evaluating
+	bool unknownQueries = false;
+};
+
+// a comparison of a field (or argument) of the root instance with a constant
+struct MathExprFieldCheck
+{
+	enum Op
+	{
+		Equal,
+		NotEqual,
+		Less,
+		LessEqual,
+		Greater,
+		GreaterEqual,
+	};
+
+	std::string field;
+	Op op;
+	int64_t value;
+};
+
 struct MathExpr
 {
 	MathExpr() {}
 	~MathExpr();
 	MathExpr(const MathExpr&) = delete;
 
-	void Compile(const char* expr);
+	// `bytecode` - false to always evaluate the tree (to compare with the bytecode)
+	void Compile(const char* expr, bool bytecode = true);
 	int64_t Evaluate(IVariableSource* vsrc);
+	// true if only the fields/arguments of the root instance and the file are used (no queries)
+	bool IsLocal() const;
+	void GetDependencies(MathExprDeps& out) const;
+	// comparisons that hold whenever the result is nonzero (those of the operands of `&` are included)
+	void GetRequiredFieldChecks(std::vector<MathExprFieldCheck>& out) const;
 	std::string GenPyScript();
+	// keys of the subexpressions whose values can be shared with other expressions (those not using any of `contextNames`)
+	void GetSharableSubexprs(const std::vector<std::string>& contextNames, std::vector<std::string>& outKeys) const;
+	// recompiles the bytecode to evaluate the listed subexpressions once per MathExprSharedValues (at the given index)
+	void SetSharedSubexprs(const std::unordered_map<std::string, uint8_t>& slots);
 
 	struct CompiledMathExpr* _impl = nullptr;
 };
@@ -119,6 +184,7 @@ struct MathExprObj
 {
 	std::string expr;
 	MathExpr* inst = nullptr;
+	bool bytecode = true;
 
 	void Recompile()
 	{
@@ -127,7 +193,7 @@ struct MathExprObj
 		if (expr.size())
 		{
 			inst = new MathExpr;
-			inst->Compile(expr.c_str());
+			inst->Compile(expr.c_str(), bytecode);
 		}
 	}
 	int64_t Evaluate(IVariableSource& vs) const
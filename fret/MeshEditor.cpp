@@ -2,11 +2,102 @@
 #include "pch.h"
 #include "MeshEditor.h"
 
+#include "MeshSimplify.h"
 #include "../Render/RHI.h"
 
 
+ui::DataCategoryTag DCT_MeshLOD[1];
+
+static ui::rhi::PrimitiveType ConvPrimitiveType(MSPrimType type)
+{
+	using namespace ui::rhi;
+	switch (type)
+	{
+	default:
+	case MSPrimType::Points: return PT_Points;
+	case MSPrimType::Lines: return PT_Lines;
+	case MSPrimType::LineStrip: return PT_LineStrip;
+	case MSPrimType::Triangles: return PT_Triangles;
+	case MSPrimType::TriangleStrip: return PT_TriangleStrip;
+	}
+}
+
+void MeshGPUPrimitive::Upload(const MSPrimitive& P)
+{
+	using namespace ui::rhi;
+
+	size_t vbSize = P.convVerts.size() * sizeof(MSVert);
+	if (vertices)
+		UpdateBuffer(vertices, P.convVerts.data(), vbSize);
+	else
+		vertices = CreateVertexBuffer(P.convVerts.data(), vbSize);
+
+	size_t ibSize = P.indices.size() * sizeof(uint32_t);
+	if (indices)
+		UpdateBuffer(indices, P.indices.data(), ibSize);
+	else if (ibSize)
+		indices = CreateIndexBuffer(P.indices.data(), ibSize);
+
+	numVertices = P.convVerts.size();
+	numIndices = P.indices.size();
+	type = P.type;
+}
+
+void MeshGPUPrimitive::Free()
+{
+	if (vertices)
+		ui::rhi::DestroyBuffer(vertices);
+	if (indices)
+		ui::rhi::DestroyBuffer(indices);
+	*this = {};
+}
+
+void MeshGPUPrimitive::Render()
+{
+	using namespace ui::rhi;
+
+	if (numIndices == 0)
+	{
+		Draw(
+			ui::Mat4f::Identity(),
+			ConvPrimitiveType(type),
+			VF_Normal | VF_Texcoord | VF_Color,
+			vertices,
+			numVertices);
+	}
+	else
+	{
+		DrawIndexed(
+			ui::Mat4f::Identity(),
+			ConvPrimitiveType(type),
+			VF_Normal | VF_Texcoord | VF_Color,
+			vertices,
+			numVertices,
+			indices,
+			numIndices,
+			true);
+	}
+}
+
+
+MeshEditorWindowNode::~MeshEditorWindowNode()
+{
+	{
+		std::lock_guard<std::mutex> g(_lodMutex);
+		_lodRunID++;
+	}
+	for (auto& G : gpuPrims)
+		G.Free();
+	for (auto& G : gpuLODPrims)
+		G.Free();
+}
+
+
 void MeshEditorWindowNode::Build()
 {
+	UpdateLOD();
+	Subscribe(DCT_MeshLOD, this);
+
 	auto& sp1 = ui::Push<ui::SplitPane>();
 	{
 		auto& sp2 = ui::Push<ui::SplitPane>();
@@ -31,6 +122,11 @@ void MeshEditorWindowNode::Build()
 						ui::imm::PropEditBool("Use texture", useTexture);
 						ui::imm::PropEditBool("Draw wireframe", drawWireframe);
 						ui::imm::PropEditColor("Wire color", wireColor);
+						ui::imm::PropEditBool("Use LOD while moving", useLOD);
+						if (lodRunning)
+							ui::Text("Building LOD...") + ui::SetPadding(5);
+						else if (numLODTriangles)
+							ui::Textf("LOD: %zu triangles", numLODTriangles) + ui::SetPadding(5);
 					}
 					ui::Pop();
 
@@ -90,22 +186,117 @@ void MeshEditorWindowNode::ReloadMesh()
 	vs.desc = ddiSrc.dataDesc;
 	vs.root = ddiSrc.dataDesc->curInst;
 	lastMesh = mesh->script.RunScript(ddiSrc.dataDesc->curInst->file->dataSource, &vs);
+	meshChanged = true;
+	StartLOD();
 }
 
-static ui::rhi::PrimitiveType ConvPrimitiveType(MSPrimType type)
+void MeshEditorWindowNode::StartLOD()
 {
-	using namespace ui::rhi;
-	switch (type)
+	uint32_t runID;
 	{
-	default:
-	case MSPrimType::Points: return PT_Points;
-	case MSPrimType::Lines: return PT_Lines;
-	case MSPrimType::LineStrip: return PT_LineStrip;
-	case MSPrimType::Triangles: return PT_Triangles;
-	case MSPrimType::TriangleStrip: return PT_TriangleStrip;
+		std::lock_guard<std::mutex> g(_lodMutex);
+		runID = ++_lodRunID;
+		_pendingLOD.clear();
+		_hasPendingLOD = false;
+	}
+	numLODTriangles = 0;
+	lodRunning = false;
+	lodPrims.clear();
+	lodChanged = false;
+
+	// the worker gets a copy of the primitives that need a LOD, empty ones in place of the rest
+	std::vector<MSPrimitive> src(lastMesh.primitives.size());
+	bool any = false;
+	for (size_t i = 0; i < src.size(); i++)
+	{
+		const auto& P = lastMesh.primitives[i];
+		size_t numTris = (P.indices.empty() ? P.convVerts.size() : P.indices.size()) / 3;
+		if (P.type != MSPrimType::Triangles || numTris <= MESH_LOD_MIN_TRIANGLES)
+			continue;
+		src[i] = P;
+		any = true;
+	}
+	if (!any)
+		return;
+
+	lodRunning = true;
+	_lodQueue.Push([this, runID, src{ std::move(src) }]()
+	{
+		auto cancel = [this, runID]() { return _lodQueue.HasItems() || _lodQueue.IsQuitting() || !_IsCurrentLOD(runID); };
+		std::vector<MSPrimitive> lods(src.size());
+		for (size_t i = 0; i < src.size(); i++)
+		{
+			if (src[i].convVerts.empty())
+				continue;
+			SimplifyMesh(src[i], MESH_LOD_TARGET_TRIANGLES, lods[i], cancel);
+			if (cancel())
+				return;
+		}
+		{
+			std::lock_guard<std::mutex> g(_lodMutex);
+			if (runID != _lodRunID)
+				return;
+			_pendingLOD = std::move(lods);
+			_hasPendingLOD = true;
+		}
+		// only the address is used, the window may be gone by the time the event runs
+		uintptr_t at = reinterpret_cast<uintptr_t>(this);
+		ui::Application::PushEvent([at]() { ui::Notify(DCT_MeshLOD, at); });
+	}, true);
+}
+
+bool MeshEditorWindowNode::_IsCurrentLOD(uint32_t runID)
+{
+	std::lock_guard<std::mutex> g(_lodMutex);
+	return runID == _lodRunID;
+}
+
+void MeshEditorWindowNode::UploadMesh()
+{
+	// called while rendering, the buffers need the render context
+	if (meshChanged)
+	{
+		meshChanged = false;
+		for (size_t i = lastMesh.primitives.size(); i < gpuPrims.size(); i++)
+			gpuPrims[i].Free();
+		gpuPrims.resize(lastMesh.primitives.size());
+		for (size_t i = 0; i < gpuPrims.size(); i++)
+			gpuPrims[i].Upload(lastMesh.primitives[i]);
+		for (auto& G : gpuLODPrims)
+			G.Free();
+		gpuLODPrims.clear();
+	}
+
+	if (lodChanged)
+	{
+		lodChanged = false;
+		for (auto& G : gpuLODPrims)
+			G.Free();
+		gpuLODPrims.resize(lodPrims.size());
+		for (size_t i = 0; i < lodPrims.size(); i++)
+			if (lodPrims[i].convVerts.size())
+				gpuLODPrims[i].Upload(lodPrims[i]);
+		lodPrims.clear();
 	}
 }
 
+void MeshEditorWindowNode::UpdateLOD()
+{
+	{
+		std::lock_guard<std::mutex> g(_lodMutex);
+		if (!_hasPendingLOD)
+			return;
+		lodPrims = std::move(_pendingLOD);
+		_pendingLOD.clear();
+		_hasPendingLOD = false;
+	}
+	lodChanged = true;
+	lodRunning = false;
+	numLODTriangles = 0;
+	for (const auto& P : lodPrims)
+		numLODTriangles += P.indices.size() / 3;
+}
+
 void MeshEditorWindowNode::OnRender3D(ui::UIRect rect)
 {
 	using namespace ui::rhi;
@@ -131,10 +322,21 @@ void MeshEditorWindowNode::OnRender3D(ui::UIRect rect)
 	DrawIndexed(ui::Mat4f::Translate(0, 0, -1) * ui::Mat4f::RotateX(90), PT_Triangles, VF_Color, verts, 4, indices, 6);
 	DrawIndexed(ui::Mat4f::Translate(0, 0, -1) * ui::Mat4f::RotateY(-90), PT_Triangles, VF_Color, verts, 4, indices, 6);
 
+	UploadMesh();
+	// the simplified primitives are drawn while the camera is being moved
+	bool lod = useLOD && (orbitCamera.rotating || orbitCamera.panning);
+	auto getGPUPrim = [this, lod](size_t i) -> MeshGPUPrimitive&
+	{
+		if (lod && i < gpuLODPrims.size() && gpuLODPrims[i].vertices)
+			return gpuLODPrims[i];
+		return gpuPrims[i];
+	};
+
 	cachedImgs.resize(lastMesh.primitives.size());
 	for (auto& P : lastMesh.primitives)
 	{
-		auto& CI = cachedImgs[&P - lastMesh.primitives.data()];
+		size_t i = &P - lastMesh.primitives.data();
+		auto& CI = cachedImgs[i];
 		Texture2D* tex = nullptr;
 		if (useTexture && P.texInstID > 0 && ddiSrc.dataDesc)
 		{
@@ -152,41 +354,14 @@ void MeshEditorWindowNode::OnRender3D(ui::UIRect rect)
 		if (alphaBlend)
 			flags |= DF_AlphaBlended;
 		SetRenderState(flags);
-		RenderMesh(P);
+		getGPUPrim(i).Render();
 	}
 	if (drawWireframe)
 	{
 		SetTexture(nullptr);
 		SetRenderState(DF_Wireframe | DF_ForceColor | DF_AlphaBlended);
 		SetForcedColor(wireColor);
-		for (auto& P : lastMesh.primitives)
-			RenderMesh(P);
-	}
-}
-
-void MeshEditorWindowNode::RenderMesh(MSPrimitive& P)
-{
-	using namespace ui::rhi;
-
-	if (P.indices.empty())
-	{
-		Draw(
-			ui::Mat4f::Identity(),
-			ConvPrimitiveType(P.type),
-			VF_Normal | VF_Texcoord | VF_Color,
-			P.convVerts.data(),
-			P.convVerts.size());
-	}
-	else
-	{
-		DrawIndexed(
-			ui::Mat4f::Identity(),
-			ConvPrimitiveType(P.type),
-			VF_Normal | VF_Texcoord | VF_Color,
-			P.convVerts.data(),
-			P.convVerts.size(),
-			P.indices.data(),
-			P.indices.size(),
-			true);
+		for (size_t i = 0; i < gpuPrims.size(); i++)
+			getGPUPrim(i).Render();
 	}
 }
@@ -4,9 +4,35 @@
 
 #include "DataDesc.h"
 
+#include <mutex>
+
+
+namespace ui {
+namespace rhi {
+struct Buffer;
+} // rhi
+} // ui
+
+extern ui::DataCategoryTag DCT_MeshLOD[1];
+
+// persistent GPU copy of a primitive, the buffers are reused by the next upload
+struct MeshGPUPrimitive
+{
+	void Upload(const MSPrimitive& P);
+	void Free();
+	void Render();
+
+	ui::rhi::Buffer* vertices = nullptr;
+	ui::rhi::Buffer* indices = nullptr;
+	size_t numVertices = 0;
+	size_t numIndices = 0;
+	MSPrimType type = MSPrimType::Triangles;
+};
+
 
 struct MeshEditorWindowNode : ui::Buildable
 {
+	~MeshEditorWindowNode();
 	void OnInit() override
 	{
 		GetNativeWindow()->SetTitle("Mesh Resource Editor");
@@ -29,7 +55,13 @@ struct MeshEditorWindowNode : ui::Buildable
 
 	void ReloadMesh();
 	void OnRender3D(ui::UIRect rect);
-	void RenderMesh(MSPrimitive& P);
+	// simplified versions of the large primitives are built on the worker thread
+	void StartLOD();
+	// takes over the finished LOD (DCT_MeshLOD is notified)
+	void UpdateLOD();
+	void UploadMesh();
+
+	bool _IsCurrentLOD(uint32_t runID);
 
 	DDStruct* structDef = nullptr;
 	DDRsrcMesh* mesh = nullptr;
@@ -40,9 +72,28 @@ struct MeshEditorWindowNode : ui::Buildable
 	MSData lastMesh;
 	ui::OrbitCamera orbitCamera;
 
+	// uploaded (in the next render) after each script run
+	bool meshChanged = false;
+	std::vector<MeshGPUPrimitive> gpuPrims;
+	// one per primitive, empty if it has no LOD
+	std::vector<MSPrimitive> lodPrims;
+	std::vector<MeshGPUPrimitive> gpuLODPrims;
+	bool lodChanged = false;
+	size_t numLODTriangles = 0;
+	bool lodRunning = false;
+
 	bool alphaBlend = false;
 	bool cull = false;
 	bool useTexture = true;
 	bool drawWireframe = false;
 	ui::Color4b wireColor = { 0, 255, 0 };
+	bool useLOD = true;
+
+	std::mutex _lodMutex;
+	uint32_t _lodRunID = 0;
+	std::vector<MSPrimitive> _pendingLOD;
+	bool _hasPendingLOD = false;
+
+	// last so that the worker is stopped first
+	ui::WorkerQueue _lodQueue;
 };
@@ -2,6 +2,8 @@
 #include "pch.h"
 #include "MeshScript.h"
 
+#include "SimdHelpers.h"
+
 
 ui::DataCategoryTag DCT_MeshScriptChanged[1];
 
@@ -123,41 +125,20 @@ MSData MeshScript::RunScript(IDataSource* src, IVariableSource* instCtx)
 
 	// remove primitives w/o any verts
 	for (size_t i = 0; i < ret.primitives.size(); i++)
-		if (ret.primitives[i].positions.size() == 0)
+		if (ret.primitives[i].numPositions == 0)
 			ret.primitives.erase(ret.primitives.begin() + i--);
 
 	for (auto& P : ret.primitives)
 	{
-		if (P.normals.size() > 0 && P.normals.size() != P.positions.size())
+		if (P.numNormals > 0 && P.numNormals != P.numPositions)
 			ctx.Error("normal count doesn't match");
-		if (P.texcoords.size() > 0 && P.texcoords.size() != P.positions.size())
+		if (P.numTexcoords > 0 && P.numTexcoords != P.numPositions)
 			ctx.Error("texcoord count doesn't match");
-		if (P.colors.size() > 0 && P.colors.size() != P.positions.size())
+		if (P.numColors > 0 && P.numColors != P.numPositions)
 			ctx.Error("color count doesn't match");
 
-		P.convVerts.reserve(P.positions.size());
-		for (size_t i = 0; i < P.positions.size(); i++)
-		{
-			MSVert vert;
-			vert.pos = P.positions[i];
-
-			if (i < P.normals.size())
-				vert.nrm = P.normals[i];
-			else
-				vert.nrm = {};
-
-			if (i < P.texcoords.size())
-				vert.tex = P.texcoords[i];
-			else
-				vert.tex = {};
-
-			if (i < P.colors.size())
-				vert.col = P.colors[i];
-			else
-				vert.col = {};
-
-			P.convVerts.push_back(vert);
-		}
+		// the other attributes may have been written past the positions
+		P.convVerts.resize(P.numPositions);
 
 		if (P.type == MSPrimType::Quads)
 		{
@@ -183,13 +164,13 @@ MSData MeshScript::RunScript(IDataSource* src, IVariableSource* instCtx)
 				P.indices.reserve(indices.size() / 4 * 6);
 				for (size_t i = 0; i + 3 < indices.size(); i += 4)
 				{
-					P.indices.push_back(P.indices[i + 0]);
-					P.indices.push_back(P.indices[i + 1]);
-					P.indices.push_back(P.indices[i + 2]);
+					P.indices.push_back(indices[i + 0]);
+					P.indices.push_back(indices[i + 1]);
+					P.indices.push_back(indices[i + 2]);
 
-					P.indices.push_back(P.indices[i + 2]);
-					P.indices.push_back(P.indices[i + 3]);
-					P.indices.push_back(P.indices[i + 0]);
+					P.indices.push_back(indices[i + 2]);
+					P.indices.push_back(indices[i + 3]);
+					P.indices.push_back(indices[i + 0]);
 				}
 			}
 
@@ -383,83 +364,168 @@ void MSN_NewPrimitive::FullEditUI()
 
 static int g_destComps[4] = { 3, 3, 2, 4 };
 
-template <class T> static void ReadVertexDataT(std::vector<float>& ret, IDataSource* src, int destcomp, int readcomp, int64_t off, int64_t count, int64_t stride)
-{
-	T buf[4];
+// vertices converted per chunk when the data is not in memory
+static constexpr int64_t VERTEX_CHUNK_SIZE = 16384;
 
-	for (int64_t i = 0; i < count; i++, off += stride)
-	{
-		src->Read(off, sizeof(T) * readcomp, &buf);
-		for (int j = 0; j < readcomp; j++)
-			ret[i * destcomp + j] = float(buf[j]);
-	}
+// loads up to 4 components (the rest are 0) and converts them to float
+template <class T> static UI_FORCEINLINE __m128 LoadComponents(const char* p, int readcomp)
+{
+	T buf[4] = {};
+	memcpy(buf, p, sizeof(T) * readcomp);
+	return _mm_setr_ps(float(buf[0]), float(buf[1]), float(buf[2]), float(buf[3]));
+}
+template <> UI_FORCEINLINE __m128 LoadComponents<int8_t>(const char* p, int readcomp)
+{
+	int32_t buf = 0;
+	memcpy(&buf, p, readcomp);
+	__m128i v = _mm_cvtsi32_si128(buf);
+	v = _mm_unpacklo_epi8(v, v);
+	v = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 24);
+	return _mm_cvtepi32_ps(v);
+}
+template <> UI_FORCEINLINE __m128 LoadComponents<uint8_t>(const char* p, int readcomp)
+{
+	int32_t buf = 0;
+	memcpy(&buf, p, readcomp);
+	__m128i v = _mm_cvtsi32_si128(buf);
+	v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, _mm_setzero_si128()), _mm_setzero_si128());
+	return _mm_cvtepi32_ps(v);
+}
+template <> UI_FORCEINLINE __m128 LoadComponents<int16_t>(const char* p, int readcomp)
+{
+	int64_t buf = 0;
+	memcpy(&buf, p, readcomp * 2);
+	__m128i v = _mm_loadl_epi64((const __m128i*)&buf);
+	return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
+template <> UI_FORCEINLINE __m128 LoadComponents<uint16_t>(const char* p, int readcomp)
+{
+	int64_t buf = 0;
+	memcpy(&buf, p, readcomp * 2);
+	__m128i v = _mm_loadl_epi64((const __m128i*)&buf);
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128()));
+}
+template <> UI_FORCEINLINE __m128 LoadComponents<int32_t>(const char* p, int readcomp)
+{
+	int32_t buf[4] = {};
+	memcpy(buf, p, readcomp * 4);
+	return _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)buf));
+}
+template <> UI_FORCEINLINE __m128 LoadComponents<float>(const char* p, int readcomp)
+{
+	float buf[4] = {};
+	memcpy(buf, p, readcomp * 4);
+	return _mm_loadu_ps(buf);
 }
-typedef void ReadVertexDataFn(std::vector<float>& ret, IDataSource* src, int destcomp, int readcomp, int64_t off, int64_t count, int64_t stride);
 
-ReadVertexDataFn* g_readFuncs[] =
+// write the converted components to one attribute of the vertex
+struct WritePosition { static UI_FORCEINLINE void Write(MSVert& V, __m128 v) { _mm_storel_pi((__m64*)&V.pos.x, v); _mm_store_ss(&V.pos.z, _mm_movehl_ps(v, v)); } };
+struct WriteNormal { static UI_FORCEINLINE void Write(MSVert& V, __m128 v) { _mm_storel_pi((__m64*)&V.nrm.x, v); _mm_store_ss(&V.nrm.z, _mm_movehl_ps(v, v)); } };
+struct WriteTexcoord { static UI_FORCEINLINE void Write(MSVert& V, __m128 v) { _mm_storel_pi((__m64*)&V.tex.x, v); } };
+struct WriteColor
 {
-	ReadVertexDataT<int8_t>,
-	ReadVertexDataT<uint8_t>,
-	ReadVertexDataT<int16_t>,
-	ReadVertexDataT<uint16_t>,
-	ReadVertexDataT<int32_t>,
-	ReadVertexDataT<uint32_t>,
-	ReadVertexDataT<int64_t>,
-	ReadVertexDataT<uint64_t>,
-	ReadVertexDataT<float>,
-	ReadVertexDataT<double>,
+	// same as the conversion from Color4f
+	static UI_FORCEINLINE void Write(MSVert& V, __m128 v)
+	{
+		v = _mm_mul_ps(_mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1)), _mm_set1_ps(255));
+		__m128i i = _mm_cvttps_epi32(v);
+		i = _mm_packus_epi16(_mm_packs_epi32(i, i), i);
+		int32_t rgba = _mm_cvtsi128_si32(i);
+		memcpy(&V.col, &rgba, 4);
+	}
 };
 
-static void ReadVertexData(std::vector<float>& ret, IDataSource* src, MSVDType type, int destcomp, int readcomp, int64_t off, int64_t count, int64_t stride)
+// the components that are not read are set to the defaults (0 and 1 for the 4th one)
+// normalization is applied to the read ones, in the same pass
+template <class T, class W> static void ConvertVertices(MSVert* out, const char* src, int64_t srcStride, int64_t count, int readcomp, bool normalize)
 {
-	ret.resize(destcomp * count, 0.0f);
-
-	if (destcomp == 4 && readcomp < 4)
+	float scale = 1;
+	float bias = 0;
+	if (normalize && std::numeric_limits<T>::is_integer)
 	{
-		// fill in the ones
-		for (int64_t i = 0; i < count; i++)
-			ret[i * 4 + 3] = 1.0f;
+		float minval = std::numeric_limits<T>::min();
+		float maxval = std::numeric_limits<T>::max();
+		float tgtmin = minval ? -1 : 0;
+		scale = (1 - tgtmin) / (maxval - minval);
+		bias = tgtmin - minval * scale;
 	}
+	__m128 vscale = _mm_set1_ps(scale);
+	__m128 vbias = _mm_set1_ps(bias);
+	static const int32_t readMasks[5][4] =
+	{
+		{ 0, 0, 0, 0 },
+		{ -1, 0, 0, 0 },
+		{ -1, -1, 0, 0 },
+		{ -1, -1, -1, 0 },
+		{ -1, -1, -1, -1 },
+	};
+	__m128 readMask = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)readMasks[readcomp]));
+	__m128 defaults = _mm_andnot_ps(readMask, _mm_setr_ps(0, 0, 0, 1));
 
-	g_readFuncs[int(type)](ret, src, destcomp, readcomp, off, count, stride);
+	for (int64_t i = 0; i < count; i++, src += srcStride)
+	{
+		__m128 v = LoadComponents<T>(src, readcomp);
+		v = _mm_add_ps(_mm_mul_ps(v, vscale), vbias);
+		v = _mm_or_ps(_mm_and_ps(v, readMask), defaults);
+		W::Write(out[i], v);
+	}
 }
 
-template <class T> static void NormalizeDataT(std::vector<float>& data)
+template <class T> static void ConvertVerticesT(MSVert* out, MSVDDest dest, const char* src, int64_t srcStride, int64_t count, int readcomp, bool normalize)
 {
-	float minval = std::numeric_limits<T>::min();
-	float maxval = std::numeric_limits<T>::max();
-	float tgtmin = minval ? -1 : 0;
-	float tgtmax = 1;
-	for (auto& elem : data)
-		elem = ui::lerp(tgtmin, tgtmax, ui::invlerp(minval, maxval, elem));
+	switch (dest)
+	{
+	case MSVDDest::Position: ConvertVertices<T, WritePosition>(out, src, srcStride, count, readcomp, normalize); break;
+	case MSVDDest::Normal: ConvertVertices<T, WriteNormal>(out, src, srcStride, count, readcomp, normalize); break;
+	case MSVDDest::Texcoord: ConvertVertices<T, WriteTexcoord>(out, src, srcStride, count, readcomp, normalize); break;
+	case MSVDDest::Color: ConvertVertices<T, WriteColor>(out, src, srcStride, count, readcomp, normalize); break;
+	}
 }
-static void NormalizeData_NONE(std::vector<float>&) {}
-typedef void NormalizeDataFn(std::vector<float>& data);
+typedef void ConvertVerticesFn(MSVert* out, MSVDDest dest, const char* src, int64_t srcStride, int64_t count, int readcomp, bool normalize);
 
-NormalizeDataFn* g_normalizeFuncs[] =
+static ConvertVerticesFn* g_convertFuncs[] =
 {
-	NormalizeDataT<int8_t>,
-	NormalizeDataT<uint8_t>,
-	NormalizeDataT<int16_t>,
-	NormalizeDataT<uint16_t>,
-	NormalizeDataT<int32_t>,
-	NormalizeDataT<uint32_t>,
-	NormalizeDataT<int64_t>,
-	NormalizeDataT<uint64_t>,
-	NormalizeData_NONE,
-	NormalizeData_NONE,
+	ConvertVerticesT<int8_t>,
+	ConvertVerticesT<uint8_t>,
+	ConvertVerticesT<int16_t>,
+	ConvertVerticesT<uint16_t>,
+	ConvertVerticesT<int32_t>,
+	ConvertVerticesT<uint32_t>,
+	ConvertVerticesT<int64_t>,
+	ConvertVerticesT<uint64_t>,
+	ConvertVerticesT<float>,
+	ConvertVerticesT<double>,
 };
+static int g_typeSizes[] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8 };
 
-static void NormalizeData(std::vector<float>& data, MSVDType type)
+// reads the attribute of each vertex directly into the interleaved vertices
+static void ReadVertexData(MSVert* out, IDataSource* src, MSVDType type, MSVDDest dest, int readcomp, bool normalize, int64_t off, int64_t count, int64_t stride)
 {
-	g_normalizeFuncs[int(type)](data);
-}
+	auto* convert = g_convertFuncs[int(type)];
+	size_t elemSize = size_t(g_typeSizes[int(type)] * readcomp);
+	if (off < 0 || stride < 0)
+	{
+		char buf[32];
+		for (int64_t i = 0; i < count; i++, off += stride)
+		{
+			src->Read(off, elemSize, buf);
+			convert(out + i, dest, buf, 0, 1, readcomp, normalize);
+		}
+		return;
+	}
 
-template <class T> static void CopyDataT(std::vector<T>& dest, const std::vector<float>& src)
-{
-	size_t oldCount = dest.size();
-	dest.resize(oldCount + src.size() / (sizeof(T) / sizeof(float)));
-	memcpy(&dest[oldCount], src.data(), src.size() * 4);
+	if (const char* span = (const char*)src->GetSpan(off, stride * (count - 1) + elemSize))
+		return convert(out, dest, span, stride, count, readcomp, normalize);
+
+	// bulk reads of the covering range, chunked to limit the memory used
+	std::vector<char> packed;
+	for (int64_t i = 0; i < count; i += VERTEX_CHUNK_SIZE)
+	{
+		int64_t n = std::min(VERTEX_CHUNK_SIZE, count - i);
+		packed.resize(size_t(n) * elemSize);
+		src->ReadStrided(off + i * stride, stride, n, elemSize, packed.data());
+		convert(out + i, dest, packed.data(), elemSize, n, readcomp, normalize);
+	}
 }
 
 void MSN_VertexData::Do(MSContext& C)
@@ -472,26 +538,27 @@ void MSN_VertexData::Do(MSContext& C)
 	int64_t v_count = count.Evaluate(*C.vs);
 	int64_t v_stride = stride.Evaluate(*C.vs);
 	int64_t v_attrOff = attrOff.Evaluate(*C.vs);
+	if (v_count <= 0)
+		return;
 
 	int destcomp = g_destComps[int(dest)];
 	int realcomp = ui::min(ncomp, destcomp);
 
-	std::vector<float> data;
-	ReadVertexData(data, C.src, type, destcomp, realcomp, v_attrOff, v_count, v_stride);
 	auto& P = C.data->primitives.back();
+	size_t* numSet = nullptr;
 	switch (dest)
 	{
-	case MSVDDest::Position: CopyDataT(P.positions, data); break;
-	case MSVDDest::Normal:
-		NormalizeData(data, type);
-		CopyDataT(P.normals, data);
-		break;
-	case MSVDDest::Texcoord: CopyDataT(P.texcoords, data); break;
-	case MSVDDest::Color:
-		NormalizeData(data, type);
-		CopyDataT(P.colors, data);
-		break;
+	case MSVDDest::Position: numSet = &P.numPositions; break;
+	case MSVDDest::Normal: numSet = &P.numNormals; break;
+	case MSVDDest::Texcoord: numSet = &P.numTexcoords; break;
+	case MSVDDest::Color: numSet = &P.numColors; break;
 	}
+	size_t first = *numSet;
+	if (P.convVerts.size() < first + size_t(v_count))
+		P.convVerts.resize(first + size_t(v_count));
+	bool normalize = dest == MSVDDest::Normal || dest == MSVDDest::Color;
+	ReadVertexData(&P.convVerts[first], C.src, type, dest, realcomp, normalize, v_attrOff, v_count, v_stride);
+	*numSet += size_t(v_count);
 }
 
 static const char* g_dests[] = { "position", "normal", "texcoord", "color" };
@@ -513,15 +580,24 @@ void MSN_VertexData::FullEditUI()
 }
 
 
-template <class T> static void ReadIndexDataT(std::vector<uint32_t>& ret, IDataSource* src, int64_t off, int64_t count)
+template <class T> static void ReadIndexDataT(uint32_t* out, IDataSource* src, int64_t off, int64_t count)
 {
+	const T* span = (const T*)src->GetSpan(off, count * sizeof(T));
 	std::vector<T> tmp;
-	tmp.resize(count);
-	src->Read(off, count * sizeof(T), tmp.data());
+	if (!span)
+	{
+		tmp.resize(count);
+		src->Read(off, count * sizeof(T), tmp.data());
+		span = tmp.data();
+	}
 	for (int64_t i = 0; i < count; i++)
-		ret.push_back(tmp[i]);
+		out[i] = span[i];
+}
+template <> void ReadIndexDataT<uint32_t>(uint32_t* out, IDataSource* src, int64_t off, int64_t count)
+{
+	src->Read(off, count * sizeof(uint32_t), out);
 }
-typedef void ReadIndexDataFn(std::vector<uint32_t>& ret, IDataSource* src, int64_t off, int64_t count);
+typedef void ReadIndexDataFn(uint32_t* out, IDataSource* src, int64_t off, int64_t count);
 
 static ReadIndexDataFn* g_readIndexFuncs[] =
 {
@@ -532,8 +608,11 @@ static ReadIndexDataFn* g_readIndexFuncs[] =
 
 static void ReadIndexData(std::vector<uint32_t>& ret, IDataSource* src, MSIDType type, int64_t off, int64_t count)
 {
-	ret.reserve(ret.size() + count);
-	g_readIndexFuncs[int(type)](ret, src, off, count);
+	if (count <= 0)
+		return;
+	size_t first = ret.size();
+	ret.resize(first + count);
+	g_readIndexFuncs[int(type)](&ret[first], src, off, count);
 }
 
 void MSN_IndexData::Do(MSContext& C)
@@ -59,12 +59,14 @@ struct MSVert
 
 struct MSPrimitive
 {
-	std::vector<ui::Vec3f> positions;
-	std::vector<ui::Vec3f> normals;
-	std::vector<ui::Vec2f> texcoords;
-	std::vector<ui::Color4f> colors;
-	std::vector<uint32_t> indices;
+	// the vertex data nodes write their attributes directly into these
 	std::vector<MSVert> convVerts;
+	// how many vertices have each attribute written
+	size_t numPositions = 0;
+	size_t numNormals = 0;
+	size_t numTexcoords = 0;
+	size_t numColors = 0;
+	std::vector<uint32_t> indices;
 	MSPrimType type;
 	int64_t texInstID = 0;
 };
@@ -0,0 +1,429 @@
+
+#include "pch.h"
+#include "MeshSimplify.h"
+
+
+// the collapse threshold grows with the iteration, as (iteration + 3) ^ aggressiveness
+static constexpr int SIMPLIFY_MAX_ITERATIONS = 100;
+static constexpr double SIMPLIFY_AGGRESSIVENESS = 7;
+// how often the deleted triangles are removed and the references rebuilt
+static constexpr int SIMPLIFY_UPDATE_INTERVAL = 5;
+
+namespace {
+
+// symmetric 4x4 matrix, the quadric of a plane (a, b, c, d)
+struct SymMat
+{
+	double m[10];
+
+	SymMat() { for (auto& v : m) v = 0; }
+	SymMat(double a, double b, double c, double d)
+	{
+		m[0] = a * a; m[1] = a * b; m[2] = a * c; m[3] = a * d;
+		m[4] = b * b; m[5] = b * c; m[6] = b * d;
+		m[7] = c * c; m[8] = c * d;
+		m[9] = d * d;
+	}
+	SymMat operator + (const SymMat& o) const
+	{
+		SymMat r;
+		for (int i = 0; i < 10; i++)
+			r.m[i] = m[i] + o.m[i];
+		return r;
+	}
+	SymMat& operator += (const SymMat& o)
+	{
+		for (int i = 0; i < 10; i++)
+			m[i] += o.m[i];
+		return *this;
+	}
+	double Det(int a11, int a12, int a13, int a21, int a22, int a23, int a31, int a32, int a33) const
+	{
+		return m[a11] * m[a22] * m[a33] + m[a13] * m[a21] * m[a32] + m[a12] * m[a23] * m[a31]
+			- m[a13] * m[a22] * m[a31] - m[a11] * m[a23] * m[a32] - m[a12] * m[a21] * m[a33];
+	}
+	double Error(const ui::Vec3f& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x
+			+ m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y
+			+ m[7] * z * z + 2 * m[8] * z
+			+ m[9];
+	}
+};
+
+struct SVert
+{
+	ui::Vec3f p;
+	SymMat q;
+	uint32_t tstart;
+	uint32_t tcount;
+	bool border;
+	// the source of the other attributes
+	uint32_t src;
+};
+
+struct STri
+{
+	uint32_t v[3];
+	double err[4];
+	bool deleted;
+	bool dirty;
+	ui::Vec3f n;
+};
+
+struct SRef
+{
+	uint32_t tid;
+	uint32_t tvertex;
+};
+
+struct PosHash
+{
+	size_t operator () (const ui::Vec3f& p) const
+	{
+		uint32_t h[3];
+		memcpy(h, &p, sizeof(h));
+		return (size_t(h[0]) * 73856093) ^ (size_t(h[1]) * 19349663) ^ (size_t(h[2]) * 83492791);
+	}
+};
+struct PosEqual
+{
+	bool operator () (const ui::Vec3f& a, const ui::Vec3f& b) const
+	{
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+};
+
+struct Simplifier
+{
+	std::vector<SVert> verts;
+	std::vector<STri> tris;
+	std::vector<SRef> refs;
+	std::vector<bool> deleted0;
+	std::vector<bool> deleted1;
+	size_t numDeleted = 0;
+
+	double CalcError(uint32_t i0, uint32_t i1, ui::Vec3f& result)
+	{
+		const SVert& v0 = verts[i0];
+		const SVert& v1 = verts[i1];
+		SymMat q = v0.q + v1.q;
+		double det = q.Det(0, 1, 2, 1, 4, 5, 2, 5, 7);
+		if (det != 0 && !(v0.border && v1.border))
+		{
+			// the position with the least error
+			result.x = float(-1 / det * q.Det(1, 2, 3, 4, 5, 6, 5, 7, 8));
+			result.y = float(1 / det * q.Det(0, 2, 3, 1, 5, 6, 2, 7, 8));
+			result.z = float(-1 / det * q.Det(0, 1, 3, 1, 4, 6, 2, 5, 8));
+			return q.Error(result);
+		}
+
+		// otherwise the best of the ends and the middle
+		ui::Vec3f mid = (v0.p + v1.p) * 0.5f;
+		double e0 = q.Error(v0.p);
+		double e1 = q.Error(v1.p);
+		double em = q.Error(mid);
+		double e = std::min(e0, std::min(e1, em));
+		result = e == e0 ? v0.p : e == e1 ? v1.p : mid;
+		return e;
+	}
+
+	void UpdateErrors(STri& t)
+	{
+		ui::Vec3f p;
+		for (int j = 0; j < 3; j++)
+			t.err[j] = CalcError(t.v[j], t.v[(j + 1) % 3], p);
+		t.err[3] = std::min(t.err[0], std::min(t.err[1], t.err[2]));
+	}
+
+	// would moving the vertex to p flip (or degenerate) any of its triangles that are not removed
+	bool Flipped(const ui::Vec3f& p, uint32_t i1, const SVert& v0, std::vector<bool>& deleted)
+	{
+		for (uint32_t k = 0; k < v0.tcount; k++)
+		{
+			const SRef& r = refs[v0.tstart + k];
+			const STri& t = tris[r.tid];
+			if (t.deleted)
+				continue;
+
+			uint32_t id1 = t.v[(r.tvertex + 1) % 3];
+			uint32_t id2 = t.v[(r.tvertex + 2) % 3];
+			// shares the collapsed edge
+			if (id1 == i1 || id2 == i1)
+			{
+				deleted[k] = true;
+				continue;
+			}
+			deleted[k] = false;
+
+			ui::Vec3f d1 = (verts[id1].p - p).Normalized();
+			ui::Vec3f d2 = (verts[id2].p - p).Normalized();
+			if (fabsf(ui::Vec3Dot(d1, d2)) > 0.999f)
+				return true;
+			ui::Vec3f n = ui::Vec3Cross(d1, d2).Normalized();
+			if (ui::Vec3Dot(n, t.n) < 0.2f)
+				return true;
+		}
+		return false;
+	}
+
+	void UpdateTriangles(uint32_t i0, const SVert& v, const std::vector<bool>& deleted)
+	{
+		for (uint32_t k = 0; k < v.tcount; k++)
+		{
+			SRef r = refs[v.tstart + k];
+			STri& t = tris[r.tid];
+			if (t.deleted)
+				continue;
+			if (deleted[k])
+			{
+				t.deleted = true;
+				numDeleted++;
+				continue;
+			}
+			t.v[r.tvertex] = i0;
+			t.dirty = true;
+			UpdateErrors(t);
+			refs.push_back(r);
+		}
+	}
+
+	void UpdateMesh(int iteration)
+	{
+		if (iteration > 0)
+		{
+			size_t dst = 0;
+			for (size_t i = 0; i < tris.size(); i++)
+				if (!tris[i].deleted)
+					tris[dst++] = tris[i];
+			tris.resize(dst);
+			numDeleted = 0;
+		}
+
+		for (auto& v : verts)
+		{
+			v.tstart = 0;
+			v.tcount = 0;
+		}
+		for (auto& t : tris)
+			for (int j = 0; j < 3; j++)
+				verts[t.v[j]].tcount++;
+		uint32_t tstart = 0;
+		for (auto& v : verts)
+		{
+			v.tstart = tstart;
+			tstart += v.tcount;
+			v.tcount = 0;
+		}
+		refs.resize(tris.size() * 3);
+		for (size_t i = 0; i < tris.size(); i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				SVert& v = verts[tris[i].v[j]];
+				refs[v.tstart + v.tcount++] = { uint32_t(i), uint32_t(j) };
+			}
+		}
+
+		if (iteration > 0)
+			return;
+
+		// edges used by a single triangle are on the border, their vertices are not moved
+		std::vector<uint32_t> vcount;
+		std::vector<uint32_t> vids;
+		for (uint32_t i = 0; i < verts.size(); i++)
+		{
+			auto& v = verts[i];
+			v.border = false;
+			vcount.clear();
+			vids.clear();
+			for (uint32_t k = 0; k < v.tcount; k++)
+			{
+				const STri& t = tris[refs[v.tstart + k].tid];
+				for (int j = 0; j < 3; j++)
+				{
+					uint32_t id = t.v[j];
+					size_t ofs = 0;
+					while (ofs < vids.size() && vids[ofs] != id)
+						ofs++;
+					if (ofs == vids.size())
+					{
+						vids.push_back(id);
+						vcount.push_back(1);
+					}
+					else
+						vcount[ofs]++;
+				}
+			}
+			for (size_t j = 0; j < vids.size(); j++)
+				if (vcount[j] == 1)
+					v.border = true;
+		}
+
+		for (auto& t : tris)
+		{
+			ui::Vec3f p0 = verts[t.v[0]].p;
+			ui::Vec3f n = ui::Vec3Cross(verts[t.v[1]].p - p0, verts[t.v[2]].p - p0).Normalized();
+			t.n = n;
+			for (int j = 0; j < 3; j++)
+				verts[t.v[j]].q += SymMat(n.x, n.y, n.z, -ui::Vec3Dot(n, p0));
+		}
+		for (auto& t : tris)
+			UpdateErrors(t);
+	}
+
+	bool Run(size_t targetTriangles, const std::function<bool()>& cancel)
+	{
+		size_t startCount = tris.size();
+		for (int iteration = 0; iteration < SIMPLIFY_MAX_ITERATIONS; iteration++)
+		{
+			if (cancel && cancel())
+				return false;
+			if (startCount - numDeleted <= targetTriangles)
+				break;
+
+			if (iteration % SIMPLIFY_UPDATE_INTERVAL == 0)
+			{
+				UpdateMesh(iteration);
+				startCount = tris.size();
+			}
+			for (auto& t : tris)
+				t.dirty = false;
+
+			double threshold = 0.000000001 * pow(double(iteration + 3), SIMPLIFY_AGGRESSIVENESS);
+			for (size_t i = 0; i < tris.size(); i++)
+			{
+				// the size changes, so no references are held
+				if (tris[i].err[3] > threshold || tris[i].deleted || tris[i].dirty)
+					continue;
+
+				for (int j = 0; j < 3; j++)
+				{
+					if (tris[i].err[j] > threshold)
+						continue;
+
+					uint32_t i0 = tris[i].v[j];
+					uint32_t i1 = tris[i].v[(j + 1) % 3];
+					if (verts[i0].border || verts[i1].border)
+						continue;
+
+					ui::Vec3f p;
+					CalcError(i0, i1, p);
+					deleted0.assign(verts[i0].tcount, false);
+					deleted1.assign(verts[i1].tcount, false);
+					if (Flipped(p, i1, verts[i0], deleted0) || Flipped(p, i0, verts[i1], deleted1))
+						continue;
+
+					verts[i0].p = p;
+					verts[i0].q += verts[i1].q;
+					uint32_t tstart = uint32_t(refs.size());
+					UpdateTriangles(i0, verts[i0], deleted0);
+					UpdateTriangles(i0, verts[i1], deleted1);
+					uint32_t tcount = uint32_t(refs.size()) - tstart;
+					SVert& v0 = verts[i0];
+					if (tcount <= v0.tcount)
+					{
+						// reuse the space of the old references
+						if (tcount)
+							memmove(&refs[v0.tstart], &refs[tstart], tcount * sizeof(SRef));
+						refs.resize(tstart);
+					}
+					else
+						v0.tstart = tstart;
+					v0.tcount = tcount;
+					break;
+				}
+				if (startCount - numDeleted <= targetTriangles)
+					break;
+			}
+		}
+		return true;
+	}
+};
+
+} // namespace
+
+bool SimplifyMesh(const MSPrimitive& P, size_t targetTriangles, MSPrimitive& out, const std::function<bool()>& cancel)
+{
+	if (P.type != MSPrimType::Triangles || P.convVerts.empty())
+		return false;
+
+	Simplifier S;
+
+	// positions are scaled to a unit cube so that the error thresholds do not depend on the size of the mesh
+	ui::Vec3f bbMin = P.convVerts[0].pos;
+	ui::Vec3f bbMax = P.convVerts[0].pos;
+	for (const auto& V : P.convVerts)
+	{
+		bbMin = { std::min(bbMin.x, V.pos.x), std::min(bbMin.y, V.pos.y), std::min(bbMin.z, V.pos.z) };
+		bbMax = { std::max(bbMax.x, V.pos.x), std::max(bbMax.y, V.pos.y), std::max(bbMax.z, V.pos.z) };
+	}
+	ui::Vec3f ext = bbMax - bbMin;
+	float extent = std::max(ext.x, std::max(ext.y, ext.z));
+	float scale = extent > 0 ? 1 / extent : 1;
+
+	// vertices at the same position are merged, otherwise the triangles would not be connected
+	std::unordered_map<ui::Vec3f, uint32_t, PosHash, PosEqual> weld;
+	std::vector<uint32_t> remap(P.convVerts.size());
+	for (size_t i = 0; i < P.convVerts.size(); i++)
+	{
+		auto it = weld.find(P.convVerts[i].pos);
+		if (it == weld.end())
+		{
+			it = weld.insert({ P.convVerts[i].pos, uint32_t(S.verts.size()) }).first;
+			SVert v = {};
+			v.p = (P.convVerts[i].pos - bbMin) * scale;
+			v.src = uint32_t(i);
+			S.verts.push_back(v);
+		}
+		remap[i] = it->second;
+	}
+
+	size_t numIndices = P.indices.empty() ? P.convVerts.size() : P.indices.size();
+	S.tris.reserve(numIndices / 3);
+	for (size_t i = 0; i + 2 < numIndices; i += 3)
+	{
+		STri t = {};
+		for (int j = 0; j < 3; j++)
+		{
+			uint32_t idx = P.indices.empty() ? uint32_t(i + j) : P.indices[i + j];
+			t.v[j] = remap[idx];
+		}
+		// degenerate after merging
+		if (t.v[0] == t.v[1] || t.v[1] == t.v[2] || t.v[2] == t.v[0])
+			continue;
+		S.tris.push_back(t);
+	}
+	if (S.tris.size() <= targetTriangles)
+		return false;
+
+	if (!S.Run(targetTriangles, cancel))
+		return false;
+
+	// only the vertices of the remaining triangles are kept
+	std::vector<uint32_t> newIndex(S.verts.size(), UINT32_MAX);
+	out = {};
+	out.type = MSPrimType::Triangles;
+	out.texInstID = P.texInstID;
+	for (const auto& t : S.tris)
+	{
+		if (t.deleted)
+			continue;
+		for (int j = 0; j < 3; j++)
+		{
+			uint32_t& ni = newIndex[t.v[j]];
+			if (ni == UINT32_MAX)
+			{
+				const SVert& v = S.verts[t.v[j]];
+				ni = uint32_t(out.convVerts.size());
+				MSVert V = P.convVerts[v.src];
+				V.pos = v.p * (1 / scale) + bbMin;
+				out.convVerts.push_back(V);
+			}
+			out.indices.push_back(ni);
+		}
+	}
+	out.numPositions = out.convVerts.size();
+	return true;
+}
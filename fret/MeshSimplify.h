@@ -0,0 +1,16 @@
+
+#pragma once
+#include "pch.h"
+
+#include "MeshScript.h"
+
+
+// primitives with more triangles than this get a simplified version for camera interaction
+static constexpr size_t MESH_LOD_MIN_TRIANGLES = 200000;
+static constexpr size_t MESH_LOD_TARGET_TRIANGLES = 50000;
+
+// quadric error metric edge collapse (Garland & Heckbert) of an indexed triangle list
+// the kept vertices keep their other attributes, only the positions are moved
+// returns false if the primitive is not made of triangles or could not be simplified
+// cancel is checked periodically, the result is incomplete if it returns true
+bool SimplifyMesh(const MSPrimitive& P, size_t targetTriangles, MSPrimitive& out, const std::function<bool()>& cancel = {});
@@ -0,0 +1,522 @@
+
+#include "pch.h"
+#include "PatternIndex.h"
+
+#include "DataDesc.h"
+#include "HexViewer.h"
+#include "SimdHelpers.h"
+
+
+namespace ui {
+double hqtime();
+} // ui
+
+
+// bytes per parallel work item
+static constexpr uint64_t PATTERN_INDEX_CHUNK_SIZE = 1024 * 1024;
+// min. time between partial results
+static constexpr double PATTERN_INDEX_PROGRESS_INTERVAL = 0.25;
+static constexpr size_t PATTERN_INDEX_DENSITY_BUCKETS = 1024;
+// shorter runs of numeric values are mostly noise
+static constexpr uint64_t MIN_ARRAY_ELEMENTS = 4;
+// smallest value considered to be a file offset
+static constexpr uint32_t MIN_FILE_POINTER = 16;
+
+static constexpr uint32_t PATTERN_INDEX_MAGIC = 0x58495046; // "FPIX"
+static constexpr uint32_t PATTERN_INDEX_VERSION = 1;
+
+struct PatternIndexFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t fileSize;
+	uint64_t fileModTime;
+	PatternIndexParams params;
+	uint32_t numRuns[PC__COUNT];
+	uint32_t reserved;
+	// followed by the runs of each class
+};
+static_assert(sizeof(PatternIndexFileHeader) == 88, "unexpected pattern index header size");
+
+ui::DataCategoryTag DCT_PatternIndex[1];
+
+static const char* patternClassNames[] =
+{
+	"ASCII",
+	"float32",
+	"int16",
+	"int32",
+	"Near file size",
+	"File pointer",
+};
+
+const char* GetPatternClassName(PatternClass pc)
+{
+	return patternClassNames[pc];
+}
+
+ui::Color4f GetPatternClassColor(PatternClass pc)
+{
+	switch (pc)
+	{
+	case PC_ASCII: return colorASCII;
+	case PC_Float32: return colorFloat32;
+	case PC_Int16: return colorInt16;
+	case PC_Int32: return colorInt32;
+	case PC_NearFileSize: return colorNearFileSize32;
+	case PC_FilePointer: return colorNearFileSize64;
+	default: return { 0 };
+	}
+}
+
+static uint64_t GetMinRunLength(PatternClass pc, const PatternIndexParams& params)
+{
+	switch (pc)
+	{
+	case PC_ASCII: return std::max(params.minASCIIChars, 1U);
+	case PC_Float32: return 4 * MIN_ARRAY_ELEMENTS;
+	case PC_Int16: return 2 * MIN_ARRAY_ELEMENTS;
+	case PC_Int32: return 4 * MIN_ARRAY_ELEMENTS;
+	case PC_FilePointer: return 4 * 2;
+	default: return 1;
+	}
+}
+
+
+PatternIndexParams PatternIndexParams::FromSettings(const HighlightSettings& hs)
+{
+	PatternIndexParams p;
+	memset(&p, 0, sizeof(p));
+	p.excludeZeroes = hs.excludeZeroes;
+	p.minFloat32 = hs.minFloat32;
+	p.maxFloat32 = hs.maxFloat32;
+	p.minInt16 = hs.minInt16;
+	p.maxInt16 = hs.maxInt16;
+	p.minInt32 = hs.minInt32;
+	p.maxInt32 = hs.maxInt32;
+	p.minASCIIChars = hs.minASCIIChars;
+	p.nearFileSizePercent = hs.nearFileSizePercent;
+	return p;
+}
+
+
+const PatternRun* PatternIndex::FindNext(PatternClass pc, uint64_t pos) const
+{
+	const auto& R = runs[pc];
+	auto it = std::upper_bound(R.begin(), R.end(), pos, [](uint64_t p, const PatternRun& r) { return p < r.start; });
+	return it != R.end() ? &*it : nullptr;
+}
+
+const PatternRun* PatternIndex::FindPrev(PatternClass pc, uint64_t pos) const
+{
+	const auto& R = runs[pc];
+	auto it = std::lower_bound(R.begin(), R.end(), pos, [](const PatternRun& r, uint64_t p) { return r.start < p; });
+	return it != R.begin() ? &*(it - 1) : nullptr;
+}
+
+size_t PatternIndex::GetNumRuns() const
+{
+	size_t n = 0;
+	for (const auto& R : runs)
+		n += R.size();
+	return n;
+}
+
+void PatternIndex::UpdateDensity()
+{
+	uint64_t bucketSize = std::max<uint64_t>(1, (fileSize + PATTERN_INDEX_DENSITY_BUCKETS - 1) / PATTERN_INDEX_DENSITY_BUCKETS);
+	for (int pc = 0; pc < PC__COUNT; pc++)
+	{
+		auto& D = density[pc];
+		D.assign(PATTERN_INDEX_DENSITY_BUCKETS, 0);
+		for (const auto& R : runs[pc])
+		{
+			for (uint64_t pos = R.start; pos < R.end; )
+			{
+				size_t b = size_t(pos / bucketSize);
+				uint64_t end = std::min(R.end, (b + 1) * bucketSize);
+				D[b] += float(end - pos);
+				pos = end;
+			}
+		}
+		for (auto& d : D)
+			d /= bucketSize;
+	}
+}
+
+bool PatternIndex::Load(ui::StringView path)
+{
+	auto data = ui::ReadBinaryFile(path);
+	if (data.size() < sizeof(PatternIndexFileHeader))
+		return false;
+
+	PatternIndexFileHeader hdr;
+	memcpy(&hdr, data.data(), sizeof(hdr));
+	if (hdr.magic != PATTERN_INDEX_MAGIC || hdr.version != PATTERN_INDEX_VERSION)
+		return false;
+	uint64_t numRuns = 0;
+	for (int pc = 0; pc < PC__COUNT; pc++)
+		numRuns += hdr.numRuns[pc];
+	if (data.size() != sizeof(hdr) + numRuns * sizeof(PatternRun))
+		return false;
+
+	params = hdr.params;
+	fileSize = hdr.fileSize;
+	fileModTime = hdr.fileModTime;
+	const char* p = data.data() + sizeof(hdr);
+	for (int pc = 0; pc < PC__COUNT; pc++)
+	{
+		runs[pc].resize(hdr.numRuns[pc]);
+		if (hdr.numRuns[pc])
+			memcpy(runs[pc].data(), p, hdr.numRuns[pc] * sizeof(PatternRun));
+		p += hdr.numRuns[pc] * sizeof(PatternRun);
+	}
+	complete = true;
+	UpdateDensity();
+	return true;
+}
+
+bool PatternIndex::Save(ui::StringView path) const
+{
+	PatternIndexFileHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = PATTERN_INDEX_MAGIC;
+	hdr.version = PATTERN_INDEX_VERSION;
+	hdr.fileSize = fileSize;
+	hdr.fileModTime = fileModTime;
+	hdr.params = params;
+	for (int pc = 0; pc < PC__COUNT; pc++)
+		hdr.numRuns[pc] = uint32_t(runs[pc].size());
+
+	std::string data;
+	data.resize(sizeof(hdr) + GetNumRuns() * sizeof(PatternRun));
+	memcpy(&data[0], &hdr, sizeof(hdr));
+	size_t off = sizeof(hdr);
+	for (const auto& R : runs)
+	{
+		if (R.size())
+			memcpy(&data[off], R.data(), R.size() * sizeof(PatternRun));
+		off += R.size() * sizeof(PatternRun);
+	}
+
+	ui::CreateMissingParentDirectories(path);
+	if (!ui::WriteBinaryFile(path, data.data(), data.size()))
+	{
+		printf("failed to write pattern index %.*s\n", int(path.size()), path.data());
+		return false;
+	}
+	return true;
+}
+
+
+// collects runs of set bits from consecutive 16-bit masks
+struct RunCollector
+{
+	void Add(uint64_t pos, unsigned mask)
+	{
+		if (mask == 0xffff)
+		{
+			if (start == UINT64_MAX)
+				start = pos;
+			return;
+		}
+		unsigned bit = 0;
+		while (bit < 16)
+		{
+			if (start == UINT64_MAX)
+			{
+				unsigned m = mask >> bit;
+				if (!m)
+					return;
+				bit += CountTrailingZeros(m);
+				start = pos + bit;
+			}
+			else
+			{
+				unsigned m = (~mask & 0xffff) >> bit;
+				if (!m)
+					return;
+				bit += CountTrailingZeros(m);
+				out->push_back({ start, pos + bit });
+				start = UINT64_MAX;
+			}
+		}
+	}
+	void Finish(uint64_t pos)
+	{
+		if (start != UINT64_MAX)
+			out->push_back({ start, pos });
+		start = UINT64_MAX;
+	}
+
+	std::vector<PatternRun>* out = nullptr;
+	uint64_t start = UINT64_MAX;
+};
+
+struct ChunkRuns
+{
+	std::vector<PatternRun> runs[PC__COUNT];
+};
+
+// element starts that fit in the first `size` bytes
+static unsigned GetElementLimitMask(size_t size, size_t elementSize)
+{
+	return size >= elementSize ? GetBlockLimitMask(0, size - elementSize + 1) : 0;
+}
+
+// numeric values are checked at their natural alignment, then the bits of their first bytes are
+// extended to all of their bytes (the multiplication doesn't carry since the bits are spaced apart)
+static void ClassifyChunk(const uint8_t* data, size_t size, uint64_t base, uint64_t fileSize, const PatternIndexParams& params, ChunkRuns& out)
+{
+	uint64_t minNearFileSize = GetMinIntNotBelow(fileSize * (params.nearFileSizePercent * 0.01f));
+	uint64_t maxNearFileSize32 = std::min(fileSize, uint64_t(UINT32_MAX));
+	bool nearFileSize32 = minNearFileSize <= maxNearFileSize32;
+	bool nearFileSize64 = minNearFileSize <= fileSize;
+	int32_t minInt16 = std::max(params.minInt16, int32_t(INT16_MIN));
+	int32_t maxInt16 = std::min(params.maxInt16, int32_t(INT16_MAX));
+	bool int16 = minInt16 <= maxInt16;
+	uint64_t maxFilePointer = std::min(fileSize ? fileSize - 1 : 0, uint64_t(UINT32_MAX));
+	bool filePointer = maxFilePointer >= MIN_FILE_POINTER;
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i asciiMin = _mm_set1_epi8(0x1f);
+	const __m128i asciiMax = _mm_set1_epi8(0x7f);
+	const __m128 fmin = _mm_set1_ps(params.minFloat32);
+	const __m128 fmax = _mm_set1_ps(params.maxFloat32);
+	const __m128 nfmin = _mm_set1_ps(-params.minFloat32);
+	const __m128 nfmax = _mm_set1_ps(-params.maxFloat32);
+	const __m128i i16min = _mm_set1_epi16(int16_t(minInt16));
+	const __m128i i16max = _mm_set1_epi16(int16_t(maxInt16));
+	const __m128i i32min = _mm_set1_epi32(params.minInt32);
+	const __m128i i32max = _mm_set1_epi32(params.maxInt32);
+	const __m128i nfs32min = _mm_set1_epi32(int32_t(uint32_t(minNearFileSize)));
+	const __m128i nfs32max = _mm_set1_epi32(int32_t(uint32_t(maxNearFileSize32)));
+	const __m128i nfs64min = _mm_set1_epi64x(int64_t(minNearFileSize));
+	const __m128i nfs64max = _mm_set1_epi64x(int64_t(fileSize));
+	const __m128i fpmin = _mm_set1_epi32(MIN_FILE_POINTER);
+	const __m128i fpmax = _mm_set1_epi32(int32_t(uint32_t(maxFilePointer)));
+
+	RunCollector collectors[PC__COUNT];
+	for (int pc = 0; pc < PC__COUNT; pc++)
+	{
+		out.runs[pc].clear();
+		collectors[pc].out = &out.runs[pc];
+	}
+
+	uint8_t tail[16];
+	for (size_t at = 0; at < size; at += 16)
+	{
+		const uint8_t* p = data + at;
+		size_t n = std::min<size_t>(16, size - at);
+		if (n < 16)
+		{
+			memset(tail, 0, 16);
+			memcpy(tail, p, n);
+			p = tail;
+		}
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+
+		unsigned lim2 = 0x5555, lim4 = 0x1111, lim8 = 0x0101;
+		if (n < 16)
+		{
+			lim2 &= GetElementLimitMask(n, 2);
+			lim4 &= GetElementLimitMask(n, 4);
+			lim8 &= GetElementLimitMask(n, 8);
+		}
+		if (params.excludeZeroes)
+		{
+			lim2 &= SpreadLanes8(MoveMask16(_mm_cmpeq_epi16(v, zero)) ^ 0xff);
+			lim4 &= SpreadLanes4(MoveMask32(_mm_cmpeq_epi32(v, zero)) ^ 15);
+			lim8 &= SpreadLanes2(MoveMask64(IsZero64(v)) ^ 3);
+		}
+
+		unsigned m[PC__COUNT];
+
+		__m128i isASCII = _mm_and_si128(_mm_cmpgt_epi8(v, asciiMin), _mm_cmplt_epi8(v, asciiMax));
+		m[PC_ASCII] = _mm_movemask_epi8(isASCII) & GetBlockLimitMask(0, n);
+
+		__m128 f = _mm_castsi128_ps(v);
+		__m128 fpos = _mm_and_ps(_mm_cmpge_ps(f, fmin), _mm_cmple_ps(f, fmax));
+		__m128 fneg = _mm_and_ps(_mm_cmpge_ps(f, nfmax), _mm_cmple_ps(f, nfmin));
+		m[PC_Float32] = (SpreadLanes4(_mm_movemask_ps(_mm_or_ps(fpos, fneg))) & lim4) * 15;
+
+		m[PC_Int16] = int16 ? (SpreadLanes8(MoveMask16(InRangeI16(v, i16min, i16max))) & lim2) * 3 : 0;
+		m[PC_Int32] = (SpreadLanes4(MoveMask32(InRangeI32(v, i32min, i32max))) & lim4) * 15;
+
+		m[PC_NearFileSize] = 0;
+		if (nearFileSize32)
+			m[PC_NearFileSize] |= (SpreadLanes4(MoveMask32(InRangeU32(v, nfs32min, nfs32max))) & lim4) * 15;
+		if (nearFileSize64)
+			m[PC_NearFileSize] |= (SpreadLanes2(MoveMask64(InRangeU64(v, nfs64min, nfs64max))) & lim8) * 255;
+
+		m[PC_FilePointer] = filePointer ? (SpreadLanes4(MoveMask32(InRangeU32(v, fpmin, fpmax))) & lim4) * 15 : 0;
+
+		for (int pc = 0; pc < PC__COUNT; pc++)
+			collectors[pc].Add(base + at, m[pc]);
+	}
+	for (auto& C : collectors)
+		C.Finish(base + size);
+}
+
+// joins runs that continue across chunks, drops the previous run if it turns out to be too short
+static void AppendRun(std::vector<PatternRun>& runs, const PatternRun& r, uint64_t minLength)
+{
+	if (!runs.empty())
+	{
+		auto& last = runs.back();
+		if (last.end == r.start)
+		{
+			last.end = r.end;
+			return;
+		}
+		if (last.end - last.start < minLength)
+			runs.pop_back();
+	}
+	runs.push_back(r);
+}
+
+
+void PatternIndexer::Start(IDataSource* ds, ui::StringView filePath, ui::StringView cachePath, const HighlightSettings& hs)
+{
+	_dataSource = ds;
+	_filePath = ui::to_string(filePath);
+	_cachePath = ui::to_string(cachePath);
+	Restart(hs);
+}
+
+void PatternIndexer::Restart(const HighlightSettings& hs)
+{
+	if (!_dataSource)
+		return;
+
+	uint32_t runID;
+	{
+		std::lock_guard<std::mutex> g(_pendingMutex);
+		runID = ++_runID;
+		_pendingIndex = nullptr;
+		_hasPending = false;
+	}
+	progress = 0;
+
+	IDataSource* ds = _dataSource;
+	std::string filePath = _filePath;
+	std::string cachePath = _cachePath;
+	auto params = PatternIndexParams::FromSettings(hs);
+	_queue.Push([this, runID, ds, filePath, cachePath, params]()
+	{
+		_Run(runID, ds, filePath, cachePath, params);
+	}, true);
+}
+
+void PatternIndexer::Update()
+{
+	std::lock_guard<std::mutex> g(_pendingMutex);
+	if (!_hasPending)
+		return;
+	if (_pendingIndex)
+		index = std::move(_pendingIndex);
+	progress = _pendingProgress;
+	_hasPending = false;
+}
+
+bool PatternIndexer::IsOutOfDate(const HighlightSettings& hs) const
+{
+	return index && index->complete && !(index->params == PatternIndexParams::FromSettings(hs));
+}
+
+void PatternIndexer::_Publish(uint32_t runID, std::unique_ptr<PatternIndex>&& pi, float p)
+{
+	{
+		std::lock_guard<std::mutex> g(_pendingMutex);
+		if (runID != _runID)
+			return;
+		_pendingIndex = std::move(pi);
+		_pendingProgress = p;
+		_hasPending = true;
+	}
+	// only the address is used, the indexer may be gone by the time the event runs
+	uintptr_t at = reinterpret_cast<uintptr_t>(this);
+	ui::Application::PushEvent([at]() { ui::Notify(DCT_PatternIndex, at); });
+}
+
+void PatternIndexer::_Run(uint32_t runID, IDataSource* ds, const std::string& filePath, const std::string& cachePath, const PatternIndexParams& params)
+{
+	uint64_t fileSize = ds->GetSize();
+	uint64_t fileModTime = filePath.empty() ? 0 : ui::GetFileModTimeUTC(filePath);
+
+	std::unique_ptr<PatternIndex> PI(new PatternIndex);
+	if (!cachePath.empty() &&
+		PI->Load(cachePath) &&
+		PI->fileSize == fileSize &&
+		PI->fileModTime == fileModTime &&
+		PI->params == params)
+	{
+		_Publish(runID, std::move(PI), 1);
+		return;
+	}
+
+	PI.reset(new PatternIndex);
+	PI->params = params;
+	PI->fileSize = fileSize;
+	PI->fileModTime = fileModTime;
+	uint64_t minRunLength[PC__COUNT];
+	for (int pc = 0; pc < PC__COUNT; pc++)
+		minRunLength[pc] = GetMinRunLength(PatternClass(pc), params);
+
+	const uint8_t* span = fileSize ? static_cast<const uint8_t*>(ds->GetSpan(0, fileSize)) : nullptr;
+	uint64_t numChunks = (fileSize + PATTERN_INDEX_CHUNK_SIZE - 1) / PATTERN_INDEX_CHUNK_SIZE;
+	size_t chunksPerStep = ui::GetParallelThreadCount() * 2;
+	std::vector<std::vector<uint8_t>> buffers(chunksPerStep);
+	std::vector<ChunkRuns> chunkRuns(chunksPerStep);
+
+	double lastProgressTime = ui::hqtime();
+	for (uint64_t c0 = 0; c0 < numChunks; c0 += chunksPerStep)
+	{
+		if (_queue.HasItems() || _queue.IsQuitting())
+			return;
+
+		size_t nc = size_t(std::min<uint64_t>(chunksPerStep, numChunks - c0));
+		ui::ParallelFor(nc, [&](size_t i)
+		{
+			uint64_t first = (c0 + i) * PATTERN_INDEX_CHUNK_SIZE;
+			size_t size = size_t(std::min(PATTERN_INDEX_CHUNK_SIZE, fileSize - first));
+			if (!span)
+			{
+				buffers[i].resize(size);
+				ds->Read(first, size, buffers[i].data());
+			}
+			ClassifyChunk(span ? span + first : buffers[i].data(), size, first, fileSize, params, chunkRuns[i]);
+		});
+
+		for (size_t i = 0; i < nc; i++)
+			for (int pc = 0; pc < PC__COUNT; pc++)
+				for (const auto& R : chunkRuns[i].runs[pc])
+					AppendRun(PI->runs[pc], R, minRunLength[pc]);
+
+		if (c0 + nc < numChunks && ui::hqtime() - lastProgressTime >= PATTERN_INDEX_PROGRESS_INTERVAL)
+		{
+			// only the overview is shown until the scan is done
+			PI->UpdateDensity();
+			std::unique_ptr<PatternIndex> partial(new PatternIndex);
+			partial->params = params;
+			partial->fileSize = fileSize;
+			partial->fileModTime = fileModTime;
+			for (int pc = 0; pc < PC__COUNT; pc++)
+				partial->density[pc] = PI->density[pc];
+			_Publish(runID, std::move(partial), float(c0 + nc) / float(numChunks));
+			lastProgressTime = ui::hqtime();
+		}
+	}
+
+	for (int pc = 0; pc < PC__COUNT; pc++)
+	{
+		auto& R = PI->runs[pc];
+		if (!R.empty() && R.back().end - R.back().start < minRunLength[pc])
+			R.pop_back();
+	}
+	PI->complete = true;
+	PI->UpdateDensity();
+	if (!cachePath.empty())
+		PI->Save(cachePath);
+	_Publish(runID, std::move(PI), 1);
+}
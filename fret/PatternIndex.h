@@ -0,0 +1,105 @@
+
+#pragma once
+#include "pch.h"
+#include "FileReaders.h"
+
+#include <memory>
+#include <mutex>
+
+
+struct HighlightSettings;
+
+enum PatternClass
+{
+	PC_ASCII,
+	PC_Float32,
+	PC_Int16,
+	PC_Int32,
+	PC_NearFileSize, // 32/64-bit values close to the file size
+	PC_FilePointer, // 32-bit values pointing inside the file
+
+	PC__COUNT,
+};
+
+const char* GetPatternClassName(PatternClass pc);
+ui::Color4f GetPatternClassColor(PatternClass pc);
+
+// the highlight settings that affect the contents of the index
+struct PatternIndexParams
+{
+	uint32_t excludeZeroes;
+	float minFloat32;
+	float maxFloat32;
+	int32_t minInt16;
+	int32_t maxInt16;
+	int32_t minInt32;
+	int32_t maxInt32;
+	uint32_t minASCIIChars;
+	float nearFileSizePercent;
+
+	static PatternIndexParams FromSettings(const HighlightSettings& hs);
+	bool operator == (const PatternIndexParams& o) const { return memcmp(this, &o, sizeof(*this)) == 0; }
+};
+
+struct PatternRun
+{
+	uint64_t start;
+	uint64_t end;
+};
+
+// byte ranges covered by each pattern class over the whole file
+// (numeric values are only checked at their natural alignment)
+struct PatternIndex
+{
+	// first run starting after `pos` / last run starting before `pos`, nullptr if none
+	const PatternRun* FindNext(PatternClass pc, uint64_t pos) const;
+	const PatternRun* FindPrev(PatternClass pc, uint64_t pos) const;
+	size_t GetNumRuns() const;
+	void UpdateDensity();
+
+	bool Load(ui::StringView path);
+	bool Save(ui::StringView path) const;
+
+	PatternIndexParams params = {};
+	uint64_t fileSize = 0;
+	uint64_t fileModTime = 0;
+	// false while the scan is in progress (only the density is filled in)
+	bool complete = false;
+	std::vector<PatternRun> runs[PC__COUNT];
+	// covered fraction of equally sized parts of the file, for overviews
+	std::vector<float> density[PC__COUNT];
+};
+
+extern ui::DataCategoryTag DCT_PatternIndex[1];
+
+// builds the index on a worker thread, reusing the one saved at `cachePath` if it is up to date
+struct PatternIndexer
+{
+	void Start(IDataSource* ds, ui::StringView filePath, ui::StringView cachePath, const HighlightSettings& hs);
+	// scan again with the same file (after changing the settings)
+	void Restart(const HighlightSettings& hs);
+	// takes over the latest results of the worker (DCT_PatternIndex is notified when there are new ones)
+	void Update();
+	bool IsRunning() const { return progress < 1; }
+	bool IsOutOfDate(const HighlightSettings& hs) const;
+
+	void _Publish(uint32_t runID, std::unique_ptr<PatternIndex>&& pi, float p);
+	void _Run(uint32_t runID, IDataSource* ds, const std::string& filePath, const std::string& cachePath, const PatternIndexParams& params);
+
+	std::unique_ptr<PatternIndex> index;
+	// 1 if not running
+	float progress = 1;
+
+	IDataSource* _dataSource = nullptr;
+	std::string _filePath;
+	std::string _cachePath;
+
+	std::mutex _pendingMutex;
+	uint32_t _runID = 0;
+	std::unique_ptr<PatternIndex> _pendingIndex;
+	float _pendingProgress = 1;
+	bool _hasPending = false;
+
+	// last so that the worker is stopped first
+	ui::WorkerQueue _queue;
+};
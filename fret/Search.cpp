@@ -0,0 +1,742 @@
+
+#include "pch.h"
+#include "Search.h"
+
+#include "DataDesc.h"
+#include "FileReaders.h"
+#include "SimdHelpers.h"
+
+
+namespace ui {
+double hqtime();
+} // ui
+
+
+// bytes per parallel work item
+static constexpr uint64_t SEARCH_CHUNK_SIZE = 1024 * 1024;
+// min. time between partial results
+static constexpr double SEARCH_PUBLISH_INTERVAL = 0.1;
+// the prefilter compares each byte against every distinct first byte of the anchors
+static constexpr size_t MAX_PREFILTER_BYTES = 4;
+
+ui::DataCategoryTag DCT_Search[1];
+
+static const char* searchPatternTypeNames[] =
+{
+	"bytes",
+	"int16",
+	"int32",
+	"float32",
+	"rel. pointer (32)",
+};
+
+const char* GetSearchPatternTypeName(SearchPatternType t)
+{
+	return searchPatternTypeNames[t];
+}
+
+void SearchPattern::EditUI()
+{
+	ui::imm::EditBool(enabled, nullptr);
+	ui::imm::PropDropdownMenuList("\bType", type,
+		ui::BuildAlloc<ui::ZeroSepCStrOptionList>(
+			"bytes\0int16\0int32\0float32\0rel. pointer (32)\0"));
+	switch (type)
+	{
+	case SPT_Bytes:
+		ui::imm::PropEditString("\bBytes", bytes.c_str(), [this](const char* v) { bytes = v; });
+		break;
+	case SPT_Int16:
+	case SPT_Int32:
+		ui::imm::PropEditInt("\bMin", minInt);
+		ui::imm::PropEditInt("\bMax", maxInt);
+		ui::imm::PropEditInt("\bAlign", alignment, {}, {}, { 1, 64 });
+		break;
+	case SPT_Float32:
+		ui::imm::PropEditFloat("\bMin", minFloat, {}, 0.01f);
+		ui::imm::PropEditFloat("\bMax", maxFloat);
+		ui::imm::PropEditInt("\bAlign", alignment, {}, {}, { 1, 64 });
+		break;
+	case SPT_RelPointer32:
+		ui::imm::PropEditInt("\bTarget min", minInt);
+		ui::imm::PropEditInt("\bTarget max", maxInt);
+		ui::imm::PropEditInt("\bBase", relBase);
+		ui::imm::PropEditInt("\bAlign", alignment, {}, {}, { 1, 64 });
+		break;
+	default:
+		break;
+	}
+}
+
+
+static int HexDigitValue(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+bool ParseBytePattern(ui::StringView text, std::vector<uint8_t>& bytes, std::vector<uint8_t>& mask, std::string& error)
+{
+	bytes.clear();
+	mask.clear();
+	size_t i = 0;
+	while (i < text.size())
+	{
+		char c = text[i];
+		if (c == ' ' || c == '\t' || c == ',')
+		{
+			i++;
+			continue;
+		}
+		if (c == '"')
+		{
+			for (i++; i < text.size() && text[i] != '"'; i++)
+			{
+				bytes.push_back(uint8_t(text[i]));
+				mask.push_back(0xff);
+			}
+			if (i >= text.size())
+			{
+				error = "unterminated string";
+				return false;
+			}
+			i++;
+			continue;
+		}
+		if (c == '?')
+		{
+			i += i + 1 < text.size() && text[i + 1] == '?' ? 2 : 1;
+			bytes.push_back(0);
+			mask.push_back(0);
+			continue;
+		}
+		int hi = HexDigitValue(c);
+		int lo = i + 1 < text.size() ? HexDigitValue(text[i + 1]) : -1;
+		if (hi < 0 || lo < 0)
+		{
+			error = ui::Format("unexpected character at %zu", i);
+			return false;
+		}
+		bytes.push_back(uint8_t(hi << 4 | lo));
+		mask.push_back(0xff);
+		i += 2;
+	}
+	if (bytes.empty())
+	{
+		error = "empty pattern";
+		return false;
+	}
+	return true;
+}
+
+
+// dense automaton matching all of the words at once, one table lookup per byte
+struct AhoCorasick
+{
+	void Build(const std::vector<std::vector<uint8_t>>& words)
+	{
+		// trie (0 = no edge, edges never lead back to the root)
+		next.assign(256, 0);
+		std::vector<std::vector<uint32_t>> out(1);
+		for (uint32_t w = 0; w < words.size(); w++)
+		{
+			int32_t s = 0;
+			for (uint8_t b : words[w])
+			{
+				if (!next[size_t(s) * 256 + b])
+				{
+					next[size_t(s) * 256 + b] = int32_t(out.size());
+					next.resize(next.size() + 256, 0);
+					out.emplace_back();
+				}
+				s = next[size_t(s) * 256 + b];
+			}
+			out[s].push_back(w);
+		}
+
+		// breadth-first so that the fallback state of each state is complete before it's used
+		std::vector<int32_t> fail(out.size(), 0);
+		std::vector<int32_t> queue;
+		for (int b = 0; b < 256; b++)
+			if (int32_t t = next[b])
+				queue.push_back(t);
+		for (size_t qi = 0; qi < queue.size(); qi++)
+		{
+			int32_t s = queue[qi];
+			const auto& fo = out[fail[s]];
+			out[s].insert(out[s].end(), fo.begin(), fo.end());
+			for (int b = 0; b < 256; b++)
+			{
+				int32_t& t = next[size_t(s) * 256 + b];
+				int32_t f = next[size_t(fail[s]) * 256 + b];
+				if (t)
+				{
+					fail[t] = f;
+					queue.push_back(t);
+				}
+				else
+					t = f;
+			}
+		}
+
+		outStart.clear();
+		outList.clear();
+		for (const auto& O : out)
+		{
+			outStart.push_back(uint32_t(outList.size()));
+			outList.insert(outList.end(), O.begin(), O.end());
+		}
+		outStart.push_back(uint32_t(outList.size()));
+
+		bool used[256] = {};
+		numFirstBytes = 0;
+		for (const auto& W : words)
+		{
+			if (used[W[0]])
+				continue;
+			used[W[0]] = true;
+			if (numFirstBytes < MAX_PREFILTER_BYTES)
+				firstBytes[numFirstBytes] = W[0];
+			numFirstBytes++;
+		}
+	}
+
+	// calls onMatch(word, end) for each occurrence of each word
+	template <class F> void Scan(const uint8_t* data, size_t size, F&& onMatch) const
+	{
+		bool prefilter = numFirstBytes <= MAX_PREFILTER_BYTES;
+		int32_t s = 0;
+		for (size_t i = 0; i < size; i++)
+		{
+			if (s == 0 && prefilter)
+			{
+				i = SkipToFirstByte(data, i, size);
+				if (i >= size)
+					break;
+			}
+			s = next[size_t(s) * 256 + data[i]];
+			for (uint32_t o = outStart[s]; o < outStart[s + 1]; o++)
+				onMatch(outList[o], i + 1);
+		}
+	}
+
+	// from the root only the first bytes of the words lead anywhere, so the rest can be skipped 16 at a time
+	size_t SkipToFirstByte(const uint8_t* data, size_t i, size_t size) const
+	{
+		__m128i fb[MAX_PREFILTER_BYTES];
+		for (size_t k = 0; k < numFirstBytes; k++)
+			fb[k] = _mm_set1_epi8(char(firstBytes[k]));
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+			__m128i eq = _mm_cmpeq_epi8(v, fb[0]);
+			for (size_t k = 1; k < numFirstBytes; k++)
+				eq = _mm_or_si128(eq, _mm_cmpeq_epi8(v, fb[k]));
+			if (unsigned m = _mm_movemask_epi8(eq))
+				return i + CountTrailingZeros(m);
+		}
+		for (; i < size; i++)
+			for (size_t k = 0; k < numFirstBytes; k++)
+				if (data[i] == firstBytes[k])
+					return i;
+		return size;
+	}
+
+	std::vector<int32_t> next;
+	std::vector<uint32_t> outStart;
+	std::vector<uint32_t> outList;
+	uint8_t firstBytes[MAX_PREFILTER_BYTES] = {};
+	size_t numFirstBytes = 0;
+};
+
+struct CompiledBytePattern
+{
+	uint32_t pattern;
+	std::vector<uint8_t> bytes;
+	std::vector<uint8_t> mask;
+	// longest run of fixed bytes, this is what the automaton looks for
+	size_t anchorOff;
+	size_t anchorLength;
+};
+
+struct CompiledValuePattern
+{
+	uint32_t pattern;
+	SearchPatternType type;
+	unsigned alignment;
+	// integers: two signed ranges (values matching as signed or as unsigned)
+	int32_t ranges[2][2];
+	bool anyRange;
+	float minFloat;
+	float maxFloat;
+	// pointers: target range (inside the file)
+	int64_t minTarget;
+	int64_t maxTarget;
+	int64_t relBase;
+
+	size_t GetSize() const { return type == SPT_Int16 ? 2 : 4; }
+
+	bool Match(const uint8_t* p, uint64_t pos) const
+	{
+		switch (type)
+		{
+		case SPT_Int16: {
+			int16_t v;
+			memcpy(&v, p, 2);
+			return anyRange && ((v >= ranges[0][0] && v <= ranges[0][1]) || (v >= ranges[1][0] && v <= ranges[1][1])); }
+		case SPT_Int32: {
+			int32_t v;
+			memcpy(&v, p, 4);
+			return anyRange && ((v >= ranges[0][0] && v <= ranges[0][1]) || (v >= ranges[1][0] && v <= ranges[1][1])); }
+		case SPT_Float32: {
+			float v;
+			memcpy(&v, p, 4);
+			return v >= minFloat && v <= maxFloat; }
+		case SPT_RelPointer32: {
+			int32_t v;
+			memcpy(&v, p, 4);
+			int64_t target = int64_t(pos) + v + relBase;
+			return v != 0 && target >= minTarget && target <= maxTarget; }
+		default:
+			return false;
+		}
+	}
+};
+
+// the signed ranges that contain the values from [vmin, vmax] interpreted as signed or unsigned
+static bool GetSignedRanges(int64_t vmin, int64_t vmax, int bits, int32_t out[2][2])
+{
+	int64_t smin = -(int64_t(1) << (bits - 1));
+	int64_t smax = (int64_t(1) << (bits - 1)) - 1;
+	int64_t umax = (int64_t(1) << bits) - 1;
+	int n = 0;
+	int64_t lo = std::max(vmin, smin);
+	int64_t hi = std::min(vmax, smax);
+	if (lo <= hi)
+	{
+		out[n][0] = int32_t(lo);
+		out[n][1] = int32_t(hi);
+		n++;
+	}
+	lo = std::max(vmin, smax + 1);
+	hi = std::min(vmax, umax);
+	if (lo <= hi)
+	{
+		out[n][0] = int32_t(lo - (umax + 1));
+		out[n][1] = int32_t(hi - (umax + 1));
+		n++;
+	}
+	if (n == 1)
+	{
+		out[1][0] = out[0][0];
+		out[1][1] = out[0][1];
+	}
+	return n > 0;
+}
+
+struct CompiledSearch
+{
+	bool Compile(const std::vector<SearchPattern>& patterns, std::string& error)
+	{
+		std::vector<std::vector<uint8_t>> anchors;
+		for (uint32_t i = 0; i < patterns.size(); i++)
+		{
+			const auto& P = patterns[i];
+			if (!P.enabled)
+				continue;
+			if (P.type == SPT_Bytes)
+			{
+				CompiledBytePattern BP;
+				BP.pattern = i;
+				std::string err;
+				if (!ParseBytePattern(P.bytes, BP.bytes, BP.mask, err))
+				{
+					error = ui::Format("pattern %u: %s", i, err.c_str());
+					return false;
+				}
+				BP.anchorOff = 0;
+				BP.anchorLength = 0;
+				for (size_t s = 0; s < BP.bytes.size(); )
+				{
+					if (!BP.mask[s])
+					{
+						s++;
+						continue;
+					}
+					size_t e = s;
+					while (e < BP.bytes.size() && BP.mask[e])
+						e++;
+					if (e - s > BP.anchorLength)
+					{
+						BP.anchorOff = s;
+						BP.anchorLength = e - s;
+					}
+					s = e;
+				}
+				if (!BP.anchorLength)
+				{
+					error = ui::Format("pattern %u: no fixed bytes", i);
+					return false;
+				}
+				anchors.push_back(std::vector<uint8_t>(BP.bytes.begin() + BP.anchorOff, BP.bytes.begin() + BP.anchorOff + BP.anchorLength));
+				maxLength = std::max(maxLength, BP.bytes.size());
+				bytePatterns.push_back(std::move(BP));
+			}
+			else
+			{
+				CompiledValuePattern VP;
+				memset(&VP, 0, sizeof(VP));
+				VP.pattern = i;
+				VP.type = P.type;
+				VP.alignment = std::max(P.alignment, 1U);
+				VP.anyRange = P.type == SPT_Int16 || P.type == SPT_Int32 ?
+					GetSignedRanges(P.minInt, P.maxInt, P.type == SPT_Int16 ? 16 : 32, VP.ranges) : false;
+				VP.minFloat = P.minFloat;
+				VP.maxFloat = P.maxFloat;
+				VP.minTarget = P.minInt;
+				VP.maxTarget = P.maxInt;
+				VP.relBase = P.relBase;
+				valuePatterns.push_back(VP);
+			}
+		}
+		if (bytePatterns.empty() && valuePatterns.empty())
+		{
+			error = "no patterns enabled";
+			return false;
+		}
+		if (!anchors.empty())
+			automaton.Build(anchors);
+		return true;
+	}
+
+	std::vector<CompiledBytePattern> bytePatterns;
+	std::vector<CompiledValuePattern> valuePatterns;
+	AhoCorasick automaton;
+	// matches starting in a chunk may continue for this many bytes
+	size_t maxLength = 4;
+	uint64_t maxResults = 0;
+};
+
+static void SearchValues(
+	const CompiledValuePattern& VP,
+	const uint8_t* data,
+	size_t ownSize,
+	size_t avail,
+	uint64_t base,
+	uint64_t fileSize,
+	std::vector<SearchResult>& out)
+{
+	size_t esz = VP.GetSize();
+	size_t end = std::min(ownSize, avail >= esz ? avail - esz + 1 : 0);
+	size_t at = size_t((VP.alignment - base % VP.alignment) % VP.alignment);
+	auto add = [&](size_t off) { out.push_back({ nullptr, base + off, uint32_t(esz), VP.pattern }); };
+
+	if ((VP.type == SPT_Int16 || VP.type == SPT_Int32) && !VP.anyRange)
+		return;
+
+	// naturally aligned values are checked 16 bytes at a time
+	if (VP.alignment == esz && at == 0 && VP.type != SPT_RelPointer32)
+	{
+		const __m128i r0min = _mm_set1_epi32(VP.ranges[0][0]);
+		const __m128i r0max = _mm_set1_epi32(VP.ranges[0][1]);
+		const __m128i r1min = _mm_set1_epi32(VP.ranges[1][0]);
+		const __m128i r1max = _mm_set1_epi32(VP.ranges[1][1]);
+		const __m128i r0min16 = _mm_set1_epi16(int16_t(VP.ranges[0][0]));
+		const __m128i r0max16 = _mm_set1_epi16(int16_t(VP.ranges[0][1]));
+		const __m128i r1min16 = _mm_set1_epi16(int16_t(VP.ranges[1][0]));
+		const __m128i r1max16 = _mm_set1_epi16(int16_t(VP.ranges[1][1]));
+		const __m128 fmin = _mm_set1_ps(VP.minFloat);
+		const __m128 fmax = _mm_set1_ps(VP.maxFloat);
+
+		for (; at + 16 <= end; at += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(data + at));
+			unsigned m;
+			if (VP.type == SPT_Int16)
+				m = MoveMask16(_mm_or_si128(InRangeI16(v, r0min16, r0max16), InRangeI16(v, r1min16, r1max16)));
+			else if (VP.type == SPT_Int32)
+				m = MoveMask32(_mm_or_si128(InRangeI32(v, r0min, r0max), InRangeI32(v, r1min, r1max)));
+			else
+			{
+				__m128 f = _mm_castsi128_ps(v);
+				m = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(f, fmin), _mm_cmple_ps(f, fmax)));
+			}
+			for (; m; m &= m - 1)
+				add(at + CountTrailingZeros(m) * esz);
+		}
+	}
+
+	for (; at < end; at += VP.alignment)
+	{
+		if (VP.Match(data + at, base + at))
+		{
+			if (VP.type == SPT_RelPointer32)
+			{
+				int32_t v;
+				memcpy(&v, data + at, 4);
+				if (uint64_t(int64_t(base + at) + v + VP.relBase) >= fileSize)
+					continue;
+			}
+			add(at);
+		}
+	}
+}
+
+// finds the matches starting in [0, ownSize), `avail` bytes are readable
+static void SearchChunk(
+	const CompiledSearch& cs,
+	const uint8_t* data,
+	size_t ownSize,
+	size_t avail,
+	uint64_t base,
+	uint64_t fileSize,
+	std::vector<SearchResult>& out)
+{
+	out.clear();
+	if (!cs.bytePatterns.empty())
+	{
+		cs.automaton.Scan(data, avail, [&](uint32_t w, size_t end)
+		{
+			const auto& BP = cs.bytePatterns[w];
+			size_t anchorStart = end - BP.anchorLength;
+			if (anchorStart < BP.anchorOff)
+				return;
+			size_t start = anchorStart - BP.anchorOff;
+			if (start >= ownSize || start + BP.bytes.size() > avail)
+				return;
+			for (size_t i = 0; i < BP.bytes.size(); i++)
+				if ((data[start + i] & BP.mask[i]) != BP.bytes[i])
+					return;
+			out.push_back({ nullptr, base + start, uint32_t(BP.bytes.size()), BP.pattern });
+		});
+	}
+	for (const auto& VP : cs.valuePatterns)
+		SearchValues(VP, data, ownSize, avail, base, fileSize, out);
+
+	std::sort(out.begin(), out.end(), [](const SearchResult& a, const SearchResult& b)
+	{
+		return a.off != b.off ? a.off < b.off : a.pattern < b.pattern;
+	});
+}
+
+
+bool SearchEngine::Start(const std::vector<DDFile*>& files)
+{
+	Cancel();
+	results.clear();
+	truncated = false;
+	time = 0;
+	error.clear();
+
+	CompiledSearch cs;
+	if (!cs.Compile(patterns, error))
+		return false;
+	cs.maxResults = maxResults ? maxResults : UINT64_MAX;
+	resultPatterns = patterns;
+
+	std::vector<DDFile*> searchFiles;
+	for (auto* F : files)
+		if (F->dataSource)
+			searchFiles.push_back(F);
+
+	uint32_t runID;
+	{
+		std::lock_guard<std::mutex> g(_pendingMutex);
+		runID = _runID;
+	}
+	progress = 0;
+	_queue.Push([this, runID, searchFiles, cs]()
+	{
+		_Run(runID, searchFiles, cs);
+	}, true);
+	return true;
+}
+
+void SearchEngine::Cancel()
+{
+	{
+		std::lock_guard<std::mutex> g(_pendingMutex);
+		_runID++;
+		_pendingResults.clear();
+		_hasPending = false;
+	}
+	progress = 1;
+}
+
+void SearchEngine::Update()
+{
+	std::lock_guard<std::mutex> g(_pendingMutex);
+	if (!_hasPending)
+		return;
+	results.insert(results.end(), _pendingResults.begin(), _pendingResults.end());
+	_pendingResults.clear();
+	progress = _pendingProgress;
+	time = _pendingTime;
+	truncated = _pendingTruncated;
+	_hasPending = false;
+}
+
+size_t SearchEngine::GetNumCols()
+{
+	return 4;
+}
+
+std::string SearchEngine::GetRowName(size_t row)
+{
+	return std::to_string(row);
+}
+
+std::string SearchEngine::GetColName(size_t col)
+{
+	switch (col)
+	{
+	case 0: return "File";
+	case 1: return "Offset";
+	case 2: return "Pattern";
+	case 3: return "Value";
+	default: return "";
+	}
+}
+
+std::string SearchEngine::GetText(size_t row, size_t col)
+{
+	const auto& R = results[row];
+	const auto& P = resultPatterns[R.pattern];
+	switch (col)
+	{
+	case 0: return R.file->name;
+	case 1: return std::to_string(R.off);
+	case 2: return ui::Format("%u: %s", R.pattern, GetSearchPatternTypeName(P.type));
+	case 3: {
+		auto* ds = R.file->dataSource;
+		char buf[64];
+		switch (P.type)
+		{
+		case SPT_Bytes: {
+			uint8_t bytes[16];
+			size_t n = ds->Read(R.off, std::min<size_t>(R.size, 16), bytes);
+			std::string text;
+			for (size_t i = 0; i < n; i++)
+				text += ui::Format(i ? " %02X" : "%02X", bytes[i]);
+			if (R.size > n)
+				text += " ...";
+			return text; }
+		case SPT_Int16:
+			ds->GetInt16Text(buf, sizeof(buf), R.off, true);
+			return buf;
+		case SPT_Int32:
+			ds->GetInt32Text(buf, sizeof(buf), R.off, true);
+			return buf;
+		case SPT_Float32:
+			ds->GetFloat32Text(buf, sizeof(buf), R.off);
+			return buf;
+		case SPT_RelPointer32: {
+			int32_t v = 0;
+			ds->Read(R.off, sizeof(v), &v);
+			return ui::Format("-> %" PRId64, int64_t(R.off) + v + P.relBase); }
+		default:
+			return "";
+		} }
+	default: return "";
+	}
+}
+
+bool SearchEngine::_IsCurrent(uint32_t runID)
+{
+	std::lock_guard<std::mutex> g(_pendingMutex);
+	return runID == _runID;
+}
+
+void SearchEngine::_Publish(uint32_t runID, std::vector<SearchResult>&& found, float p, double t, bool trunc)
+{
+	{
+		std::lock_guard<std::mutex> g(_pendingMutex);
+		if (runID != _runID)
+			return;
+		_pendingResults.insert(_pendingResults.end(), found.begin(), found.end());
+		_pendingProgress = p;
+		_pendingTime = t;
+		_pendingTruncated = trunc;
+		_hasPending = true;
+	}
+	found.clear();
+	// only the address is used, the engine may be gone by the time the event runs
+	uintptr_t at = reinterpret_cast<uintptr_t>(this);
+	ui::Application::PushEvent([at]() { ui::Notify(DCT_Search, at); });
+}
+
+void SearchEngine::_Run(uint32_t runID, const std::vector<DDFile*>& files, const CompiledSearch& cs)
+{
+	double t0 = ui::hqtime();
+	uint64_t totalSize = 0;
+	for (auto* F : files)
+		totalSize += F->dataSource->GetSize();
+
+	size_t chunksPerStep = ui::GetParallelThreadCount() * 2;
+	std::vector<std::vector<uint8_t>> buffers(chunksPerStep);
+	std::vector<std::vector<SearchResult>> chunkResults(chunksPerStep);
+	std::vector<SearchResult> found;
+	uint64_t numFound = 0;
+	uint64_t doneSize = 0;
+	double lastPublishTime = t0;
+
+	for (auto* F : files)
+	{
+		IDataSource* ds = F->dataSource;
+		uint64_t fileSize = ds->GetSize();
+		const uint8_t* span = fileSize ? static_cast<const uint8_t*>(ds->GetSpan(0, fileSize)) : nullptr;
+		uint64_t numChunks = (fileSize + SEARCH_CHUNK_SIZE - 1) / SEARCH_CHUNK_SIZE;
+
+		for (uint64_t c0 = 0; c0 < numChunks; c0 += chunksPerStep)
+		{
+			if (_queue.HasItems() || _queue.IsQuitting() || !_IsCurrent(runID))
+				return;
+
+			// chunks overlap by the length of the longest pattern
+			size_t nc = size_t(std::min<uint64_t>(chunksPerStep, numChunks - c0));
+			auto getChunkAvail = [&](uint64_t first)
+			{
+				return size_t(std::min<uint64_t>(SEARCH_CHUNK_SIZE + cs.maxLength - 1, fileSize - first));
+			};
+			ui::ParallelFor(nc, [&](size_t i)
+			{
+				uint64_t first = (c0 + i) * SEARCH_CHUNK_SIZE;
+				size_t ownSize = size_t(std::min(SEARCH_CHUNK_SIZE, fileSize - first));
+				if (!span)
+				{
+					buffers[i].resize(getChunkAvail(first));
+					ds->Read(first, buffers[i].size(), buffers[i].data());
+				}
+				SearchChunk(cs, span ? span + first : buffers[i].data(), ownSize, getChunkAvail(first), first, fileSize, chunkResults[i]);
+			});
+
+			for (size_t i = 0; i < nc; i++)
+			{
+				for (auto R : chunkResults[i])
+				{
+					R.file = F;
+					found.push_back(R);
+					if (++numFound >= cs.maxResults)
+					{
+						_Publish(runID, std::move(found), 1, ui::hqtime() - t0, true);
+						return;
+					}
+				}
+			}
+
+			doneSize += std::min((c0 + nc) * SEARCH_CHUNK_SIZE, fileSize) - c0 * SEARCH_CHUNK_SIZE;
+			if (ui::hqtime() - lastPublishTime >= SEARCH_PUBLISH_INTERVAL)
+			{
+				_Publish(runID, std::move(found), float(doneSize) / float(totalSize), ui::hqtime() - t0, false);
+				lastPublishTime = ui::hqtime();
+			}
+		}
+	}
+
+	_Publish(runID, std::move(found), 1, ui::hqtime() - t0, false);
+}
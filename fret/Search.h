@@ -0,0 +1,101 @@
+
+#pragma once
+#include "pch.h"
+
+#include <mutex>
+
+
+struct DDFile;
+struct CompiledSearch;
+
+enum SearchPatternType
+{
+	SPT_Bytes,
+	SPT_Int16,
+	SPT_Int32,
+	SPT_Float32,
+	SPT_RelPointer32, // int32 offsets relative to their own position
+
+	SPT__COUNT,
+};
+
+const char* GetSearchPatternTypeName(SearchPatternType t);
+
+struct SearchPattern
+{
+	bool enabled = true;
+	SearchPatternType type = SPT_Bytes;
+	// SPT_Bytes: hex bytes, ?? for any byte, "quoted" ASCII text (e.g. "RIFF" ?? ?? ?? ?? "WAVE")
+	std::string bytes;
+	// SPT_Int16/SPT_Int32: value range, SPT_RelPointer32: target offset range
+	int64_t minInt = 0;
+	int64_t maxInt = 0;
+	// SPT_Float32
+	float minFloat = 0;
+	float maxFloat = 0;
+	// values are only checked at offsets that are multiples of this
+	unsigned alignment = 4;
+	// SPT_RelPointer32: target = offset of value + value + relBase
+	int64_t relBase = 0;
+
+	void EditUI();
+};
+
+// parses SearchPattern::bytes, `mask` is 0 for wildcard bytes and 0xff otherwise
+bool ParseBytePattern(ui::StringView text, std::vector<uint8_t>& bytes, std::vector<uint8_t>& mask, std::string& error);
+
+struct SearchResult
+{
+	DDFile* file;
+	uint64_t off;
+	uint32_t size;
+	uint32_t pattern;
+};
+
+extern ui::DataCategoryTag DCT_Search[1];
+
+// searches all files for any of the patterns on a worker thread
+// the files are split into chunks which are searched in parallel, results come in file/offset order
+struct SearchEngine : ui::TableDataSource
+{
+	// returns false (with the reason in `error`) if the patterns are not valid
+	bool Start(const std::vector<DDFile*>& files);
+	void Cancel();
+	// takes over the results found since the last call (DCT_Search is notified when there are new ones)
+	void Update();
+	bool IsRunning() const { return progress < 1; }
+
+	size_t GetNumRows() override { return results.size(); }
+	size_t GetNumCols() override;
+	std::string GetRowName(size_t row) override;
+	std::string GetColName(size_t col) override;
+	std::string GetText(size_t row, size_t col) override;
+
+	bool _IsCurrent(uint32_t runID);
+	void _Publish(uint32_t runID, std::vector<SearchResult>&& found, float p, double t, bool trunc);
+	void _Run(uint32_t runID, const std::vector<DDFile*>& files, const CompiledSearch& cs);
+
+	std::vector<SearchPattern> patterns;
+	uint64_t maxResults = 100000;
+
+	std::vector<SearchResult> results;
+	// copy of the patterns that the results refer to
+	std::vector<SearchPattern> resultPatterns;
+	std::string error;
+	// 1 if not running
+	float progress = 1;
+	double time = 0;
+	// stopped after finding `maxResults`
+	bool truncated = false;
+
+	std::mutex _pendingMutex;
+	uint32_t _runID = 0;
+	std::vector<SearchResult> _pendingResults;
+	float _pendingProgress = 1;
+	double _pendingTime = 0;
+	bool _pendingTruncated = false;
+	bool _hasPending = false;
+
+	// last so that the worker is stopped first
+	ui::WorkerQueue _queue;
+};
@@ -0,0 +1,114 @@
+
+#pragma once
+#include "pch.h"
+
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+// SSE2 helpers shared by the byte pattern classifiers (highlighting, pattern index)
+
+inline int CountTrailingZeros(uint32_t x)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward(&idx, x);
+	return int(idx);
+#else
+	return __builtin_ctz(x);
+#endif
+}
+
+// the near-file-size checks compare integers converted to float against a float threshold,
+// this finds the smallest integer that passes so that the SIMD checks can compare integers
+inline uint64_t GetMinIntNotBelow(float f)
+{
+	if (!(f > 0))
+		return 0;
+	if (f >= 18446744073709551616.0f)
+		return UINT64_MAX;
+	uint64_t lo = 0;
+	uint64_t hi = uint64_t(f) + 1;
+	while (lo < hi)
+	{
+		uint64_t mid = lo + (hi - lo) / 2;
+		if (float(mid) >= f)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
+
+
+// byte classifiers produce one bit per offset, 16 offsets per mask
+// values at consecutive offsets come from loads at +0..+(size-1), lane j of the load at +k being offset j*size+k
+inline unsigned SpreadLanes2(unsigned m) { return (m & 1) | (m & 2) << 7; }
+inline unsigned SpreadLanes4(unsigned m) { return (m & 1) | (m & 2) << 3 | (m & 4) << 6 | (m & 8) << 9; }
+inline unsigned SpreadLanes8(unsigned m)
+{
+	m = (m | m << 4) & 0x0f0f;
+	m = (m | m << 2) & 0x3333;
+	m = (m | m << 1) & 0x5555;
+	return m;
+}
+
+inline unsigned MoveMask16(__m128i m) { return _mm_movemask_epi8(_mm_packs_epi16(m, _mm_setzero_si128())); }
+inline unsigned MoveMask32(__m128i m) { return _mm_movemask_ps(_mm_castsi128_ps(m)); }
+inline unsigned MoveMask64(__m128i m) { return _mm_movemask_pd(_mm_castsi128_pd(m)); }
+
+inline __m128i InRangeI16(__m128i v, __m128i vmin, __m128i vmax)
+{
+	return _mm_andnot_si128(_mm_or_si128(_mm_cmpgt_epi16(vmin, v), _mm_cmpgt_epi16(v, vmax)), _mm_set1_epi32(-1));
+}
+inline __m128i InRangeI32(__m128i v, __m128i vmin, __m128i vmax)
+{
+	return _mm_andnot_si128(_mm_or_si128(_mm_cmpgt_epi32(vmin, v), _mm_cmpgt_epi32(v, vmax)), _mm_set1_epi32(-1));
+}
+inline __m128i InRangeU32(__m128i v, __m128i vmin, __m128i vmax)
+{
+	const __m128i sign = _mm_set1_epi32(INT32_MIN);
+	return InRangeI32(_mm_xor_si128(v, sign), _mm_xor_si128(vmin, sign), _mm_xor_si128(vmax, sign));
+}
+// SSE2 only has signed 32-bit compares
+inline __m128i CmpGtU64(__m128i a, __m128i b)
+{
+	const __m128i sign = _mm_set1_epi32(INT32_MIN);
+	a = _mm_xor_si128(a, sign);
+	b = _mm_xor_si128(b, sign);
+	__m128i gt = _mm_cmpgt_epi32(a, b);
+	__m128i eq = _mm_cmpeq_epi32(a, b);
+	__m128i gtHi = _mm_shuffle_epi32(gt, _MM_SHUFFLE(3, 3, 1, 1));
+	__m128i eqHi = _mm_shuffle_epi32(eq, _MM_SHUFFLE(3, 3, 1, 1));
+	__m128i gtLo = _mm_shuffle_epi32(gt, _MM_SHUFFLE(2, 2, 0, 0));
+	return _mm_or_si128(gtHi, _mm_and_si128(eqHi, gtLo));
+}
+inline __m128i InRangeU64(__m128i v, __m128i vmin, __m128i vmax)
+{
+	return _mm_andnot_si128(_mm_or_si128(CmpGtU64(vmin, v), CmpGtU64(v, vmax)), _mm_set1_epi32(-1));
+}
+inline __m128i IsZero64(__m128i v)
+{
+	__m128i z = _mm_cmpeq_epi32(v, _mm_setzero_si128());
+	return _mm_and_si128(z, _mm_shuffle_epi32(z, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+// bits of the offsets in block `b` that are below `end`
+inline unsigned GetBlockLimitMask(size_t b, size_t end)
+{
+	size_t first = b * 16;
+	if (first + 16 <= end)
+		return 0xffff;
+	if (first >= end)
+		return 0;
+	return (1U << (end - first)) - 1;
+}
+
+template <class F> void ForEachSetBit(const uint16_t* masks, size_t numMasks, F&& f)
+{
+	for (size_t b = 0; b < numMasks; b++)
+		for (unsigned m = masks[b]; m; m &= m - 1)
+			f(b * 16 + CountTrailingZeros(m));
+}
@@ -0,0 +1,401 @@
+
+#include "pch.h"
+#include "StructScanner.h"
+
+#include "DataDesc.h"
+#include "FileReaders.h"
+#include "InstanceExpander.h"
+
+
+namespace ui {
+double hqtime();
+} // ui
+
+
+// bytes tested by one parallel job
+static constexpr uint64_t SCAN_CHUNK_SIZE = 1024 * 1024;
+// jobs per thread in a batch, the matches of a batch are added before the next one is scanned
+static constexpr unsigned SCAN_CHUNKS_PER_THREAD = 4;
+// time spent in one Update
+static constexpr double SCAN_STEP_TIME = 0.05;
+
+ui::DataCategoryTag DCT_StructScan[1];
+
+
+struct ScanFieldType
+{
+	uint8_t size;
+	bool isSigned;
+	// false if the value can't be compared on the file bytes
+	bool comparable;
+
+	int64_t Min() const { return isSigned ? -(int64_t(1) << (size * 8 - 1)) : 0; }
+	int64_t Max() const { return isSigned ? (int64_t(1) << (size * 8 - 1)) - 1 : (int64_t(1) << (size * 8)) - 1; }
+};
+
+// the builtin types that the range checks can read (the same values as DDStructInst::GetFieldIntValue)
+static bool GetScanFieldType(const std::string& type, ScanFieldType& out)
+{
+	static const std::pair<const char*, ScanFieldType> types[] =
+	{
+		{ "pad", { 1, false, false } },
+		{ "char", { 1, true, true } },
+		{ "i8", { 1, true, true } },
+		{ "u8", { 1, false, true } },
+		{ "i16", { 2, true, true } },
+		{ "u16", { 2, false, true } },
+		{ "i32", { 4, true, true } },
+		{ "u32", { 4, false, true } },
+		{ "f32", { 4, true, false } },
+	};
+	for (const auto& T : types)
+	{
+		if (type == T.first)
+		{
+			out = T.second;
+			return true;
+		}
+	}
+	return false;
+}
+
+static int64_t ReadScanValue(const char* p, uint8_t size, bool isSigned)
+{
+	switch (size)
+	{
+	case 1: return isSigned ? int64_t(*(const int8_t*)p) : int64_t(*(const uint8_t*)p);
+	case 2: { uint16_t v; memcpy(&v, p, 2); return isSigned ? int64_t(int16_t(v)) : int64_t(v); }
+	case 4: { uint32_t v; memcpy(&v, p, 4); return isSigned ? int64_t(int32_t(v)) : int64_t(v); }
+	default: return 0;
+	}
+}
+
+static UI_FORCEINLINE bool InRange(int64_t v, int64_t lo, int64_t hi)
+{
+	return uint64_t(v) - uint64_t(lo) <= uint64_t(hi) - uint64_t(lo);
+}
+
+static bool PassesChecks(const ScanRangeCheck* checks, size_t count, const char* p)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		const auto& C = checks[i];
+		if (InRange(ReadScanValue(p + C.off, C.size, C.isSigned), C.lo, C.hi) == C.invert)
+			return false;
+	}
+	return true;
+}
+
+// the first check is read with the actual type, the rest only for the offsets that pass it
+// `data` is the file data at `from`
+template <class T>
+static void ScanWithFirstCheck(const ScanRangeCheck* checks, size_t count, const char* data, uint64_t from, uint64_t to, uint64_t step, std::vector<uint64_t>& out)
+{
+	const char* first = data + checks[0].off;
+	int64_t lo = checks[0].lo;
+	int64_t hi = checks[0].hi;
+	bool invert = checks[0].invert;
+	for (uint64_t r = 0, rn = to - from; r < rn; r += step)
+	{
+		T v;
+		memcpy(&v, first + r, sizeof(v));
+		if (InRange(int64_t(v), lo, hi) == invert)
+			continue;
+		if (PassesChecks(checks + 1, count - 1, data + r))
+			out.push_back(from + r);
+	}
+}
+
+
+void StructScanner::Start(DataDesc* desc, DDFile* file, DDStruct* S)
+{
+	_desc = desc;
+	_file = file;
+	_struct = S;
+	_expr.SetExpr(signature);
+	if (alignment < 1)
+		alignment = 1;
+	progress = 0;
+	numTested = 0;
+	numCandidates = 0;
+	numMatches = 0;
+	numCreated = 0;
+	time = 0;
+
+	_next = 0;
+	_span = static_cast<const char*>(file->dataSource->GetSpan(0, file->dataSource->GetSize()));
+	_Compile();
+}
+
+void StructScanner::Cancel()
+{
+	_desc = nullptr;
+	_span = nullptr;
+	_buffers = {};
+	progress = 1;
+}
+
+void StructScanner::_Compile()
+{
+	_CompileChecks();
+	uint64_t size = _file->dataSource->GetSize();
+	uint64_t minSize = std::max<uint64_t>(_checkedSize, 1);
+	_end = size >= minSize ? size - minSize + 1 : 0;
+	_parallelEval = (!_expr.inst || _expr.inst->IsLocal()) && IsStructEvaluationLocal(_desc, _struct);
+	if (!_expr.inst || _noMatches)
+		_end = 0;
+	_compiledVersion = DDStruct::lastEditVersion;
+}
+
+void StructScanner::_CompileChecks()
+{
+	_checks.clear();
+	_checkedSize = 0;
+	_noMatches = false;
+	if (!_expr.inst)
+		return;
+
+	std::vector<MathExprFieldCheck> required;
+	_expr.inst->GetRequiredFieldChecks(required);
+
+	// fields that are always at the same offset from the start of the instance
+	struct FixedField
+	{
+		size_t index;
+		uint32_t off;
+		ScanFieldType type;
+	};
+	std::vector<FixedField> fixedFields;
+	int64_t serialOff = 0;
+	for (size_t i = 0; i < _struct->fields.size(); i++)
+	{
+		auto& F = _struct->fields[i];
+		ScanFieldType type;
+		bool isBuiltin = GetScanFieldType(F.type, type);
+		bool present = F.condition.expr.empty() && !F.IsComputed();
+		bool fixedCount = F.countSrc.empty() && !F.countIsMaxSize && !F.readUntil0;
+		int64_t off = _struct->serialized ? serialOff : F.off;
+		if (_struct->serialized)
+		{
+			// the later fields move with the size of this one
+			if (!isBuiltin || !present || !fixedCount || F.count < 0)
+				break;
+			serialOff += type.size * F.count;
+		}
+		if (!isBuiltin || !present || !fixedCount || F.count < 1 || !type.comparable)
+			continue;
+		if (off < 0 || off + type.size > INT32_MAX)
+			continue;
+		fixedFields.push_back({ i, uint32_t(off), type });
+	}
+
+	struct FieldRange
+	{
+		const FixedField* field;
+		int64_t lo;
+		int64_t hi;
+	};
+	std::vector<FieldRange> ranges;
+	std::vector<ScanRangeCheck> exclusions;
+	for (const auto& RC : required)
+	{
+		// the first field with the name is the one that the expression reads
+		size_t fid = _struct->FindFieldByName(RC.field);
+		const FixedField* FF = nullptr;
+		for (const auto& ff : fixedFields)
+			if (ff.index == fid)
+				FF = &ff;
+		if (!FF)
+			continue;
+
+		if (RC.op == MathExprFieldCheck::NotEqual)
+		{
+			if (RC.value >= FF->type.Min() && RC.value <= FF->type.Max())
+				exclusions.push_back({ FF->off, FF->type.size, FF->type.isSigned, true, RC.value, RC.value });
+			continue;
+		}
+
+		FieldRange* R = nullptr;
+		for (auto& r : ranges)
+			if (r.field == FF)
+				R = &r;
+		if (!R)
+		{
+			ranges.push_back({ FF, FF->type.Min(), FF->type.Max() });
+			R = &ranges.back();
+		}
+		switch (RC.op)
+		{
+		case MathExprFieldCheck::Equal:
+			R->lo = std::max(R->lo, RC.value);
+			R->hi = std::min(R->hi, RC.value);
+			break;
+		case MathExprFieldCheck::Less:
+			if (RC.value == INT64_MIN)
+				_noMatches = true;
+			else
+				R->hi = std::min(R->hi, RC.value - 1);
+			break;
+		case MathExprFieldCheck::LessEqual:
+			R->hi = std::min(R->hi, RC.value);
+			break;
+		case MathExprFieldCheck::Greater:
+			if (RC.value == INT64_MAX)
+				_noMatches = true;
+			else
+				R->lo = std::max(R->lo, RC.value + 1);
+			break;
+		case MathExprFieldCheck::GreaterEqual:
+			R->lo = std::max(R->lo, RC.value);
+			break;
+		default:
+			break;
+		}
+	}
+
+	for (const auto& R : ranges)
+	{
+		if (R.lo > R.hi)
+			_noMatches = true;
+		// the whole range of the type passes
+		if (R.lo <= R.field->type.Min() && R.hi >= R.field->type.Max())
+			continue;
+		_checks.push_back({ R.field->off, R.field->type.size, R.field->type.isSigned, false, R.lo, R.hi });
+	}
+	// the narrowest ranges reject the most offsets
+	std::stable_sort(_checks.begin(), _checks.end(), [](const ScanRangeCheck& a, const ScanRangeCheck& b)
+	{
+		return uint64_t(a.hi) - uint64_t(a.lo) < uint64_t(b.hi) - uint64_t(b.lo);
+	});
+	_checks.insert(_checks.end(), exclusions.begin(), exclusions.end());
+
+	for (const auto& C : _checks)
+		_checkedSize = std::max(_checkedSize, C.off + C.size);
+}
+
+void StructScanner::_ScanRange(const char* data, uint64_t from, uint64_t to, std::vector<uint64_t>& out) const
+{
+	if (_checks.empty())
+	{
+		for (uint64_t o = from; o < to; o += alignment)
+			out.push_back(o);
+		return;
+	}
+	const auto& C = _checks[0];
+	switch (C.size * 2 + C.isSigned)
+	{
+	case 2: ScanWithFirstCheck<uint8_t>(_checks.data(), _checks.size(), data, from, to, alignment, out); break;
+	case 3: ScanWithFirstCheck<int8_t>(_checks.data(), _checks.size(), data, from, to, alignment, out); break;
+	case 4: ScanWithFirstCheck<uint16_t>(_checks.data(), _checks.size(), data, from, to, alignment, out); break;
+	case 5: ScanWithFirstCheck<int16_t>(_checks.data(), _checks.size(), data, from, to, alignment, out); break;
+	case 8: ScanWithFirstCheck<uint32_t>(_checks.data(), _checks.size(), data, from, to, alignment, out); break;
+	case 9: ScanWithFirstCheck<int32_t>(_checks.data(), _checks.size(), data, from, to, alignment, out); break;
+	}
+}
+
+bool StructScanner::_Matches(uint64_t off) const
+{
+	DDStructInst SI = { -1, _desc, _struct, _file, int64_t(off), "", CreationReason::Query };
+	VariableSource vs;
+	{
+		vs.desc = _desc;
+		vs.root = &SI;
+	}
+	return _expr.Evaluate(vs) != 0;
+}
+
+bool StructScanner::Step(double maxTime)
+{
+	if (!_desc)
+		return true;
+
+	// the field layout (or the structs it uses) has changed, the rest of the file is scanned with the new one
+	if (_compiledVersion != DDStruct::lastEditVersion)
+		_Compile();
+
+	double t0 = ui::hqtime();
+	unsigned numChunks = ui::GetParallelThreadCount() * SCAN_CHUNKS_PER_THREAD;
+	// chunks start at aligned offsets
+	uint64_t chunkSize = SCAN_CHUNK_SIZE - SCAN_CHUNK_SIZE % alignment;
+	if (chunkSize == 0)
+		chunkSize = alignment;
+	std::vector<std::vector<uint64_t>> found(numChunks);
+	std::vector<uint64_t> candidates(numChunks);
+	if (!_span)
+		_buffers.resize(numChunks);
+	while (_next < _end && numMatches < maxMatches)
+	{
+		uint64_t batchStart = _next;
+		uint64_t batchEnd = std::min(batchStart + chunkSize * numChunks, _end);
+		ui::ParallelFor(numChunks, [&](size_t i)
+		{
+			found[i].clear();
+			candidates[i] = 0;
+			uint64_t from = batchStart + chunkSize * i;
+			uint64_t to = std::min(from + chunkSize, batchEnd);
+			if (from >= to)
+				return;
+			const char* data = _span ? _span + from : nullptr;
+			if (!data)
+			{
+				// the checks of the last offsets read past the chunk
+				auto& buf = _buffers[i];
+				buf.resize(size_t(to - 1 + std::max<uint32_t>(_checkedSize, 1) - from));
+				_file->dataSource->Read(from, buf.size(), buf.data());
+				data = buf.data();
+			}
+			auto& F = found[i];
+			_ScanRange(data, from, to, F);
+			candidates[i] = F.size();
+			if (_parallelEval)
+				F.erase(std::remove_if(F.begin(), F.end(), [this](uint64_t o) { return !_Matches(o); }), F.end());
+		});
+
+		for (size_t i = 0; i < numChunks; i++)
+		{
+			auto& F = found[i];
+			numCandidates += candidates[i];
+			if (!_parallelEval)
+				F.erase(std::remove_if(F.begin(), F.end(), [this](uint64_t o) { return !_Matches(o); }), F.end());
+
+			_desc->BeginInstanceBatch();
+			for (uint64_t o : F)
+			{
+				if (numMatches >= maxMatches)
+					break;
+				numMatches++;
+				// AddInstance would overwrite the remaining count of an existing instance
+				if (_desc->instIndex.FindAt(_file, _struct, int64_t(o)))
+					continue;
+				DDStructInst SI = { -1, _desc, _struct, _file, int64_t(o), "", CreationReason::Query };
+				_desc->AddInstance(SI);
+				numCreated++;
+			}
+			_desc->EndInstanceBatch();
+		}
+
+		numTested += (batchEnd - batchStart + alignment - 1) / alignment;
+		_next = batchEnd;
+		if (ui::hqtime() - t0 >= maxTime)
+			break;
+	}
+	time += ui::hqtime() - t0;
+
+	if (_next >= _end || numMatches >= maxMatches)
+	{
+		Cancel();
+		return true;
+	}
+	progress = float(double(_next) / double(_end));
+	return false;
+}
+
+void StructScanner::Update()
+{
+	if (!_desc)
+		return;
+	Step(SCAN_STEP_TIME);
+	// only the address is used, the scanner may be gone by the time the event runs
+	uintptr_t at = reinterpret_cast<uintptr_t>(this);
+	ui::Application::PushEvent([at]() { ui::Notify(DCT_StructScan, at); });
+}
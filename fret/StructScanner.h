@@ -0,0 +1,84 @@
+
+#pragma once
+#include "pch.h"
+
+#include "MathExpr.h"
+
+
+struct DataDesc;
+struct DDFile;
+struct DDStruct;
+
+extern ui::DataCategoryTag DCT_StructScan[1];
+
+// a comparison of a leading field with constants, tested on the file bytes
+struct ScanRangeCheck
+{
+	// from the start of the instance
+	uint32_t off;
+	uint8_t size;
+	bool isSigned;
+	// the value passes if it's in [lo; hi], or if it's not when `invert` is set
+	bool invert;
+	int64_t lo;
+	int64_t hi;
+};
+
+// finds the instances of a struct by testing each aligned offset of a file with a signature expression
+// (e.g. "magic == 0x46464952 & version < 4"), in steps so that it can run alongside the UI
+// - the comparisons of fixed-offset fields with constants that the signature requires are compiled to range checks,
+//   which reject most offsets without creating an instance
+// - the remaining offsets are evaluated fully (by the workers if the struct doesn't query other instances)
+// - the matches are added as CreationReason::Query instances after each batch (unless they already exist)
+// - struct edits during the scan recompile the checks, the offsets that were already tested are kept
+struct StructScanner
+{
+	void Start(DataDesc* desc, DDFile* file, DDStruct* S);
+	void Cancel();
+	// scans for at least `maxTime` seconds or until done, returns true if done
+	bool Step(double maxTime);
+	// runs a step and schedules the next one (DCT_StructScan is notified)
+	void Update();
+	bool IsRunning() const { return _desc != nullptr; }
+
+	// compiles the checks for the current struct definitions
+	void _Compile();
+	void _CompileChecks();
+	// `data` is the file data at `from`
+	void _ScanRange(const char* data, uint64_t from, uint64_t to, std::vector<uint64_t>& out) const;
+	bool _Matches(uint64_t off) const;
+
+	std::string signature;
+	unsigned alignment = 4;
+	// the scan stops after finding this many
+	size_t maxMatches = 100000;
+
+	// 1 if not running
+	float progress = 1;
+	uint64_t numTested = 0;
+	// offsets that passed the range checks
+	uint64_t numCandidates = 0;
+	size_t numMatches = 0;
+	size_t numCreated = 0;
+	double time = 0;
+
+	DataDesc* _desc = nullptr;
+	DDFile* _file = nullptr;
+	DDStruct* _struct = nullptr;
+	MathExprObj _expr;
+	// the checks are ordered by how many values they let through
+	std::vector<ScanRangeCheck> _checks;
+	// bytes read by the checks
+	uint32_t _checkedSize = 0;
+	// the signature contradicts itself
+	bool _noMatches = false;
+	bool _parallelEval = false;
+	// DDStruct::lastEditVersion when the checks were compiled
+	uint32_t _compiledVersion = 0;
+	// first offset that hasn't been tested yet
+	uint64_t _next = 0;
+	uint64_t _end = 0;
+	// the whole file if it's in memory, otherwise each chunk is read to its buffer
+	const char* _span = nullptr;
+	std::vector<std::vector<char>> _buffers;
+};
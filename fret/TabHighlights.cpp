@@ -13,6 +13,8 @@ void TabHighlights::Build()
 
 		ui::Text("Highlighted items") + ui::SetPadding(5);
 
+		BuildPatternIndexUI();
+
 		ui::Pop();
 
 		ui::PushBox();
@@ -22,3 +24,48 @@ void TabHighlights::Build()
 	ui::Pop();
 	spmkr.SetSplits({ 0.6f });
 }
+
+void TabHighlights::BuildPatternIndexUI()
+{
+	auto& PIX = of->patternIndexer;
+	PIX.Update();
+	Subscribe(DCT_PatternIndex, &PIX);
+
+	ui::Text("Pattern index") + ui::SetPadding(5);
+
+	if (PIX.IsRunning())
+		ui::MakeWithText<ui::ProgressBar>("Indexing").progress = PIX.progress;
+	else if (PIX.index)
+		ui::Text(ui::Format("%zu runs", PIX.index->GetNumRuns())) + ui::SetPadding(5);
+
+	if (PIX.IsOutOfDate(of->highlightSettings))
+		ui::Text("Highlight settings changed since indexing") + ui::SetPadding(5);
+	if (ui::imm::Button("Rebuild index"))
+		PIX.Restart(of->highlightSettings);
+
+	auto* PI = PIX.index.get();
+	if (!PI || !PI->complete)
+		return;
+
+	auto& HVS = of->hexViewerState;
+	for (int pc = 0; pc < PC__COUNT; pc++)
+	{
+		ui::PushBox() + ui::Set(ui::StackingDirection::LeftToRight);
+		ui::Text(ui::Format("%s: %zu", GetPatternClassName(PatternClass(pc)), PI->runs[pc].size())) + ui::SetPadding(5);
+
+		uint64_t pos = HVS.selectionStart != UINT64_MAX ? HVS.selectionStart : HVS.basePos;
+		const PatternRun* run = nullptr;
+		if (ui::imm::Button("<"))
+			run = PI->FindPrev(PatternClass(pc), pos);
+		if (ui::imm::Button(">"))
+			run = PI->FindNext(PatternClass(pc), pos);
+		if (run)
+		{
+			HVS.GoToPos(run->start);
+			HVS.selectionEnd = run->end - 1;
+			ui::Notify(DCT_HexViewerState, &HVS);
+		}
+
+		ui::Pop();
+	}
+}
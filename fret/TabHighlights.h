@@ -8,6 +8,7 @@ struct OpenedFile;
 struct TabHighlights : ui::Buildable
 {
 	void Build() override;
+	void BuildPatternIndexUI();
 
 	OpenedFile* of = nullptr;
 };
@@ -13,71 +13,69 @@ void TabImages::Build()
 
 		workspace->ddimgSrc.Edit();
 
-		auto& tv = ui::Make<ui::TableView>();
-		tv + ui::SetLayout(ui::layouts::EdgeSlice());
-		tv.SetDataSource(&workspace->ddimgSrc);
-		tv.SetSelectionStorage(&workspace->ddimgSrc);
-		tv.SetSelectionMode(ui::SelectionMode::Single);
+		ui::imm::PropEditBool("Show thumbnails", showThumbnails);
+
 		workspace->ddimgSrc.refilter = true;
-		tv.CalculateColumnWidths();
-		tv.HandleEvent(ui::EventType::SelectionChange) = [this, &tv](ui::Event& e) { e.current->Rebuild(); };
-		tv.HandleEvent(&tv, ui::EventType::Click) = [this, &tv](ui::Event& e)
+		if (showThumbnails)
 		{
-			size_t row = tv.GetHoverRow();
-			if (row != SIZE_MAX && e.GetButton() == ui::MouseButton::Left && e.numRepeats == 2)
+			Subscribe(DCT_ImageThumbnails, &workspace->thumbnails);
+
+			auto& grid = ui::Make<ImageThumbnailGrid>();
+			grid.Init(&workspace->ddimgSrc, &workspace->thumbnails, &thumbnailScroll);
+			grid.HandleEvent(ui::EventType::SelectionChange) = [this](ui::Event& e) { e.current->Rebuild(); };
+			grid.HandleEvent(&grid, ui::EventType::Click) = [this, &grid](ui::Event& e)
 			{
-				auto idx = workspace->ddimgSrc._indices[row];
-				auto& IMG = workspace->desc.images[idx];
-				// find tab showing this image
-				OpenedFile* ofile = nullptr;
-				int ofid = -1;
-				for (auto* of : workspace->openedFiles)
-				{
-					ofid++;
-					if (of->ddFile != IMG.file)
-						continue;
-					ofile = of;
-					break;
-				}
-				// TODO open a new tab if not opened already
-				if (ofile)
-				{
-					workspace->curOpenedFile = ofid;
-					ofile->hexViewerState.basePos = IMG.offImage;
-					tv.Rebuild();
-				}
-			}
-		};
-		tv.HandleEvent(&tv, ui::EventType::ButtonUp) = [this, &tv](ui::Event& e)
+				size_t cell = grid.GetCellAt(e.position);
+				if (cell != SIZE_MAX && e.GetButton() == ui::MouseButton::Left && e.numRepeats == 2)
+					GoToImage(workspace->ddimgSrc._indices[cell]);
+			};
+		}
+		else
 		{
-			size_t row = tv.GetHoverRow();
-			if (row != SIZE_MAX && e.GetButton() == ui::MouseButton::Right)
+			auto& tv = ui::Make<ui::TableView>();
+			tv + ui::SetLayout(ui::layouts::EdgeSlice());
+			tv.SetDataSource(&workspace->ddimgSrc);
+			tv.SetSelectionStorage(&workspace->ddimgSrc);
+			tv.SetSelectionMode(ui::SelectionMode::Single);
+			tv.CalculateColumnWidths();
+			tv.HandleEvent(ui::EventType::SelectionChange) = [this, &tv](ui::Event& e) { e.current->Rebuild(); };
+			tv.HandleEvent(&tv, ui::EventType::Click) = [this, &tv](ui::Event& e)
+			{
+				size_t row = tv.GetHoverRow();
+				if (row != SIZE_MAX && e.GetButton() == ui::MouseButton::Left && e.numRepeats == 2)
+					GoToImage(workspace->ddimgSrc._indices[row]);
+			};
+			tv.HandleEvent(&tv, ui::EventType::ButtonUp) = [this, &tv](ui::Event& e)
 			{
-				auto idx = workspace->ddimgSrc._indices[row];
-				auto& IMG = workspace->desc.images[idx];
-				ui::MenuItem items[] =
+				size_t row = tv.GetHoverRow();
+				if (row != SIZE_MAX && e.GetButton() == ui::MouseButton::Right)
 				{
-					ui::MenuItem("Delete").Func([this, idx, &e]() { workspace->desc.DeleteImage(idx); e.current->Rebuild(); }),
-					ui::MenuItem("Duplicate").Func([this, idx, &e]() { workspace->desc.curImage = workspace->desc.DuplicateImage(idx); e.current->Rebuild(); }),
-				};
-				ui::Menu menu(items);
-				menu.Show(e.current);
-				e.StopPropagation();
-			}
-		};
-		tv.HandleEvent(ui::EventType::KeyAction) = [this, &tv](ui::Event& e)
-		{
-			if (e.GetKeyAction() == ui::KeyAction::Delete)
+					auto idx = workspace->ddimgSrc._indices[row];
+					auto& IMG = workspace->desc.images[idx];
+					ui::MenuItem items[] =
+					{
+						ui::MenuItem("Delete").Func([this, idx, &e]() { workspace->desc.DeleteImage(idx); e.current->Rebuild(); }),
+						ui::MenuItem("Duplicate").Func([this, idx, &e]() { workspace->desc.curImage = workspace->desc.DuplicateImage(idx); e.current->Rebuild(); }),
+					};
+					ui::Menu menu(items);
+					menu.Show(e.current);
+					e.StopPropagation();
+				}
+			};
+			tv.HandleEvent(ui::EventType::KeyAction) = [this, &tv](ui::Event& e)
 			{
-				if (workspace->desc.curImage < workspace->desc.images.size())
+				if (e.GetKeyAction() == ui::KeyAction::Delete)
 				{
-					workspace->desc.images.erase(workspace->desc.images.begin() + workspace->desc.curImage);
-					workspace->desc.curImage = UINT32_MAX;
-					workspace->ddimgSrc.refilter = true;
-					e.current->Rebuild();
+					if (workspace->desc.curImage < workspace->desc.images.size())
+					{
+						workspace->desc.images.erase(workspace->desc.images.begin() + workspace->desc.curImage);
+						workspace->desc.curImage = UINT32_MAX;
+						workspace->ddimgSrc.refilter = true;
+						e.current->Rebuild();
+					}
 				}
-			}
-		};
+			};
+		}
 
 		ui::Pop();
 	}
@@ -97,6 +95,8 @@ void TabImages::Build()
 			}
 			ui::PushBox();
 			workspace->desc.EditImageItems();
+			if (workspace->desc.curImage < workspace->desc.images.size())
+				BuildFormatDetection();
 			ui::Pop();
 		}
 		ui::Pop();
@@ -106,3 +106,86 @@ void TabImages::Build()
 	ui::Pop();
 	spstr.SetSplits({ 0.5f });
 }
+
+void TabImages::OnNotify(ui::DataCategoryTag* tag, uintptr_t at)
+{
+	// the thumbnail grid only needs to be repainted to pick up the new thumbnails
+	if (tag == DCT_ImageThumbnails)
+		GetNativeWindow()->InvalidateAll();
+	else
+		ui::Buildable::OnNotify(tag, at);
+}
+
+void TabImages::GoToImage(size_t idx)
+{
+	auto& IMG = workspace->desc.images[idx];
+	// find tab showing this image
+	OpenedFile* ofile = nullptr;
+	int ofid = -1;
+	for (auto* of : workspace->openedFiles)
+	{
+		ofid++;
+		if (of->ddFile != IMG.file)
+			continue;
+		ofile = of;
+		break;
+	}
+	// TODO open a new tab if not opened already
+	if (ofile)
+	{
+		workspace->curOpenedFile = ofid;
+		ofile->hexViewerState.basePos = IMG.offImage;
+		Rebuild();
+	}
+}
+
+void TabImages::BuildFormatDetection()
+{
+	auto& D = workspace->imgDetector;
+	D.Update();
+	Subscribe(DCT_ImageDetection, &D);
+
+	auto& IMG = workspace->desc.images[workspace->desc.curImage];
+
+	ui::Text("Format detection (at the image/palette offsets)") + ui::SetPadding(5);
+	D.settings.EditUI();
+	if (D.IsRunning())
+	{
+		if (ui::imm::Button("Cancel"))
+			D.Cancel();
+		ui::MakeWithText<ui::ProgressBar>("Detecting...").progress = D.progress;
+	}
+	else if (ui::imm::Button("Detect format"))
+		D.Start(IMG.file, IMG.offImage, IMG.offPalette);
+
+	// results of another image are not shown
+	if (D.file != IMG.file || D.offImage != IMG.offImage || D.offPalette != IMG.offPalette)
+		return;
+	if (!D.IsRunning() && D.results.size())
+		ui::Text(ui::Format("%zu candidates in %.2f ms", D.results.size(), D.time * 1000)) + ui::SetPadding(5);
+
+	for (const auto& C : D.results)
+	{
+		ui::PushBox() + ui::Set(ui::StackingDirection::LeftToRight);
+
+		auto& img = ui::Make<ui::ImageElement>();
+		img + ui::SetWidth(64);
+		img + ui::SetHeight(64);
+		img.GetStyle().SetBackgroundPainter(ui::CheckerboardPainter::Get());
+		img.SetImage(C.previewImage);
+		img.SetScaleMode(ui::ScaleMode::Fit);
+
+		ui::Text(ui::Format("%s %ux%u score=%.3f (corr.=%.2f entropy=%.2f palette=%.2f)",
+			C.format.c_str(), C.width, C.height, C.score, C.correlation, C.entropy, C.palette)) + ui::SetPadding(5);
+
+		if (ui::imm::Button("Apply"))
+		{
+			IMG.format = C.format;
+			IMG.width = C.width;
+			IMG.height = C.height;
+			workspace->ddimgSrc.refilter = true;
+		}
+
+		ui::Pop();
+	}
+}
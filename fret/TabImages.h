@@ -8,6 +8,12 @@ struct Workspace;
 struct TabImages : ui::Buildable
 {
 	void Build() override;
+	void OnNotify(ui::DataCategoryTag* tag, uintptr_t at) override;
+	// opens the file of the image at its offset
+	void GoToImage(size_t idx);
+	void BuildFormatDetection();
 
 	Workspace* workspace = nullptr;
+	bool showThumbnails = true;
+	float thumbnailScroll = 0;
 };
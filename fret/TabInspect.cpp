@@ -56,6 +56,14 @@ void TabInspect::Build()
 		ui::imm::PropText("f64", txt_float64);
 		ui::imm::PropText("ASCII", txt_ascii);
 
+		if (auto* cds = dynamic_cast<CachedDataSource*>(ds))
+		{
+			auto stats = cds->GetStats();
+			char txt_cache[128];
+			snprintf(txt_cache, 128, "%" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " read ahead", stats.hits, stats.misses, stats.readAheads);
+			ui::imm::PropText("Cache", txt_cache);
+		}
+
 		ui::Pop();
 
 		ui::PushBox();
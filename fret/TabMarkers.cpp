@@ -49,6 +49,7 @@ void TabMarkers::Build()
 				if (f->mdSrc.selected < f->markerData.markers.size())
 				{
 					f->markerData.markers.erase(f->markerData.markers.begin() + f->mdSrc.selected);
+					f->markerData.OnEdit();
 					f->mdSrc.selected = SIZE_MAX;
 					e.current->Rebuild();
 				}
@@ -62,6 +63,7 @@ void TabMarkers::Build()
 		{
 			auto& MIE = ui::Make<MarkedItemEditor>();
 			MIE.dataSource = f->dataSource;
+			MIE.markerData = &f->markerData;
 			MIE.marker = &f->markerData.markers[f->mdSrc.selected];
 		}
 		ui::Pop();
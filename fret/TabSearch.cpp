@@ -0,0 +1,84 @@
+
+#include "pch.h"
+#include "TabSearch.h"
+
+#include "Workspace.h"
+
+
+void TabSearch::Build()
+{
+	auto& S = workspace->search;
+	S.Update();
+	Subscribe(DCT_Search, &S);
+
+	auto& spsrch = ui::Push<ui::SplitPane>();
+	spsrch.SetDirection(true);
+	{
+		ui::PushBox();
+		{
+			auto& seqEd = ui::Make<ui::SequenceEditor>();
+			seqEd.SetSequence(ui::BuildAlloc<ui::StdSequence<decltype(S.patterns)>>(S.patterns));
+			seqEd.itemUICallback = [](ui::SequenceEditor* se, size_t idx, void* ptr)
+			{
+				static_cast<SearchPattern*>(ptr)->EditUI();
+			};
+
+			ui::PushBox() + ui::Set(ui::StackingDirection::LeftToRight);
+			if (ui::imm::Button("Add"))
+			{
+				S.patterns.push_back({});
+				ui::RebuildCurrent();
+			}
+			if (S.IsRunning())
+			{
+				if (ui::imm::Button("Cancel"))
+					S.Cancel();
+			}
+			else if (ui::imm::Button("Search all files"))
+				S.Start(workspace->desc.files);
+			ui::Pop();
+
+			ui::imm::PropEditInt("Max. results", S.maxResults);
+		}
+		ui::Pop();
+
+		ui::PushBox() + ui::SetLayout(ui::layouts::EdgeSlice());
+
+		if (!S.error.empty())
+			ui::Text("Error: " + S.error) + ui::SetPadding(5);
+		if (S.IsRunning())
+			ui::MakeWithText<ui::ProgressBar>(ui::Format("Searching... %zu found", S.results.size())).progress = S.progress;
+		else if (S.results.size())
+			ui::Text(ui::Format("%zu found%s in %.2f ms", S.results.size(), S.truncated ? " (stopped at max.)" : "", S.time * 1000)) + ui::SetPadding(5);
+
+		auto& tv = ui::Make<ui::TableView>();
+		tv + ui::SetLayout(ui::layouts::EdgeSlice()) + ui::SetHeight(ui::Coord::Percent(100));
+		tv.SetDataSource(&S);
+		tv.CalculateColumnWidths();
+		tv.HandleEvent(&tv, ui::EventType::Click) = [this, &tv](ui::Event& e)
+		{
+			size_t row = tv.GetHoverRow();
+			if (row != SIZE_MAX && e.GetButton() == ui::MouseButton::Left && e.numRepeats == 2)
+			{
+				const auto& R = workspace->search.results[row];
+				// find tab showing this file
+				int ofid = -1;
+				for (auto* of : workspace->openedFiles)
+				{
+					ofid++;
+					if (of->ddFile != R.file)
+						continue;
+					workspace->curOpenedFile = ofid;
+					of->hexViewerState.GoToPos(R.off);
+					of->hexViewerState.selectionEnd = R.off + R.size - 1;
+					tv.Rebuild();
+					break;
+				}
+			}
+		};
+
+		ui::Pop();
+	}
+	ui::Pop();
+	spsrch.SetSplits({ 0.4f });
+}
@@ -0,0 +1,13 @@
+
+#pragma once
+#include "pch.h"
+
+struct Workspace;
+
+
+struct TabSearch : ui::Buildable
+{
+	void Build() override;
+
+	Workspace* workspace = nullptr;
+};
@@ -16,11 +16,22 @@ void TabStructures::Build()
 
 		workspace->ddiSrc.Edit();
 
+		auto& IE = workspace->expander;
+		IE.Update();
+		Subscribe(DCT_InstanceExpansion, &IE);
+
 		ui::Property::Begin();
 		ui::Text("Instances") + ui::SetPadding(5);
-		if (ui::imm::Button("Expand all instances"))
+		if (IE.IsRunning())
+		{
+			ui::MakeWithText<ui::ProgressBar>(ui::Format("Expanding... %zu created", IE.numCreated)).progress = IE.progress;
+			if (ui::imm::Button("Cancel"))
+				IE.Cancel();
+		}
+		else if (ui::imm::Button("Expand all instances"))
 		{
-			workspace->desc.ExpandAllInstances(workspace->ddiSrc.filterFile);
+			IE.Start(&workspace->desc, workspace->ddiSrc.filterFile);
+			IE.Update();
 		}
 		if (ui::imm::Button("Delete auto-created"))
 		{
@@ -28,6 +39,38 @@ void TabStructures::Build()
 		}
 		ui::Property::End();
 
+		// finds the instances of the filtered struct in the filtered file
+		auto& SS = workspace->scanner;
+		SS.Update();
+		Subscribe(DCT_StructScan, &SS);
+		if (workspace->ddiSrc.filterStruct && workspace->ddiSrc.filterFile)
+		{
+			ui::imm::PropEditString("Signature", SS.signature.c_str(), [this](const char* v) { workspace->scanner.signature = v; });
+			ui::imm::PropEditInt("Alignment", SS.alignment, {}, {}, { 1, 4096 });
+			ui::Property::Begin();
+			if (SS.IsRunning())
+			{
+				ui::MakeWithText<ui::ProgressBar>(ui::Format("Scanning... %zu found", SS.numMatches)).progress = SS.progress;
+				if (ui::imm::Button("Cancel"))
+					SS.Cancel();
+			}
+			else if (ui::imm::Button("Scan file for struct"))
+			{
+				SS.Start(&workspace->desc, workspace->ddiSrc.filterFile, workspace->ddiSrc.filterStruct);
+				SS.Update();
+			}
+			ui::Property::End();
+			if (SS.numTested)
+			{
+				ui::Text(ui::Format("%" PRIu64 " offsets tested (%.0f/s), %" PRIu64 " evaluated, %zu found, %zu created",
+					SS.numTested,
+					SS.time > 0 ? SS.numTested / SS.time : 0.0,
+					SS.numCandidates,
+					SS.numMatches,
+					SS.numCreated)) + ui::SetPadding(5);
+			}
+		}
+
 		auto& tv = ui::Make<ui::TableView>();
 		curTable = &tv;
 		tv + ui::SetLayout(ui::layouts::EdgeSlice()) + ui::SetHeight(ui::Coord::Percent(100));
@@ -42,8 +85,7 @@ void TabStructures::Build()
 			size_t row = tv.GetHoverRow();
 			if (row != SIZE_MAX && e.GetButton() == ui::MouseButton::Left && e.numRepeats == 2)
 			{
-				auto idx = workspace->ddiSrc._indices[row];
-				auto* SI = workspace->desc.instances[idx];
+				auto* SI = workspace->ddiSrc._instances[row];
 				// find tab showing this SI
 				OpenedFile* ofile = nullptr;
 				int ofid = -1;
@@ -29,14 +29,7 @@ void Workspace::Load(NamedTextSerializeReader& r)
 	r.BeginDict("workspace");
 
 	desc.Load("desc", r);
-	for (auto* F : desc.files)
-	{
-		std::string path = F->path;
-		if (path.size() < 2 || path[1] != ':')
-			path = "FRET_Plugins/" + path;
-		F->dataSource = new FileDataSource(path.c_str());
-		F->mdSrc.dataSource = F->dataSource;
-	}
+	OpenFileDataSources();
 
 	r.BeginArray("openedFiles");
 	for (auto E : r.GetCurrentRange())
@@ -46,6 +39,7 @@ void Workspace::Load(NamedTextSerializeReader& r)
 		auto* F = new OpenedFile;
 		F->Load(r);
 		F->ddFile = desc.FindFileByID(F->fileID);
+		StartPatternIndexer(F);
 		openedFiles.push_back(F);
 
 		r.EndEntry();
@@ -69,3 +63,31 @@ void Workspace::Save(NamedTextSerializeWriter& w)
 
 	w.EndDict();
 }
+
+void Workspace::OpenFileDataSources()
+{
+	for (auto* F : desc.files)
+	{
+		std::string path = GetFilePath(F);
+		F->dataSource = OpenFileDataSource(path.c_str());
+		F->mdSrc.dataSource = F->dataSource;
+	}
+}
+
+std::string Workspace::GetFilePath(const DDFile* F)
+{
+	std::string path = F->path;
+	if (path.size() < 2 || path[1] != ':')
+		path = "FRET_Plugins/" + path;
+	return path;
+}
+
+void Workspace::StartPatternIndexer(OpenedFile* F)
+{
+	if (!F->ddFile || !F->ddFile->dataSource)
+		return;
+	std::string cachePath;
+	if (!cacheDir.empty())
+		cachePath = ui::PathJoin(cacheDir, ui::Format("patterns_%" PRIu64 ".bin", F->ddFile->id));
+	F->patternIndexer.Start(F->ddFile->dataSource, GetFilePath(F->ddFile), cachePath, F->highlightSettings);
+}
@@ -4,6 +4,12 @@
 
 #include "HexViewer.h"
 #include "FileReaders.h"
+#include "PatternIndex.h"
+#include "Search.h"
+#include "InstanceExpander.h"
+#include "StructScanner.h"
+#include "ImageThumbnails.h"
+#include "ImageDetection.h"
 
 
 enum class SubtabType
@@ -13,6 +19,7 @@ enum class SubtabType
 	Markers = 2,
 	Structures = 3,
 	Images = 4,
+	Search = 5,
 };
 
 struct OpenedFile
@@ -24,6 +31,7 @@ struct OpenedFile
 	uint64_t fileID = 0;
 	HexViewerState hexViewerState;
 	HighlightSettings highlightSettings;
+	PatternIndexer patternIndexer;
 };
 
 struct Workspace
@@ -40,14 +48,30 @@ struct Workspace
 
 	void Clear()
 	{
-		desc.Clear();
+		// opened files and searches first, their workers may still be reading from the data sources
+		search.Cancel();
+		search.results.clear();
+		expander.Cancel();
+		scanner.Cancel();
+		thumbnails.Clear();
+		imgDetector.Stop();
 		for (auto* F : openedFiles)
 			delete F;
 		openedFiles.clear();
+		desc.Clear();
+		_savedPath.clear();
 	}
 
 	void Load(NamedTextSerializeReader& r);
 	void Save(NamedTextSerializeWriter& w);
+	// the binary format (WorkspaceFile.cpp), only the changed sections are written when saving to an existing file
+	bool LoadBinary(ui::StringView path);
+	bool SaveBinary(ui::StringView path);
+	void _OnInstancesSectionSaved(const std::string& path, uint64_t size, uint64_t hash);
+
+	void OpenFileDataSources();
+	static std::string GetFilePath(const DDFile* F);
+	void StartPatternIndexer(OpenedFile* F);
 
 	std::vector<OpenedFile*> openedFiles;
 	int curOpenedFile = 0;
@@ -56,6 +80,21 @@ struct Workspace
 	DataDescInstanceSource ddiSrc;
 	DataDescImageSource ddimgSrc;
 
+	// where the pattern indices are saved
+	std::string cacheDir;
+	SearchEngine search;
+	InstanceExpander expander;
+	StructScanner scanner;
+	ImageFormatDetector imgDetector;
+
 	// runtime cache
 	CachedImage cachedImg;
+	ImageThumbnailCache thumbnails;
+
+	// the binary file that the instances section was last loaded from or saved to, and what it was built from
+	std::string _savedPath;
+	CacheVersion _savedInstanceVersion = 0;
+	CacheVersion _savedStructVersion = 0;
+	uint64_t _savedInstancesSize = 0;
+	uint64_t _savedInstancesHash = 0;
 };
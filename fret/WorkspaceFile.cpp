@@ -0,0 +1,714 @@
+
+#include "pch.h"
+#include "Workspace.h"
+
+
+// the binary workspace file: a header with the section table, followed by the sections
+// sections that did not change (same bytes) keep their place when saving, changed ones are appended
+// and the header is written last, the file is rewritten when more than half of it would be unused
+static constexpr uint32_t WORKSPACE_FILE_MAGIC = 0x53575246; // "FRWS"
+static constexpr uint32_t WORKSPACE_FILE_VERSION = 1;
+static constexpr uint64_t WORKSPACE_SECTION_ALIGN = 16;
+
+enum WorkspaceSection
+{
+	WSS_Files,
+	WSS_Structs,
+	WSS_Instances,
+	WSS_Images,
+	WSS_Markers,
+	WSS_State,
+
+	WSS__COUNT,
+};
+
+struct WorkspaceFileSection
+{
+	uint64_t offset;
+	uint64_t size;
+	uint64_t hash;
+};
+
+struct WorkspaceFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numSections;
+	uint32_t reserved;
+	// where the next changed section is appended
+	uint64_t end;
+	WorkspaceFileSection sections[WSS__COUNT];
+};
+static_assert(sizeof(WorkspaceFileHeader) == 24 + 24 * WSS__COUNT, "unexpected workspace header size");
+
+// the binary sections start with a string table, the records refer to the strings by index
+
+struct WSFileRecord
+{
+	uint64_t id;
+	uint32_t name;
+	uint32_t path;
+};
+
+enum WSInstanceFlags
+{
+	WSIF_AllowAutoExpand = 1 << 0,
+	WSIF_RemainingCountIsSize = 1 << 1,
+	WSIF_SizeOverrideEnable = 1 << 2,
+};
+
+struct WSInstanceRecord
+{
+	int64_t id;
+	uint64_t file;
+	int64_t off;
+	int64_t remainingCount;
+	int64_t sizeOverrideValue;
+	uint32_t structName;
+	uint32_t notes;
+	uint32_t firstArg;
+	uint32_t numArgs;
+	uint8_t creationReason;
+	uint8_t flags;
+	uint8_t reserved[6];
+};
+static_assert(sizeof(WSInstanceRecord) == 64, "unexpected instance record size");
+
+struct WSArgRecord
+{
+	uint32_t name;
+	uint32_t reserved;
+	int64_t intVal;
+};
+
+struct WSImageRecord
+{
+	uint64_t file;
+	int64_t offImage;
+	int64_t offPalette;
+	uint32_t width;
+	uint32_t height;
+	uint32_t format;
+	uint32_t notes;
+	uint8_t userCreated;
+	uint8_t reserved[7];
+};
+
+struct WSMarkerRecord
+{
+	uint64_t at;
+	uint64_t count;
+	uint64_t repeats;
+	uint64_t stride;
+	uint32_t notes;
+	uint8_t type;
+	uint8_t bitstart;
+	uint8_t bitend;
+	uint8_t excludeZeroes;
+};
+
+
+// only used to skip comparing the sections that have changed, the kept ones are compared with the old bytes
+static uint64_t HashSection(const std::string& data)
+{
+	// FNV-1a, 8 bytes at a time, the shift mixes the high bits of each word into the low ones
+	uint64_t h = 0xcbf29ce484222325ULL;
+	size_t i = 0;
+	for (; i + 8 <= data.size(); i += 8)
+	{
+		uint64_t v;
+		memcpy(&v, &data[i], 8);
+		h = (h ^ v) * 0x100000001b3ULL;
+		h ^= h >> 29;
+	}
+	for (; i < data.size(); i++)
+		h = (h ^ uint8_t(data[i])) * 0x100000001b3ULL;
+	return h;
+}
+
+static bool SameAsOldSection(FILE* fp, const WorkspaceFileSection& old, const std::string& data)
+{
+	if (old.size != data.size())
+		return false;
+	std::string oldData(data.size(), '\0');
+	if (_fseeki64(fp, old.offset, SEEK_SET) != 0 || fread(&oldData[0], 1, oldData.size(), fp) != oldData.size())
+		return false;
+	return memcmp(oldData.data(), data.data(), data.size()) == 0;
+}
+
+struct SectionWriter
+{
+	std::string strings;
+	uint32_t numStrings = 0;
+	std::unordered_map<std::string, uint32_t> stringIDs;
+	std::string records;
+
+	uint32_t AddString(const std::string& s)
+	{
+		auto it = stringIDs.find(s);
+		if (it != stringIDs.end())
+			return it->second;
+		uint32_t len = uint32_t(s.size());
+		strings.append((const char*)&len, sizeof(len));
+		strings.append(s);
+		stringIDs.emplace(s, numStrings);
+		return numStrings++;
+	}
+	template <class T> void Write(const T& v)
+	{
+		records.append((const char*)&v, sizeof(v));
+	}
+	std::string Finish()
+	{
+		std::string out;
+		out.reserve(sizeof(uint32_t) * 2 + strings.size() + records.size());
+		uint32_t size = uint32_t(strings.size());
+		out.append((const char*)&numStrings, sizeof(numStrings));
+		out.append((const char*)&size, sizeof(size));
+		out.append(strings);
+		out.append(records);
+		return out;
+	}
+};
+
+struct SectionReader
+{
+	const char* pos;
+	const char* end;
+	bool ok = true;
+	std::vector<ui::StringView> strings;
+
+	SectionReader(ui::StringView data) : pos(data.data()), end(data.data() + data.size())
+	{
+		uint32_t numStrings = Read<uint32_t>();
+		uint32_t size = Read<uint32_t>();
+		if (!ok || size > uint64_t(end - pos))
+		{
+			ok = false;
+			return;
+		}
+		const char* send = pos + size;
+		strings.reserve(numStrings);
+		for (uint32_t i = 0; i < numStrings && ok; i++)
+		{
+			uint32_t len = Read<uint32_t>();
+			if (!ok || len > uint64_t(send - pos))
+			{
+				ok = false;
+				return;
+			}
+			strings.push_back({ pos, len });
+			pos += len;
+		}
+		pos = send;
+	}
+	template <class T> T Read()
+	{
+		T v;
+		if (sizeof(T) > uint64_t(end - pos))
+		{
+			ok = false;
+			memset(&v, 0, sizeof(v));
+			return v;
+		}
+		memcpy(&v, pos, sizeof(v));
+		pos += sizeof(v);
+		return v;
+	}
+	ui::StringView GetString(uint32_t i) const
+	{
+		return i < strings.size() ? strings[i] : ui::StringView();
+	}
+};
+
+
+static std::string WriteFilesSection(const DataDesc& desc)
+{
+	SectionWriter w;
+	w.Write(uint32_t(desc.files.size()));
+	for (const DDFile* F : desc.files)
+	{
+		WSFileRecord R = { F->id, w.AddString(F->name), w.AddString(F->path) };
+		w.Write(R);
+	}
+	return w.Finish();
+}
+
+static bool ReadFilesSection(DataDesc& desc, ui::StringView data)
+{
+	SectionReader r(data);
+	uint32_t count = r.Read<uint32_t>();
+	for (uint32_t i = 0; i < count && r.ok; i++)
+	{
+		auto R = r.Read<WSFileRecord>();
+		auto* F = desc.CreateNewFile();
+		F->id = R.id;
+		F->name = ui::to_string(r.GetString(R.name));
+		F->path = ui::to_string(r.GetString(R.path));
+	}
+	return r.ok;
+}
+
+// struct definitions are few and deeply nested, they are stored as text
+static std::string WriteStructsSection(const DataDesc& desc)
+{
+	NamedTextSerializeWriter w;
+	w.BeginDict("structs");
+	w.BeginArray("structs");
+	std::vector<std::string> structNames;
+	for (const auto& sp : desc.structs)
+		structNames.push_back(sp.first);
+	std::sort(structNames.begin(), structNames.end());
+	for (const auto& sname : structNames)
+	{
+		w.BeginDict("");
+		desc.structs.find(sname)->second->Save(w);
+		w.EndDict();
+	}
+	w.EndArray();
+	w.EndDict();
+	return w.data;
+}
+
+static bool ReadStructsSection(DataDesc& desc, ui::StringView data)
+{
+	NamedTextSerializeReader r;
+	if (!r.Parse(data))
+		return false;
+	r.BeginDict("structs");
+	r.BeginArray("structs");
+	for (auto E : r.GetCurrentRange())
+	{
+		r.BeginEntry(E);
+		r.BeginDict("");
+
+		auto name = r.ReadString("name");
+		auto* S = desc.CreateNewStruct(name);
+		S->Load(r);
+
+		r.EndDict();
+		r.EndEntry();
+	}
+	r.EndArray();
+	r.EndDict();
+	return true;
+}
+
+static std::string WriteInstancesSection(const DataDesc& desc)
+{
+	SectionWriter w;
+	std::string args;
+	uint32_t numInstances = 0;
+	uint32_t numArgs = 0;
+	w.AddString({});
+	for (const DDStructInst* SI : desc.instances)
+	{
+		// the others are recreated by expanding
+		if (SI->creationReason >= CreationReason::AutoExpand)
+			continue;
+
+		WSInstanceRecord R = {};
+		R.id = SI->id;
+		R.file = SI->file->id;
+		R.off = SI->off;
+		R.remainingCount = SI->remainingCount;
+		R.sizeOverrideValue = SI->sizeOverrideValue;
+		R.structName = w.AddString(SI->def->name);
+		R.notes = w.AddString(SI->notes);
+		R.firstArg = numArgs;
+		R.numArgs = uint32_t(SI->args.size());
+		R.creationReason = uint8_t(SI->creationReason);
+		R.flags = (SI->allowAutoExpand ? WSIF_AllowAutoExpand : 0)
+			| (SI->remainingCountIsSize ? WSIF_RemainingCountIsSize : 0)
+			| (SI->sizeOverrideEnable ? WSIF_SizeOverrideEnable : 0);
+		w.Write(R);
+		numInstances++;
+
+		for (const DDArg& A : SI->args)
+		{
+			WSArgRecord AR = { w.AddString(A.name), 0, A.intVal };
+			args.append((const char*)&AR, sizeof(AR));
+			numArgs++;
+		}
+	}
+
+	std::string records = std::move(w.records);
+	w.records.clear();
+	w.Write(numInstances);
+	w.Write(numArgs);
+	w.records += records;
+	w.records += args;
+	return w.Finish();
+}
+
+static bool ReadInstancesSection(DataDesc& desc, ui::StringView data)
+{
+	SectionReader r(data);
+	uint32_t numInstances = r.Read<uint32_t>();
+	uint32_t numArgs = r.Read<uint32_t>();
+	if (!r.ok || uint64_t(numInstances) * sizeof(WSInstanceRecord) + uint64_t(numArgs) * sizeof(WSArgRecord) > uint64_t(r.end - r.pos))
+		return false;
+
+	// each name is looked up once
+	std::vector<DDStruct*> structsByString(r.strings.size(), nullptr);
+	std::vector<bool> structFound(r.strings.size(), false);
+	std::unordered_map<uint64_t, DDFile*> filesByID;
+	for (auto* F : desc.files)
+		filesByID[F->id] = F;
+
+	const char* argData = r.pos + size_t(numInstances) * sizeof(WSInstanceRecord);
+	desc.instances.reserve(desc.instances.size() + numInstances);
+	for (uint32_t i = 0; i < numInstances; i++)
+	{
+		auto R = r.Read<WSInstanceRecord>();
+		if (R.structName >= r.strings.size() || uint64_t(R.firstArg) + R.numArgs > numArgs)
+			return false;
+		if (!structFound[R.structName])
+		{
+			structsByString[R.structName] = desc.FindStructByName(ui::to_string(r.GetString(R.structName)));
+			structFound[R.structName] = true;
+		}
+
+		auto* SI = new DDStructInst;
+		SI->id = R.id;
+		SI->desc = &desc;
+		SI->def = structsByString[R.structName];
+		auto fit = filesByID.find(R.file);
+		SI->file = fit != filesByID.end() ? fit->second : nullptr;
+		SI->off = R.off;
+		SI->notes = ui::to_string(r.GetString(R.notes));
+		SI->creationReason = CreationReason(R.creationReason);
+		SI->allowAutoExpand = (R.flags & WSIF_AllowAutoExpand) != 0;
+		SI->remainingCountIsSize = (R.flags & WSIF_RemainingCountIsSize) != 0;
+		SI->remainingCount = R.remainingCount;
+		SI->sizeOverrideEnable = (R.flags & WSIF_SizeOverrideEnable) != 0;
+		SI->sizeOverrideValue = R.sizeOverrideValue;
+		SI->args.resize(R.numArgs);
+		for (uint32_t a = 0; a < R.numArgs; a++)
+		{
+			WSArgRecord AR;
+			memcpy(&AR, argData + size_t(R.firstArg + a) * sizeof(WSArgRecord), sizeof(AR));
+			SI->args[a].name = ui::to_string(r.GetString(AR.name));
+			SI->args[a].intVal = AR.intVal;
+		}
+		desc.instances.push_back(SI);
+	}
+	desc.instIndex.Rebuild();
+	desc.instanceListVersion++;
+	return true;
+}
+
+static std::string WriteImagesSection(const DataDesc& desc)
+{
+	SectionWriter w;
+	w.Write(uint32_t(desc.images.size()));
+	for (const auto& I : desc.images)
+	{
+		WSImageRecord R = {};
+		R.file = I.file->id;
+		R.offImage = I.offImage;
+		R.offPalette = I.offPalette;
+		R.width = I.width;
+		R.height = I.height;
+		R.format = w.AddString(I.format);
+		R.notes = w.AddString(I.notes);
+		R.userCreated = I.userCreated;
+		w.Write(R);
+	}
+	return w.Finish();
+}
+
+static bool ReadImagesSection(DataDesc& desc, ui::StringView data)
+{
+	SectionReader r(data);
+	uint32_t count = r.Read<uint32_t>();
+	for (uint32_t i = 0; i < count && r.ok; i++)
+	{
+		auto R = r.Read<WSImageRecord>();
+		DataDesc::Image I;
+		I.file = desc.FindFileByID(R.file);
+		I.offImage = R.offImage;
+		I.offPalette = R.offPalette;
+		I.width = R.width;
+		I.height = R.height;
+		I.format = ui::to_string(r.GetString(R.format));
+		I.notes = ui::to_string(r.GetString(R.notes));
+		I.userCreated = R.userCreated != 0;
+		desc.images.push_back(I);
+	}
+	return r.ok;
+}
+
+static std::string WriteMarkersSection(const DataDesc& desc)
+{
+	SectionWriter w;
+	w.Write(uint32_t(desc.files.size()));
+	for (const DDFile* F : desc.files)
+	{
+		const auto& markers = F->markerData.markers;
+		w.Write(F->id);
+		w.Write(uint32_t(markers.size()));
+		for (const Marker& M : markers)
+		{
+			WSMarkerRecord R = {};
+			R.at = M.at;
+			R.count = M.count;
+			R.repeats = M.repeats;
+			R.stride = M.stride;
+			R.notes = w.AddString(M.notes);
+			R.type = uint8_t(M.type);
+			R.bitstart = M.bitstart;
+			R.bitend = M.bitend;
+			R.excludeZeroes = M.excludeZeroes;
+			w.Write(R);
+		}
+	}
+	return w.Finish();
+}
+
+static bool ReadMarkersSection(DataDesc& desc, ui::StringView data)
+{
+	SectionReader r(data);
+	uint32_t numFiles = r.Read<uint32_t>();
+	for (uint32_t i = 0; i < numFiles && r.ok; i++)
+	{
+		uint64_t fileID = r.Read<uint64_t>();
+		uint32_t count = r.Read<uint32_t>();
+		if (!r.ok || uint64_t(count) * sizeof(WSMarkerRecord) > uint64_t(r.end - r.pos))
+			return false;
+		DDFile* F = desc.FindFileByID(fileID);
+		if (F)
+		{
+			F->markerData.markers.clear();
+			F->markerData.markers.reserve(count);
+		}
+		for (uint32_t j = 0; j < count; j++)
+		{
+			auto R = r.Read<WSMarkerRecord>();
+			if (!F)
+				continue;
+			Marker M;
+			M.type = R.type < DT__COUNT ? DataType(R.type) : DT_CHAR;
+			M.at = R.at;
+			M.count = R.count;
+			M.repeats = R.repeats;
+			M.stride = R.stride;
+			M.bitstart = R.bitstart;
+			M.bitend = R.bitend;
+			M.excludeZeroes = R.excludeZeroes != 0;
+			M.notes = ui::to_string(r.GetString(R.notes));
+			F->markerData.markers.push_back(M);
+		}
+		if (F)
+			F->markerData.OnEdit();
+	}
+	return r.ok;
+}
+
+// the opened files and the ui state are small and change on every save, they are stored as text
+static std::string WriteStateSection(Workspace& ws)
+{
+	NamedTextSerializeWriter w;
+	w.BeginDict("state");
+	w.WriteInt("fileIDAlloc", ws.desc.fileIDAlloc);
+	w.WriteInt("instIDAlloc", ws.desc.instIDAlloc);
+	w.WriteInt("editMode", ws.desc.editMode);
+	w.WriteInt("curInst", ws.desc.curInst ? ws.desc.curInst->id : -1LL);
+	w.WriteInt("curImage", ws.desc.curImage);
+	w.WriteInt("curField", ws.desc.curField);
+
+	w.BeginArray("openedFiles");
+	for (auto* F : ws.openedFiles)
+		F->Save(w);
+	w.EndArray();
+
+	w.EndDict();
+	return w.data;
+}
+
+static bool ReadStateSection(Workspace& ws, ui::StringView data)
+{
+	NamedTextSerializeReader r;
+	if (!r.Parse(data))
+		return false;
+	r.BeginDict("state");
+	ws.desc.fileIDAlloc = r.ReadUInt64("fileIDAlloc");
+	ws.desc.instIDAlloc = r.ReadInt64("instIDAlloc");
+	ws.desc.editMode = r.ReadInt("editMode");
+	auto curInstID = r.ReadInt64("curInst", -1);
+	ws.desc.SetCurrentInstance(curInstID == -1 ? nullptr : ws.desc.FindInstanceByID(curInstID));
+	ws.desc.curImage = r.ReadUInt("curImage");
+	ws.desc.curField = r.ReadUInt("curField");
+
+	r.BeginArray("openedFiles");
+	for (auto E : r.GetCurrentRange())
+	{
+		r.BeginEntry(E);
+
+		auto* F = new OpenedFile;
+		F->Load(r);
+		F->ddFile = ws.desc.FindFileByID(F->fileID);
+		ws.StartPatternIndexer(F);
+		ws.openedFiles.push_back(F);
+
+		r.EndEntry();
+	}
+	r.EndArray();
+
+	r.EndDict();
+	return true;
+}
+
+
+bool Workspace::LoadBinary(ui::StringView path)
+{
+	ui::MappedFile mf(path);
+	if (!mf.data || mf.size < sizeof(WorkspaceFileHeader))
+		return false;
+
+	WorkspaceFileHeader hdr;
+	memcpy(&hdr, mf.data, sizeof(hdr));
+	if (hdr.magic != WORKSPACE_FILE_MAGIC || hdr.version != WORKSPACE_FILE_VERSION || hdr.numSections != WSS__COUNT)
+		return false;
+	ui::StringView sections[WSS__COUNT];
+	for (int s = 0; s < WSS__COUNT; s++)
+	{
+		const auto& S = hdr.sections[s];
+		if (S.offset > mf.size || S.size > mf.size - S.offset)
+			return false;
+		sections[s] = { static_cast<const char*>(mf.data) + S.offset, size_t(S.size) };
+	}
+
+	Clear();
+	bool ok = ReadFilesSection(desc, sections[WSS_Files]);
+	if (ok)
+		OpenFileDataSources();
+	ok = ok && ReadStructsSection(desc, sections[WSS_Structs]);
+	ok = ok && ReadInstancesSection(desc, sections[WSS_Instances]);
+	ok = ok && ReadImagesSection(desc, sections[WSS_Images]);
+	ok = ok && ReadMarkersSection(desc, sections[WSS_Markers]);
+	ok = ok && ReadStateSection(*this, sections[WSS_State]);
+	if (!ok)
+	{
+		printf("failed to load workspace %.*s\n", int(path.size()), path.data());
+		Clear();
+		return false;
+	}
+	_OnInstancesSectionSaved(ui::to_string(path), hdr.sections[WSS_Instances].size, hdr.sections[WSS_Instances].hash);
+	return true;
+}
+
+void Workspace::_OnInstancesSectionSaved(const std::string& path, uint64_t size, uint64_t hash)
+{
+	_savedPath = path;
+	_savedInstanceVersion = desc.instanceListVersion;
+	_savedStructVersion = DDStruct::lastEditVersion;
+	_savedInstancesSize = size;
+	_savedInstancesHash = hash;
+}
+
+bool Workspace::SaveBinary(ui::StringView path)
+{
+	std::string pathStr = ui::to_string(path);
+	WorkspaceFileHeader old;
+	FILE* fp = fopen(pathStr.c_str(), "r+b");
+	bool haveOld = fp
+		&& fread(&old, 1, sizeof(old), fp) == sizeof(old)
+		&& old.magic == WORKSPACE_FILE_MAGIC
+		&& old.version == WORKSPACE_FILE_VERSION
+		&& old.numSections == WSS__COUNT;
+
+	// the instances section is the largest one, it's not built again if nothing it stores has changed since this file was saved/loaded
+	bool instancesClean = haveOld
+		&& _savedPath == pathStr
+		&& _savedInstanceVersion == desc.instanceListVersion
+		&& _savedStructVersion == DDStruct::lastEditVersion
+		&& old.sections[WSS_Instances].size == _savedInstancesSize
+		&& old.sections[WSS_Instances].hash == _savedInstancesHash;
+
+	std::string sections[WSS__COUNT];
+	sections[WSS_Files] = WriteFilesSection(desc);
+	sections[WSS_Structs] = WriteStructsSection(desc);
+	if (!instancesClean)
+		sections[WSS_Instances] = WriteInstancesSection(desc);
+	sections[WSS_Images] = WriteImagesSection(desc);
+	sections[WSS_Markers] = WriteMarkersSection(desc);
+	sections[WSS_State] = WriteStateSection(*this);
+
+	WorkspaceFileHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = WORKSPACE_FILE_MAGIC;
+	hdr.version = WORKSPACE_FILE_VERSION;
+	hdr.numSections = WSS__COUNT;
+
+	auto align = [](uint64_t v) { return (v + WORKSPACE_SECTION_ALIGN - 1) & ~(WORKSPACE_SECTION_ALIGN - 1); };
+	bool keep[WSS__COUNT] = {};
+	uint64_t used = sizeof(hdr);
+	uint64_t appended = 0;
+	for (int s = 0; s < WSS__COUNT; s++)
+	{
+		if (s == WSS_Instances && instancesClean)
+		{
+			hdr.sections[s] = old.sections[s];
+			keep[s] = true;
+			used += hdr.sections[s].size;
+			continue;
+		}
+		hdr.sections[s].size = sections[s].size();
+		hdr.sections[s].hash = HashSection(sections[s]);
+		keep[s] = haveOld && old.sections[s].hash == hdr.sections[s].hash && SameAsOldSection(fp, old.sections[s], sections[s]);
+		if (keep[s])
+			hdr.sections[s].offset = old.sections[s].offset;
+		else
+			appended += align(sections[s].size());
+		used += sections[s].size();
+	}
+	hdr.end = haveOld ? old.end : align(sizeof(hdr));
+
+	if (!haveOld || hdr.end + appended > used * 2)
+	{
+		// rewrite everything
+		if (instancesClean)
+		{
+			sections[WSS_Instances] = WriteInstancesSection(desc);
+			hdr.sections[WSS_Instances].size = sections[WSS_Instances].size();
+			hdr.sections[WSS_Instances].hash = HashSection(sections[WSS_Instances]);
+		}
+		if (fp)
+			fclose(fp);
+		ui::CreateMissingParentDirectories(path);
+		fp = fopen(pathStr.c_str(), "wb");
+		if (!fp)
+		{
+			printf("failed to write workspace %s\n", pathStr.c_str());
+			_savedPath.clear();
+			return false;
+		}
+		memset(keep, 0, sizeof(keep));
+		hdr.end = align(sizeof(hdr));
+	}
+
+	bool ok = true;
+	for (int s = 0; s < WSS__COUNT; s++)
+	{
+		if (keep[s])
+			continue;
+		hdr.sections[s].offset = hdr.end;
+		ok = ok && _fseeki64(fp, hdr.end, SEEK_SET) == 0;
+		ok = ok && fwrite(sections[s].data(), 1, sections[s].size(), fp) == sections[s].size();
+		hdr.end = align(hdr.end + sections[s].size());
+	}
+	// the header is only updated once the sections are written
+	ok = ok && fflush(fp) == 0;
+	ok = ok && _fseeki64(fp, 0, SEEK_SET) == 0;
+	ok = ok && fwrite(&hdr, 1, sizeof(hdr), fp) == sizeof(hdr);
+	ok = fclose(fp) == 0 && ok;
+	if (!ok)
+	{
+		printf("failed to write workspace %s\n", pathStr.c_str());
+		_savedPath.clear();
+		return false;
+	}
+	_OnInstancesSectionSaved(pathStr, hdr.sections[WSS_Instances].size, hdr.sections[WSS_Instances].hash);
+	return true;
+}
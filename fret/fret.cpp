@@ -1,5 +1,6 @@
 
 #include "pch.h"
+#include "Benchmarks.h"
 #include "FileReaders.h"
 #include "FileStructureViewer.h"
 #include "DataDesc.h"
@@ -17,9 +18,12 @@
 #include "TabMarkers.h"
 #include "TabStructures.h"
 #include "TabImages.h"
+#include "TabSearch.h"
 
 
 #define CUR_WORKSPACE "FRET_Plugins/wav.bdaw"
+#define CUR_WORKSPACE_BINARY "FRET_Plugins/wav.bdawb"
+#define CUR_WORKSPACE_CACHE "FRET_Plugins/wav_cache"
 
 struct MainWindowContents : ui::Buildable
 {
@@ -27,13 +31,18 @@ struct MainWindowContents : ui::Buildable
 	{
 		GetNativeWindow()->SetTitle("Binary Data Analysis Tool");
 		GetNativeWindow()->SetSize(1200, 800);
-		FileDataSource fds(CUR_WORKSPACE);
-		std::string wsdata;
-		wsdata.resize(fds.GetSize());
-		fds.Read(0, fds.GetSize(), &wsdata[0]);
-		NamedTextSerializeReader ntsr;
-		printf("parsed: %s\n", ntsr.Parse(wsdata) ? "yes" : "no");
-		workspace.Load(ntsr);
+		workspace.cacheDir = CUR_WORKSPACE_CACHE;
+		// the text version is only used until the workspace is saved in the binary format
+		if (!workspace.LoadBinary(CUR_WORKSPACE_BINARY))
+		{
+			FileDataSource fds(CUR_WORKSPACE);
+			std::string wsdata;
+			wsdata.resize(fds.GetSize());
+			fds.Read(0, fds.GetSize(), &wsdata[0]);
+			NamedTextSerializeReader ntsr;
+			printf("parsed: %s\n", ntsr.Parse(wsdata) ? "yes" : "no");
+			workspace.Load(ntsr);
+		}
 		//files.push_back(new REFile("tree.mesh"));
 		//files.push_back(new REFile("arch.tar"));
 	}
@@ -93,6 +102,10 @@ struct MainWindowContents : ui::Buildable
 
 		ui::Push<ui::MenuBarElement>();
 		ui::Make<ui::MenuItemElement>().SetText("Save").Func([&]()
+		{
+			workspace.SaveBinary(CUR_WORKSPACE_BINARY);
+		});
+		ui::Make<ui::MenuItemElement>().SetText("Save as text").Func([&]()
 		{
 			NamedTextSerializeWriter ntsw;
 			workspace.Save(ntsw);
@@ -107,6 +120,21 @@ struct MainWindowContents : ui::Buildable
 			auto scr = ExportPythonScript(&workspace.desc);
 			ui::WriteTextFile(bfr, scr);
 		});
+		ui::Push<ui::MenuItemElement>().SetText("Debug");
+		{
+			ui::Make<ui::MenuItemElement>().SetText("Benchmarks").Func([&]()
+			{
+				if (!curBenchmarks)
+					curBenchmarks = new WindowT<BenchmarkWindowNode>();
+				curBenchmarks->SetVisible(true);
+				HighlightSettings* hs = nullptr;
+				if (workspace.curOpenedFile < (int)workspace.openedFiles.size())
+					hs = &workspace.openedFiles[workspace.curOpenedFile]->highlightSettings;
+				curBenchmarks->rootBuildable->highlightSettings = hs;
+				curBenchmarks->rootBuildable->Rebuild();
+			});
+		}
+		ui::Pop();
 		ui::Pop();
 
 		ui::Push<ui::TabGroup>()
@@ -156,6 +184,7 @@ struct MainWindowContents : ui::Buildable
 								ui::MakeWithText<ui::TabButtonT<SubtabType>>("Markers").Init(workspace.curSubtab, SubtabType::Markers);
 								ui::MakeWithText<ui::TabButtonT<SubtabType>>("Structures").Init(workspace.curSubtab, SubtabType::Structures);
 								ui::MakeWithText<ui::TabButtonT<SubtabType>>("Images").Init(workspace.curSubtab, SubtabType::Images);
+								ui::MakeWithText<ui::TabButtonT<SubtabType>>("Search").Init(workspace.curSubtab, SubtabType::Search);
 								ui::Pop();
 
 								ui::Push<ui::TabPanel>()
@@ -191,6 +220,11 @@ struct MainWindowContents : ui::Buildable
 									ui::Make<TabImages>().workspace = &workspace;
 								}
 
+								if (workspace.curSubtab == SubtabType::Search)
+								{
+									ui::Make<TabSearch>().workspace = &workspace;
+								}
+
 								// tab panel
 								ui::Pop();
 							}
@@ -213,11 +247,15 @@ struct MainWindowContents : ui::Buildable
 	TableWithOffsets* curTable = nullptr;
 	WindowT<ImageEditorWindowNode>* curImageEditor = nullptr;
 	WindowT<MeshEditorWindowNode>* curMeshEditor = nullptr;
+	WindowT<BenchmarkWindowNode>* curBenchmarks = nullptr;
 };
 
 int uimain(int argc, char* argv[])
 {
 	ui::Application app(argc, argv);
+	auto cacheDir = ui::GetUserCacheDirectory();
+	if (!cacheDir.empty())
+		ui::ImageCacheSetDirectory(ui::PathJoin(cacheDir, "fret/images"));
 	WindowT<MainWindowContents> mw;
 	mw.subWindow = false;
 	mw.SetVisible(true);
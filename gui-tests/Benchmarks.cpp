@@ -68,3 +68,264 @@ void Benchmark_SubUI()
 	ui::Make<SubUIBenchmark>();
 }
 
+
+
+namespace ui {
+double hqtime();
+} // ui
+
+struct ImageUpdateBenchmark : ui::Buildable, ui::AnimationRequester
+{
+	static constexpr int W = 320;
+	static constexpr int H = 240;
+
+	ImageUpdateBenchmark() : canvas(W, H)
+	{
+		accum.resize(W * H * 3, 0.0f);
+		BeginAnimation();
+	}
+	void Build() override
+	{
+		BasicRadioButton("Recreate image", mode, 0);
+		BasicRadioButton("Update in place (UpdateRect)", mode, 1);
+		ui::Textf("passes: %u, avg. upload time: %.3f ms",
+			unsigned(numPasses),
+			numTimedUploads ? uploadTime * 1000 / numTimedUploads : 0.0);
+		auto& img = ui::Make<ui::ImageElement>();
+		img.GetStyle().SetWidth(W * 2);
+		img.GetStyle().SetHeight(H * 2);
+		img.SetScaleMode(ui::ScaleMode::Stretch);
+		img.SetImage(image);
+	}
+	void OnAnimationFrame() override
+	{
+		if (mode != prevMode)
+		{
+			prevMode = mode;
+			uploadTime = 0;
+			numTimedUploads = 0;
+		}
+
+		TracePass();
+
+		double t0 = ui::hqtime();
+		if (mode == 0)
+			image = ui::draw::ImageCreateFromCanvas(canvas);
+		else
+			image = ui::draw::ImageUpdateFromCanvas(image, canvas);
+		uploadTime += ui::hqtime() - t0;
+		numTimedUploads++;
+
+		Rebuild();
+	}
+	// one progressive sample per pixel of a diffuse sphere under a moving area light
+	void TracePass()
+	{
+		numPasses++;
+		auto* px = canvas.GetPixels();
+		for (int y = 0; y < H; y++)
+		{
+			for (int x = 0; x < W; x++)
+			{
+				float fx = (x + rng() - W * 0.5f) / (H * 0.4f);
+				float fy = (y + rng() - H * 0.5f) / (H * 0.4f);
+				float r2 = fx * fx + fy * fy;
+				float lum = 0.05f;
+				if (r2 < 1)
+				{
+					float nz = sqrtf(1 - r2);
+					// jittered light direction
+					float lx = -0.5f + (rng() - 0.5f) * 0.6f;
+					float ly = -0.6f + (rng() - 0.5f) * 0.6f;
+					float lz = 0.62f;
+					float dot = (fx * lx + fy * ly + nz * lz) / sqrtf(lx * lx + ly * ly + lz * lz);
+					lum = dot > 0 ? dot : 0;
+				}
+				float* a = &accum[(x + y * W) * 3];
+				a[0] += lum;
+				a[1] += lum * 0.8f;
+				a[2] += lum * 0.6f;
+				float inv = 255.0f / numPasses;
+				px[x + y * W] = 0xff000000 |
+					(unsigned(ui::min(a[2] * inv, 255.0f)) << 16) |
+					(unsigned(ui::min(a[1] * inv, 255.0f)) << 8) |
+					unsigned(ui::min(a[0] * inv, 255.0f));
+			}
+		}
+	}
+	float rng()
+	{
+		seed = seed * 1103515245 + 12345;
+		return float((seed >> 8) & 0xffff) / 65536.0f;
+	}
+
+	ui::Canvas canvas;
+	std::vector<float> accum;
+	ui::draw::ImageHandle image;
+	uint32_t seed = 1;
+	uint32_t numPasses = 0;
+	int mode = 1;
+	int prevMode = 1;
+	double uploadTime = 0;
+	uint32_t numTimedUploads = 0;
+};
+void Benchmark_ImageUpdate()
+{
+	ui::Make<ImageUpdateBenchmark>();
+}
+
+
+struct TableTextBenchmark : ui::Buildable, ui::AnimationRequester
+{
+	struct DataSource : ui::TableDataSource
+	{
+		size_t GetNumRows() override { return 10000; }
+		size_t GetNumCols() override { return 6; }
+		std::string GetRowName(size_t row) override { return std::to_string(row + 1); }
+		std::string GetColName(size_t col) override { return "Column " + std::to_string(col + 1); }
+		std::string GetText(size_t row, size_t col) override
+		{
+			return std::to_string(((unsigned(row) * 6 + unsigned(col)) + 1013904223U) * 1664525U);
+		}
+	};
+
+	TableTextBenchmark()
+	{
+		BeginAnimation();
+	}
+	~TableTextBenchmark()
+	{
+		ui::debug::SetTextRunCacheEnabled(true);
+	}
+	void Build() override
+	{
+		GetStyle().SetLayout(ui::layouts::EdgeSlice());
+
+		if (ui::imm::PropEditBool("Text run cache", runCache))
+		{
+			ui::debug::SetTextRunCacheEnabled(runCache);
+			ResetStats();
+		}
+		if (ui::imm::PropEditBool("Zoomed text overlay", zoomOverlay))
+			ResetStats();
+
+		auto& tv = ui::Make<ui::TableView>();
+		tv + ui::SetHeight(ui::Coord::Percent(100));
+		tv.SetDataSource(&dataSource);
+	}
+	void OnPaint() override
+	{
+		double t0 = ui::hqtime();
+		ui::Buildable::OnPaint();
+
+		auto r = GetContentRect();
+		if (zoomOverlay)
+		{
+			// every frame uses a different size, distance field glyphs are shared between them
+			int size = 24 + int(numFrames % 40);
+			auto* font = ui::GetFont(ui::FONT_FAMILY_SANS_SERIF);
+			for (int i = 0; i < 10; i++)
+				ui::draw::TextLine(font, size, r.x0 + 20, r.y0 + 100 + i * size, "The quick brown fox jumps over the lazy dog", ui::Color4f(1, 0.8f, 0.3f));
+		}
+		ui::draw::internals::Flush();
+		paintTime += ui::hqtime() - t0;
+		numFrames++;
+
+		char bfr[128];
+		snprintf(bfr, 128, "avg. paint time: %.3f ms", paintTime * 1000 / numFrames);
+		ui::DrawTextLine(r.x1 - 200, r.y0 + 16, bfr, 1, 1, 1);
+	}
+	void OnAnimationFrame() override
+	{
+		GetNativeWindow()->InvalidateAll();
+	}
+	void ResetStats()
+	{
+		paintTime = 0;
+		numFrames = 0;
+	}
+
+	DataSource dataSource;
+	bool runCache = true;
+	bool zoomOverlay = false;
+	double paintTime = 0;
+	uint32_t numFrames = 0;
+};
+void Benchmark_TableText()
+{
+	ui::Make<TableTextBenchmark>();
+}
+
+
+struct LongTextboxBenchmark : ui::Buildable, ui::AnimationRequester
+{
+	LongTextboxBenchmark()
+	{
+		// ~100 KB on a single line, with some multibyte characters
+		while (text.size() < 100 * 1024)
+		{
+			text += "lorem ipsum dolor sit amet ";
+			text += "\xC3\xBC\xC3\xA9 \xE2\x86\x92 ";
+			text += std::to_string(text.size());
+			text += " ";
+		}
+		BeginAnimation();
+	}
+	void Build() override
+	{
+		if (ui::imm::PropEditBool("Edit every frame", editEveryFrame))
+			ResetStats();
+
+		tb = &ui::Make<ui::Textbox>();
+		tb->SetText(text);
+	}
+	void OnPaint() override
+	{
+		auto r = GetContentRect();
+
+		// drag selection across the visible part of the textbox
+		double t0 = ui::hqtime();
+		if (editEveryFrame)
+			tb->_InvalidateTextWidths();
+		auto tbr = tb->GetContentRect();
+		for (int i = 0; i < 100; i++)
+		{
+			tb->startCursor = tb->_FindCursorPos(tbr.x0);
+			tb->endCursor = tb->_FindCursorPos(tbr.x0 + (tbr.x1 - tbr.x0) * i / 100);
+		}
+		hitTestTime += ui::hqtime() - t0;
+
+		double t1 = ui::hqtime();
+		ui::Buildable::OnPaint();
+		ui::draw::internals::Flush();
+		paintTime += ui::hqtime() - t1;
+		numFrames++;
+
+		char bfr[128];
+		snprintf(bfr, 128, "avg. hit test time (x100): %.3f ms", hitTestTime * 1000 / numFrames);
+		ui::DrawTextLine(r.x0 + 4, r.y1 - 32, bfr, 1, 1, 1);
+		snprintf(bfr, 128, "avg. paint time: %.3f ms", paintTime * 1000 / numFrames);
+		ui::DrawTextLine(r.x0 + 4, r.y1 - 16, bfr, 1, 1, 1);
+	}
+	void OnAnimationFrame() override
+	{
+		GetNativeWindow()->InvalidateAll();
+	}
+	void ResetStats()
+	{
+		hitTestTime = 0;
+		paintTime = 0;
+		numFrames = 0;
+	}
+
+	std::string text;
+	ui::Textbox* tb = nullptr;
+	bool editEveryFrame = false;
+	double hitTestTime = 0;
+	double paintTime = 0;
+	uint32_t numFrames = 0;
+};
+void Benchmark_LongTextbox()
+{
+	ui::Make<LongTextboxBenchmark>();
+}
@@ -370,6 +370,9 @@ void Test_MessageLogView();
 void Test_CurveEditor();
 
 void Benchmark_SubUI();
+void Benchmark_ImageUpdate();
+void Benchmark_TableText();
+void Benchmark_LongTextbox();
 void Test_TableView();
 
 void Demo_Calculator();
@@ -478,6 +481,9 @@ static const TestEntry dseditTestEntries[] =
 static const TestEntry benchmarkEntries[] =
 {
 	{ "SubUI benchmark", Benchmark_SubUI },
+	{ "Image update benchmark", Benchmark_ImageUpdate },
+	{ "Table text benchmark", Benchmark_TableText },
+	{ "Long textbox benchmark", Benchmark_LongTextbox },
 };
 static const TestEntry demoEntries[] =
 {
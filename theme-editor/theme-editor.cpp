@@ -414,6 +414,9 @@ struct ThemeEditorMainWindow : NativeMainWindow
 int uimain(int argc, char* argv[])
 {
 	Application app(argc, argv);
+	auto cacheDir = GetUserCacheDirectory();
+	if (!cacheDir.empty())
+		ImageCacheSetDirectory(PathJoin(cacheDir, "theme-editor/images"));
 	ThemeEditorMainWindow mw;
 	mw.SetVisible(true);
 	return app.Run();